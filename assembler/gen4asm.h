@@ -30,6 +30,7 @@
 #define __GEN4ASM_H__
 
 #include <inttypes.h>
+#include <stdio.h>
 #include <stdbool.h>
 #include <assert.h>
 
@@ -48,6 +49,9 @@ extern unsigned int warning_flags;
 
 extern const char *input_filename;
 
+/* Where warnings and errors go */
+extern FILE *message_file;
+
 extern struct brw_context genasm_context;
 extern struct brw_compile genasm_compile;
 
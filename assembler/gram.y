@@ -134,13 +134,13 @@ static void message(enum message_level level, YYLTYPE *location,
     va_list args;
 
     if (location)
-	fprintf(stderr, "%s:%d:%d: %s: ", input_filename, location->first_line,
+	fprintf(message_file, "%s:%d:%d: %s: ", input_filename, location->first_line,
 		location->first_column, level_str[level]);
     else
-	fprintf(stderr, "%s:%s: ", input_filename, level_str[level]);
+	fprintf(message_file, "%s:%s: ", input_filename, level_str[level]);
 
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    vfprintf(message_file, fmt, args);
     va_end(args);
 }
 
@@ -292,13 +292,13 @@ static bool validate_dst_reg(struct brw_program_instruction *insn, struct brw_re
 	reg->dw1.bits.writemask != 0 &&
 	reg->dw1.bits.writemask != BRW_WRITEMASK_XYZW)
     {
-	fprintf(stderr, "error: write mask set in align1 instruction\n");
+	fprintf(message_file, "error: write mask set in align1 instruction\n");
 	return false;
     }
 
     if (reg->address_mode == BRW_ADDRESS_REGISTER_INDIRECT_REGISTER &&
 	access_mode(insn) == BRW_ALIGN_16) {
-	fprintf(stderr, "error: indirect Dst addr mode in align16 instruction\n");
+	fprintf(message_file, "error: indirect Dst addr mode in align16 instruction\n");
 	return false;
     }
 
@@ -327,7 +327,7 @@ static bool validate_src_reg(struct brw_program_instruction *insn,
 
     if (reg.address_mode == BRW_ADDRESS_REGISTER_INDIRECT_REGISTER &&
 	access_mode(insn) == BRW_ALIGN_16) {
-	fprintf(stderr, "error: indirect Source addr mode in align16 instruction\n");
+	fprintf(message_file, "error: indirect Source addr mode in align16 instruction\n");
 	return false;
     }
 
@@ -2188,7 +2188,7 @@ imm32reg:	imm32 srcimmtype
 		    break;
 #if 0
 		  case BRW_REGISTER_TYPE_VF:
-		    fprintf (stderr, "Immediate type VF not supported yet\n");
+		    fprintf (message_file, "Immediate type VF not supported yet\n");
 		    YYERROR;
 #endif
 		  default:
@@ -2558,7 +2558,7 @@ notifyreg:	NOTIFYREG regtype
 		| NOTIFYREG regtype
 		{
 		  if ($1 > 1) {
-		    fprintf(stderr,
+		    fprintf(message_file,
 			    "notification register number %d out of range",
 			    $1);
 		    YYERROR;
@@ -2976,7 +2976,7 @@ extern int yylineno;
 
 void yyerror (char *msg)
 {
-	fprintf(stderr, "%s: %d: %s at \"%s\"\n",
+	fprintf(message_file, "%s: %d: %s at \"%s\"\n",
 		input_filename, yylineno, msg, lex_text());
 	++errors;
 }
@@ -0,0 +1,466 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ralloc.h"
+#include "gen4asm.h"
+#include "brw_eu.h"
+#include "libgen4asm.h"
+
+extern FILE *yyin;
+extern int yycolumn;
+extern void set_branch_two_offsets(struct brw_program_instruction *insn, int jip_offset, int uip_offset);
+extern void set_branch_one_offset(struct brw_program_instruction *insn, int jip_offset);
+
+long int gen_level = 40;
+int advanced_flag = 0; /* 0: in unit of byte, 1: in unit of data element size */
+unsigned int warning_flags = WARN_ALWAYS;
+int need_export = 0;
+const char *input_filename = "<stdin>";
+int errors;
+FILE *message_file;
+
+struct brw_context genasm_brw_context;
+struct brw_compile genasm_compile;
+
+struct brw_program compiled_program;
+struct program_defaults program_defaults = {.register_type = BRW_REGISTER_TYPE_F};
+
+/*
+ * Open addressed hash tables of names, growing to stay at most 3/4 full.
+ * Labels may be defined more than once, so each label keeps all of its
+ * addresses in ascending order for a branch to find the nearest one.
+ */
+struct symbol {
+	char *name;
+	uint32_t hash;
+	void *value;
+	int *addrs;
+	unsigned int num_addrs;
+};
+
+struct symbol_table {
+	struct symbol *slots;
+	unsigned int size;
+	unsigned int count;
+	bool ignore_case;
+};
+
+static struct symbol_table declared_register_table = { .ignore_case = true };
+static struct symbol_table label_table;
+static struct symbol_table entry_point_table;
+
+static uint32_t symbol_hash(const struct symbol_table *t, const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name) {
+		unsigned char c = *name++;
+
+		if (t->ignore_case)
+			c = tolower(c);
+		hash = (hash ^ c) * 16777619u;
+	}
+
+	return hash;
+}
+
+static struct symbol *
+symbol_slot(struct symbol_table *t, const char *name, uint32_t hash)
+{
+	unsigned int i = hash & (t->size - 1);
+
+	for (;; i = (i + 1) & (t->size - 1)) {
+		struct symbol *s = &t->slots[i];
+
+		if (!s->name)
+			return s;
+
+		if (s->hash == hash &&
+		    (t->ignore_case ? strcasecmp(s->name, name) :
+		     strcmp(s->name, name)) == 0)
+			return s;
+	}
+}
+
+static struct symbol *find_symbol(struct symbol_table *t, const char *name)
+{
+	struct symbol *s;
+
+	if (!t->count)
+		return NULL;
+
+	s = symbol_slot(t, name, symbol_hash(t, name));
+	return s->name ? s : NULL;
+}
+
+static void grow_symbol_table(struct symbol_table *t)
+{
+	struct symbol *old = t->slots;
+	unsigned int old_size = t->size, i;
+
+	t->size = old_size ? 2 * old_size : 64;
+	t->slots = calloc(t->size, sizeof(*t->slots));
+	assert(t->slots);
+
+	for (i = 0; i < old_size; i++)
+		if (old[i].name)
+			*symbol_slot(t, old[i].name, old[i].hash) = old[i];
+
+	free(old);
+}
+
+/* The name isn't copied, it must live as long as the table */
+static struct symbol *add_symbol(struct symbol_table *t, char *name)
+{
+	uint32_t hash = symbol_hash(t, name);
+	struct symbol *s;
+
+	if (4 * (t->count + 1) > 3 * t->size)
+		grow_symbol_table(t);
+
+	s = symbol_slot(t, name, hash);
+	if (!s->name) {
+		s->name = name;
+		s->hash = hash;
+		t->count++;
+	}
+
+	return s;
+}
+
+static void free_symbol_table(struct symbol_table *t)
+{
+	unsigned int i;
+
+	for (i = 0; i < t->size; i++)
+		free(t->slots[i].addrs);
+
+	free(t->slots);
+	t->slots = NULL;
+	t->size = t->count = 0;
+}
+
+struct declared_register *find_register(char *name)
+{
+	struct symbol *s = find_symbol(&declared_register_table, name);
+
+	return s ? s->value : NULL;
+}
+
+void insert_register(struct declared_register *reg)
+{
+	add_symbol(&declared_register_table, reg->name)->value = reg;
+}
+
+static void free_registers(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < declared_register_table.size; i++) {
+		struct symbol *s = &declared_register_table.slots[i];
+
+		if (s->name) {
+			free(s->name);
+			free(s->value);
+		}
+	}
+
+	free_symbol_table(&declared_register_table);
+}
+
+static void add_label(struct brw_program_instruction *i)
+{
+	struct symbol *s = add_symbol(&label_table, label_name(i));
+	unsigned int n = s->num_addrs;
+
+	/* Grow to the next power of two */
+	if (!(n & (n - 1))) {
+		s->addrs = realloc(s->addrs, (n ? 2 * n : 1) * sizeof(*s->addrs));
+		assert(s->addrs);
+	}
+
+	for (; n && s->addrs[n - 1] > (int)i->inst_offset; n--)
+		s->addrs[n] = s->addrs[n - 1];
+	s->addrs[n] = i->inst_offset;
+	s->num_addrs++;
+}
+
+/* Some assembly code have duplicated labels.
+   Return the first label at or after start_addr, or failing that the first
+   label of the program. */
+static int label_to_addr(char *name, int start_addr)
+{
+	struct symbol *s = find_symbol(&label_table, name);
+	unsigned int lo = 0, hi;
+
+	if (!s) {
+		fprintf(message_file, "Can't find label %s\n", name);
+		errors++;
+		return -1;
+	}
+
+	hi = s->num_addrs;
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (s->addrs[mid] < start_addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return s->addrs[lo < s->num_addrs ? lo : 0];
+}
+
+static int is_entry_point(struct brw_program_instruction *i)
+{
+	assert(i->type == GEN4ASM_INSTRUCTION_LABEL);
+
+	return find_symbol(&entry_point_table, label_name(i)) != NULL;
+}
+
+static void layout_program(void)
+{
+	struct brw_program_instruction *entry, *entry1, *tmp_entry;
+	int inst_offset = 0;
+
+	for (entry = compiled_program.first;
+		entry != NULL; entry = entry->next) {
+	    entry->inst_offset = inst_offset;
+	    entry1 = entry->next;
+	    if (entry1 && is_label(entry1) && is_entry_point(entry1)) {
+		// insert NOP instructions until (inst_offset+1) % 4 == 0
+		while (((inst_offset+1) % 4) != 0) {
+		    tmp_entry = calloc(1, sizeof(*tmp_entry));
+		    tmp_entry->insn.gen.header.opcode = BRW_OPCODE_NOP;
+		    entry->next = tmp_entry;
+		    tmp_entry->next = entry1;
+		    entry = tmp_entry;
+		    tmp_entry->inst_offset = ++inst_offset;
+		}
+	    }
+	    if (!is_label(entry))
+              inst_offset++;
+	}
+
+	for (entry = compiled_program.first; entry; entry = entry->next)
+	    if (is_label(entry))
+		add_label(entry);
+}
+
+static int relocate_program(void)
+{
+	struct brw_program_instruction *entry;
+	int addr;
+
+	for (entry = compiled_program.first; entry; entry = entry->next) {
+	    struct relocation *reloc = &entry->reloc;
+
+	    if (!is_relocatable(entry))
+		continue;
+
+	    if (reloc->first_reloc_target) {
+		addr = label_to_addr(reloc->first_reloc_target, entry->inst_offset);
+		if (addr < 0)
+		    continue;
+		reloc->first_reloc_offset = addr - entry->inst_offset;
+	    }
+
+	    if (reloc->second_reloc_target) {
+		addr = label_to_addr(reloc->second_reloc_target, entry->inst_offset);
+		if (addr < 0)
+		    continue;
+		reloc->second_reloc_offset = addr - entry->inst_offset;
+	    }
+
+	    if (reloc->second_reloc_offset) { // this is a branch instruction with two offset arguments
+                set_branch_two_offsets(entry, reloc->first_reloc_offset, reloc->second_reloc_offset);
+	    } else if (reloc->first_reloc_offset) {
+                set_branch_one_offset(entry, reloc->first_reloc_offset);
+	    }
+	}
+
+	return errors ? -1 : 0;
+}
+
+static int emit_program(struct gen4asm_program *program)
+{
+	struct brw_program_instruction *entry;
+	unsigned int num_insns = 0;
+	char *out;
+
+	for (entry = compiled_program.first; entry; entry = entry->next) {
+	    if (is_label(entry))
+		program->num_labels++;
+	    else
+		num_insns++;
+	}
+
+	program->size = num_insns * sizeof(struct brw_instruction);
+	program->code = malloc(program->size ?: 1);
+	program->labels = calloc(program->num_labels ?: 1,
+				 sizeof(*program->labels));
+	if (!program->code || !program->labels)
+	    return -1;
+
+	out = program->code;
+	program->num_labels = 0;
+	for (entry = compiled_program.first; entry; entry = entry->next) {
+	    if (is_label(entry)) {
+		struct gen4asm_label *label =
+		    &program->labels[program->num_labels++];
+
+		label->name = strdup(label_name(entry));
+		label->offset = entry->inst_offset;
+		if (!label->name)
+		    return -1;
+	    } else {
+		memcpy(out, &entry->insn.gen, sizeof(struct brw_instruction));
+		out += sizeof(struct brw_instruction);
+	    }
+	}
+
+	return 0;
+}
+
+static void free_program(void)
+{
+	struct brw_program_instruction *entry, *next;
+
+	for (entry = compiled_program.first; entry; entry = next) {
+	    next = entry->next;
+	    if (is_label(entry))
+		free(entry->insn.label.name);
+	    free(entry->reloc.first_reloc_target);
+	    free(entry->reloc.second_reloc_target);
+	    free(entry);
+	}
+
+	compiled_program.first = compiled_program.last = NULL;
+}
+
+/**
+ * gen4asm_assemble:
+ * @filename: name to give the source in messages, or NULL
+ * @source: assembly source, need not be NUL terminated
+ * @length: length of @source in bytes
+ * @options: generation and flags to assemble with
+ *
+ * Assembles @source without touching the filesystem. The instructions are
+ * only set when there are no errors, while the log of warnings and errors
+ * is always set.
+ *
+ * Returns: The assembled program, to be freed with gen4asm_program_free(),
+ * or NULL if memory ran out.
+ */
+struct gen4asm_program *
+gen4asm_assemble(const char *filename, const char *source, size_t length,
+		 const struct gen4asm_options *options)
+{
+	struct gen4asm_program *program;
+	size_t log_size;
+	void *mem_ctx;
+	unsigned int i;
+	int err;
+
+	program = calloc(1, sizeof(*program));
+	if (!program)
+		return NULL;
+
+	message_file = open_memstream(&program->log, &log_size);
+	if (!message_file) {
+		free(program);
+		return NULL;
+	}
+
+	/* Older fmemopen() refuses empty buffers */
+	if (!length) {
+		source = "\n";
+		length = 1;
+	}
+
+	yyin = fmemopen((void *)source, length, "r");
+	if (!yyin) {
+		fclose(message_file);
+		gen4asm_program_free(program);
+		return NULL;
+	}
+
+	gen_level = options->gen_level;
+	advanced_flag = options->advanced;
+	warning_flags = WARN_ALWAYS | (options->all_warnings ? WARN_ALL : 0);
+	input_filename = filename ?: "<memory>";
+	yycolumn = 1;
+	errors = 0;
+	compiled_program.first = compiled_program.last = NULL;
+	memset(&program_defaults, 0, sizeof(program_defaults));
+	program_defaults.register_type = BRW_REGISTER_TYPE_F;
+
+	for (i = 0; i < options->num_entry_points; i++)
+		add_symbol(&entry_point_table, (char *)options->entry_points[i]);
+
+	brw_init_context(&genasm_brw_context, gen_level);
+	mem_ctx = ralloc_context(NULL);
+	brw_init_compile(&genasm_brw_context, &genasm_compile, mem_ctx);
+
+	err = yyparse();
+
+	fclose(yyin);
+	yylex_destroy();
+
+	if (!err && !errors) {
+		layout_program();
+		if (relocate_program() == 0 && emit_program(program)) {
+			fprintf(message_file, "Out of memory\n");
+			errors++;
+		}
+	}
+
+	if (err && !errors)
+		errors++;
+
+	free_program();
+	free_registers();
+	free_symbol_table(&label_table);
+	free_symbol_table(&entry_point_table);
+	ralloc_free(mem_ctx);
+
+	program->errors = errors;
+	if (errors) {
+		free(program->code);
+		program->code = NULL;
+		program->size = 0;
+	}
+
+	fclose(message_file);
+	message_file = stderr;
+
+	return program;
+}
+
+/**
+ * gen4asm_program_free:
+ * @program: program returned by gen4asm_assemble()
+ */
+void gen4asm_program_free(struct gen4asm_program *program)
+{
+	unsigned int i;
+
+	if (!program)
+		return;
+
+	for (i = 0; i < program->num_labels; i++)
+		free(program->labels[i].name);
+	free(program->labels);
+	free(program->code);
+	free(program->log);
+	free(program);
+}
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#ifndef __LIBGEN4ASM_H__
+#define __LIBGEN4ASM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * In-process entry point to the assembler: assembles a program held in
+ * memory into a buffer of instructions, reporting problems in a log
+ * rather than on stderr or by exiting. The assembler keeps its state in
+ * globals, so only one program may be assembled at a time.
+ */
+
+struct gen4asm_options {
+	/* Generation times ten, e.g. 45 for G4x or 75 for Haswell */
+	int gen_level;
+	/* Register offsets in units of the data element size, not bytes */
+	bool advanced;
+	bool all_warnings;
+	/* Labels to align to four instructions with NOPs */
+	const char * const *entry_points;
+	unsigned int num_entry_points;
+};
+
+struct gen4asm_label {
+	char *name;
+	/* In instructions from the start of the program */
+	unsigned int offset;
+};
+
+struct gen4asm_program {
+	/* 16 bytes per instruction, NULL if the program failed to assemble */
+	void *code;
+	size_t size;
+
+	struct gen4asm_label *labels;
+	unsigned int num_labels;
+
+	/* Warnings and errors, NUL terminated */
+	char *log;
+	int errors;
+};
+
+struct gen4asm_program *
+gen4asm_assemble(const char *filename, const char *source, size_t length,
+		 const struct gen4asm_options *options);
+void gen4asm_program_free(struct gen4asm_program *program);
+
+#endif /* __LIBGEN4ASM_H__ */
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Assembles the test cases given on the command line through the library
+ * entry point, twice each to check nothing leaks from one program into the
+ * next, and compares the instructions with the expected output. A test case
+ * may list the labels to use as entry points in a .entry file, one a line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libgen4asm.h"
+
+static char *read_file(const char *path, size_t *length)
+{
+	FILE *file = fopen(path, "r");
+	char *buf;
+	long size;
+
+	if (!file)
+		return NULL;
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+
+	buf = malloc(size + 1);
+	if (buf && fread(buf, 1, size, file) != (size_t)size) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(file);
+
+	if (buf)
+		buf[size] = '\0';
+	*length = size;
+
+	return buf;
+}
+
+static int run_test(const char *srcdir, const char *test)
+{
+	struct gen4asm_options options = { .gen_level = 40 };
+	char path[4096], *source, *expected, *entry, *output;
+	size_t length, expected_length, entry_length, output_length;
+	const char *entry_points[16];
+	int pass, ret = 0;
+
+	snprintf(path, sizeof(path), "%s/%s.g4a", srcdir, test);
+	source = read_file(path, &length);
+	snprintf(path, sizeof(path), "%s/%s.expected", srcdir, test);
+	expected = read_file(path, &expected_length);
+	if (!source || !expected) {
+		fprintf(stderr, "%s: couldn't read the test case\n", test);
+		return 1;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s.entry", srcdir, test);
+	entry = read_file(path, &entry_length);
+	if (entry) {
+		char *label, *saveptr;
+
+		for (label = strtok_r(entry, "\n", &saveptr);
+		     label && options.num_entry_points < 16;
+		     label = strtok_r(NULL, "\n", &saveptr))
+			entry_points[options.num_entry_points++] = label;
+		options.entry_points = entry_points;
+	}
+
+	for (pass = 0; pass < 2 && !ret; pass++) {
+		struct gen4asm_program *program;
+		const unsigned int *dw;
+		FILE *out;
+		size_t i;
+
+		program = gen4asm_assemble(test, source, length, &options);
+		if (!program || program->errors) {
+			fprintf(stderr, "%s: %s", test,
+				program ? program->log : "out of memory\n");
+			gen4asm_program_free(program);
+			ret = 1;
+			break;
+		}
+
+		out = open_memstream(&output, &output_length);
+		dw = program->code;
+		for (i = 0; i < program->size / 4; i += 4)
+			fprintf(out, "   { 0x%08x, 0x%08x, 0x%08x, 0x%08x },\n",
+				dw[i], dw[i + 1], dw[i + 2], dw[i + 3]);
+		fclose(out);
+
+		if (output_length != expected_length ||
+		    memcmp(output, expected, output_length)) {
+			fprintf(stderr, "Output comparison for %s, pass %d:\n%s",
+				test, pass, output);
+			ret = 1;
+		}
+
+		free(output);
+		gen4asm_program_free(program);
+	}
+
+	free(source);
+	free(expected);
+	free(entry);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	const char *srcdir = getenv("srcdir") ?: ".";
+	int i, ret = 0;
+
+	for (i = 1; i < argc; i++)
+		ret |= run_test(srcdir, argv[i]);
+
+	return ret;
+}
@@ -11,7 +11,12 @@ fi
 
 test -d "${BUILDDIR}/test" || mkdir "${BUILDDIR}/test/"
 
-"${BUILDDIR}/intel-gen4asm" -o "${BUILDDIR}/${test}.out" "$SRCDIR/${test}.g4a"
+entry=""
+if [ -f "$SRCDIR/${test}.entry" ] ; then
+	entry="-l $SRCDIR/${test}.entry"
+fi
+
+"${BUILDDIR}/intel-gen4asm" $entry -o "${BUILDDIR}/${test}.out" "$SRCDIR/${test}.g4a"
 if cmp "${BUILDDIR}/${test}.out" "${SRCDIR}/${test}.expected" 2> /dev/null; then : ; else
   echo "Output comparison for ${test}"
   diff -u "${SRCDIR}/${test}.expected" "${test}.out"
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Time taken by the device scan every test does at startup, going to udev
+ * and then when answered from the scan cache, and by matching a device
+ * filter against the result. Point IGT_DEVICE_SCAN_SYSFS at a copy of a
+ * sysfs tree to measure without the real devices.
+ */
+
+#include "igt.h"
+#include "igt_device_scan.h"
+
+static int loops = 100;
+
+static int opt_handler(int opt, int opt_index, void *data)
+{
+	switch (opt) {
+	case 'l':
+		loops = atoi(optarg);
+		if (loops < 1)
+			return IGT_OPT_HANDLER_ERROR;
+		break;
+	default:
+		return IGT_OPT_HANDLER_ERROR;
+	}
+
+	return IGT_OPT_HANDLER_SUCCESS;
+}
+
+static const char *help_str =
+	"  -l\tNumber of scans of each kind (default: 100)\n";
+
+static double match(const char *filter, int count)
+{
+	struct igt_device_card card;
+	struct timespec then, now;
+
+	igt_assert_eq(igt_gettime(&then), 0);
+	for (int i = 0; i < count; i++)
+		igt_device_card_match(filter, &card);
+	igt_assert_eq(igt_gettime(&now), 0);
+
+	return igt_time_elapsed(&then, &now) / count;
+}
+
+static double scan(int count)
+{
+	struct timespec then, now;
+
+	igt_assert_eq(igt_gettime(&then), 0);
+	for (int i = 0; i < count; i++)
+		igt_devices_scan(true);
+	igt_assert_eq(igt_gettime(&now), 0);
+
+	return igt_time_elapsed(&then, &now) / count;
+}
+
+igt_simple_main_args("l:", NULL, help_str, opt_handler, NULL)
+{
+	char dir[] = "/tmp/device_scan.XXXXXX", cache[PATH_MAX];
+	double uncached, cached, filter;
+	int devices;
+
+	igt_assert(mkdtemp(dir));
+	snprintf(cache, sizeof(cache), "%s/cache", dir);
+
+	igt_assert_eq(setenv("IGT_DEVICE_SCAN_CACHE", "", 1), 0);
+	uncached = scan(loops);
+
+	/* The first scan writes the cache */
+	igt_assert_eq(setenv("IGT_DEVICE_SCAN_CACHE", cache, 1), 0);
+	scan(1);
+	cached = scan(loops);
+	devices = igt_device_filter_pci();
+	filter = match("sriov:vendor=intel,card=0,vf=0", loops);
+
+	igt_info("PCI devices: %d\n", devices);
+	igt_info("Uncached scan: %.3fms\n", uncached * 1e3);
+	igt_info("Cached scan: %.3fms\n", cached * 1e3);
+	igt_info("Filter match: %.3fus\n", filter * 1e6);
+
+	igt_devices_free();
+	unlink(cache);
+	rmdir(dir);
+}
@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Measure the per-record cost of classifying a kernel log as igt_results
+ * does, with a drm.debug style mix of messages: parsing the kmsg record
+ * header, looking for the subtest markers and matching the dmesg warning
+ * whitelist and the piglit style blacklist, once with sscanf() and the
+ * combined regexp, and once with the runner's kmsg classifier.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "kmsg.h"
+#include "output_strings.h"
+
+/* Same filters as runner/resultgen.c */
+#define _ "|"
+static const char dmesg_whitelist[] =
+	"ACPI: button: The lid device is not compliant to SW_LID" _
+	"ACPI: .*: Unable to dock!" _
+	"IRQ [0-9]+: no longer affine to CPU[0-9]+" _
+	"IRQ fixup: irq [0-9]+ move in progress, old vector [0-9]+" _
+	"Setting dangerous option [a-z_]+ - tainting kernel" _
+	"Suspending console\\(s\\) \\(use no_console_suspend to debug\\)" _
+	"atkbd serio[0-9]+: Failed to (deactivate|enable) keyboard on isa[0-9]+/serio[0-9]+" _
+	"cache: parent cpu[0-9]+ should not be sleeping" _
+	"hpet[0-9]+: lost [0-9]+ rtc interrupts" _
+	"i915: probe of [0-9a-fA-F:.]+ failed with error -25" _
+	"mock: DMA: Out of SW-IOMMU space for [0-9]+ bytes" _
+	"usb usb[0-9]+: root hub lost power or was reset"
+	;
+#undef _
+
+static const char piglit_style_dmesg_blacklist[] =
+	"(\\[drm:|drm_|intel_|i915_|\\[drm\\])";
+
+/* Each message is made of the text before and after a number */
+static const struct {
+	const char *prefix, *suffix;
+} messages[] = {
+	{ "[drm:drm_mode_addfb2 [drm]] [FB:", "]" },
+	{ "[drm:intel_atomic_check [i915]] [CONNECTOR:", ":DP-1] checking" },
+	{ "[drm:i915_gem_context_create_ioctl [i915]] context ", "" },
+	{ "i915 0000:00:02.0: [drm] GT0: GuC firmware i915/tgl_guc_70.bin version ", "" },
+	{ "IRQ ", ": no longer affine to CPU3" },
+	{ "usb usb", ": root hub lost power or was reset" },
+	{ "[IGT] kms_flip: starting subtest flip-vs-expired-vblank-", "" },
+	{ "[IGT] kms_flip: starting dynamic subtest pipe-A-", "" },
+	{ "PM: suspend entry (s2idle) ", "" },
+};
+
+static double elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static char **generate(unsigned int count)
+{
+	unsigned int n = sizeof(messages) / sizeof(messages[0]);
+	char **lines = malloc(count * sizeof(*lines));
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		/* Mostly debug spam, a few real messages */
+		unsigned int m = random() % 16 ? random() % 3 : random() % n;
+		char message[256];
+
+		snprintf(message, sizeof(message), "%s%u%s",
+			 messages[m].prefix, i, messages[m].suffix);
+		asprintf(&lines[i], "%u,%u,%llu,-;%s",
+			 random() % 16 ? 7 : 4, i,
+			 1000ull * i, message);
+	}
+
+	return lines;
+}
+
+static void run_regex(char **lines, unsigned int count, const char *filter)
+{
+	GRegex *re = g_regex_new(filter, G_REGEX_OPTIMIZE, 0, NULL);
+	struct timespec start, end;
+	unsigned int i, matches = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++) {
+		unsigned flags;
+		unsigned long long seq, ts_usec;
+		char continuation;
+		char *message;
+
+		if (sscanf(lines[i], "%u,%llu,%llu,%c;",
+			   &flags, &seq, &ts_usec, &continuation) != 4)
+			continue;
+		message = strchr(lines[i], ';') + 1;
+
+		matches += !!strstr(message, STARTING_SUBTEST_DMESG);
+		matches += !!strstr(message, STARTING_DYNAMIC_SUBTEST_DMESG);
+		matches += g_regex_match(re, message, 0, NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("  regex      %8.1fns/record (%u matches)\n",
+	       1e9 * elapsed(&start, &end) / count, matches);
+
+	g_regex_unref(re);
+}
+
+static void run_classifier(char **lines, unsigned int count, const char *filter)
+{
+	struct kmsg_classifier *classifier = kmsg_classifier_create(filter);
+	struct timespec start, end;
+	unsigned int i, matches = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++) {
+		struct kmsg_record record;
+		const char *subtest, *dynamic_subtest;
+		unsigned class;
+
+		if (!kmsg_parse_record(lines[i], &record))
+			continue;
+
+		class = kmsg_classify(classifier, record.message, true,
+				      &subtest, &dynamic_subtest);
+		matches += __builtin_popcount(class);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("  classifier %8.1fns/record (%u matches)\n",
+	       1e9 * elapsed(&start, &end) / count, matches);
+
+	kmsg_classifier_destroy(classifier);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int count = 1000000;
+	char **lines;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n records]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	srandom(0x1234);
+	lines = generate(count);
+
+	printf("whitelist:\n");
+	run_regex(lines, count, dmesg_whitelist);
+	run_classifier(lines, count, dmesg_whitelist);
+
+	printf("piglit style blacklist:\n");
+	run_regex(lines, count, piglit_style_dmesg_blacklist);
+	run_classifier(lines, count, piglit_style_dmesg_blacklist);
+
+	for (i = 0; i < count; i++)
+		free(lines[i]);
+	free(lines);
+
+	return 0;
+}
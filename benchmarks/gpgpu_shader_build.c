@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Rate at which gpgpu shaders are put together from their iga64
+ * templates, with and without the shader cache, on the CPU alone.
+ */
+
+#include "igt.h"
+#include "gpgpu_shader.h"
+
+static unsigned int gen_ver = 1260;
+static unsigned int count = 1000000;
+
+static int opt_handler(int opt, int opt_index, void *data)
+{
+	switch (opt) {
+	case 'g':
+		gen_ver = atoi(optarg);
+		break;
+	case 'n':
+		count = atoi(optarg);
+		break;
+	default:
+		return IGT_OPT_HANDLER_ERROR;
+	}
+
+	return IGT_OPT_HANDLER_SUCCESS;
+}
+
+static const char *help_str =
+	"  -g\tPlatform to build for, as graphics version times 100 (default: 1260)\n"
+	"  -n\tNumber of shaders to build (default: 1000000)\n";
+
+/* Builds count shaders, distinct of them different, checksumming the code */
+static void build(const char *name, unsigned int distinct)
+{
+	struct timespec then, now;
+	uint32_t sum = 0;
+	double elapsed;
+
+	igt_assert_eq(igt_gettime(&then), 0);
+
+	for (unsigned int i = 0; i < count; i++) {
+		struct gpgpu_shader *shdr = __gpgpu_shader_create(gen_ver);
+		const uint32_t *code;
+
+		gpgpu_shader__write_dword(shdr, 0xc0ffee00 + i % distinct, 0);
+		gpgpu_shader__eot(shdr);
+		code = gpgpu_shader_finalize(shdr);
+
+		for (unsigned int n = 0; n < shdr->size; n++)
+			sum += code[n];
+
+		gpgpu_shader_destroy(shdr);
+	}
+
+	igt_assert_eq(igt_gettime(&now), 0);
+	elapsed = igt_time_elapsed(&then, &now);
+
+	igt_info("%-24s %10.0f shaders/s (checksum %08x)\n",
+		 name, count / elapsed, sum);
+}
+
+igt_simple_main_args("g:n:", NULL, help_str, opt_handler, NULL)
+{
+	unsigned int limit;
+
+	igt_require(gen_ver >= 1200);
+
+	limit = gpgpu_shader_cache_set_limit(0);
+	build("uncached", 1);
+	build("uncached, distinct", count);
+
+	gpgpu_shader_cache_set_limit(limit);
+	build("cached", 1);
+	build("cached, 16 variants", 16);
+}
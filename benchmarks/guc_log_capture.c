@@ -0,0 +1,261 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Throughput of the intel_guc_logger capture engine, with a regular file
+ * or a FIFO fed by another thread standing in for the relay file. Every
+ * capture is checked against the data that went in.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "intel_guc_log_capture.h"
+
+#define SUBBUF_SIZE (19 * 4096)
+
+static unsigned int num_subbufs = 100;
+static unsigned int total_subbufs;
+static const char *dir = "/tmp";
+
+static double elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+/* Log-like contents: mostly small counters, so they compress somewhat */
+static void fill_subbuf(uint32_t *buf, unsigned int index)
+{
+	uint32_t state = index * 2654435761u;
+	unsigned int n;
+
+	for (n = 0; n < SUBBUF_SIZE / sizeof(*buf); n++) {
+		state = state * 1103515245 + 12345;
+		buf[n] = n % 4 ? (state >> 24) : index << 16 | n / 4;
+	}
+}
+
+static char *temp_path(const char *name)
+{
+	char *path;
+
+	if (asprintf(&path, "%s/guc_log_capture.%d.%s", dir, getpid(), name) < 0)
+		exit(EXIT_FAILURE);
+
+	return path;
+}
+
+static int write_input_file(const char *path)
+{
+	uint32_t *buf = malloc(SUBBUF_SIZE);
+	unsigned int n;
+	int fd;
+
+	fd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0600);
+	if (fd < 0)
+		return -1;
+
+	for (n = 0; n < total_subbufs; n++) {
+		fill_subbuf(buf, n);
+		if (write(fd, buf, SUBBUF_SIZE) != SUBBUF_SIZE)
+			return -1;
+	}
+
+	free(buf);
+	return fd;
+}
+
+static void *feed_fifo(void *data)
+{
+	const char *path = data;
+	uint32_t *buf = malloc(SUBBUF_SIZE);
+	unsigned int n;
+	int fd;
+
+	fd = open(path, O_WRONLY);
+	for (n = 0; fd >= 0 && n < total_subbufs; n++) {
+		size_t done = 0;
+
+		fill_subbuf(buf, n);
+		while (done < SUBBUF_SIZE) {
+			ssize_t ret = write(fd, (char *)buf + done,
+					    SUBBUF_SIZE - done);
+
+			if (ret < 0)
+				goto out;
+			done += ret;
+		}
+	}
+out:
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+static bool check_output(const char *path)
+{
+	uint32_t *expect = malloc(SUBBUF_SIZE);
+	uint32_t *buf = malloc(SUBBUF_SIZE);
+	bool ok = true;
+	unsigned int n;
+	gzFile file;
+
+	/* gzread() passes uncompressed files through */
+	file = gzopen(path, "rb");
+	if (!file)
+		return false;
+
+	for (n = 0; ok && n < total_subbufs; n++) {
+		fill_subbuf(expect, n);
+		ok = gzread(file, buf, SUBBUF_SIZE) == SUBBUF_SIZE &&
+		     !memcmp(buf, expect, SUBBUF_SIZE);
+	}
+	ok = ok && gzread(file, buf, 1) == 0;
+
+	gzclose(file);
+	free(expect);
+	free(buf);
+
+	return ok;
+}
+
+static void run(const char *name, bool fifo, bool copy, int compress)
+{
+	struct guc_log_capture_params params = {
+		.subbuf_size = SUBBUF_SIZE,
+		.num_subbufs = num_subbufs,
+		.copy = copy,
+		.compress = compress,
+	};
+	char *in_path = temp_path("in"), *out_path = temp_path("out");
+	struct guc_log_capture_stats stats;
+	struct guc_log_capture *capture;
+	struct timespec start, end;
+	pthread_t feeder;
+	bool ok;
+
+	if (fifo) {
+		unlink(in_path);
+		if (mkfifo(in_path, 0600))
+			exit(EXIT_FAILURE);
+		pthread_create(&feeder, NULL, feed_fifo, in_path);
+		params.relay_fd = open(in_path, O_RDONLY);
+		fcntl(params.relay_fd, F_SETFL, O_NONBLOCK);
+	} else {
+		params.relay_fd = write_input_file(in_path);
+		lseek(params.relay_fd, 0, SEEK_SET);
+	}
+
+	params.out_fd = open(out_path, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+	if (params.relay_fd < 0 || params.out_fd < 0) {
+		perror("open");
+		exit(EXIT_FAILURE);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	capture = guc_log_capture_create(&params);
+	if (!capture) {
+		perror("guc_log_capture_create");
+		exit(EXIT_FAILURE);
+	}
+
+	for (;;) {
+		struct pollfd pfd = { .fd = params.relay_fd, .events = POLLIN };
+		int ret;
+
+		poll(&pfd, 1, -1);
+
+		ret = guc_log_capture_pull(capture);
+		if (ret < 0) {
+			fprintf(stderr, "%s: %s\n", name, strerror(-ret));
+			exit(EXIT_FAILURE);
+		}
+
+		/* End of the file, or the feeder is gone and all was read */
+		if (!ret && (!fifo || pfd.revents & POLLHUP))
+			break;
+	}
+
+	if (guc_log_capture_finish(capture)) {
+		fprintf(stderr, "%s: capture failed\n", name);
+		exit(EXIT_FAILURE);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	guc_log_capture_get_stats(capture, &stats);
+	guc_log_capture_destroy(capture);
+	if (fifo)
+		pthread_join(feeder, NULL);
+	close(params.relay_fd);
+	close(params.out_fd);
+
+	ok = stats.captured == (uint64_t)total_subbufs * SUBBUF_SIZE &&
+	     check_output(out_path);
+
+	printf("%-14s %-5s %8.1f MiB/s, %6.1f MiB written, %5llu stalls%s\n",
+	       name, stats.spliced ? "splice" : "copy",
+	       stats.captured / elapsed(&start, &end) / (1 << 20),
+	       stats.written / (double)(1 << 20),
+	       (unsigned long long)stats.stalls, ok ? "" : ", MISMATCH");
+
+	unlink(in_path);
+	unlink(out_path);
+	free(in_path);
+	free(out_path);
+
+	if (!ok)
+		exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int size = 256;
+	int c;
+
+	while ((c = getopt(argc, argv, "s:b:d:")) != -1) {
+		switch (c) {
+		case 's':
+			size = atoi(optarg);
+			break;
+		case 'b':
+			num_subbufs = atoi(optarg);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-s MiB] [-b sub-buffers] [-d tmpdir]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	total_subbufs = ((uint64_t)size << 20) / SUBBUF_SIZE;
+	if (!total_subbufs || !num_subbufs)
+		return EXIT_FAILURE;
+
+	run("file", false, false, 0);
+	run("file", false, true, 0);
+	run("file gzip", false, true, 1);
+	run("fifo", true, false, 0);
+	run("fifo", true, true, 0);
+	run("fifo gzip", true, true, 1);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Time taken to set up and tear down an igt_display, the first time round
+ * and then again with the property metadata already cached, as at the
+ * start of every subtest group. vkms makes a handy device for it:
+ *
+ *   IGT_DEVICE=sys:/sys/devices/platform/vkms kms_display_init
+ */
+
+#include "igt.h"
+
+static int loops = 100;
+
+static int opt_handler(int opt, int opt_index, void *data)
+{
+	switch (opt) {
+	case 'l':
+		loops = atoi(optarg);
+		if (loops < 1)
+			return IGT_OPT_HANDLER_ERROR;
+		break;
+	default:
+		return IGT_OPT_HANDLER_ERROR;
+	}
+
+	return IGT_OPT_HANDLER_SUCCESS;
+}
+
+static const char *help_str =
+	"  -l\tNumber of times to set up the display once cached (default: 100)\n";
+
+static double display_init(int fd)
+{
+	igt_display_t display;
+	struct timespec then, now;
+
+	igt_assert_eq(igt_gettime(&then), 0);
+	igt_display_require(&display, fd);
+	igt_display_fini(&display);
+	igt_assert_eq(igt_gettime(&now), 0);
+
+	return igt_time_elapsed(&then, &now);
+}
+
+igt_simple_main_args("l:", NULL, help_str, opt_handler, NULL)
+{
+	double first, total = 0;
+	int fd;
+
+	fd = drm_open_driver_master(DRIVER_ANY);
+	kmstest_set_vt_graphics_mode();
+
+	first = display_init(fd);
+	for (int i = 0; i < loops; i++)
+		total += display_init(fd);
+
+	igt_info("First display init: %.3fms\n", first * 1e3);
+	igt_info("Cached display init: %.3fms (average of %d)\n",
+		 total / loops * 1e3, loops);
+
+	drm_close_driver(fd);
+}
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Measure the cost of parsing a large KTAP report, as produced by KUnit
+ * suites with thousands of test cases, one line at a time with
+ * igt_ktap_parse() and in chunks with igt_ktap_parse_stream(), both as plain
+ * text and as /dev/kmsg records. The report is either synthetic or read from
+ * a file recorded from the results file of a suite in debugfs.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_ktap.h"
+
+struct text {
+	char *buf;
+	size_t len, size;
+};
+
+static void __attribute__((format(printf, 2, 3)))
+append(struct text *text, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+
+	if (text->len + len + 1 > text->size) {
+		text->size = 2 * (text->len + len + 1);
+		text->buf = realloc(text->buf, text->size);
+		igt_assert(text->buf);
+	}
+
+	va_start(ap, fmt);
+	vsnprintf(text->buf + text->len, len + 1, fmt, ap);
+	va_end(ap);
+	text->len += len;
+}
+
+static void generate(struct text *text, unsigned int suites, unsigned int cases)
+{
+	unsigned int s, c, p;
+
+	append(text, "KTAP version 1\n1..%u\n", suites);
+	for (s = 1; s <= suites; s++) {
+		append(text, "    KTAP version 1\n    # Subtest: drm_suite_%u\n    1..%u\n",
+		       s, cases);
+		for (c = 1; c <= cases; c++) {
+			/* every 16th test case is parametrized */
+			if (c % 16 == 0) {
+				append(text, "        KTAP version 1\n        # Subtest: drm_test_case_%u\n", c);
+				for (p = 1; p <= 8; p++)
+					append(text, "        ok %u param-%u\n", p, p);
+				append(text, "    # drm_test_case_%u: pass:8 fail:0 skip:0 total:8\n", c);
+			} else {
+				append(text, "    # drm_test_case_%u: running\n", c);
+			}
+
+			if (c % 64 == 1)
+				append(text, "    ok %u drm_test_case_%u # SKIP not supported\n", c, c);
+			else
+				append(text, "    ok %u drm_test_case_%u\n", c, c);
+		}
+		append(text, "# drm_suite_%u: pass:%u fail:0 skip:0 total:%u\n",
+		       s, cases, cases);
+		append(text, "ok %u drm_suite_%u\n", s, s);
+	}
+}
+
+/* Prefix each line with a kmsg record header */
+static void to_kmsg(const struct text *text, struct text *kmsg)
+{
+	const char *line, *eol;
+	unsigned int seq = 0;
+
+	for (line = text->buf; *line; line = eol + 1) {
+		eol = strchrnul(line, '\n');
+		append(kmsg, "6,%u,%llu,-;%.*s\n", seq, seq * 1000ull,
+		       (int)(eol - line), line);
+		seq++;
+		if (!*eol)
+			break;
+	}
+}
+
+static void free_results(struct igt_list_head *results)
+{
+	struct igt_ktap_result *r, *rn;
+	char *suite_name = NULL, *case_name = NULL;
+
+	igt_list_for_each_entry_safe(r, rn, results, link) {
+		igt_list_del(&r->link);
+		if (r->suite_name != suite_name) {
+			free(suite_name);
+			suite_name = r->suite_name;
+		}
+		if (r->case_name != case_name) {
+			free(case_name);
+			case_name = r->case_name;
+		}
+		free(r->msg);
+		free(r);
+	}
+	free(suite_name);
+	free(case_name);
+}
+
+static double elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static void report(const char *name, const struct text *text, int ret,
+		   unsigned int count, const struct timespec *start,
+		   const struct timespec *end)
+{
+	double t = elapsed(start, end);
+
+	printf("%-8s %8.2fms, %8.2f MiB/s, %u results (%s)\n",
+	       name, 1e3 * t, text->len / t / (1 << 20), count,
+	       ret ? strerror(-ret) : "complete");
+}
+
+static void run_lines(const struct text *text)
+{
+	char *copy = strdup(text->buf), *line, *eol;
+	struct igt_ktap_results *ktap;
+	struct timespec start, end;
+	int ret = -EINPROGRESS;
+	IGT_LIST_HEAD(results);
+
+	ktap = igt_ktap_alloc(&results);
+
+	/* as kunit_get_results() used to get them from getline() */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (line = copy; *line && ret == -EINPROGRESS; line = eol) {
+		char c;
+
+		eol = strchrnul(line, '\n');
+		if (*eol)
+			eol++;
+		c = *eol;
+		*eol = '\0';
+		ret = igt_ktap_parse(line, ktap);
+		*eol = c;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	report("lines", text, ret, igt_list_length(&results), &start, &end);
+
+	igt_ktap_free(&ktap);
+	free_results(&results);
+	free(copy);
+}
+
+static void run_stream(const char *name, const struct text *text,
+		       size_t chunk, bool kmsg)
+{
+	struct igt_ktap_results *ktap;
+	struct timespec start, end;
+	int ret = -EINPROGRESS;
+	IGT_LIST_HEAD(results);
+	size_t i;
+
+	ktap = igt_ktap_alloc(&results);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < text->len && ret == -EINPROGRESS; i += chunk)
+		ret = igt_ktap_parse_stream(text->buf + i,
+					    chunk < text->len - i ? chunk : text->len - i,
+					    kmsg, ktap);
+	if (ret == -EINPROGRESS)
+		ret = igt_ktap_parse_stream(NULL, 0, kmsg, ktap);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	report(name, text, ret, igt_list_length(&results), &start, &end);
+
+	igt_ktap_free(&ktap);
+	free_results(&results);
+}
+
+static void read_file(struct text *text, const char *filename)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(filename);
+		exit(1);
+	}
+
+	text->size = st.st_size + 1;
+	text->buf = malloc(text->size);
+	igt_assert(text->buf);
+	text->len = read(fd, text->buf, st.st_size);
+	if (text->len != st.st_size) {
+		perror(filename);
+		exit(1);
+	}
+	text->buf[text->len] = '\0';
+	close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	struct text text = {}, kmsg = {};
+	unsigned int suites = 16, cases = 4096;
+	const char *filename = NULL;
+	int c;
+
+	while ((c = getopt(argc, argv, "f:s:c:")) != -1) {
+		switch (c) {
+		case 'f':
+			filename = optarg;
+			break;
+		case 's':
+			suites = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			cases = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-f KTAP log] [-s suites] [-c test cases per suite]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (filename)
+		read_file(&text, filename);
+	else
+		generate(&text, suites, cases);
+	to_kmsg(&text, &kmsg);
+
+	run_lines(&text);
+	run_stream("stream", &text, BUF_LEN, false);
+	run_stream("kmsg", &kmsg, BUF_LEN, true);
+
+	free(text.buf);
+	free(kmsg.buf);
+
+	return 0;
+}
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Measure the cost of the basic igt_map operations with 64-bit keys, as used
+ * by the allocator handle/vm maps: insertion, successful and failed lookups,
+ * iteration, removal and a mixed insert/remove churn.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_map.h"
+
+static double elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+#define TIMED(name, count, body) do { \
+	struct timespec start__, end__; \
+	clock_gettime(CLOCK_MONOTONIC, &start__); \
+	body; \
+	clock_gettime(CLOCK_MONOTONIC, &end__); \
+	printf("%-10s %8.2fns/op\n", name, \
+	       1e9 * elapsed(&start__, &end__) / (count)); \
+} while (0)
+
+static void run(unsigned int count, unsigned int reps)
+{
+	uint64_t *keys = malloc(2 * count * sizeof(*keys));
+	struct igt_map_entry *pos;
+	struct igt_map *map;
+	unsigned int i, r;
+	uintptr_t sum = 0;
+	void *data;
+
+	/* page aligned offsets, as the allocators use */
+	for (i = 0; i < 2 * count; i++)
+		keys[i] = (uint64_t)(random() ^ ((uint64_t)random() << 31)) << 12;
+
+	map = igt_map_create(igt_map_hash_64, igt_map_equal_64);
+
+	TIMED("insert", count,
+	      for (i = 0; i < count; i++)
+		      igt_map_insert(map, &keys[i], &keys[i]));
+
+	TIMED("lookup", (uint64_t)count * reps,
+	      for (r = 0; r < reps; r++)
+		      for (i = 0; i < count; i++) {
+			      data = igt_map_search(map, &keys[i]);
+			      sum += (uintptr_t)data;
+		      });
+
+	TIMED("miss", (uint64_t)count * reps,
+	      for (r = 0; r < reps; r++)
+		      for (i = count; i < 2 * count; i++) {
+			      data = igt_map_search(map, &keys[i]);
+			      sum += (uintptr_t)data;
+		      });
+
+	TIMED("iterate", (uint64_t)count * reps,
+	      for (r = 0; r < reps; r++)
+		      igt_map_foreach(map, pos)
+			      sum += (uintptr_t)pos->data);
+
+	TIMED("churn", (uint64_t)count * reps,
+	      for (r = 0; r < reps; r++)
+		      for (i = 0; i < count; i++) {
+			      unsigned int k = (i + r * count) % (2 * count);
+			      unsigned int old = (k + count) % (2 * count);
+
+			      igt_map_remove(map, &keys[old], NULL);
+			      igt_map_insert(map, &keys[k], &keys[k]);
+		      });
+
+	TIMED("remove", count,
+	      for (i = 0; i < 2 * count; i++)
+		      igt_map_remove(map, &keys[i], NULL));
+
+	igt_map_destroy(map, NULL);
+	free(keys);
+
+	/* keep the lookups from being optimised away */
+	if (sum == 1)
+		printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int count = 100000;
+	unsigned int reps = 10;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:r:")) != -1) {
+		switch (c) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n entries] [-r repetitions]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	srandom(0x1234);
+	run(count, reps);
+
+	return 0;
+}
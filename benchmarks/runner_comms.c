@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Measure the throughput of sending log packets from a test to igt_runner,
+ * over the SOCK_DGRAM socketpair with one datagram per packet and over the
+ * shared memory ring with its eventfd doorbell, counting how often the
+ * receiving side had to be woken up.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "runnercomms.h"
+
+static double elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static void report(const char *name, unsigned int count, size_t bytes,
+		   unsigned int wakeups,
+		   const struct timespec *start, const struct timespec *end)
+{
+	double t = elapsed(start, end);
+
+	printf("%-8s %8.0f packets/s, %8.2f MiB/s, %u wakeups (%.1f packets/wakeup)\n",
+	       name, count / t, bytes / t / (1 << 20), wakeups,
+	       (double)count / (wakeups ?: 1));
+}
+
+static void sender(int socketfd, struct runnercomms_ring *ring, int doorbellfd,
+		   unsigned int count, unsigned int length)
+{
+	char *text = malloc(length + 1);
+	unsigned int n;
+
+	memset(text, 'x', length);
+	text[length] = '\0';
+
+	for (n = 0; n < count; n++) {
+		struct runnerpacket *packet = runnerpacket_log(STDOUT_FILENO, text);
+
+		if (!ring || !runnercomms_ring_send(ring, doorbellfd, packet))
+			write(socketfd, packet, packet->size);
+		free(packet);
+	}
+
+	free(text);
+}
+
+static void run_socket(unsigned int count, unsigned int length)
+{
+	size_t bufsize = 256 * 1024, bytes = 0;
+	char *buf = malloc(bufsize);
+	struct timespec start, end;
+	unsigned int received = 0, wakeups = 0;
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv)) {
+		perror("socketpair");
+		exit(1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (fork() == 0) {
+		close(sv[0]);
+		sender(sv[1], NULL, -1, count, length);
+		_exit(0);
+	}
+	close(sv[1]);
+
+	while (received < count) {
+		struct pollfd pfd = { .fd = sv[0], .events = POLLIN };
+
+		poll(&pfd, 1, -1);
+		wakeups++;
+
+		while (true) {
+			ssize_t s = recv(sv[0], buf, bufsize, MSG_DONTWAIT);
+
+			if (s < 0) {
+				if (errno == EAGAIN)
+					break;
+				perror("recv");
+				exit(1);
+			}
+
+			received++;
+			bytes += s;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	wait(NULL);
+
+	report("socket", received, bytes, wakeups, &start, &end);
+
+	close(sv[0]);
+	free(buf);
+}
+
+static void run_ring(unsigned int count, unsigned int length)
+{
+	unsigned int received = 0, wakeups = 0;
+	struct runnercomms_reader reader;
+	struct runnercomms_ring *ring;
+	struct timespec start, end;
+	int ringfd, doorbellfd;
+	size_t bytes = 0;
+
+	ring = runnercomms_ring_create(RUNNERCOMMS_RING_SIZE, &ringfd);
+	doorbellfd = eventfd(0, EFD_NONBLOCK);
+	if (!ring || doorbellfd < 0) {
+		perror("ring");
+		exit(1);
+	}
+	runnercomms_reader_init(&reader, ring);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (fork() == 0) {
+		struct runnercomms_ring *child = runnercomms_ring_map(ringfd);
+
+		sender(-1, child, doorbellfd, count, length);
+		_exit(0);
+	}
+
+	while (received < count) {
+		const struct runnerpacket *packet;
+
+		if (runnercomms_ring_arm(ring)) {
+			struct pollfd pfd = { .fd = doorbellfd, .events = POLLIN };
+			uint64_t doorbell;
+
+			poll(&pfd, 1, -1);
+			read(doorbellfd, &doorbell, sizeof(doorbell));
+			wakeups++;
+		}
+
+		while ((packet = runnercomms_reader_next(&reader, false))) {
+			received++;
+			bytes += packet->size;
+		}
+		runnercomms_reader_release(&reader);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	wait(NULL);
+
+	report("ring", received, bytes, wakeups, &start, &end);
+
+	runnercomms_reader_fini(&reader);
+	runnercomms_ring_unmap(ring);
+	close(ringfd);
+	close(doorbellfd);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int count = 1000000;
+	unsigned int length = 80;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:l:")) != -1) {
+		switch (c) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			length = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n packets] [-l log line length]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	run_socket(count, length);
+	run_ring(count, length);
+
+	return 0;
+}
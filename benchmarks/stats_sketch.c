@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Compare the cost of collecting latency-like samples into an exact
+ * igt_stats_t against a bounded-memory sketch (igt_stats_init_sketch()),
+ * and the accuracy of the quantiles reported by the latter.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_stats.h"
+
+static double elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static uint64_t lcg_next(uint64_t *state)
+{
+	*state = *state * 6364136223846793005ull + 1442695040888963407ull;
+	return *state >> 33;
+}
+
+static uint64_t *make_samples(unsigned int count)
+{
+	uint64_t *samples = malloc(count * sizeof(*samples));
+	uint64_t state = 0x1234;
+	unsigned int n;
+
+	for (n = 0; n < count; n++) {
+		samples[n] = 1000 + lcg_next(&state) % 100000;
+		if (n % 16 == 0)
+			samples[n] *= 50;
+	}
+
+	return samples;
+}
+
+static void run(igt_stats_t *stats, const char *name,
+		const uint64_t *samples, unsigned int count, int queries)
+{
+	struct timespec start, mid, end;
+	double q[3];
+	int n;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	igt_stats_push_array(stats, samples, count);
+	clock_gettime(CLOCK_MONOTONIC, &mid);
+	for (n = 0; n < queries; n++) {
+		/* invalidate any cached sorting, as another push would */
+		stats->sorted_array_valid = false;
+		igt_stats_get_quartiles(stats, &q[0], &q[1], &q[2]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("%-8s push: %7.2fns/sample, quartiles: %10.3fus/query, p99: %.0f, median: %.0f, iqr: %.0f\n",
+	       name,
+	       1e9 * elapsed(&start, &mid) / count,
+	       1e6 * elapsed(&mid, &end) / queries,
+	       igt_stats_get_quantile(stats, .99),
+	       q[1], q[2] - q[0]);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int count = 10000000;
+	unsigned int precision = 7;
+	int queries = 10;
+	igt_stats_t stats;
+	uint64_t *samples;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:p:q:")) != -1) {
+		switch (c) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			precision = atoi(optarg);
+			break;
+		case 'q':
+			queries = atoi(optarg);
+			if (queries < 1)
+				queries = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n samples] [-p precision] [-q queries]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	samples = make_samples(count);
+
+	igt_stats_init_with_size(&stats, count);
+	run(&stats, "exact", samples, count, queries);
+	igt_stats_fini(&stats);
+
+	igt_stats_init_sketch(&stats, precision);
+	run(&stats, "sketch", samples, count, queries);
+	printf("sketch size: %zu bytes\n",
+	       stats.n_buckets * sizeof(*stats.buckets));
+	igt_stats_fini(&stats);
+
+	free(samples);
+	return 0;
+}
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Cost of sampling the gt frequencies the way tests poll them: reopening
+ * each attribute with igt_sysfs_get_u32(), through handles kept open with
+ * igt_sysfs_attr_open(), and all of them at once with
+ * igt_sysfs_attr_get_u64_array(). By default this runs against a fake sysfs
+ * of regular files in a temporary directory, set up with
+ * igt_sysfs_set_root(), so it needs no device.
+ */
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <sys/sysmacros.h>
+
+#include "igt.h"
+#include "igt_sysfs.h"
+
+static const enum i915_attr_id ids[] = {
+	RPS_ACT_FREQ_MHZ,
+	RPS_CUR_FREQ_MHZ,
+	RPS_MIN_FREQ_MHZ,
+	RPS_MAX_FREQ_MHZ,
+};
+
+static bool use_device;
+static int loops = 100000;
+
+static int opt_handler(int opt, int opt_index, void *data)
+{
+	switch (opt) {
+	case 'd':
+		use_device = true;
+		break;
+	case 'l':
+		loops = atoi(optarg);
+		if (loops < 1)
+			return IGT_OPT_HANDLER_ERROR;
+		break;
+	default:
+		return IGT_OPT_HANDLER_ERROR;
+	}
+
+	return IGT_OPT_HANDLER_SUCCESS;
+}
+
+static const char *help_str =
+	"  -d\tSample gt0 of the first i915 device instead of a fake sysfs\n"
+	"  -l\tNumber of samples of each attribute (default: 100000)\n";
+
+static char root[] = "/tmp/igt_sysfs_attr.XXXXXX";
+
+static void __attribute__((format(printf, 2, 3)))
+fake_path(char *path, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	len = snprintf(path, PATH_MAX, "%s", root);
+	va_start(ap, fmt);
+	vsnprintf(path + len, PATH_MAX - len, fmt, ap);
+	va_end(ap);
+}
+
+static int fake_device(void)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	int device, fd;
+
+	/* Any char device does, its sysfs is looked up by major:minor */
+	device = open("/dev/null", O_RDONLY);
+	igt_assert_lte(0, device);
+	igt_assert_eq(fstat(device, &st), 0);
+
+	igt_assert(mkdtemp(root));
+	fake_path(path, "/dev");
+	igt_assert_eq(mkdir(path, 0755), 0);
+	fake_path(path, "/dev/char");
+	igt_assert_eq(mkdir(path, 0755), 0);
+	fake_path(path, "/dev/char/%d:%d", major(st.st_rdev), minor(st.st_rdev));
+	igt_assert_eq(mkdir(path, 0755), 0);
+
+	/* Without a gt/gt0, the legacy names in the device directory */
+	for (int i = 0; i < ARRAY_SIZE(ids); i++) {
+		fake_path(path, "/dev/char/%d:%d/%s",
+			  major(st.st_rdev), minor(st.st_rdev),
+			  igt_sysfs_dir_id_to_name(-1, ids[i]));
+		fd = open(path, O_WRONLY | O_CREAT, 0644);
+		igt_assert_lte(0, fd);
+		igt_assert_eq(write(fd, "1100\n", 5), 5);
+		close(fd);
+	}
+
+	igt_sysfs_set_root(root);
+
+	return device;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+			struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static double elapsed(struct timespec *then)
+{
+	struct timespec now;
+
+	igt_assert_eq(igt_gettime(&now), 0);
+
+	return igt_time_elapsed(then, &now);
+}
+
+igt_simple_main_args("dl:", NULL, help_str, opt_handler, NULL)
+{
+	struct igt_sysfs_attr *attrs[ARRAY_SIZE(ids)];
+	const char *names[ARRAY_SIZE(ids)];
+	uint64_t values[ARRAY_SIZE(ids)];
+	double reopen, cached, batch;
+	struct timespec then;
+	int device, dir;
+
+	device = use_device ? drm_open_driver(DRIVER_INTEL) : fake_device();
+	dir = igt_sysfs_gt_open(device, 0);
+	igt_require(dir >= 0);
+
+	for (int i = 0; i < ARRAY_SIZE(ids); i++) {
+		names[i] = igt_sysfs_dir_id_to_name(dir, ids[i]);
+		attrs[i] = igt_sysfs_attr_open(dir, names[i]);
+		igt_assert(attrs[i]);
+	}
+
+	igt_assert_eq(igt_gettime(&then), 0);
+	for (int n = 0; n < loops; n++) {
+		for (int i = 0; i < ARRAY_SIZE(ids); i++)
+			values[i] = igt_sysfs_get_u32(dir, names[i]);
+	}
+	reopen = elapsed(&then) / loops / ARRAY_SIZE(ids);
+
+	igt_assert_eq(igt_gettime(&then), 0);
+	for (int n = 0; n < loops; n++) {
+		for (int i = 0; i < ARRAY_SIZE(ids); i++)
+			values[i] = igt_sysfs_attr_get_u32(attrs[i]);
+	}
+	cached = elapsed(&then) / loops / ARRAY_SIZE(ids);
+
+	igt_assert_eq(igt_gettime(&then), 0);
+	for (int n = 0; n < loops; n++)
+		igt_sysfs_attr_get_u64_array(attrs, ARRAY_SIZE(ids), values);
+	batch = elapsed(&then) / loops;
+
+	igt_info("Reopening each attribute: %.3fus per sample\n", reopen * 1e6);
+	igt_info("Attribute handles: %.3fus per sample (%.1fx)\n",
+		 cached * 1e6, reopen / cached);
+	igt_info("Batch of %zu attributes: %.3fus per batch\n",
+		 ARRAY_SIZE(ids), batch * 1e6);
+
+	for (int i = 0; i < ARRAY_SIZE(ids); i++)
+		igt_sysfs_attr_close(attrs[i]);
+	close(dir);
+	close(device);
+
+	if (!use_device) {
+		igt_sysfs_set_root(NULL);
+		nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+	}
+}
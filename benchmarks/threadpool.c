@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Overhead of the igt_threadpool primitives: the round trip of submitting
+ * and waiting on an empty task, recursive tasks that keep every worker busy
+ * stealing, and the speedup of a parallel loop over the same loop run
+ * serially.
+ */
+
+#include "igt.h"
+#include "igt_threadpool.h"
+
+static unsigned int threads;
+static int loops = 100000;
+
+static int opt_handler(int opt, int opt_index, void *data)
+{
+	switch (opt) {
+	case 'l':
+		loops = atoi(optarg);
+		if (loops < 1)
+			return IGT_OPT_HANDLER_ERROR;
+		break;
+	case 't':
+		threads = atoi(optarg);
+		break;
+	default:
+		return IGT_OPT_HANDLER_ERROR;
+	}
+
+	return IGT_OPT_HANDLER_SUCCESS;
+}
+
+static const char *help_str =
+	"  -l\tNumber of tasks and loop iterations (default: 100000)\n"
+	"  -t\tNumber of worker threads (default: one per CPU)\n";
+
+static struct igt_threadpool *pool;
+
+static void *nop(void *data)
+{
+	return data;
+}
+
+static void *tree(void *data)
+{
+	unsigned long n = (unsigned long)data;
+	struct igt_future *a, *b;
+	void *x, *y;
+
+	if (n < 2)
+		return (void *)1ul;
+
+	a = igt_threadpool_submit(pool, tree, (void *)(n / 2));
+	b = igt_threadpool_submit(pool, tree, (void *)(n - n / 2));
+
+	x = igt_future_wait(a);
+	y = igt_future_wait(b);
+
+	return (void *)((unsigned long)x + (unsigned long)y);
+}
+
+static void body(unsigned long idx, void *data)
+{
+	uint32_t *out = data;
+	uint32_t x = idx;
+
+	/* Something like a pixel of a gradient, costly enough to split */
+	for (int i = 0; i < 256; i++)
+		x = x * 1664525 + 1013904223;
+	out[idx] = x;
+}
+
+static double elapsed(struct timespec *then)
+{
+	struct timespec now;
+
+	igt_assert_eq(igt_gettime(&now), 0);
+
+	return igt_time_elapsed(then, &now);
+}
+
+igt_simple_main_args("l:t:", NULL, help_str, opt_handler, NULL)
+{
+	struct igt_future **futures;
+	double roundtrip, batch, recursive, serial, parallel;
+	struct timespec then;
+	uint32_t *out;
+	void *leaves;
+
+	pool = igt_threadpool_create(threads);
+	futures = calloc(loops, sizeof(*futures));
+	out = calloc(loops, sizeof(*out));
+	igt_assert(futures && out);
+
+	igt_assert_eq(igt_gettime(&then), 0);
+	for (int i = 0; i < loops; i++)
+		igt_future_wait(igt_threadpool_submit(pool, nop, NULL));
+	roundtrip = elapsed(&then) / loops;
+
+	igt_assert_eq(igt_gettime(&then), 0);
+	for (int i = 0; i < loops; i++)
+		futures[i] = igt_threadpool_submit(pool, nop, NULL);
+	for (int i = 0; i < loops; i++)
+		igt_future_wait(futures[i]);
+	batch = elapsed(&then) / loops;
+
+	igt_assert_eq(igt_gettime(&then), 0);
+	leaves = igt_future_wait(igt_threadpool_submit(pool, tree,
+						       (void *)(unsigned long)loops));
+	igt_assert_eq_u64((unsigned long)leaves, loops);
+	recursive = elapsed(&then) / (2 * loops - 1);
+
+	igt_assert_eq(igt_gettime(&then), 0);
+	for (int i = 0; i < loops; i++)
+		body(i, out);
+	serial = elapsed(&then);
+
+	igt_assert_eq(igt_gettime(&then), 0);
+	igt_threadpool_for(pool, 0, loops, 0, body, out);
+	parallel = elapsed(&then);
+
+	igt_info("Workers: %u\n", igt_threadpool_size(pool));
+	igt_info("Submit and wait: %.3fus\n", roundtrip * 1e6);
+	igt_info("Batched submit and wait: %.3fus per task\n", batch * 1e6);
+	igt_info("Recursive tasks: %.3fus per task\n", recursive * 1e6);
+	igt_info("Parallel for: %.3fms, serially %.3fms (%.1fx)\n",
+		 parallel * 1e3, serial * 1e3, serial / parallel);
+
+	free(out);
+	free(futures);
+	igt_threadpool_destroy(pool);
+}
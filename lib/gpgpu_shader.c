@@ -6,10 +6,12 @@
  */
 
 #include <i915_drm.h>
+#include <pthread.h>
 
 #include "ioctl_wrappers.h"
 #include "gpgpu_shader.h"
 #include "gpu_cmds.h"
+#include "igt_map.h"
 
 #define IGA64_ARG0 0xc0ded000
 #define IGA64_ARG_MASK 0xffffff00
@@ -25,18 +27,116 @@
 #define GPGPU_CURBE_SIZE 0
 #define GEN7_VFE_STATE_GPGPU_MODE 1
 
-static void gpgpu_shader_extend(struct gpgpu_shader *shdr)
+/*
+ * Shaders are recorded as the sequence of template variants they're made
+ * of and the values to patch in, and only turned into code when they're
+ * executed. Code is looked up by the hash of that recipe in a process
+ * wide cache first, so tests rebuilding the same shader over and over
+ * share one copy of the code. The places to patch in every template are
+ * found once and kept in a table, rather than checking each dword of the
+ * template each time it is emitted.
+ */
+struct iga64_patch_table {
+	uint64_t tpl;
+	uint32_t num_sites;
+	uint32_t max_arg;
+	struct iga64_patch_site {
+		uint16_t offset;
+		uint16_t arg;
+	} sites[];
+};
+
+struct iga64_snippet {
+	const struct iga64_template *tpl;
+	const struct iga64_patch_table *patches;
+	uint32_t argv_offset;
+};
+
+struct gpgpu_shader_cache_entry {
+	uint64_t key;
+	uint32_t gen_ver;
+	uint32_t size;
+	uint32_t num_snippets;
+	uint32_t num_args;
+	struct iga64_snippet *snippets;
+	uint32_t *args;
+	uint32_t *code;
+};
+
+static pthread_mutex_t gpgpu_shader_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct igt_map *iga64_patch_tables;
+static struct igt_map *gpgpu_shader_cache;
+static unsigned int gpgpu_shader_cache_count;
+static unsigned int gpgpu_shader_cache_limit = 256;
+
+static const struct iga64_patch_table *
+iga64_get_patch_table(const struct iga64_template *tpl)
+{
+	struct iga64_patch_table *table;
+	uint64_t key = (uintptr_t)tpl;
+	uint32_t num_sites = 0;
+
+	pthread_mutex_lock(&gpgpu_shader_cache_lock);
+
+	if (!iga64_patch_tables)
+		iga64_patch_tables = igt_map_create(igt_map_hash_64,
+						    igt_map_equal_64);
+
+	table = igt_map_search(iga64_patch_tables, &key);
+	if (table)
+		goto out;
+
+	for (int i = 0; i < tpl->size; i++)
+		if ((tpl->code[i] & IGA64_ARG_MASK) == IGA64_ARG0)
+			num_sites++;
+
+	table = calloc(1, sizeof(*table) + num_sites * sizeof(table->sites[0]));
+	igt_assert(table);
+	table->tpl = key;
+
+	for (int i = 0; i < tpl->size; i++) {
+		struct iga64_patch_site *site;
+
+		if ((tpl->code[i] & IGA64_ARG_MASK) != IGA64_ARG0)
+			continue;
+
+		site = &table->sites[table->num_sites++];
+		site->offset = i;
+		site->arg = tpl->code[i] - IGA64_ARG0;
+		if (site->arg >= table->max_arg)
+			table->max_arg = site->arg + 1;
+	}
+
+	igt_map_insert(iga64_patch_tables, &table->tpl, table);
+out:
+	pthread_mutex_unlock(&gpgpu_shader_cache_lock);
+	return table;
+}
+
+static uint64_t gpgpu_shader_hash(uint64_t hash, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len--)
+		hash = (hash ^ *p++) * 0x100000001b3ull;
+
+	return hash;
+}
+
+static void gpgpu_shader_release_code(struct gpgpu_shader *shdr)
 {
-	shdr->max_size <<= 1;
-	shdr->code = realloc(shdr->code, 4 * shdr->max_size);
-	igt_assert(shdr->code);
+	if (shdr->max_size)
+		free(shdr->code);
+
+	shdr->code = NULL;
+	shdr->max_size = 0;
 }
 
 void
 __emit_iga64_code(struct gpgpu_shader *shdr, struct iga64_template const *tpls,
 		  int argc, uint32_t *argv)
 {
-	uint32_t *ptr;
+	struct iga64_snippet *snippet;
 
 	igt_require_f(shdr->gen_ver >= SUPPORTED_GEN_VER,
 		      "No available shader templates for platforms older than XeLP\n");
@@ -44,24 +144,170 @@ __emit_iga64_code(struct gpgpu_shader *shdr, struct iga64_template const *tpls,
 	while (shdr->gen_ver < tpls->gen_ver)
 		tpls++;
 
-	while (shdr->max_size < shdr->size + tpls->size)
-		gpgpu_shader_extend(shdr);
-
-	ptr = shdr->code + shdr->size;
-	memcpy(ptr, tpls->code, 4 * tpls->size);
+	if (shdr->num_snippets == shdr->max_snippets) {
+		shdr->max_snippets <<= 1;
+		shdr->snippets = realloc(shdr->snippets, shdr->max_snippets *
+					 sizeof(*shdr->snippets));
+		igt_assert(shdr->snippets);
+	}
 
-	/* patch the template */
-	for (int n, i = 0; i < tpls->size; ++i) {
-		if ((ptr[i] & IGA64_ARG_MASK) != IGA64_ARG0)
-			continue;
-		n = ptr[i] - IGA64_ARG0;
-		igt_assert(n < argc);
-		ptr[i] = argv[n];
+	while (shdr->max_args < shdr->num_args + argc) {
+		shdr->max_args <<= 1;
+		shdr->args = realloc(shdr->args,
+				     shdr->max_args * sizeof(*shdr->args));
+		igt_assert(shdr->args);
 	}
 
+	snippet = &shdr->snippets[shdr->num_snippets++];
+	snippet->tpl = tpls;
+	snippet->patches = iga64_get_patch_table(tpls);
+	snippet->argv_offset = shdr->num_args;
+	igt_assert(snippet->patches->max_arg <= argc);
+
+	if (argc)
+		memcpy(shdr->args + shdr->num_args, argv, argc * sizeof(*argv));
+	shdr->num_args += argc;
+
+	shdr->key = gpgpu_shader_hash(shdr->key, &snippet->tpl,
+				      sizeof(snippet->tpl));
+	shdr->key = gpgpu_shader_hash(shdr->key, &argc, sizeof(argc));
+	shdr->key = gpgpu_shader_hash(shdr->key, argv, argc * sizeof(*argv));
+
+	/* Anything built before is stale now */
+	gpgpu_shader_release_code(shdr);
 	shdr->size += tpls->size;
 }
 
+static void
+gpgpu_shader_build_code(const struct gpgpu_shader *shdr, uint32_t *code)
+{
+	for (uint32_t s = 0; s < shdr->num_snippets; s++) {
+		const struct iga64_snippet *snippet = &shdr->snippets[s];
+		const struct iga64_patch_table *patches = snippet->patches;
+		const uint32_t *argv = shdr->args + snippet->argv_offset;
+
+		memcpy(code, snippet->tpl->code, 4 * snippet->tpl->size);
+
+		for (uint32_t i = 0; i < patches->num_sites; i++)
+			code[patches->sites[i].offset] =
+				argv[patches->sites[i].arg];
+
+		code += snippet->tpl->size;
+	}
+}
+
+static bool
+gpgpu_shader_cache_match(const struct gpgpu_shader_cache_entry *entry,
+			 const struct gpgpu_shader *shdr)
+{
+	if (entry->gen_ver != shdr->gen_ver ||
+	    entry->num_snippets != shdr->num_snippets ||
+	    entry->num_args != shdr->num_args)
+		return false;
+
+	for (uint32_t s = 0; s < shdr->num_snippets; s++)
+		if (entry->snippets[s].tpl != shdr->snippets[s].tpl ||
+		    entry->snippets[s].argv_offset != shdr->snippets[s].argv_offset)
+			return false;
+
+	return !memcmp(entry->args, shdr->args,
+		       shdr->num_args * sizeof(*shdr->args));
+}
+
+static struct gpgpu_shader_cache_entry *
+gpgpu_shader_cache_insert(const struct gpgpu_shader *shdr)
+{
+	struct gpgpu_shader_cache_entry *entry;
+
+	entry = calloc(1, sizeof(*entry));
+	igt_assert(entry);
+	entry->key = shdr->key;
+	entry->gen_ver = shdr->gen_ver;
+	entry->size = shdr->size;
+	entry->num_snippets = shdr->num_snippets;
+	entry->num_args = shdr->num_args;
+	entry->snippets = malloc(shdr->num_snippets * sizeof(*shdr->snippets));
+	entry->args = malloc((shdr->num_args ?: 1) * sizeof(*shdr->args));
+	entry->code = malloc(4 * shdr->size);
+	igt_assert(entry->snippets && entry->args && entry->code);
+
+	memcpy(entry->snippets, shdr->snippets,
+	       shdr->num_snippets * sizeof(*shdr->snippets));
+	memcpy(entry->args, shdr->args, shdr->num_args * sizeof(*shdr->args));
+	gpgpu_shader_build_code(shdr, entry->code);
+
+	igt_map_insert(gpgpu_shader_cache, &entry->key, entry);
+	gpgpu_shader_cache_count++;
+
+	return entry;
+}
+
+/**
+ * gpgpu_shader_finalize:
+ * @shdr: shader to build
+ *
+ * Turns the templates emitted into @shdr into code, taking it from the
+ * shader cache if an identical shader was built before. Called by
+ * gpgpu_shader_exec(), only needed to get at the code directly.
+ *
+ * Returns: the code of @shdr, @shdr->size dwords long.
+ */
+const uint32_t *gpgpu_shader_finalize(struct gpgpu_shader *shdr)
+{
+	struct gpgpu_shader_cache_entry *entry = NULL;
+
+	if (shdr->code)
+		return shdr->code;
+
+	pthread_mutex_lock(&gpgpu_shader_cache_lock);
+
+	if (!gpgpu_shader_cache)
+		gpgpu_shader_cache = igt_map_create(igt_map_hash_64,
+						    igt_map_equal_64);
+
+	entry = igt_map_search(gpgpu_shader_cache, &shdr->key);
+	if (entry && !gpgpu_shader_cache_match(entry, shdr))
+		entry = NULL; /* hash collision, build a private copy */
+	else if (!entry && shdr->size &&
+		 gpgpu_shader_cache_count < gpgpu_shader_cache_limit)
+		entry = gpgpu_shader_cache_insert(shdr);
+
+	pthread_mutex_unlock(&gpgpu_shader_cache_lock);
+
+	if (entry) {
+		/* Shared and never freed, so max_size stays 0 */
+		shdr->code = entry->code;
+	} else {
+		shdr->max_size = shdr->size ?: 1;
+		shdr->code = malloc(4 * shdr->max_size);
+		igt_assert(shdr->code);
+		gpgpu_shader_build_code(shdr, shdr->code);
+	}
+
+	return shdr->code;
+}
+
+/**
+ * gpgpu_shader_cache_set_limit:
+ * @entries: maximum number of distinct shaders to keep, 0 disables the cache
+ *
+ * Shaders built once the limit is reached get code of their own, which is
+ * freed along with them.
+ *
+ * Returns: the previous limit.
+ */
+unsigned int gpgpu_shader_cache_set_limit(unsigned int entries)
+{
+	unsigned int old;
+
+	pthread_mutex_lock(&gpgpu_shader_cache_lock);
+	old = gpgpu_shader_cache_limit;
+	gpgpu_shader_cache_limit = entries;
+	pthread_mutex_unlock(&gpgpu_shader_cache_lock);
+
+	return old;
+}
+
 static uint32_t fill_sip(struct intel_bb *ibb,
 			 const uint32_t sip[][4],
 			 const size_t size)
@@ -209,6 +455,10 @@ void gpgpu_shader_exec(struct intel_bb *ibb,
 	igt_assert(ibb->size >= PAGE_SIZE);
 	igt_assert(ibb->ptr == ibb->batch);
 
+	gpgpu_shader_finalize(shdr);
+	if (sip)
+		gpgpu_shader_finalize(sip);
+
 	if (shdr->gen_ver >= 1250)
 		__xehp_gpgpu_execfunc(ibb, target, x_dim, y_dim, shdr, sip,
 				      ring, explicit_engine);
@@ -217,6 +467,30 @@ void gpgpu_shader_exec(struct intel_bb *ibb,
 				      ring, explicit_engine);
 }
 
+/**
+ * __gpgpu_shader_create:
+ * @gen_ver: graphics version times 100 plus the release, e.g. 1260
+ *
+ * Creates empty shader for the given platform, without a device.
+ *
+ * Returns: pointer to empty shader struct.
+ */
+struct gpgpu_shader *__gpgpu_shader_create(uint32_t gen_ver)
+{
+	struct gpgpu_shader *shdr = calloc(1, sizeof(struct gpgpu_shader));
+
+	igt_assert(shdr);
+	shdr->gen_ver = gen_ver;
+	shdr->key = gpgpu_shader_hash(0xcbf29ce484222325ull,
+				      &gen_ver, sizeof(gen_ver));
+	shdr->max_snippets = 8;
+	shdr->snippets = malloc(shdr->max_snippets * sizeof(*shdr->snippets));
+	shdr->max_args = 32;
+	shdr->args = malloc(shdr->max_args * sizeof(*shdr->args));
+	igt_assert(shdr->snippets && shdr->args);
+	return shdr;
+}
+
 /**
  * gpgpu_shader_create:
  * @fd: drm fd - i915 or xe
@@ -227,16 +501,11 @@ void gpgpu_shader_exec(struct intel_bb *ibb,
  */
 struct gpgpu_shader *gpgpu_shader_create(int fd)
 {
-	struct gpgpu_shader *shdr = calloc(1, sizeof(struct gpgpu_shader));
 	const struct intel_device_info *info;
 
-	igt_assert(shdr);
 	info = intel_get_device_info(intel_get_drm_devid(fd));
-	shdr->gen_ver = 100 * info->graphics_ver + info->graphics_rel;
-	shdr->max_size = 16 * 4;
-	shdr->code = malloc(4 * shdr->max_size);
-	igt_assert(shdr->code);
-	return shdr;
+	return __gpgpu_shader_create(100 * info->graphics_ver +
+				     info->graphics_rel);
 }
 
 /**
@@ -247,7 +516,9 @@ struct gpgpu_shader *gpgpu_shader_create(int fd)
  */
 void gpgpu_shader_destroy(struct gpgpu_shader *shdr)
 {
-	free(shdr->code);
+	gpgpu_shader_release_code(shdr);
+	free(shdr->snippets);
+	free(shdr->args);
 	free(shdr);
 }
 
@@ -13,14 +13,27 @@
 struct intel_bb;
 struct intel_buf;
 
+struct iga64_snippet;
+
 struct gpgpu_shader {
 	uint32_t gen_ver;
 	uint32_t size;
+	/* 0 unless the code is the shader's own rather than the cache's */
 	uint32_t max_size;
+	/* Built by gpgpu_shader_finalize(), NULL until then */
 	union {
 		uint32_t *code;
 		uint32_t (*instr)[4];
 	};
+
+	/* What the shader is made of, and the hash of it to look it up by */
+	struct iga64_snippet *snippets;
+	uint32_t num_snippets;
+	uint32_t max_snippets;
+	uint32_t *args;
+	uint32_t num_args;
+	uint32_t max_args;
+	uint64_t key;
 };
 
 struct iga64_template {
@@ -44,8 +57,11 @@ __emit_iga64_code(struct gpgpu_shader *shdr, const struct iga64_template *tpls,
 	__emit_iga64_code(__shdr, iga64_code_ ## __name, ARRAY_SIZE(args), args); \
 })
 
+struct gpgpu_shader *__gpgpu_shader_create(uint32_t gen_ver);
 struct gpgpu_shader *gpgpu_shader_create(int fd);
 void gpgpu_shader_destroy(struct gpgpu_shader *shdr);
+const uint32_t *gpgpu_shader_finalize(struct gpgpu_shader *shdr);
+unsigned int gpgpu_shader_cache_set_limit(unsigned int entries);
 
 void gpgpu_shader_dump(struct gpgpu_shader *shdr);
 
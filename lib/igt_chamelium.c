@@ -120,8 +120,14 @@ struct chamelium_fb_crc_async_data {
 struct chamelium {
 	xmlrpc_env env;
 	xmlrpc_client *client;
+	xmlrpc_server_info *server_info;
 	char *url;
 
+	/* Asynchronous RPCs waiting to be sent in one system.multicall */
+	struct igt_list_head queued;
+	bool batching;
+	bool no_multicall;
+
 	/* Indicates the last port to have been used for capturing video */
 	struct chamelium_port *capturing_port;
 
@@ -585,6 +591,427 @@ static void *chamelium_fsm_mon(void *data)
 
 #define _RECEIVER_RESPONSIVE_AFTER_RESET_SECONDS 10
 
+/*
+ * Asynchronous RPCs, to have several of them in flight at once or to send
+ * a batch of them in a single system.multicall request, instead of paying a
+ * full round trip to the Chamelium for each one. Their completion is only
+ * noticed while running the event loop of the xmlrpc client, so waiting for
+ * one of them also makes progress on all the others.
+ */
+enum chamelium_rpc_state {
+	CHAMELIUM_RPC_QUEUED,
+	CHAMELIUM_RPC_SENT,
+	CHAMELIUM_RPC_DONE,
+};
+
+struct chamelium_rpc {
+	struct chamelium *chamelium;
+	enum chamelium_rpc_state state;
+	struct timespec start;
+
+	char *method_name;
+	xmlrpc_value *params;
+
+	xmlrpc_env fault;
+	xmlrpc_value *result;
+
+	/* In chamelium->queued, or in the calls of a multicall */
+	struct igt_list_head link;
+	/* For a system.multicall, the calls it is made of */
+	struct igt_list_head calls;
+};
+
+static struct chamelium_rpc *chamelium_rpc_new(struct chamelium *chamelium,
+					       const char *method_name)
+{
+	struct chamelium_rpc *rpc = calloc(1, sizeof(*rpc));
+
+	igt_assert(rpc);
+
+	rpc->chamelium = chamelium;
+	rpc->method_name = strdup(method_name);
+	igt_assert(rpc->method_name);
+	xmlrpc_env_init(&rpc->fault);
+	IGT_INIT_LIST_HEAD(&rpc->link);
+	IGT_INIT_LIST_HEAD(&rpc->calls);
+	igt_nsec_elapsed(&rpc->start);
+
+	return rpc;
+}
+
+static void chamelium_rpc_free(struct chamelium_rpc *rpc)
+{
+	if (rpc->params)
+		xmlrpc_DECREF(rpc->params);
+	if (rpc->result)
+		xmlrpc_DECREF(rpc->result);
+	xmlrpc_env_clean(&rpc->fault);
+	free(rpc->method_name);
+	free(rpc);
+}
+
+static void multicall_call_done(struct chamelium_rpc *rpc, xmlrpc_value *item)
+{
+	xmlrpc_env env;
+
+	xmlrpc_env_init(&env);
+
+	/* Either a one element array of the result, or a fault struct */
+	if (xmlrpc_value_type(item) == XMLRPC_TYPE_ARRAY) {
+		xmlrpc_array_read_item(&env, item, 0, &rpc->result);
+	} else {
+		const char *string;
+		int code;
+
+		xmlrpc_decompose_value(&env, item, "{s:i,s:s,*}",
+				       "faultCode", &code,
+				       "faultString", &string);
+		if (!env.fault_occurred) {
+			xmlrpc_env_set_fault(&rpc->fault, code, string);
+			free((void *)string);
+		}
+	}
+
+	if (env.fault_occurred)
+		xmlrpc_env_set_fault(&rpc->fault, env.fault_code,
+				     env.fault_string);
+
+	xmlrpc_env_clean(&env);
+	rpc->state = CHAMELIUM_RPC_DONE;
+}
+
+/*
+ * Whether the server has no system.multicall: -32601 is the code for
+ * that in the specification, xmlrpc-c servers use their own, and the
+ * Python server of the Chamelium only says so in the string.
+ */
+static bool multicall_unsupported(const xmlrpc_env *fault)
+{
+	return fault->fault_code == -32601 ||
+	       fault->fault_code == XMLRPC_NO_SUCH_METHOD_ERROR ||
+	       (fault->fault_string &&
+		strstr(fault->fault_string, "system.multicall"));
+}
+
+static void multicall_done(struct chamelium_rpc *multicall,
+			   xmlrpc_env *fault, xmlrpc_value *result)
+{
+	struct chamelium *chamelium = multicall->chamelium;
+	struct chamelium_rpc *rpc, *tmp;
+	xmlrpc_env env;
+	int i = 0;
+
+	xmlrpc_env_init(&env);
+
+	if (fault->fault_occurred && multicall_unsupported(fault)) {
+		/* Nothing was executed, send them one by one */
+		igt_debug("Chamelium multicall unsupported: %s\n",
+			  fault->fault_string);
+		chamelium->no_multicall = true;
+
+		igt_list_for_each_entry_safe(rpc, tmp, &multicall->calls, link) {
+			rpc->state = CHAMELIUM_RPC_QUEUED;
+			igt_list_move_tail(&rpc->link, &chamelium->queued);
+		}
+	} else if (fault->fault_occurred ||
+		   xmlrpc_array_size(&env, result) !=
+		   igt_list_length(&multicall->calls)) {
+		/*
+		 * Some of the calls may have run already, so sending them
+		 * again could plug or capture twice. Fail them all instead.
+		 */
+		igt_list_for_each_entry_safe(rpc, tmp, &multicall->calls, link) {
+			igt_list_del_init(&rpc->link);
+			if (fault->fault_occurred)
+				xmlrpc_env_set_fault(&rpc->fault, fault->fault_code,
+						     fault->fault_string);
+			else
+				xmlrpc_env_set_fault(&rpc->fault, XMLRPC_PARSE_ERROR,
+						     "Unexpected multicall response");
+			rpc->state = CHAMELIUM_RPC_DONE;
+		}
+	} else {
+		igt_list_for_each_entry_safe(rpc, tmp, &multicall->calls, link) {
+			xmlrpc_value *item;
+
+			igt_list_del_init(&rpc->link);
+
+			xmlrpc_array_read_item(&env, result, i++, &item);
+			if (env.fault_occurred) {
+				xmlrpc_env_set_fault(&rpc->fault, env.fault_code,
+						     env.fault_string);
+				rpc->state = CHAMELIUM_RPC_DONE;
+				continue;
+			}
+
+			multicall_call_done(rpc, item);
+			xmlrpc_DECREF(item);
+		}
+	}
+
+	xmlrpc_env_clean(&env);
+	chamelium_rpc_free(multicall);
+}
+
+static void chamelium_rpc_done(const char *server_url, const char *method_name,
+			       xmlrpc_value *params, void *data,
+			       xmlrpc_env *fault, xmlrpc_value *result)
+{
+	struct chamelium_rpc *rpc = data;
+
+	if (!igt_list_empty(&rpc->calls)) {
+		multicall_done(rpc, fault, result);
+		return;
+	}
+
+	if (fault->fault_occurred) {
+		xmlrpc_env_set_fault(&rpc->fault, fault->fault_code,
+				     fault->fault_string);
+	} else {
+		xmlrpc_INCREF(result);
+		rpc->result = result;
+	}
+
+	rpc->state = CHAMELIUM_RPC_DONE;
+}
+
+static void chamelium_rpc_send(struct chamelium_rpc *rpc)
+{
+	struct chamelium *chamelium = rpc->chamelium;
+	xmlrpc_env env;
+
+	rpc->state = CHAMELIUM_RPC_SENT;
+
+	xmlrpc_env_init(&env);
+	xmlrpc_client_start_rpc(&env, chamelium->client,
+				chamelium->server_info, rpc->method_name,
+				rpc->params, chamelium_rpc_done, rpc);
+	if (env.fault_occurred)
+		chamelium_rpc_done(chamelium->url, rpc->method_name,
+				   rpc->params, rpc, &env, NULL);
+	xmlrpc_env_clean(&env);
+}
+
+/* Sends the queued RPCs, in a single multicall if there are several */
+static void chamelium_rpc_flush(struct chamelium *chamelium)
+{
+	struct chamelium_rpc *multicall, *rpc, *tmp;
+	xmlrpc_value *calls;
+
+	if (igt_list_empty(&chamelium->queued))
+		return;
+
+	if (chamelium->no_multicall ||
+	    igt_list_length(&chamelium->queued) == 1) {
+		igt_list_for_each_entry_safe(rpc, tmp, &chamelium->queued, link) {
+			igt_list_del_init(&rpc->link);
+			chamelium_rpc_send(rpc);
+		}
+		return;
+	}
+
+	multicall = chamelium_rpc_new(chamelium, "system.multicall");
+	calls = xmlrpc_array_new(&multicall->fault);
+
+	igt_list_for_each_entry_safe(rpc, tmp, &chamelium->queued, link) {
+		xmlrpc_value *call;
+
+		call = xmlrpc_build_value(&multicall->fault, "{s:s,s:A}",
+					  "methodName", rpc->method_name,
+					  "params", rpc->params);
+		xmlrpc_array_append_item(&multicall->fault, calls, call);
+		xmlrpc_DECREF(call);
+
+		rpc->state = CHAMELIUM_RPC_SENT;
+		igt_list_move_tail(&rpc->link, &multicall->calls);
+	}
+
+	multicall->params = xmlrpc_build_value(&multicall->fault, "(A)", calls);
+	xmlrpc_DECREF(calls);
+	igt_assert_f(!multicall->fault.fault_occurred,
+		     "Failed to build Chamelium multicall: %s\n",
+		     multicall->fault.fault_string);
+
+	chamelium_rpc_send(multicall);
+}
+
+/*
+ * Blocking calls wait for every asynchronous RPC to complete first, so that
+ * they are still executed in the order they were made in.
+ */
+static void chamelium_rpc_drain(struct chamelium *chamelium)
+{
+	do {
+		chamelium_rpc_flush(chamelium);
+		xmlrpc_client_event_loop_finish(chamelium->client);
+	} while (!igt_list_empty(&chamelium->queued));
+}
+
+static void chamelium_rpc_complete(struct chamelium_rpc *rpc)
+{
+	struct chamelium *chamelium = rpc->chamelium;
+
+	for (;;) {
+		while (rpc->state != CHAMELIUM_RPC_DONE) {
+			if (rpc->state == CHAMELIUM_RPC_QUEUED)
+				chamelium_rpc_flush(chamelium);
+			else
+				xmlrpc_client_event_loop_finish_timeout(chamelium->client,
+									1);
+		}
+
+		/* i2c errors are retried, like for the blocking calls */
+		if (!rpc->fault.fault_occurred ||
+		    !strstr(rpc->fault.fault_string, "I2C") ||
+		    igt_seconds_elapsed(&rpc->start) >=
+		    _RECEIVER_RESPONSIVE_AFTER_RESET_SECONDS)
+			break;
+
+		xmlrpc_env_clean(&rpc->fault);
+		xmlrpc_env_init(&rpc->fault);
+		chamelium_rpc_send(rpc);
+	}
+}
+
+static xmlrpc_value *chamelium_rpc_result(struct chamelium_rpc *rpc)
+{
+	xmlrpc_value *res;
+
+	chamelium_rpc_complete(rpc);
+	igt_assert_f(!rpc->fault.fault_occurred,
+		     "Chamelium RPC call[%s] failed: %s\n", rpc->method_name,
+		     rpc->fault.fault_string);
+
+	res = rpc->result;
+	rpc->result = NULL;
+	chamelium_rpc_free(rpc);
+
+	return res;
+}
+
+/**
+ * chamelium_rpc_start:
+ * @chamelium: The Chamelium instance to use
+ * @method_name: The name of the RPC method to call
+ * @format_str: The xmlrpc-c format string of the arguments, such as "(ii)"
+ * @...: The arguments
+ *
+ * Starts an RPC on the Chamelium without waiting for its answer, so that
+ * several RPCs can be in flight at once. Between #chamelium_rpc_batch_begin
+ * and #chamelium_rpc_batch_end, the RPCs are instead queued up to be sent
+ * in a single system.multicall request.
+ *
+ * The RPCs in flight aren't ordered with respect to each other, and no FSM
+ * handling is done for them, so only RPCs that don't depend on one another
+ * and don't need the receiver to be reset should be started this way.
+ * Blocking calls on the Chamelium wait for all the RPCs in flight first.
+ *
+ * Returns: The pending RPC, to be passed to one of the chamelium_rpc_wait
+ * functions.
+ */
+struct chamelium_rpc *chamelium_rpc_start(struct chamelium *chamelium,
+					  const char *method_name,
+					  const char *format_str, ...)
+{
+	struct chamelium_rpc *rpc = chamelium_rpc_new(chamelium, method_name);
+	const char *tail;
+	va_list va_args;
+
+	va_start(va_args, format_str);
+	xmlrpc_build_value_va(&rpc->fault, format_str, va_args,
+			      &rpc->params, &tail);
+	va_end(va_args);
+	igt_assert_f(!rpc->fault.fault_occurred,
+		     "Chamelium RPC call[%s] has bad arguments: %s\n",
+		     method_name, rpc->fault.fault_string);
+
+	igt_list_add_tail(&rpc->link, &chamelium->queued);
+	if (!chamelium->batching)
+		chamelium_rpc_flush(chamelium);
+
+	return rpc;
+}
+
+/**
+ * chamelium_rpc_wait:
+ * @rpc: The RPC started with #chamelium_rpc_start
+ *
+ * Waits for @rpc to complete, discarding its result, and frees it. Fails the
+ * test if the RPC failed.
+ */
+void chamelium_rpc_wait(struct chamelium_rpc *rpc)
+{
+	xmlrpc_value *res = chamelium_rpc_result(rpc);
+
+	if (res)
+		xmlrpc_DECREF(res);
+}
+
+/**
+ * chamelium_rpc_wait_int:
+ * @rpc: The RPC started with #chamelium_rpc_start
+ *
+ * Waits for @rpc to complete and frees it. Fails the test if the RPC failed.
+ *
+ * Returns: The integer result of the RPC
+ */
+int chamelium_rpc_wait_int(struct chamelium_rpc *rpc)
+{
+	struct chamelium *chamelium = rpc->chamelium;
+	xmlrpc_value *res = chamelium_rpc_result(rpc);
+	int val;
+
+	xmlrpc_read_int(&chamelium->env, res, &val);
+	xmlrpc_DECREF(res);
+
+	return val;
+}
+
+/**
+ * chamelium_rpc_wait_bool:
+ * @rpc: The RPC started with #chamelium_rpc_start
+ *
+ * Waits for @rpc to complete and frees it. Fails the test if the RPC failed.
+ *
+ * Returns: The boolean result of the RPC
+ */
+bool chamelium_rpc_wait_bool(struct chamelium_rpc *rpc)
+{
+	struct chamelium *chamelium = rpc->chamelium;
+	xmlrpc_value *res = chamelium_rpc_result(rpc);
+	xmlrpc_bool val;
+
+	xmlrpc_read_bool(&chamelium->env, res, &val);
+	xmlrpc_DECREF(res);
+
+	return val;
+}
+
+/**
+ * chamelium_rpc_batch_begin:
+ * @chamelium: The Chamelium instance to use
+ *
+ * Makes #chamelium_rpc_start queue up the RPCs, until
+ * #chamelium_rpc_batch_end sends them all in a single system.multicall
+ * request. Waiting for one of the queued RPCs sends them early.
+ */
+void chamelium_rpc_batch_begin(struct chamelium *chamelium)
+{
+	chamelium->batching = true;
+}
+
+/**
+ * chamelium_rpc_batch_end:
+ * @chamelium: The Chamelium instance to use
+ *
+ * Sends the RPCs queued up since #chamelium_rpc_batch_begin.
+ */
+void chamelium_rpc_batch_end(struct chamelium *chamelium)
+{
+	chamelium->batching = false;
+	chamelium_rpc_flush(chamelium);
+}
+
 static xmlrpc_value *__chamelium_rpc_va(struct chamelium *chamelium,
 					struct chamelium_port *fsm_port,
 					const char *method_name,
@@ -595,6 +1022,8 @@ static xmlrpc_value *__chamelium_rpc_va(struct chamelium *chamelium,
 	struct fsm_monitor_args monitor_args;
 	pthread_t fsm_thread_id;
 
+	chamelium_rpc_drain(chamelium);
+
 	/* Unfortunately xmlrpc_client's event loop helpers are rather useless
 	 * for implementing any sort of event loop, since they provide no way
 	 * to poll for events other then the RPC response. This means in order
@@ -1420,6 +1849,58 @@ igt_crc_t *chamelium_get_crc_for_area(struct chamelium *chamelium,
 	return ret;
 }
 
+/**
+ * chamelium_get_crc_for_area_start:
+ * @chamelium: The Chamelium instance to use
+ * @port: The port to perform the CRC checking on
+ * @x: The X coordinate on the emulated display to start calculating the CRC
+ * from
+ * @y: The Y coordinate on the emulated display to start calculating the CRC
+ * from
+ * @w: The width of the area to fetch the CRC from, or %0 for the whole display
+ * @h: The height of the area to fetch the CRC from, or %0 for the whole display
+ *
+ * Asynchronous version of #chamelium_get_crc_for_area, to read back the CRCs
+ * of several areas or ports in a single round trip. As with any RPC started
+ * with #chamelium_rpc_start, no FSM handling is done, so the video input of
+ * @port should already be stable.
+ *
+ * Returns: The pending RPC, to be passed to #chamelium_get_crc_for_area_wait
+ */
+struct chamelium_rpc *
+chamelium_get_crc_for_area_start(struct chamelium *chamelium,
+				 struct chamelium_port *port,
+				 int x, int y, int w, int h)
+{
+	chamelium->capturing_port = port;
+
+	return chamelium_rpc_start(chamelium, "ComputePixelChecksum",
+				   (w && h) ? "(iiiii)" : "(innnn)",
+				   port->id, x, y, w, h);
+}
+
+/**
+ * chamelium_get_crc_for_area_wait:
+ * @rpc: The RPC started with #chamelium_get_crc_for_area_start
+ *
+ * Waits for the CRC read back by @rpc. The caller should free the CRC when
+ * finished with it.
+ *
+ * Returns: The CRC read back from the chamelium
+ */
+igt_crc_t *chamelium_get_crc_for_area_wait(struct chamelium_rpc *rpc)
+{
+	struct chamelium *chamelium = rpc->chamelium;
+	igt_crc_t *ret = malloc(sizeof(igt_crc_t));
+	xmlrpc_value *res;
+
+	res = chamelium_rpc_result(rpc);
+	crc_from_xml(chamelium, res, ret);
+	xmlrpc_DECREF(res);
+
+	return ret;
+}
+
 /**
  * chamelium_start_capture:
  * @chamelium: The Chamelium instance to use
@@ -2858,7 +3339,13 @@ static void chamelium_exit_handler(int sig)
  */
 void chamelium_deinit_rpc_only(struct chamelium *chamelium)
 {
+	if (chamelium->server_info)
+		xmlrpc_server_info_free(chamelium->server_info);
+	if (chamelium->client)
+		xmlrpc_client_destroy(chamelium->client);
+
 	xmlrpc_env_clean(&chamelium->env);
+	g_free(chamelium->url);
 	free(chamelium);
 }
 
@@ -2897,6 +3384,7 @@ struct chamelium *chamelium_init_rpc_only(void)
 	clientparms.transportparm_size = XMLRPC_CXPSIZE(timeout);
 
 	chamelium->drm_fd = -1;
+	IGT_INIT_LIST_HEAD(&chamelium->queued);
 
 	/* Setup the libxmlrpc context */
 	xmlrpc_env_init(&chamelium->env);
@@ -2912,6 +3400,14 @@ struct chamelium *chamelium_init_rpc_only(void)
 	if (!chamelium_read_config(chamelium))
 		goto error;
 
+	chamelium->server_info = xmlrpc_server_info_new(&chamelium->env,
+							chamelium->url);
+	if (chamelium->env.fault_occurred) {
+		igt_debug("Failed to init xmlrpc: %s\n",
+			  chamelium->env.fault_string);
+		goto error;
+	}
+
 	return chamelium;
 error:
 	chamelium_deinit_rpc_only(chamelium);
@@ -3064,8 +3560,6 @@ void chamelium_deinit(struct chamelium *chamelium)
 
 	close(chamelium->drm_fd);
 
-	xmlrpc_client_destroy(chamelium->client);
-
 	for (i = 0; i < chamelium->port_count; i++)
 		free(chamelium->ports[i].name);
 
@@ -44,6 +44,7 @@ struct chamelium;
 struct chamelium_port;
 struct chamelium_frame_dump;
 struct chamelium_fb_crc_async_data;
+struct chamelium_rpc;
 
 /**
  * chamelium_check:
@@ -129,6 +130,15 @@ struct chamelium *chamelium_init(int drm_fd, igt_display_t *display);
 void chamelium_deinit(struct chamelium *chamelium);
 void chamelium_reset(struct chamelium *chamelium);
 
+struct chamelium_rpc *chamelium_rpc_start(struct chamelium *chamelium,
+					  const char *method_name,
+					  const char *format_str, ...);
+void chamelium_rpc_wait(struct chamelium_rpc *rpc);
+int chamelium_rpc_wait_int(struct chamelium_rpc *rpc);
+bool chamelium_rpc_wait_bool(struct chamelium_rpc *rpc);
+void chamelium_rpc_batch_begin(struct chamelium *chamelium);
+void chamelium_rpc_batch_end(struct chamelium *chamelium);
+
 struct chamelium_port **chamelium_get_ports(struct chamelium *chamelium,
 					    int *count);
 unsigned int chamelium_port_get_type(const struct chamelium_port *port);
@@ -201,6 +211,11 @@ void chamelium_port_get_video_params(struct chamelium *chamelium,
 igt_crc_t *chamelium_get_crc_for_area(struct chamelium *chamelium,
 				      struct chamelium_port *port,
 				      int x, int y, int w, int h);
+struct chamelium_rpc *
+chamelium_get_crc_for_area_start(struct chamelium *chamelium,
+				 struct chamelium_port *port,
+				 int x, int y, int w, int h);
+igt_crc_t *chamelium_get_crc_for_area_wait(struct chamelium_rpc *rpc);
 void chamelium_start_capture(struct chamelium *chamelium,
 			     struct chamelium_port *port,
 			     int x, int y, int w, int h);
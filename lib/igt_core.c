@@ -43,10 +43,14 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <poll.h>
 #if defined(__linux__) || defined(__FreeBSD__)
 #include <sys/syscall.h>
 #endif
 #include <pthread.h>
+#include <stdatomic.h>
 #include <sys/utsname.h>
 #include <termios.h>
 #include <errno.h>
@@ -306,7 +310,12 @@ static struct igt_list_head subgroup_descriptions;
 bool __igt_plain_output = false;
 
 /* fork support state */
-pid_t *test_children;
+struct test_child {
+	pid_t pid;
+	int pidfd; /* -1 if pidfds aren't available */
+	struct timespec start;
+};
+struct test_child *test_children;
 int num_test_children;
 int test_children_sz;
 bool test_child;
@@ -317,6 +326,30 @@ int num_test_multi_fork_children;
 int test_multi_fork_children_sz;
 bool test_multi_fork_child;
 
+/* parallel subtest support state */
+struct subtest_job {
+	char *name;
+	pid_t pid;
+	int pidfd;
+	int status;
+	bool done;
+	/* runner packets, only when connected to the runner, stdout, stderr */
+	int capture[3];
+	size_t replayed[3];
+	struct timespec start;
+};
+static struct subtest_job *subtest_jobs;
+static int num_subtest_jobs;
+static int subtest_jobs_sz;
+static int max_subtest_jobs = 1;
+static bool subtest_job;
+static bool next_subtest_parallel_safe;
+
+#define SUBTEST_JOB_FLUSH_MS 1000
+
+static bool start_subtest_job(const char *subtest_name);
+static void wait_for_subtest_jobs(void);
+
 /* For allocator purposes */
 pid_t child_pid  = -1;
 __thread pid_t child_tid  = -1;
@@ -340,6 +373,7 @@ enum {
 	OPT_TRACE_OOPS,
 	OPT_DEVICE,
 	OPT_VERSION,
+	OPT_JOBS,
 	OPT_HELP = 'h'
 };
 
@@ -347,11 +381,51 @@ static int igt_exitcode = IGT_EXIT_SUCCESS;
 static const char *command_str;
 
 static char* igt_log_domain_filter;
-static struct {
-	char *entries[256];
-	uint8_t start, end;
-} log_buffer;
-static pthread_mutex_t log_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The log buffer keeps the last lines logged, to be dumped on failure. To
+ * keep logging cheap even from many threads, each thread writes fixed-size
+ * binary records into its own preallocated ring, without locking nor
+ * allocating. The "(prog:pid) thread-domain-LEVEL: " prefix is only formatted
+ * when the buffer is dumped, the rings being merged back in logging order
+ * thanks to a global sequence number. A line too long for one record spans
+ * several consecutive ones.
+ *
+ * Each record is a tiny seqlock: its owner clears the sequence number while
+ * rewriting it, so that a concurrent reader can detect and skip it.
+ */
+#define LOG_RECORD_TEXT 216
+#define LOG_RECORD_FIRST (1 << 0)	/* first record of a line */
+#define LOG_RECORD_PREFIX (1 << 1)	/* line is not a continuation */
+#define LOG_RECORD_MORE (1 << 2)	/* text continues in the next record */
+
+struct log_record {
+	_Atomic(uint64_t) seq;
+	pid_t pid;
+	pid_t tid; /* 0 for the main thread */
+	uint8_t level;
+	uint8_t flags;
+	uint16_t len;
+	const char *domain; /* IGT_LOG_DOMAIN, a string literal */
+	char text[LOG_RECORD_TEXT];
+};
+
+struct log_ring {
+	struct log_ring *next;
+	_Atomic(bool) in_use;
+	pid_t pid, tid;
+	unsigned int head;
+	unsigned int size;
+	struct log_record records[];
+};
+
+static _Atomic(struct log_ring *) log_rings;
+static __thread struct log_ring *log_ring;
+static pthread_key_t log_ring_key;
+static unsigned int log_buffer_size = 256;
+static _Atomic(uint64_t) log_seq;
+static _Atomic(uint64_t) log_buffer_start;
+
 #define LOG_PREFIX_SIZE 32
 char log_prefix[LOG_PREFIX_SIZE] = { 0 };
 
@@ -447,68 +521,294 @@ const char *igt_test_name(void)
 	return command_str;
 }
 
-static void _igt_log_buffer_append(char *line)
+static void log_ring_release(void *data)
 {
-	pthread_mutex_lock(&log_buffer_mutex);
+	struct log_ring *ring = data;
+
+	atomic_store(&ring->in_use, false);
+}
+
+static void log_ring_atfork_child(void)
+{
+	struct log_ring *ring;
+
+	/* The other threads are gone, let their rings be reused */
+	for (ring = atomic_load(&log_rings); ring; ring = ring->next) {
+		if (ring == log_ring)
+			ring->pid = getpid();
+		else
+			atomic_store(&ring->in_use, false);
+	}
+}
+
+igt_constructor {
+	const char *env = getenv("IGT_LOG_BUFFER_SIZE");
+
+	if (env && atoi(env) > 0)
+		log_buffer_size = atoi(env);
+
+	pthread_key_create(&log_ring_key, log_ring_release);
+	pthread_atfork(NULL, NULL, log_ring_atfork_child);
+}
+
+/* Finds or creates the calling thread's ring */
+static struct log_ring *log_ring_get(void)
+{
+	struct log_ring *ring, *head;
+
+	if (log_ring)
+		return log_ring;
+
+	head = atomic_load(&log_rings);
+	for (ring = head; ring; ring = ring->next) {
+		bool expected = false;
+
+		/* Adopt the ring of an exited thread, keeping its records */
+		if (atomic_compare_exchange_strong(&ring->in_use,
+						   &expected, true))
+			goto out;
+	}
+
+	ring = calloc(1, sizeof(*ring) +
+		      log_buffer_size * sizeof(ring->records[0]));
+	if (!ring)
+		return NULL;
+
+	ring->size = log_buffer_size;
+	atomic_store(&ring->in_use, true);
+
+	do
+		ring->next = head;
+	while (!atomic_compare_exchange_weak(&log_rings, &head, ring));
+
+out:
+	ring->pid = getpid();
+	ring->tid = igt_thread_is_main() ? 0 : gettid();
+	pthread_setspecific(log_ring_key, ring);
+	log_ring = ring;
+
+	return ring;
+}
+
+static void _igt_log_buffer_append(const char *domain,
+				   enum igt_log_level level, bool prefix,
+				   const char *line, size_t len)
+{
+	struct log_ring *ring = log_ring_get();
+	unsigned int i, n;
+	uint64_t seq;
+
+	if (!ring)
+		return;
 
-	free(log_buffer.entries[log_buffer.end]);
-	log_buffer.entries[log_buffer.end] = line;
-	log_buffer.end++;
-	if (log_buffer.end == log_buffer.start)
-		log_buffer.start++;
+	n = len ? (len + LOG_RECORD_TEXT - 1) / LOG_RECORD_TEXT : 1;
+	if (n > ring->size) {
+		n = ring->size;
+		len = n * LOG_RECORD_TEXT;
+	}
 
-	pthread_mutex_unlock(&log_buffer_mutex);
+	/* reserve consecutive numbers so that the pieces stay together */
+	seq = atomic_fetch_add(&log_seq, n) + 1;
+
+	for (i = 0; i < n; i++) {
+		struct log_record *rec = &ring->records[ring->head++ % ring->size];
+		size_t chunk = len > LOG_RECORD_TEXT ? LOG_RECORD_TEXT : len;
+
+		atomic_store_explicit(&rec->seq, 0, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+
+		rec->pid = ring->pid;
+		rec->tid = ring->tid;
+		rec->level = level;
+		rec->flags = 0;
+		if (i == 0)
+			rec->flags |= LOG_RECORD_FIRST;
+		if (prefix)
+			rec->flags |= LOG_RECORD_PREFIX;
+		if (i + 1 < n)
+			rec->flags |= LOG_RECORD_MORE;
+		rec->domain = domain;
+		rec->len = chunk;
+		memcpy(rec->text, line, chunk);
+
+		atomic_store_explicit(&rec->seq, seq + i, memory_order_release);
+
+		line += chunk;
+		len -= chunk;
+	}
 }
 
 static void _igt_log_buffer_reset(void)
 {
-	pthread_mutex_lock(&log_buffer_mutex);
+	atomic_store(&log_buffer_start, atomic_load(&log_seq));
+}
 
-	log_buffer.start = log_buffer.end = 0;
+static int cmp_log_record(const void *a, const void *b)
+{
+	const struct log_record *ra = a, *rb = b;
+	uint64_t sa = atomic_load_explicit(&ra->seq, memory_order_relaxed);
+	uint64_t sb = atomic_load_explicit(&rb->seq, memory_order_relaxed);
 
-	pthread_mutex_unlock(&log_buffer_mutex);
+	return sa < sb ? -1 : sa > sb;
 }
 
-static void _log_to_runner_split(int stream, const char *str)
+/*
+ * Takes a consistent copy of the last log_buffer_size lines still present in
+ * the rings, in logging order. Returns the number of records copied into the
+ * newly allocated *out.
+ */
+static unsigned int _igt_log_buffer_collect(struct log_record **out)
 {
-	size_t limit = 4096;
-	size_t len;
-	char *buf = NULL;
+	uint64_t start = atomic_load(&log_buffer_start);
+	struct log_record *records;
+	struct log_ring *ring;
+	unsigned int count = 0, first, lines, i;
 
-	len = strlen(str);
+	for (ring = atomic_load(&log_rings); ring; ring = ring->next)
+		count += ring->size;
 
-	while (len > limit) {
-		if (!buf)
-			buf = malloc(limit + 1);
+	*out = records = malloc(count * sizeof(*records));
+	if (!records)
+		return 0;
+
+	count = 0;
+	for (ring = atomic_load(&log_rings); ring; ring = ring->next) {
+		for (i = 0; i < ring->size; i++) {
+			struct log_record *rec = &ring->records[i];
+			uint64_t seq;
+
+			seq = atomic_load_explicit(&rec->seq, memory_order_acquire);
+			if (seq <= start)
+				continue;
 
-		strncpy(buf, str, limit);
-		buf[limit] = '\0';
+			memcpy(&records[count], rec, sizeof(*rec));
 
-		send_to_runner(runnerpacket_log(stream, buf));
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(&rec->seq, memory_order_relaxed) != seq)
+				continue; /* rewritten under our feet */
+
+			atomic_store_explicit(&records[count].seq, seq,
+					      memory_order_relaxed);
+			count++;
+		}
+	}
+
+	qsort(records, count, sizeof(*records), cmp_log_record);
+
+	/* Keep the last log_buffer_size lines, starting on a full line */
+	first = count;
+	lines = 0;
+	while (first && lines < log_buffer_size)
+		if (records[--first].flags & LOG_RECORD_FIRST)
+			lines++;
+	while (first < count && !(records[first].flags & LOG_RECORD_FIRST))
+		first++;
+
+	memmove(records, records + first, (count - first) * sizeof(*records));
+
+	return count - first;
+}
+
+static const char *igt_log_level_str[] = {
+	"DEBUG",
+	"INFO",
+	"WARNING",
+	"CRITICAL",
+	"NONE"
+};
+
+/*
+ * Formats the line starting at records[*idx] into buf, the way igt_vlog()
+ * would have, and advances *idx past it.
+ */
+static void _igt_log_record_format(const struct log_record *records,
+				   unsigned int count, unsigned int *idx,
+				   char *buf, size_t size)
+{
+	const struct log_record *rec = &records[*idx];
+	const char *program_name;
+	size_t len = 0;
+	int ret;
+
+#ifdef __GLIBC__
+	program_name = program_invocation_short_name;
+#else
+	program_name = command_str;
+#endif
+
+	if (rec->flags & LOG_RECORD_PREFIX) {
+		char thread_id[LOG_PREFIX_SIZE + 24];
+
+		if (rec->tid)
+			snprintf(thread_id, sizeof(thread_id), "%s[thread:%d] ",
+				 log_prefix, rec->tid);
+		else
+			snprintf(thread_id, sizeof(thread_id), "%s", log_prefix);
+
+		ret = snprintf(buf, size, "(%s:%d) %s%s%s%s: ",
+			       program_name, rec->pid, thread_id,
+			       rec->domain ?: "", rec->domain ? "-" : "",
+			       igt_log_level_str[rec->level]);
+		len = ret < size ? ret : size - 1;
+	}
+
+	/* A line too long for buf is cut off, the rest of it skipped */
+	do {
+		size_t chunk;
+
+		rec = &records[(*idx)++];
+		chunk = min_t(size_t, rec->len, size - 1 - len);
+		memcpy(buf + len, rec->text, chunk);
+		len += chunk;
+	} while ((rec->flags & LOG_RECORD_MORE) && *idx < count);
+
+	buf[len] = '\0';
+}
+
+static void _log_to_runner_split(int stream, const char *str, size_t len)
+{
+	size_t limit = 4096;
+
+	while (len > limit) {
+		log_to_runner(stream, str, limit);
 
 		str += limit;
 		len -= limit;
 	}
 
-	send_to_runner(runnerpacket_log(stream, str));
-	free(buf);
+	log_to_runner(stream, str, len);
 }
 
 __attribute__((format(printf, 2, 3)))
 static void _log_line_fprintf(FILE* stream, const char *format, ...)
 {
 	va_list ap;
-	char *str;
 
 	va_start(ap, format);
 
 	if (runner_connected()) {
-		vasprintf(&str, format, ap);
-		_log_to_runner_split(fileno(stream), str);
-		free(str);
+		char buf[4096], *str = buf;
+		va_list aq;
+		int len;
+
+		/* Only allocate for lines longer than a runner packet */
+		va_copy(aq, ap);
+		len = vsnprintf(buf, sizeof(buf), format, aq);
+		va_end(aq);
+
+		if (len >= (int)sizeof(buf) && vasprintf(&str, format, ap) == -1)
+			str = NULL;
+
+		if (len >= 0 && str)
+			_log_to_runner_split(fileno(stream), str, len);
+
+		if (str != buf)
+			free(str);
 	} else {
 		vfprintf(stream, format, ap);
 	}
+
+	va_end(ap);
 }
 
 enum _subtest_type {
@@ -574,7 +874,9 @@ static void _subtest_starting_message(enum _subtest_type subtest_type,
 
 static void _igt_log_buffer_dump(void)
 {
-	uint8_t i;
+	struct log_record *records;
+	unsigned int count, i;
+	char line[4096];
 
 	if (in_subtest && !in_dynamic_subtest && _igt_dynamic_tests_executed >= 0) {
 		/*
@@ -600,26 +902,25 @@ static void _igt_log_buffer_dump(void)
 	else
 		_log_line_fprintf(stderr, "Test %s failed.\n", command_str);
 
-	if (log_buffer.start == log_buffer.end) {
+	count = _igt_log_buffer_collect(&records);
+	if (!count) {
 		_log_line_fprintf(stderr, "No log.\n");
+		free(records);
 		return;
 	}
 
-	pthread_mutex_lock(&log_buffer_mutex);
 	_log_line_fprintf(stderr, "**** DEBUG ****\n");
 
-	i = log_buffer.start;
-	do {
-		char *last_line = log_buffer.entries[i];
-		_log_line_fprintf(stderr, "%s", last_line);
-		i++;
-	} while (i != log_buffer.start && i != log_buffer.end);
+	for (i = 0; i < count; ) {
+		_igt_log_record_format(records, count, &i, line, sizeof(line));
+		_log_line_fprintf(stderr, "%s", line);
+	}
 
 	/* reset the buffer */
-	log_buffer.start = log_buffer.end = 0;
+	_igt_log_buffer_reset();
 
 	_log_line_fprintf(stderr, "****  END  ****\n");
-	pthread_mutex_unlock(&log_buffer_mutex);
+	free(records);
 }
 
 /**
@@ -633,17 +934,18 @@ static void _igt_log_buffer_dump(void)
  */
 void igt_log_buffer_inspect(igt_buffer_log_handler_t check, void *data)
 {
-	uint8_t i;
-	pthread_mutex_lock(&log_buffer_mutex);
-
-	i = log_buffer.start;
-	do {
-		if (check(log_buffer.entries[i], data))
+	struct log_record *records;
+	unsigned int count, i;
+	char line[4096];
+
+	count = _igt_log_buffer_collect(&records);
+	for (i = 0; i < count; ) {
+		_igt_log_record_format(records, count, &i, line, sizeof(line));
+		if (check(line, data))
 			break;
-		i++;
-	} while (i != log_buffer.start && i != log_buffer.end);
+	}
 
-	pthread_mutex_unlock(&log_buffer_mutex);
+	free(records);
 }
 
 void igt_kmsg(const char *format, ...)
@@ -761,6 +1063,9 @@ bool __igt_fixture(void)
 	if (skip_subtests_henceforth)
 		return false;
 
+	/* Fixtures may tear down what the subtests before them use */
+	wait_for_subtest_jobs();
+
 	in_fixture = true;
 	return true;
 }
@@ -910,6 +1215,7 @@ static void print_usage(const char *help_str, bool output_on_stderr)
 		   "  --help-description\n"
 		   "  --describe\n"
 		   "  --device filters\n"
+		   "  --jobs <n>\n"
 		   "  --version\n"
 		   "  --help|-h\n");
 	if (help_str)
@@ -1068,6 +1374,11 @@ static void common_init_env(void)
 	env = getenv("IGT_RUNNER_SOCKET_FD");
 	if (env) {
 		set_runner_socket(atoi(env));
+
+		env = getenv("IGT_RUNNER_COMMS_RING_FD");
+		if (env && getenv("IGT_RUNNER_COMMS_DOORBELL_FD"))
+			set_runner_ring(atoi(env),
+					atoi(getenv("IGT_RUNNER_COMMS_DOORBELL_FD")));
 	}
 }
 
@@ -1092,6 +1403,7 @@ static int common_init(int *argc, char **argv,
 		{"trace-on-oops",     no_argument,       NULL, OPT_TRACE_OOPS},
 		{"device",            required_argument, NULL, OPT_DEVICE},
 		{"version",           no_argument,       NULL, OPT_VERSION},
+		{"jobs",              required_argument, NULL, OPT_JOBS},
 		{"help",              no_argument,       NULL, OPT_HELP},
 		{0, 0, 0, 0}
 	};
@@ -1238,6 +1550,12 @@ static int common_init(int *argc, char **argv,
 			print_version();
 			ret = -1;
 			goto out;
+		case OPT_JOBS:
+			assert(optarg);
+			max_subtest_jobs = atoi(optarg);
+			if (max_subtest_jobs <= 0)
+				max_subtest_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+			break;
 		case OPT_HELP:
 			print_usage(help_str, false);
 			ret = -1;
@@ -1440,10 +1758,14 @@ static bool valid_name_for_subtest(const char *subtest_name)
  */
 bool __igt_run_subtest(const char *subtest_name, const char *file, const int line)
 {
+	bool parallel_safe = next_subtest_parallel_safe;
+
 	internal_assert(!igt_can_fail(),
 			"igt_subtest can be nested only in igt_main"
 			" or igt_subtest_group\n");
 
+	next_subtest_parallel_safe = false;
+
 	if (!valid_name_for_subtest(subtest_name)) {
 		igt_critical("Invalid subtest name \"%s\".\n",
 			     subtest_name);
@@ -1479,6 +1801,14 @@ bool __igt_run_subtest(const char *subtest_name, const char *file, const int lin
 		return false;
 	}
 
+	/* The job carries on from here in a child, or we run it ourselves */
+	if (parallel_safe && max_subtest_jobs > 1 && !subtest_job) {
+		if (start_subtest_job(subtest_name))
+			return false;
+	} else {
+		wait_for_subtest_jobs();
+	}
+
 	igt_kmsg(KMSG_INFO "%s: starting subtest %s\n",
 		 command_str, subtest_name);
 	_subtest_starting_message(_SUBTEST_TYPE_NORMAL, subtest_name);
@@ -1531,6 +1861,27 @@ const char *igt_subtest_name(void)
 	return in_subtest;
 }
 
+/**
+ * igt_parallel_safe:
+ *
+ * Marks the following #igt_subtest as independent of the subtests around
+ * it, so that when the test is run with --jobs it may run concurrently with
+ * the other parallel-safe subtests, each in a child process of its own. Such
+ * a subtest must not rely on anything done by the subtests before it and
+ * may not leave anything behind for the ones after it, as it runs on a copy
+ * of the state left by the fixtures before it. Fixtures and subtests not
+ * marked this way wait for all the jobs started before them to finish.
+ *
+ * The output of each job, including its dynamic subtests, is held back and
+ * reported in the order the subtests appear in the test. The job first in
+ * line has its output passed on about every second while it runs, so it
+ * doesn't look stuck to igt_runner.
+ */
+void igt_parallel_safe(void)
+{
+	next_subtest_parallel_safe = true;
+}
+
 /**
  * igt_only_list_subtests:
  *
@@ -1585,16 +1936,66 @@ bool __igt_enter_dynamic_container(void)
 	return true;
 }
 
+/* Signal all first, so the children exit in parallel rather than in turn */
 static void kill_and_wait(pid_t *pids, int size, int signum)
 {
 	for (int c = 0; c < size; c++) {
-		if (pids[c] > 0) {
+		if (pids[c] > 0)
 			kill(pids[c], signum);
+	}
+
+	for (int c = 0; c < size; c++) {
+		if (pids[c] > 0)
 			waitpid(pids[c], NULL, 0); /* don't leave zombies! */
-		}
 	}
 }
 
+static int pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* Signal through the pidfd where there is one, it can't hit a reused pid */
+static void kill_child(struct test_child *child, int signal)
+{
+#ifdef SYS_pidfd_send_signal
+	if (child->pidfd >= 0 &&
+	    syscall(SYS_pidfd_send_signal, child->pidfd, signal, NULL, 0) == 0)
+		return;
+#endif
+
+	kill(child->pid, signal);
+}
+
+static void close_child(struct test_child *child)
+{
+	if (child->pidfd >= 0)
+		close(child->pidfd);
+	child->pidfd = -1;
+	child->pid = -1;
+}
+
+static void kill_and_wait_children(void)
+{
+	for (int c = 0; c < num_test_children; c++) {
+		if (test_children[c].pid > 0)
+			kill_child(&test_children[c], SIGKILL);
+	}
+
+	for (int c = 0; c < num_test_children; c++) {
+		if (test_children[c].pid > 0)
+			waitpid(test_children[c].pid, NULL, 0); /* don't leave zombies! */
+		close_child(&test_children[c]);
+	}
+
+	num_test_children = 0;
+}
+
 __noreturn static void exit_subtest(const char *result)
 {
 	struct timespec now;
@@ -1622,13 +2023,7 @@ __noreturn static void exit_subtest(const char *result)
 	igt_terminate_spins();
 
 	/* If the subtest aborted, it may have left children behind */
-	for (int c = 0; c < num_test_children; c++) {
-		if (test_children[c] > 0) {
-			kill(test_children[c], SIGKILL);
-			waitpid(test_children[c], NULL, 0); /* don't leave zombies! */
-		}
-	}
-	num_test_children = 0;
+	kill_and_wait_children();
 	if (!test_multi_fork_child && num_test_multi_fork_children > 0)
 		kill_and_wait(test_multi_fork_children, num_test_multi_fork_children, SIGKILL);
 
@@ -1662,6 +2057,15 @@ __noreturn static void exit_subtest(const char *result)
 
 	*subtest_name = NULL;
 
+	/* A subtest job has nothing left to do but report its result */
+	if (subtest_job && jmptarget == &igt_subtest_jmpbuf) {
+		if (!strcmp(result, "SUCCESS"))
+			exit(IGT_EXIT_SUCCESS);
+		if (!strcmp(result, "SKIP"))
+			exit(IGT_EXIT_SKIP);
+		exit(igt_exitcode);
+	}
+
 	siglongjmp(*jmptarget, 1);
 }
 
@@ -2208,8 +2612,8 @@ void __igt_fail_assert(const char *domain, const char *file, const int line,
 void igt_kill_children(int signal)
 {
 	for (int c = 0; c < num_test_children; c++) {
-		if (test_children[c] > 0)
-			kill(test_children[c], signal);
+		if (test_children[c].pid > 0)
+			kill_child(&test_children[c], signal);
 	}
 
 	for (int c = 0; c < num_test_multi_fork_children; c++) {
@@ -2278,6 +2682,8 @@ void igt_exit(void)
 	if (!test_with_subtests)
 		igt_thread_assert_no_failures();
 
+	wait_for_subtest_jobs();
+
 	igt_exit_called = true;
 
 	if (igt_key_file)
@@ -2498,6 +2904,8 @@ static pthread_mutex_t print_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 bool __igt_fork(void)
 {
+	struct test_child *child;
+
 	internal_assert(!test_with_subtests || in_subtest,
 			"forking is only allowed in subtests or igt_simple_main\n");
 	internal_assert(!test_child,
@@ -2512,18 +2920,29 @@ bool __igt_fork(void)
 			test_children_sz *= 2;
 
 		test_children = realloc(test_children,
-					sizeof(pid_t)*test_children_sz);
+					sizeof(*test_children)*test_children_sz);
 		igt_assert(test_children);
 	}
 
 	/* ensure any buffers are flushed before fork */
 	fflush(NULL);
 
-	switch (test_children[num_test_children++] = fork()) {
+	child = &test_children[num_test_children++];
+	child->pidfd = -1;
+	igt_gettime(&child->start);
+
+	switch (child->pid = fork()) {
 	case -1:
 		num_test_children--; /* so we won't kill(-1) during cleanup */
 		igt_assert(0);
 	case 0:
+		/* The siblings' pidfds are only of use to the parent */
+		for (int c = 0; c < num_test_children - 1; c++) {
+			if (test_children[c].pidfd >= 0)
+				close(test_children[c].pidfd);
+			test_children[c].pidfd = -1;
+		}
+
 		test_child = true;
 		pthread_mutex_init(&print_mutex, NULL);
 		pthread_mutex_init(&ahnd_map_mutex, NULL);
@@ -2537,6 +2956,8 @@ bool __igt_fork(void)
 
 		return true;
 	default:
+		/* May fail on old kernels or when out of fds, then we wait() */
+		child->pidfd = pidfd_open(child->pid);
 		return false;
 	}
 
@@ -2600,13 +3021,501 @@ bool __igt_multi_fork(void)
 
 }
 
+/* parallel subtest support code */
+
+static void subtest_jobs_exit_handler(int sig)
+{
+	/* The exit handler can be called from a fatal signal, so play safe */
+	for (int j = 0; j < num_subtest_jobs; j++) {
+		if (!subtest_jobs[j].done)
+			kill(subtest_jobs[j].pid, SIGKILL);
+	}
+
+	for (int j = 0; j < num_subtest_jobs; j++) {
+		if (!subtest_jobs[j].done)
+			waitpid(subtest_jobs[j].pid, NULL, 0);
+	}
+}
+
+static void close_subtest_job(struct subtest_job *job)
+{
+	for (int i = 0; i < ARRAY_SIZE(job->capture); i++) {
+		if (job->capture[i] >= 0)
+			close(job->capture[i]);
+	}
+
+	if (job->pidfd >= 0)
+		close(job->pidfd);
+
+	free(job->name);
+}
+
+static bool open_subtest_job(struct subtest_job *job)
+{
+	memset(job, 0, sizeof(*job));
+	job->pidfd = -1;
+
+	job->capture[0] = runner_connected() ?
+		memfd_create("igt_subtest_job packets", MFD_CLOEXEC) : -1;
+	job->capture[1] = memfd_create("igt_subtest_job stdout", MFD_CLOEXEC);
+	job->capture[2] = memfd_create("igt_subtest_job stderr", MFD_CLOEXEC);
+
+	if ((runner_connected() && job->capture[0] < 0) ||
+	    job->capture[1] < 0 || job->capture[2] < 0) {
+		close_subtest_job(job);
+		return false;
+	}
+
+	return true;
+}
+
+static void enter_subtest_job(struct subtest_job *job)
+{
+	/* The siblings are only of concern to the parent */
+	for (int j = 0; j < num_subtest_jobs; j++)
+		close_subtest_job(&subtest_jobs[j]);
+	num_subtest_jobs = 0;
+	subtest_job = true;
+
+	/* Everything we say is held back until it's our turn */
+	dup2(job->capture[1], STDOUT_FILENO);
+	dup2(job->capture[2], STDERR_FILENO);
+	close(job->capture[1]);
+	close(job->capture[2]);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	if (job->capture[0] >= 0)
+		set_runner_capture(job->capture[0]);
+
+	/* The parent tallies up the results */
+	skipped_one = false;
+	succeeded_one = false;
+	failed_one = false;
+	igt_exitcode = IGT_EXIT_SUCCESS;
+
+	pthread_mutex_init(&print_mutex, NULL);
+	exit_handler_count = 0;
+	reset_helper_process_list();
+}
+
+static void replay_packets(int fd, size_t *offset)
+{
+	struct stat st;
+	char *buf;
+
+	if (fstat(fd, &st) || st.st_size <= *offset)
+		return;
+
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (buf == MAP_FAILED)
+		return;
+
+	/* A packet still being written is picked up next time */
+	while (*offset + sizeof(struct runnerpacket) <= st.st_size) {
+		const struct runnerpacket *packet = (void *)(buf + *offset);
+		struct runnerpacket *copy;
+
+		if (packet->size < sizeof(*packet) ||
+		    packet->size > st.st_size - *offset)
+			break;
+
+		copy = malloc(packet->size);
+		if (!copy)
+			break;
+
+		memcpy(copy, packet, packet->size);
+		send_to_runner(copy);
+		*offset += packet->size;
+	}
+
+	munmap(buf, st.st_size);
+}
+
+static void replay_output(int fd, int out, size_t *offset)
+{
+	char buf[4096];
+	ssize_t len;
+
+	/* The file offset is shared with a job that may still be writing */
+	while ((len = pread(fd, buf, sizeof(buf), *offset)) > 0) {
+		for (ssize_t done = 0, ret; done < len; done += ret) {
+			ret = write(out, buf + done, len - done);
+			if (ret < 0) {
+				if (errno != EINTR)
+					return;
+				ret = 0;
+			}
+		}
+		*offset += len;
+	}
+}
+
+/* Passes on whatever the job has said since the last time */
+static void flush_subtest_job(struct subtest_job *job)
+{
+	fflush(stdout);
+	fflush(stderr);
+
+	if (job->capture[0] >= 0)
+		replay_packets(job->capture[0], &job->replayed[0]);
+	replay_output(job->capture[1], STDOUT_FILENO, &job->replayed[1]);
+	replay_output(job->capture[2], STDERR_FILENO, &job->replayed[2]);
+}
+
+static void report_subtest_job(struct subtest_job *job)
+{
+	int exitcode;
+
+	flush_subtest_job(job);
+
+	if (WIFSIGNALED(job->status)) {
+		struct timespec now;
+
+		/* Killed outright, without a chance to report anything */
+		igt_gettime(&now);
+		_subtest_result_message(_SUBTEST_TYPE_NORMAL, job->name, "CRASH",
+					igt_time_elapsed(&job->start, &now));
+		exitcode = 128 + WTERMSIG(job->status);
+	} else {
+		exitcode = WEXITSTATUS(job->status);
+	}
+
+	switch (exitcode) {
+	case IGT_EXIT_SUCCESS:
+		succeeded_one = true;
+		break;
+	case IGT_EXIT_SKIP:
+		skipped_one = true;
+		break;
+	case IGT_EXIT_ABORT:
+		/* The exit handler takes care of the jobs still running */
+		igt_is_aborting = true;
+		exit(IGT_EXIT_ABORT);
+	default:
+		if (!failed_one)
+			igt_exitcode = exitcode;
+		failed_one = true;
+	}
+}
+
+/* Results are reported in the order the subtests were started */
+static void report_subtest_jobs(void)
+{
+	int j;
+
+	for (j = 0; j < num_subtest_jobs && subtest_jobs[j].done; j++) {
+		report_subtest_job(&subtest_jobs[j]);
+		close_subtest_job(&subtest_jobs[j]);
+	}
+
+	num_subtest_jobs -= j;
+	memmove(subtest_jobs, subtest_jobs + j,
+		num_subtest_jobs * sizeof(*subtest_jobs));
+}
+
+static int running_subtest_jobs(void)
+{
+	int running = 0;
+
+	for (int j = 0; j < num_subtest_jobs; j++)
+		running += !subtest_jobs[j].done;
+
+	return running;
+}
+
+/* Waits for at least one job to exit, whichever comes first */
+static void wait_for_subtest_job(void)
+{
+	struct pollfd *pfd;
+	int oldest = -1, n = 0;
+
+	pfd = calloc(num_subtest_jobs, sizeof(*pfd));
+
+	for (int j = 0; j < num_subtest_jobs; j++) {
+		if (subtest_jobs[j].done)
+			continue;
+
+		if (oldest < 0)
+			oldest = j;
+		if (pfd && subtest_jobs[j].pidfd >= 0) {
+			pfd[n].fd = subtest_jobs[j].pidfd;
+			pfd[n++].events = POLLIN;
+		}
+	}
+
+	if (oldest < 0) {
+		free(pfd);
+		return;
+	}
+
+	for (;;) {
+		int ret;
+
+		if (n == running_subtest_jobs()) {
+			ret = poll(pfd, n, SUBTEST_JOB_FLUSH_MS);
+		} else {
+			struct subtest_job *job = &subtest_jobs[oldest];
+
+			/* Without pidfds for all of them, wait for the oldest */
+			ret = waitpid(job->pid, &job->status, WNOHANG);
+			if (ret == job->pid || (ret < 0 && errno != EINTR))
+				job->done = true;
+			else if (ret == 0)
+				ret = poll(NULL, 0, SUBTEST_JOB_FLUSH_MS);
+		}
+
+		if (ret > 0 || (ret < 0 && errno != EINTR))
+			break;
+
+		/*
+		 * The output of the first job in line needn't be held back,
+		 * and a long running one would otherwise look stuck to the
+		 * runner's inactivity timeout.
+		 */
+		flush_subtest_job(&subtest_jobs[0]);
+	}
+	free(pfd);
+
+	for (int j = 0; j < num_subtest_jobs; j++) {
+		struct subtest_job *job = &subtest_jobs[j];
+
+		if (!job->done &&
+		    waitpid(job->pid, &job->status, WNOHANG) == job->pid)
+			job->done = true;
+	}
+}
+
+static void wait_for_subtest_jobs(void)
+{
+	while (num_subtest_jobs) {
+		wait_for_subtest_job();
+		report_subtest_jobs();
+	}
+}
+
+/*
+ * Forks a job to run the subtest, returning true in the parent which is to
+ * carry on with the next one. The child, or the parent if the job couldn't
+ * be started, is to run the subtest as usual.
+ */
+static bool start_subtest_job(const char *subtest_name)
+{
+	struct subtest_job *job;
+
+	while (running_subtest_jobs() >= max_subtest_jobs) {
+		wait_for_subtest_job();
+		report_subtest_jobs();
+	}
+
+	if (num_subtest_jobs >= subtest_jobs_sz) {
+		int sz = subtest_jobs_sz ? 2 * subtest_jobs_sz : 4;
+		struct subtest_job *jobs;
+
+		jobs = realloc(subtest_jobs, sz * sizeof(*subtest_jobs));
+		if (!jobs)
+			goto sequential;
+
+		subtest_jobs = jobs;
+		subtest_jobs_sz = sz;
+	}
+
+	job = &subtest_jobs[num_subtest_jobs];
+	if (!open_subtest_job(job))
+		goto sequential;
+
+	igt_install_exit_handler(subtest_jobs_exit_handler);
+
+	/* ensure any buffers are flushed before fork */
+	fflush(NULL);
+
+	igt_gettime(&job->start);
+	switch (job->pid = fork()) {
+	case -1:
+		close_subtest_job(job);
+		goto sequential;
+	case 0:
+		enter_subtest_job(job);
+		return false;
+	default:
+		job->name = strdup(subtest_name);
+		job->pidfd = pidfd_open(job->pid);
+		num_subtest_jobs++;
+		return true;
+	}
+
+sequential:
+	wait_for_subtest_jobs();
+	return false;
+}
+
+static int child_failure(int c, int status)
+{
+	if (WIFEXITED(status)) {
+		printf("child %i failed with exit status %i\n",
+		       c, WEXITSTATUS(status));
+		return WEXITSTATUS(status);
+	} else if (WIFSIGNALED(status)) {
+		printf("child %i died with signal %i, %s\n",
+		       c, WTERMSIG(status),
+		       strsignal(WTERMSIG(status)));
+		return 128 + WTERMSIG(status);
+	}
+
+	printf("Unhandled failure [%d] in child %i\n", status, c);
+	return 256;
+}
+
+static double timeval_to_sec(const struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec * 1e-6;
+}
+
+static void report_running_children(void)
+{
+	struct timespec now;
+	int running = 0;
+
+	igt_gettime(&now);
+
+	for (int c = 0; c < num_test_children; c++)
+		running += test_children[c].pid > 0;
+
+	igt_info("Still waiting for %d of %d children:\n",
+		 running, num_test_children);
+
+	for (int c = 0, shown = 0; c < num_test_children && shown < 8; c++) {
+		if (test_children[c].pid <= 0)
+			continue;
+
+		igt_info("  child %d pid:%d running for %.1fs\n",
+			 c, test_children[c].pid,
+			 igt_time_elapsed(&test_children[c].start, &now));
+		shown++;
+	}
+}
+
+#define CHILDREN_REPORT_MS 10000
+
+/*
+ * Wait for the children through their pidfds, so each exit is picked up as
+ * it happens, along with its resource usage. If they take a while, say who
+ * is still running every so often, backing off each time.
+ */
+static int __igt_waitchildren_pidfd(int epfd)
+{
+	struct epoll_event events[64];
+	int timeout = CHILDREN_REPORT_MS;
+	double slowest = 0, user = 0, sys = 0;
+	int slowest_child = -1;
+	int count = 0, err = 0;
+
+	while (count < num_test_children) {
+		int n;
+
+		n = epoll_wait(epfd, events, ARRAY_SIZE(events), timeout);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+
+			printf("epoll_wait(num_children:%d) failed with %m\n",
+			       num_test_children - count);
+			return IGT_EXIT_FAILURE;
+		}
+
+		if (n == 0) {
+			report_running_children();
+			if (timeout < INT_MAX / 2)
+				timeout *= 2;
+			continue;
+		}
+
+		for (int i = 0; i < n; i++) {
+			struct test_child *child = &test_children[events[i].data.u32];
+			struct timespec now;
+			struct rusage ru;
+			int status = -1;
+			double elapsed;
+
+			while (wait4(child->pid, &status, 0, &ru) == -1) {
+				if (errno != EINTR) {
+					printf("wait4(pid:%d) failed with %m\n",
+					       child->pid);
+					return IGT_EXIT_FAILURE;
+				}
+			}
+
+			igt_gettime(&now);
+			elapsed = igt_time_elapsed(&child->start, &now);
+			if (elapsed > slowest) {
+				slowest = elapsed;
+				slowest_child = child - test_children;
+			}
+			user += timeval_to_sec(&ru.ru_utime);
+			sys += timeval_to_sec(&ru.ru_stime);
+
+			epoll_ctl(epfd, EPOLL_CTL_DEL, child->pidfd, NULL);
+			close_child(child);
+
+			if (err == 0 && status != 0) {
+				err = child_failure(child - test_children, status);
+				igt_kill_children(SIGKILL);
+			}
+
+			count++;
+		}
+	}
+
+	igt_debug("Reaped %d children, slowest child %d took %.3fs, "
+		  "%.3fs user and %.3fs system time in total\n",
+		  count, slowest_child, slowest, user, sys);
+
+	num_test_children = 0;
+	return err;
+}
+
+static int children_epoll(void)
+{
+	int epfd;
+
+	for (int c = 0; c < num_test_children; c++) {
+		if (test_children[c].pidfd < 0)
+			return -1;
+	}
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0)
+		return -1;
+
+	for (int c = 0; c < num_test_children; c++) {
+		struct epoll_event ev = {
+			.events = EPOLLIN,
+			.data.u32 = c,
+		};
+
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD,
+			      test_children[c].pidfd, &ev)) {
+			close(epfd);
+			return -1;
+		}
+	}
+
+	return epfd;
+}
+
 int __igt_waitchildren(void)
 {
 	int err = 0;
 	int count;
+	int epfd;
 
 	assert(!test_child);
 
+	epfd = children_epoll();
+	if (epfd >= 0) {
+		err = __igt_waitchildren_pidfd(epfd);
+		close(epfd);
+		return err;
+	}
+
 	count = 0;
 	while (count < num_test_children) {
 		int status = -1;
@@ -2624,26 +3533,15 @@ int __igt_waitchildren(void)
 		}
 
 		for (c = 0; c < num_test_children; c++)
-			if (pid == test_children[c])
+			if (pid == test_children[c].pid)
 				break;
 		if (c == num_test_children)
 			continue;
 
-		if (err == 0 && status != 0) {
-			if (WIFEXITED(status)) {
-				printf("child %i failed with exit status %i\n",
-				       c, WEXITSTATUS(status));
-				err = WEXITSTATUS(status);
-			} else if (WIFSIGNALED(status)) {
-				printf("child %i died with signal %i, %s\n",
-				       c, WTERMSIG(status),
-				       strsignal(WTERMSIG(status)));
-				err = 128 + WTERMSIG(status);
-			} else {
-				printf("Unhandled failure [%d] in child %i\n", status, c);
-				err = 256;
-			}
+		close_child(&test_children[c]);
 
+		if (err == 0 && status != 0) {
+			err = child_failure(c, status);
 			igt_kill_children(SIGKILL);
 		}
 
@@ -2666,6 +3564,9 @@ int __igt_waitchildren(void)
  *
  * Note that igt_skip() will not be forwarded, feature tests need to be done
  * before spawning threads with igt_fork().
+ *
+ * Children still running after a while are listed periodically, and the
+ * slowest child and total CPU time of all are logged at debug level.
  */
 void igt_waitchildren(void)
 {
@@ -3055,6 +3956,10 @@ void igt_skip_on_simulation(void)
  * debug message are disabled. "none" completely disables all output and is not
  * recommended since crucial issues only reported at the IGT_LOG_WARN level are
  * ignored.
+ *
+ * Regardless of the log level, the last 256 lines are kept and dumped when the
+ * test fails. That number can be changed through the IGT_LOG_BUFFER_SIZE
+ * environment variable.
  */
 void igt_log(const char *domain, enum igt_log_level level, const char *format, ...)
 {
@@ -3088,16 +3993,12 @@ igt_constructor {
 void igt_vlog(const char *domain, enum igt_log_level level, const char *format, va_list args)
 {
 	FILE *file;
-	char *line, *formatted_line;
-	char *thread_id;
+	char buf[1024], *line = buf;
+	char thread_id[LOG_PREFIX_SIZE + 24];
 	const char *program_name;
-	const char *igt_log_level_str[] = {
-		"DEBUG",
-		"INFO",
-		"WARNING",
-		"CRITICAL",
-		"NONE"
-	};
+	bool continuation;
+	va_list ap;
+	int len;
 
 	assert(format);
 
@@ -3107,39 +4008,25 @@ void igt_vlog(const char *domain, enum igt_log_level level, const char *format,
 	program_name = command_str;
 #endif
 
-	if (igt_thread_is_main()) {
-		thread_id = strdup(log_prefix);
-	} else {
-		if (asprintf(&thread_id, "%s[thread:%d] ", log_prefix, gettid()) == -1)
-			thread_id = NULL;
-	}
-
-	if (!thread_id)
-		return;
-
 	if (igt_only_list_subtests() && level <= IGT_LOG_WARN)
 		return;
 
-	if (vasprintf(&line, format, args) == -1)
+	va_copy(ap, args);
+	len = vsnprintf(buf, sizeof(buf), format, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+	if (len >= sizeof(buf) && vasprintf(&line, format, args) == -1)
 		return;
 
-	if (pthread_getspecific(__vlog_line_continuation)) {
-		formatted_line = strdup(line);
-		if (!formatted_line)
-			goto out;
-	} else if (asprintf(&formatted_line, "(%s:%d) %s%s%s%s: %s", program_name,
-		     getpid(), thread_id, (domain) ? domain : "", (domain) ? "-" : "",
-		     igt_log_level_str[level], line) == -1) {
-		goto out;
-	}
-
-	if (line[strlen(line) - 1] == '\n')
+	continuation = pthread_getspecific(__vlog_line_continuation);
+	if (len && line[len - 1] == '\n')
 		pthread_setspecific(__vlog_line_continuation, (void*) false);
 	else
 		pthread_setspecific(__vlog_line_continuation, (void*) true);
 
-	/* append log buffer */
-	_igt_log_buffer_append(formatted_line);
+	/* append log buffer, the prefix is only formatted if it gets dumped */
+	_igt_log_buffer_append(domain, level, !continuation, line, len);
 
 	/* check print log level */
 	if (igt_log_level > level)
@@ -3155,6 +4042,12 @@ void igt_vlog(const char *domain, enum igt_log_level level, const char *format,
 			goto out;
 	}
 
+	if (igt_thread_is_main())
+		snprintf(thread_id, sizeof(thread_id), "%s", log_prefix);
+	else
+		snprintf(thread_id, sizeof(thread_id), "%s[thread:%d] ",
+			 log_prefix, gettid());
+
 	pthread_mutex_lock(&print_mutex);
 
 	/* use stderr for warning messages and above */
@@ -3168,7 +4061,13 @@ void igt_vlog(const char *domain, enum igt_log_level level, const char *format,
 	/* prepend all except information messages with process, domain and log
 	 * level information */
 	if (level != IGT_LOG_INFO) {
-		_log_line_fprintf(file, "%s", formatted_line);
+		if (continuation)
+			_log_line_fprintf(file, "%s", line);
+		else
+			_log_line_fprintf(file, "(%s:%d) %s%s%s%s: %s",
+					  program_name, getpid(), thread_id,
+					  domain ? domain : "", domain ? "-" : "",
+					  igt_log_level_str[level], line);
 	} else {
 		_log_line_fprintf(file, "%s%s", thread_id, line);
 	}
@@ -3176,8 +4075,8 @@ void igt_vlog(const char *domain, enum igt_log_level level, const char *format,
 	pthread_mutex_unlock(&print_mutex);
 
 out:
-	free(line);
-	free(thread_id);
+	if (line != buf)
+		free(line);
 }
 
 static const char *timeout_op;
@@ -381,6 +381,7 @@ bool __igt_run_dynamic_subtest(const char *dynamic_subtest_name);
 
 const char *igt_subtest_name(void);
 bool igt_only_list_subtests(void);
+void igt_parallel_safe(void);
 
 void __igt_subtest_group_save(int *, int *);
 void __igt_subtest_group_restore(int, int);
@@ -111,14 +111,24 @@ static const char *__igt_debugfs_mount(void)
  *
  * This attempts to locate where debugfs is mounted on the filesystem,
  * and if not found, will then try to mount debugfs at /sys/kernel/debug.
+ * With a fake sysfs set up by igt_sysfs_set_root(), its kernel/debug
+ * directory is used instead.
  *
  * Returns:
  * The path to the debugfs mount point (e.g. /sys/kernel/debug)
  */
 const char *igt_debugfs_mount(void)
 {
+	static char fake[PATH_MAX];
 	static const char *path;
 
+	/* A fake sysfs from igt_sysfs_set_root() is never mounted over */
+	if (strcmp(igt_sysfs_root(), "/sys")) {
+		snprintf(fake, sizeof(fake), "%s/kernel/debug",
+			 igt_sysfs_root());
+		return fake;
+	}
+
 	if (!path)
 		path = __igt_debugfs_mount();
 
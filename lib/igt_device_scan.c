@@ -55,6 +55,10 @@
  * Parent devices are bus devices (like PCI, platform, etc.) and contain a lot
  * of extra data on top of the DRM device itself.
  *
+ * The scan result is cached on disk until the kernel reports a device event,
+ * so tests starting one after another don't walk udev again each time.
+ * Sysattrs are read from sysfs only when looked at.
+ *
  * # Filters
  *
  * Device selection can be done using filters that are using the data collected
@@ -238,6 +242,7 @@ struct igt_device {
 	char *device;
 	char *pci_slot_name;
 	char *driver;
+	uint16_t pci_vendor, pci_device;
 	int gpu_index; /* For more than one GPU with same vendor and device. */
 
 	char *codename; /* For grouping by codename */
@@ -251,6 +256,7 @@ static struct {
 	struct igt_list_head all;
 	struct igt_list_head filtered;
 	bool devs_scanned;
+	unsigned int generation; /* Bumped on each scan */
 } igt_devs;
 
 static void igt_device_free(struct igt_device *dev);
@@ -491,40 +497,6 @@ static void igt_device_add_prop(struct igt_device *dev,
 	g_hash_table_insert(dev->props_ht, strdup(key), strdup(value));
 }
 
-static void igt_device_add_attr(struct igt_device *dev,
-				const char *key, const char *value)
-{
-	char linkto[PATH_MAX];
-	const char *v = value;
-
-	if (!key)
-		return;
-
-	/* It's possible we have symlink at key filename, but udev
-	 * library resolves only few of them
-	 */
-	if (!v) {
-		struct stat st;
-		char path[PATH_MAX];
-		int len;
-
-		snprintf(path, sizeof(path), "%s/%s", dev->syspath, key);
-		if (lstat(path, &st) != 0)
-			return;
-
-		len = readlink(path, linkto, sizeof(linkto));
-		if (len <= 0 || len == (ssize_t) sizeof(linkto))
-			return;
-		linkto[len] = '\0';
-		v = strrchr(linkto, '/');
-		if (v == NULL)
-			return;
-		v++;
-	}
-
-	g_hash_table_insert(dev->attrs_ht, strdup(key), strdup(v));
-}
-
 /* Iterate over udev properties list and rewrite it to igt_device properties
  * hash table for instant access.
  */
@@ -543,41 +515,99 @@ static void get_props(struct udev_device *dev, struct igt_device *idev)
 	}
 }
 
-/* Same as get_props(), but rewrites sysattrs. Resolves symbolic links
- * not handled by udev get_sysattr_value().
- * Function skips sysattrs from blacklist ht (acquiring some values can take
- * seconds).
+/* Read a sysattr straight from sysfs. Symbolic links resolve to the last
+ * component of their target, like udev does for driver or subsystem.
  */
-static void get_attrs(struct udev_device *dev, struct igt_device *idev)
+static char *read_sysattr(const char *syspath, const char *key)
 {
-	struct udev_list_entry *entry;
+	char path[PATH_MAX], buf[4096];
+	struct stat st;
+	ssize_t len;
+	int fd;
 
-	entry = udev_device_get_sysattr_list_entry(dev);
-	while (entry) {
-		const char *key = udev_list_entry_get_name(entry);
-		const char *value;
+	snprintf(path, sizeof(path), "%s/%s", syspath, key);
+	if (lstat(path, &st) != 0)
+		return NULL;
+
+	if (S_ISLNK(st.st_mode)) {
+		const char *v;
+
+		len = readlink(path, buf, sizeof(buf));
+		if (len <= 0 || len == (ssize_t) sizeof(buf))
+			return NULL;
+		buf[len] = '\0';
+		v = strrchr(buf, '/');
+
+		return v ? strdup(v + 1) : NULL;
+	}
+
+	if (!S_ISREG(st.st_mode))
+		return NULL;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len < 0)
+		return NULL;
 
-		if (is_on_blacklist(key)) {
-			entry = udev_list_entry_get_next(entry);
+	while (len && isspace(buf[len - 1]))
+		len--;
+	buf[len] = '\0';
+
+	return strdup(buf);
+}
+
+/* Sysattrs are read on first use rather than copied from udev up front,
+ * filters only ever look at a handful of them. Attributes which don't
+ * exist are remembered with a NULL value.
+ */
+static const char *get_attr(struct igt_device *dev, const char *key)
+{
+	gpointer value;
+
+	if (!g_hash_table_lookup_extended(dev->attrs_ht, key, NULL, &value)) {
+		value = read_sysattr(dev->syspath, key);
+		g_hash_table_insert(dev->attrs_ht, strdup(key), value);
+		DBG("attr: %s, val: %s\n", key, (char *) value);
+	}
+
+	return value;
+}
+
+/* Read all the sysattrs of a device for printing. Function skips sysattrs
+ * from blacklist (acquiring some values can take seconds).
+ */
+static void get_attrs(struct igt_device *dev)
+{
+	struct dirent *de;
+	DIR *dir;
+
+	dir = opendir(dev->syspath);
+	if (!dir)
+		return;
+
+	while ((de = readdir(dir))) {
+		if (de->d_name[0] == '.' || de->d_type == DT_DIR ||
+		    is_on_blacklist(de->d_name))
 			continue;
-		}
 
-		value = udev_device_get_sysattr_value(dev, key);
-		igt_device_add_attr(idev, key, value);
-		entry = udev_list_entry_get_next(entry);
-		DBG("attr: %s, val: %s\n", key, value);
+		get_attr(dev, de->d_name);
 	}
+	closedir(dir);
 }
 
 #define get_prop(dev, prop) ((char *) g_hash_table_lookup(dev->props_ht, prop))
-#define get_attr(dev, attr) ((char *) g_hash_table_lookup(dev->attrs_ht, attr))
 #define get_prop_subsystem(dev) get_prop(dev, "SUBSYSTEM")
 #define is_drm_subsystem(dev)  (strequal(get_prop_subsystem(dev), "drm"))
 #define is_pci_subsystem(dev)  (strequal(get_prop_subsystem(dev), "pci"))
 
 static void print_ht(GHashTable *ht);
-static void dump_props_and_attrs(const struct igt_device *dev)
+static void dump_props_and_attrs(struct igt_device *dev)
 {
+	get_attrs(dev);
+
 	printf("\n[properties]\n");
 	print_ht(dev->props_ht);
 	printf("\n[attributes]\n");
@@ -635,41 +665,109 @@ static char* strdup_nullsafe(const char* str)
 	return strdup(str);
 }
 
-/* Create new igt_device from udev device.
- * Fills structure with most usable udev device variables, properties
- * and sysattrs.
+/* Fill the fields derived from the devnode and properties, common to
+ * devices coming from udev, sysfs or the scan cache.
  */
-static struct igt_device *igt_device_new_from_udev(struct udev_device *dev)
+static bool igt_device_init(struct igt_device *idev)
 {
-	struct igt_device *idev = igt_device_new();
-
-	igt_assert(idev);
-	idev->syspath = strdup_nullsafe(udev_device_get_syspath(dev));
-	idev->subsystem = strdup_nullsafe(udev_device_get_subsystem(dev));
-	idev->devnode = strdup_nullsafe(udev_device_get_devnode(dev));
-
 	if (idev->devnode && strstr(idev->devnode, "/dev/dri/card"))
 		idev->drm_card = strdup(idev->devnode);
 	else if (idev->devnode && strstr(idev->devnode, "/dev/dri/render"))
 		idev->drm_render = strdup(idev->devnode);
 
-	get_props(dev, idev);
-	get_attrs(dev, idev);
-
 	if (is_pci_subsystem(idev)) {
 		uint16_t vendor, device;
 
-		if (!set_vendor_device(idev) || !set_pci_slot_name(idev)) {
-			igt_device_free(idev);
-			return NULL;
-		}
+		if (!set_vendor_device(idev) || !set_pci_slot_name(idev))
+			return false;
+
 		get_pci_vendor_device(idev, &vendor, &device);
+		idev->pci_vendor = vendor;
+		idev->pci_device = device;
 		idev->codename = __pci_codename(vendor, device);
 		idev->dev_type = __pci_devtype(vendor, device, idev->pci_slot_name);
 		idev->driver = strdup_nullsafe(get_attr(idev, "driver"));
 		igt_assert(idev->driver);
 	}
 
+	return true;
+}
+
+/* Create new igt_device from udev device.
+ * Fills structure with most usable udev device variables and properties,
+ * sysattrs are read when needed.
+ */
+static struct igt_device *igt_device_new_from_udev(struct udev_device *dev)
+{
+	struct igt_device *idev = igt_device_new();
+
+	igt_assert(idev);
+	idev->syspath = strdup_nullsafe(udev_device_get_syspath(dev));
+	idev->subsystem = strdup_nullsafe(udev_device_get_subsystem(dev));
+	idev->devnode = strdup_nullsafe(udev_device_get_devnode(dev));
+
+	get_props(dev, idev);
+
+	if (!igt_device_init(idev)) {
+		igt_device_free(idev);
+		free(idev);
+		return NULL;
+	}
+
+	return idev;
+}
+
+/* Create new igt_device from its sysfs directory alone, taking the
+ * properties from the uevent file. Used in place of udev when scanning
+ * a sysfs tree other than /sys.
+ */
+static struct igt_device *igt_device_new_from_sysfs(const char *root,
+						    const char *syspath)
+{
+	struct igt_device *idev;
+	char path[PATH_MAX];
+	char *line = NULL;
+	size_t n = 0;
+	FILE *uevent;
+
+	snprintf(path, sizeof(path), "%s/uevent", syspath);
+	uevent = fopen(path, "r");
+	if (!uevent)
+		return NULL;
+
+	idev = igt_device_new();
+	igt_assert(idev);
+	idev->syspath = strdup(syspath);
+	idev->subsystem = read_sysattr(syspath, "subsystem");
+
+	while (getline(&line, &n, uevent) > 0) {
+		char *value = strchr(line, '=');
+
+		if (!value)
+			continue;
+		*value++ = '\0';
+		value[strcspn(value, "\n")] = '\0';
+
+		if (!strcmp(line, "DEVNAME") && *value != '/') {
+			snprintf(path, sizeof(path), "/dev/%s", value);
+			value = path;
+		}
+		igt_device_add_prop(idev, line, value);
+	}
+	free(line);
+	fclose(uevent);
+
+	if (strncmp(syspath, root, strlen(root)) == 0)
+		igt_device_add_prop(idev, "DEVPATH", syspath + strlen(root));
+	igt_device_add_prop(idev, "SUBSYSTEM", idev->subsystem);
+	idev->devnode = strdup_nullsafe(get_prop(idev, "DEVNAME"));
+
+	if (!idev->subsystem || !igt_device_init(idev)) {
+		igt_device_free(idev);
+		free(idev);
+		return NULL;
+	}
+
 	return idev;
 }
 
@@ -691,44 +789,6 @@ static struct igt_device *igt_device_find(const char *subsystem,
 	return NULL;
 }
 
-static bool is_vendor_matched(struct igt_device *dev, const char *vendor)
-{
-	const char *vendor_id;
-
-	if (!dev->vendor || !vendor)
-		return false;
-
-	/* First we compare vendor id, like 8086 */
-	if (!strcasecmp(dev->vendor, vendor))
-		return true;
-
-	/* Likely we have vendor string instead of id */
-	vendor_id = get_pci_vendor_id_by_name(vendor);
-	if (!vendor_id)
-		return false;
-
-	return !strcasecmp(dev->vendor, vendor_id);
-}
-
-static bool is_device_matched(struct igt_device *dev, const char *device)
-{
-	if (!dev->device || !device)
-		return false;
-
-	/* First we compare device id, like 1926 */
-	if (!strcasecmp(dev->device, device))
-		return true;
-
-	/* Try "integrated" and "discrete" */
-	if (dev->dev_type == DEVTYPE_INTEGRATED && !strcasecmp(device, STR_INTEGRATED))
-		return true;
-	else if (dev->dev_type == DEVTYPE_DISCRETE && !strcasecmp(device, STR_DISCRETE))
-		return true;
-
-	/* Try codename */
-	return !strcasecmp(dev->codename, device);
-}
-
 static char *safe_strncpy(char *dst, const char *src, int n)
 {
 	char *s;
@@ -861,6 +921,20 @@ static struct igt_device *igt_device_from_syspath(const char *syspath)
 	return NULL;
 }
 
+/* Link drm device to its parent, recording the drm nodes on the parent */
+static void attach_to_parent(struct igt_device *idev,
+			     struct igt_device *parent_idev)
+{
+	const char *devname = idev->devnode;
+
+	if (devname != NULL && strstr(devname, "/dev/dri/card"))
+		parent_idev->drm_card = strdup(devname);
+	else if (devname != NULL && strstr(devname, "/dev/dri/render"))
+		parent_idev->drm_render = strdup(devname);
+
+	idev->parent = parent_idev;
+}
+
 #define RETRIES_GET_PARENT 5
 /* For each drm igt_device add or update its parent igt_device to the array.
  * As card/render drm devices mostly have same parent (vkms is an exception)
@@ -872,7 +946,7 @@ static void update_or_add_parent(struct udev *udev,
 {
 	struct udev_device *parent_dev;
 	struct igt_device *parent_idev;
-	const char *subsystem, *syspath, *devname;
+	const char *subsystem, *syspath;
 	int retries = RETRIES_GET_PARENT;
 
 	/*
@@ -909,13 +983,7 @@ static void update_or_add_parent(struct udev *udev,
 	}
 	igt_assert(parent_idev);
 
-	devname = udev_device_get_devnode(dev);
-	if (devname != NULL && strstr(devname, "/dev/dri/card"))
-		parent_idev->drm_card = strdup(devname);
-	else if (devname != NULL && strstr(devname, "/dev/dri/render"))
-		parent_idev->drm_render = strdup(devname);
-
-	idev->parent = parent_idev;
+	attach_to_parent(idev, parent_idev);
 }
 
 static struct igt_device *duplicate_device(struct igt_device *dev) {
@@ -997,20 +1065,26 @@ static void index_pci_devices(void)
  *
  * Function iterates over devices on 'drm' subsystem. For each drm device
  * its parent is taken (bus device) and stored inside same array.
- * Function sorts all found devices to keep same order of bus devices
- * for providing predictable search.
+ *
+ * Returns false if udev still had events to process, in which case the
+ * properties may be incomplete and the result shouldn't be cached.
  */
-static void scan_drm_devices(void)
+static bool scan_drm_devices(void)
 {
 	struct udev *udev;
+	struct udev_queue *queue;
 	struct udev_enumerate *enumerate;
 	struct udev_list_entry *devices, *dev_list_entry;
-	struct igt_device *dev;
+	bool settled;
 	int ret;
 
 	udev = udev_new();
 	igt_assert(udev);
 
+	queue = udev_queue_new(udev);
+	settled = queue && udev_queue_get_queue_is_empty(queue);
+	udev_queue_unref(queue);
+
 	enumerate = udev_enumerate_new(udev);
 	igt_assert(enumerate);
 
@@ -1025,8 +1099,6 @@ static void scan_drm_devices(void)
 	igt_assert(!ret);
 
 	devices = udev_enumerate_get_list_entry(enumerate);
-	if (!devices)
-		return;
 
 	udev_list_entry_foreach(dev_list_entry, devices) {
 		const char *path;
@@ -1035,6 +1107,9 @@ static void scan_drm_devices(void)
 
 		path = udev_list_entry_get_name(dev_list_entry);
 		udev_dev = udev_device_new_from_syspath(udev, path);
+		/* Properties of a device udev hasn't processed yet are partial */
+		if (!udev_device_get_is_initialized(udev_dev))
+			settled = false;
 		idev = igt_device_new_from_udev(udev_dev);
 		igt_list_add_tail(&idev->link, &igt_devs.all);
 		update_or_add_parent(udev, udev_dev, idev);
@@ -1044,13 +1119,368 @@ static void scan_drm_devices(void)
 	udev_enumerate_unref(enumerate);
 	udev_unref(udev);
 
-	sort_all_devices();
-	index_pci_devices();
+	return settled;
+}
+
+/* Same as scan_drm_devices(), but walks class/drm of a sysfs tree by hand,
+ * which allows pointing the library at a fake tree.
+ */
+static bool scan_sysfs_drm_devices(const char *root)
+{
+	char path[PATH_MAX], syspath[PATH_MAX];
+	struct dirent *de;
+	DIR *dir;
+
+	snprintf(path, sizeof(path), "%s/class/drm", root);
+	dir = opendir(path);
+	if (!dir)
+		return true;
+
+	while ((de = readdir(dir))) {
+		struct igt_device *idev, *parent_idev;
+		char *sep;
+
+		if (de->d_name[0] == '.')
+			continue;
+
+		snprintf(path, sizeof(path), "%s/class/drm/%s", root, de->d_name);
+		if (!realpath(path, syspath))
+			continue;
+
+		idev = igt_device_new_from_sysfs(root, syspath);
+		if (!idev)
+			continue;
+
+		if (!idev->devnode || strncmp(idev->devnode, "/dev/dri/", 9)) {
+			igt_device_free(idev);
+			free(idev);
+			continue;
+		}
+		igt_list_add_tail(&idev->link, &igt_devs.all);
+
+		/* Parent is the nearest directory up which is a device */
+		while ((sep = strrchr(syspath, '/')) && sep != syspath) {
+			*sep = '\0';
+			snprintf(path, sizeof(path), "%s/uevent", syspath);
+			if (access(path, F_OK) == 0)
+				break;
+		}
+
+		parent_idev = igt_device_from_syspath(syspath);
+		if (!parent_idev) {
+			parent_idev = igt_device_new_from_sysfs(root, syspath);
+			igt_assert(parent_idev);
+			igt_list_add_tail(&parent_idev->link, &igt_devs.all);
+		}
+
+		attach_to_parent(idev, parent_idev);
+	}
+	closedir(dir);
+
+	return true;
+}
+
+/*
+ * Scan results are cached on disk between processes, keyed by the kernel
+ * uevent sequence number (and boot id) at the start of the scan: each
+ * device added, removed, bound or unbound generates an uevent, so while
+ * the number stays the same the snapshot describes the devices there are.
+ *
+ * The snapshot is a text file with the key on the first line and then
+ * per device a "dev" line, followed by its "prop" and "attr" lines. Fields
+ * are tab separated and escaped with g_strescape().
+ */
+#define SCAN_CACHE_MAGIC "igt_device_scan 1"
+
+static const char *sysfs_root(void)
+{
+	return getenv("IGT_DEVICE_SCAN_SYSFS") ?: "/sys";
+}
+
+static char *scan_cache_path(void)
+{
+	const char *env = getenv("IGT_DEVICE_SCAN_CACHE");
+	char *path;
+	int ret;
+
+	if (env)
+		return *env ? strdup(env) : NULL;
+
+	env = getenv("XDG_RUNTIME_DIR");
+	if (env && *env)
+		ret = asprintf(&path, "%s/igt_device_scan", env);
+	else
+		ret = asprintf(&path, "/tmp/igt_device_scan.%u", geteuid());
+
+	return ret < 0 ? NULL : path;
+}
+
+static char *read_line(const char *path)
+{
+	char buf[128];
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return NULL;
+
+	buf[len] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+
+	return strdup(buf);
+}
+
+static char *scan_cache_key(void)
+{
+	char path[PATH_MAX];
+	char *seqnum, *boot_id, *key;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/kernel/uevent_seqnum", sysfs_root());
+	seqnum = read_line(path);
+	if (!seqnum)
+		return NULL;
+
+	boot_id = read_line("/proc/sys/kernel/random/boot_id");
+	ret = asprintf(&key, "%s %s %s", seqnum, boot_id ?: "", sysfs_root());
+	free(boot_id);
+	free(seqnum);
+
+	return ret < 0 ? NULL : key;
+}
+
+static void write_field(FILE *f, const char *str)
+{
+	gchar *escaped = g_strescape(str ?: "", NULL);
+
+	fprintf(f, "\t%s", escaped);
+	g_free(escaped);
+}
+
+static void write_ht(FILE *f, const char *type, GHashTable *ht)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_hash_table_iter_init(&iter, ht);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (!value)
+			continue;
+
+		fputs(type, f);
+		write_field(f, key);
+		write_field(f, value);
+		fputc('\n', f);
+	}
+}
+
+static int device_index(const struct igt_device *dev)
+{
+	struct igt_device *d;
+	int i = 0;
+
+	igt_list_for_each_entry(d, &igt_devs.all, link) {
+		if (d == dev)
+			return i;
+		i++;
+	}
+
+	return -1;
+}
+
+/* Write the snapshot to a temporary file and rename it into place, so
+ * concurrent readers see either the old or the new one.
+ */
+static void save_scan_cache(const char *path, const char *key)
+{
+	struct igt_device *dev;
+	char *tmp;
+	FILE *f;
+	int fd;
+
+	if (asprintf(&tmp, "%s.XXXXXX", path) < 0)
+		return;
+
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		free(tmp);
+		return;
+	}
+
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		unlink(tmp);
+		free(tmp);
+		return;
+	}
+
+	fputs(SCAN_CACHE_MAGIC, f);
+	write_field(f, key);
+	fputc('\n', f);
 
 	igt_list_for_each_entry(dev, &igt_devs.all, link) {
-		struct igt_device *dev_dup = duplicate_device(dev);
-		igt_list_add_tail(&dev_dup->link, &igt_devs.filtered);
+		fputs("dev", f);
+		write_field(f, dev->subsystem);
+		write_field(f, dev->syspath);
+		write_field(f, dev->devnode);
+		fprintf(f, "\t%d\n", dev->parent ? device_index(dev->parent) : -1);
+
+		write_ht(f, "prop", dev->props_ht);
+		write_ht(f, "attr", dev->attrs_ht);
 	}
+
+	if (fclose(f) || rename(tmp, path))
+		unlink(tmp);
+	free(tmp);
+}
+
+static char *unescape(const gchar *field)
+{
+	gchar *str = g_strcompress(field);
+	char *ret = strdup(str);
+
+	g_free(str);
+
+	return ret;
+}
+
+static char *nullable(char *str)
+{
+	if (str && !*str) {
+		free(str);
+		return NULL;
+	}
+
+	return str;
+}
+
+static bool parse_cache_line(gchar **fields, GPtrArray *devs, GArray *parents)
+{
+	guint len = g_strv_length(fields);
+	struct igt_device *dev;
+	GHashTable *ht;
+
+	if (len == 5 && !strcmp(fields[0], "dev")) {
+		int parent = atoi(fields[4]);
+
+		dev = igt_device_new();
+		igt_assert(dev);
+		dev->subsystem = nullable(unescape(fields[1]));
+		dev->syspath = nullable(unescape(fields[2]));
+		dev->devnode = nullable(unescape(fields[3]));
+		g_ptr_array_add(devs, dev);
+		g_array_append_val(parents, parent);
+
+		return true;
+	}
+
+	if (len != 3 || !devs->len)
+		return false;
+
+	dev = g_ptr_array_index(devs, devs->len - 1);
+	if (!strcmp(fields[0], "prop"))
+		ht = dev->props_ht;
+	else if (!strcmp(fields[0], "attr"))
+		ht = dev->attrs_ht;
+	else
+		return false;
+
+	g_hash_table_insert(ht, unescape(fields[1]), unescape(fields[2]));
+
+	return true;
+}
+
+static bool __load_scan_cache(FILE *f, const char *key, GPtrArray *devs,
+			      GArray *parents)
+{
+	char *line = NULL;
+	size_t n = 0;
+	gchar **fields;
+	bool ret = false;
+
+	/* First line carries the key */
+	if (getline(&line, &n, f) > 0) {
+		line[strcspn(line, "\n")] = '\0';
+		fields = g_strsplit(line, "\t", 0);
+		if (g_strv_length(fields) == 2 &&
+		    !strcmp(fields[0], SCAN_CACHE_MAGIC)) {
+			char *str = unescape(fields[1]);
+
+			ret = !strcmp(str, key);
+			free(str);
+		}
+		g_strfreev(fields);
+	}
+
+	while (ret && getline(&line, &n, f) > 0) {
+		line[strcspn(line, "\n")] = '\0';
+		fields = g_strsplit(line, "\t", 0);
+		ret = parse_cache_line(fields, devs, parents);
+		g_strfreev(fields);
+	}
+	free(line);
+
+	return ret;
+}
+
+/* Rebuild the device array from the snapshot if it is still current */
+static bool load_scan_cache(const char *path, const char *key)
+{
+	GPtrArray *devs;
+	GArray *parents;
+	struct stat st;
+	bool ret;
+	FILE *f;
+	int fd;
+	guint i;
+
+	fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_uid != geteuid()) {
+		close(fd);
+		return false;
+	}
+
+	f = fdopen(fd, "r");
+	igt_assert(f);
+	devs = g_ptr_array_new();
+	parents = g_array_new(false, false, sizeof(int));
+	ret = __load_scan_cache(f, key, devs, parents);
+	fclose(f);
+
+	for (i = 0; ret && i < devs->len; i++) {
+		struct igt_device *dev = g_ptr_array_index(devs, i);
+		int parent = g_array_index(parents, int, i);
+
+		if (!dev->subsystem || !dev->syspath ||
+		    parent >= (int) devs->len || !igt_device_init(dev))
+			ret = false;
+		else if (parent >= 0)
+			attach_to_parent(dev, g_ptr_array_index(devs, parent));
+	}
+
+	for (i = 0; i < devs->len; i++) {
+		struct igt_device *dev = g_ptr_array_index(devs, i);
+
+		if (ret) {
+			igt_list_add_tail(&dev->link, &igt_devs.all);
+		} else {
+			igt_device_free(dev);
+			free(dev);
+		}
+	}
+	g_ptr_array_free(devs, true);
+	g_array_free(parents, true);
+
+	return ret;
 }
 
 static void igt_device_free(struct igt_device *dev)
@@ -1094,9 +1524,19 @@ void igt_devices_free(void)
  * called with @force = false. If something changes during the the test
  * or test does some module loading (new drm devices occurs during execution)
  * function must be called again with @force = true to refresh device array.
+ *
+ * The result is cached on disk, in $XDG_RUNTIME_DIR or /tmp, and reused by
+ * following scans until the kernel reports any device event. The cache
+ * location can be changed with IGT_DEVICE_SCAN_CACHE, which disables it
+ * when empty. IGT_DEVICE_SCAN_SYSFS makes the scan walk another sysfs tree
+ * in place of asking udev about /sys.
  */
 void igt_devices_scan(bool force)
 {
+	struct igt_device *dev;
+	char *path, *key = NULL;
+	bool cached = false;
+
 	if (force && igt_devs.devs_scanned)
 		igt_devices_free();
 
@@ -1104,8 +1544,45 @@ void igt_devices_scan(bool force)
 		return;
 
 	prepare_scan();
-	scan_drm_devices();
 
+	/* Take the key before scanning, so any event during it invalidates */
+	path = scan_cache_path();
+	if (path)
+		key = scan_cache_key();
+	if (key)
+		cached = load_scan_cache(path, key);
+
+	if (!cached) {
+		bool settled;
+
+		if (getenv("IGT_DEVICE_SCAN_SYSFS"))
+			settled = scan_sysfs_drm_devices(sysfs_root());
+		else
+			settled = scan_drm_devices();
+
+		/* Sort to keep same order of bus devices for predictable search */
+		sort_all_devices();
+
+		/* Don't persist if any uevent arrived while we were scanning */
+		if (key && settled) {
+			char *after = scan_cache_key();
+
+			if (after && !strcmp(after, key))
+				save_scan_cache(path, key);
+			free(after);
+		}
+	}
+	free(key);
+	free(path);
+
+	index_pci_devices();
+
+	igt_list_for_each_entry(dev, &igt_devs.all, link) {
+		struct igt_device *dev_dup = duplicate_device(dev);
+		igt_list_add_tail(&dev_dup->link, &igt_devs.filtered);
+	}
+
+	igt_devs.generation++;
 	igt_devs.devs_scanned = true;
 }
 
@@ -1309,7 +1786,8 @@ static void print_ht(GHashTable *ht)
 		char *k = (char *) keys->data;
 		char *v = g_hash_table_lookup(ht, k);
 
-		_print_key_value(k, v);
+		if (v)
+			_print_key_value(k, v);
 		keys = g_list_next(keys);
 	}
 	g_list_free(keys);
@@ -1407,6 +1885,17 @@ struct filter {
 		char *pf;
 		char *vf;
 	} data;
+
+	/* Data in the form matched against, see compile_filter() */
+	int vendor_id;
+	int device_id;
+	enum dev_type dev_type;
+	int card, pf, vf;
+
+	/* Result against the devices of scan generation */
+	unsigned int generation;
+	bool matched;
+	struct igt_device match;
 };
 
 static void fill_filter_data(struct filter *filter, const char *key, const char *value)
@@ -1446,6 +1935,61 @@ static void split_filter_data(struct filter *filter)
 
 static struct filter_class *get_filter_class(const char *class_name, const struct filter *filter);
 
+/* Parse a 4 digit hex id like 8086, -1 if it isn't one */
+static int parse_id(const char *str)
+{
+	char *end;
+	long id;
+
+	if (strlen(str) != 4)
+		return -1;
+
+	id = strtol(str, &end, 16);
+
+	return *end ? -1 : id;
+}
+
+/* Parse card, pf or vf index, -1 if it isn't a valid one */
+static int parse_index(const char *str)
+{
+	int index;
+
+	if (sscanf(str, "%d", &index) != 1 || index < 0)
+		return -1;
+
+	return index;
+}
+
+/*
+ * Resolve the filter data into numbers once, instead of comparing strings
+ * for every device each time the filter is applied. A vendor or device
+ * that can't match anything gets an id of -1.
+ */
+static void compile_filter(struct filter *filter)
+{
+	const char *vendor_id;
+
+	filter->vendor_id = -1;
+	if (filter->data.vendor) {
+		vendor_id = get_pci_vendor_id_by_name(filter->data.vendor);
+		filter->vendor_id = parse_id(vendor_id ?: filter->data.vendor);
+	}
+
+	filter->device_id = -1;
+	filter->dev_type = DEVTYPE_ALL;
+	if (filter->data.device) {
+		filter->device_id = parse_id(filter->data.device);
+		if (!strcasecmp(filter->data.device, STR_INTEGRATED))
+			filter->dev_type = DEVTYPE_INTEGRATED;
+		else if (!strcasecmp(filter->data.device, STR_DISCRETE))
+			filter->dev_type = DEVTYPE_DISCRETE;
+	}
+
+	filter->card = filter->data.card ? parse_index(filter->data.card) : 0;
+	filter->pf = filter->data.pf ? parse_index(filter->data.pf) : 0;
+	filter->vf = filter->data.vf ? parse_index(filter->data.vf) : -1;
+}
+
 static bool parse_filter(const char *fstr, struct filter *filter)
 {
 	char class_name[32];
@@ -1457,12 +2001,81 @@ static bool parse_filter(const char *fstr, struct filter *filter)
 	if (sscanf(fstr, "%31[^:]:%255s", class_name, filter->raw_data) >= 1) {
 		filter->class = get_filter_class(class_name, filter);
 		split_filter_data(filter);
+		compile_filter(filter);
 		return true;
 	}
 
 	return false;
 }
 
+static void free_filter(void *data)
+{
+	struct filter *filter = data;
+
+	free(filter->data.vendor);
+	free(filter->data.device);
+	free(filter->data.card);
+	free(filter->data.slot);
+	free(filter->data.drm);
+	free(filter->data.driver);
+	free(filter->data.pf);
+	free(filter->data.vf);
+	free(filter);
+}
+
+/* Filters parsed so far, by filter string */
+static GHashTable *compiled_filters;
+
+static struct filter *get_filter(const char *fstr)
+{
+	struct filter *filter;
+
+	if (!fstr)
+		return NULL;
+
+	if (!compiled_filters)
+		compiled_filters = g_hash_table_new_full(g_str_hash, g_str_equal,
+							 free, free_filter);
+
+	filter = g_hash_table_lookup(compiled_filters, fstr);
+	if (filter)
+		return filter;
+
+	filter = calloc(1, sizeof(*filter));
+	igt_assert(filter);
+	if (!parse_filter(fstr, filter)) {
+		free_filter(filter);
+		return NULL;
+	}
+	g_hash_table_insert(compiled_filters, strdup(fstr), filter);
+
+	return filter;
+}
+
+static bool is_vendor_matched(const struct igt_device *dev,
+			      const struct filter *filter)
+{
+	return dev->vendor && dev->pci_vendor == filter->vendor_id;
+}
+
+static bool is_device_matched(const struct igt_device *dev,
+			      const struct filter *filter)
+{
+	if (!dev->device)
+		return false;
+
+	/* First we compare device id, like 1926 */
+	if (dev->pci_device == filter->device_id)
+		return true;
+
+	/* Try "integrated" and "discrete" */
+	if (filter->dev_type != DEVTYPE_ALL)
+		return dev->dev_type == filter->dev_type;
+
+	/* Try codename */
+	return dev->codename && !strcasecmp(dev->codename, filter->data.device);
+}
+
 /* Filter which matches subsystem:/sys/... path.
  * Used as first filter in chain.
  */
@@ -1522,7 +2135,7 @@ static struct igt_list_head *filter_pci(const struct filter_class *fcls,
 					const struct filter *filter)
 {
 	struct igt_device *dev;
-	int card = -1;
+	int card = filter->card;
 	(void) fcls;
 
 	DBG("filter pci\n");
@@ -1532,14 +2145,8 @@ static struct igt_list_head *filter_pci(const struct filter_class *fcls,
 		exit(EXIT_FAILURE);
 	}
 
-	if (filter->data.card) {
-		sscanf(filter->data.card, "%d", &card);
-		if (card < 0) {
-			return &igt_devs.filtered;
-		}
-	} else {
-		card = 0;
-	}
+	if (card < 0)
+		return &igt_devs.filtered;
 
 	igt_list_for_each_entry(dev, &igt_devs.all, link) {
 		if (!is_pci_subsystem(dev))
@@ -1550,11 +2157,11 @@ static struct igt_list_head *filter_pci(const struct filter_class *fcls,
 			continue;
 
 		/* Skip if 'vendor' doesn't match (hex or name) */
-		if (filter->data.vendor && !is_vendor_matched(dev, filter->data.vendor))
+		if (filter->data.vendor && !is_vendor_matched(dev, filter))
 			continue;
 
 		/* Skip if 'device' doesn't match */
-		if (filter->data.device && !is_device_matched(dev, filter->data.device))
+		if (filter->data.device && !is_device_matched(dev, filter))
 			continue;
 
 		/* We get n-th card */
@@ -1594,47 +2201,25 @@ static struct igt_list_head *filter_sriov(const struct filter_class *fcls,
 					const struct filter *filter)
 {
 	struct igt_device *dev, *dup;
-	int card = -1, pf = -1, vf = -1;
+	int card = filter->card, pf = filter->pf, vf = filter->vf;
 	char *pf_pci_slot_name = NULL;
 	(void) fcls;
 
 	DBG("filter sriov\n");
 
-	if (filter->data.card) {
-		sscanf(filter->data.card, "%d", &card);
-		if (card < 0) {
-			return &igt_devs.filtered;
-		}
-	} else {
-		card = 0;
-	}
-
-	if (filter->data.pf) {
-		sscanf(filter->data.pf, "%d", &pf);
-		if (pf < 0) {
-			return &igt_devs.filtered;
-		}
-	} else {
-		pf = 0;
-	}
-
-	if (filter->data.vf) {
-		sscanf(filter->data.vf, "%d", &vf);
-		if (vf < 0) {
-			return &igt_devs.filtered;
-		}
-	}
+	if (card < 0 || pf < 0 || (filter->data.vf && vf < 0))
+		return &igt_devs.filtered;
 
 	igt_list_for_each_entry(dev, &igt_devs.all, link) {
 		if (!is_pci_subsystem(dev))
 			continue;
 
 		/* Skip if 'vendor' doesn't match (hex or name) */
-		if (filter->data.vendor && !is_vendor_matched(dev, filter->data.vendor))
+		if (filter->data.vendor && !is_vendor_matched(dev, filter))
 			continue;
 
 		/* Skip if 'device' doesn't match */
-		if (filter->data.device && !is_device_matched(dev, filter->data.device))
+		if (filter->data.device && !is_device_matched(dev, filter))
 			continue;
 
 		/* We get n-th card */
@@ -1782,21 +2367,20 @@ int igt_device_filter_count(void)
  */
 static bool is_filter_valid(const char *fstr)
 {
-	struct filter filter;
-	int ret;
+	struct filter *filter;
 
-	ret = parse_filter(fstr, &filter);
-	if (!ret)
+	filter = get_filter(fstr);
+	if (!filter)
 		return false;
 
-	if (filter.class == NULL) {
+	if (filter->class == NULL) {
 		igt_warn("No filter class matching [%s]\n", fstr);
 		return false;
 	}
 
-	if (filter.class->is_valid != NULL && !filter.class->is_valid(filter.class, &filter))
+	if (filter->class->is_valid != NULL && !filter->class->is_valid(filter->class, filter))
 	{
-		igt_warn("Filter not valid [%s:%s]\n", filter.class->name, filter.raw_data);
+		igt_warn("Filter not valid [%s:%s]\n", filter->class->name, filter->raw_data);
 		return false;
 	}
 
@@ -1885,6 +2469,11 @@ void igt_device_filter_free_all(void)
 		igt_list_del(&filter->link);
 		free(filter);
 	}
+
+	if (compiled_filters) {
+		g_hash_table_destroy(compiled_filters);
+		compiled_filters = NULL;
+	}
 }
 
 /**
@@ -1938,14 +2527,13 @@ int igt_device_filter_pci(void)
 static bool igt_device_filter_apply(const char *fstr)
 {
 	struct igt_device *dev, *tmp;
-	struct filter filter;
-	bool ret;
+	struct filter *filter;
 
 	if (!fstr)
 		return false;
 
-	ret = parse_filter(fstr, &filter);
-	if (!ret) {
+	filter = get_filter(fstr);
+	if (!filter) {
 		igt_warn("Can't split filter [%s]\n", fstr);
 		return false;
 	}
@@ -1960,11 +2548,26 @@ static bool igt_device_filter_apply(const char *fstr)
 	 * contextual filter.
 	 */
 
-	if (!filter.class) {
+	if (!filter->class) {
 		igt_warn("No filter class matching [%s]\n", fstr);
 		return false;
 	}
-	filter.class->filter_function(filter.class, &filter);
+
+	/* Filters select at most one device, remember which until rescan */
+	if (filter->generation == igt_devs.generation) {
+		if (filter->matched) {
+			dev = duplicate_device(&filter->match);
+			igt_list_add_tail(&dev->link, &igt_devs.filtered);
+		}
+		return true;
+	}
+
+	filter->class->filter_function(filter->class, filter);
+
+	filter->generation = igt_devs.generation;
+	filter->matched = !igt_list_empty(&igt_devs.filtered);
+	if (filter->matched)
+		filter->match = *igt_list_first_entry(&igt_devs.filtered, dev, link);
 
 	return true;
 }
@@ -979,7 +979,7 @@ static int kunit_kmsg_result_get(struct igt_list_head *results,
 {
 	struct sigaction sigchld = { .sa_handler = kunit_sigchld_handler, },
 			 saved;
-	char record[BUF_LEN + 1], *buf;
+	char record[BUF_LEN];
 	unsigned long taints;
 	int ret;
 
@@ -1030,20 +1030,8 @@ static int kunit_kmsg_result_get(struct igt_list_head *results,
 		if (unlikely(igt_debug_on(ret < 0)))
 			break;
 
-		/* skip kmsg continuation lines */
-		if (igt_debug_on(*record == ' '))
-			continue;
-
-		/* NULL-terminate the record */
-		record[ret] = '\0';
-
-		/* detect start of log message, continue if not found */
-		buf = strchrnul(record, ';');
-		if (igt_debug_on(*buf == '\0'))
-			continue;
-		buf++;
-
-		ret = igt_ktap_parse(buf, ktap);
+		/* parse the record in place, skipping its prefix */
+		ret = igt_ktap_parse_stream(record, ret, true, ktap);
 		if (!ret || igt_debug_on(ret != -EINPROGRESS))
 			break;
 	} while (igt_list_empty(results));
@@ -1090,37 +1078,38 @@ static int kunit_get_results(struct igt_list_head *results, const char *debugfs_
 			     const char *suite, struct igt_ktap_results **ktap)
 {
 	char results_path[PATH_MAX];
-	FILE *results_stream;
-	char *buf = NULL;
-	size_t size = 0;
+	char buf[BUF_LEN];
 	ssize_t len;
-	int err;
+	int fd, err;
 
 	if (igt_debug_on(strlen(debugfs_path) + strlen(suite) + strlen("/results") >= PATH_MAX))
 		return -ENOSPC;
 
 	strcpy(stpcpy(stpcpy(results_path, debugfs_path), suite), "/results");
-	results_stream = fopen(results_path, "r");
-	if (igt_debug_on(!results_stream))
+	fd = open(results_path, O_RDONLY);
+	if (igt_debug_on(fd < 0))
 		return -errno;
 
 	*ktap = igt_ktap_alloc(results);
 	if (igt_debug_on(!*ktap)) {
 		err = -ENOMEM;
-		goto out_fclose;
+		goto out_close;
 	}
 
-	while (len = getline(&buf, &size, results_stream), len > 0) {
-		err = igt_ktap_parse(buf, *ktap);
-		if (err != -EINPROGRESS)
+	/* whole chunks of the results file at a time, a final 0 flushes */
+	do {
+		len = read(fd, buf, sizeof(buf));
+		if (igt_debug_on(len < 0)) {
+			err = -errno;
 			break;
-	}
+		}
 
-	free(buf);
+		err = igt_ktap_parse_stream(buf, len, false, *ktap);
+	} while (len > 0 && err == -EINPROGRESS);
 
 	igt_ktap_free(ktap);
-out_fclose:
-	fclose(results_stream);
+out_close:
+	close(fd);
 
 	return err;
 }
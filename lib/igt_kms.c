@@ -54,6 +54,8 @@
 #include "igt_kms.h"
 #include "igt_aux.h"
 #include "igt_edid.h"
+#include "igt_list.h"
+#include "igt_map.h"
 #include "intel_chipset.h"
 #include "igt_debugfs.h"
 #include "igt_device.h"
@@ -743,9 +745,7 @@ const char * const igt_rotation_names[] = {
 	[5] = "reflect-y",
 };
 
-static unsigned int
-igt_plane_rotations(igt_display_t *display, igt_plane_t *plane,
-		    drmModePropertyPtr prop)
+static unsigned int igt_plane_rotations(drmModePropertyPtr prop)
 {
 	unsigned int rotations = 0;
 
@@ -769,6 +769,207 @@ igt_plane_rotations(igt_display_t *display, igt_plane_t *plane,
 	return rotations;
 }
 
+/*
+ * Property IDs are allocated once per device and never change while the
+ * device exists, so the names (and for rotation, the supported rotations)
+ * behind them are cached per device for the life of the process. This
+ * saves a GETPROPERTY ioctl per property of every object each time a
+ * display is set up. The device node's inode tells a rebound driver, with
+ * a new set of IDs, apart from the one the cache was filled from.
+ */
+struct igt_prop_cache {
+	struct igt_list_head link;
+	dev_t rdev;
+	ino_t ino;
+	struct igt_map *props;
+};
+
+struct igt_cached_prop {
+	uint32_t id;
+	unsigned int rotations;
+	char name[DRM_PROP_NAME_LEN];
+};
+
+static IGT_LIST_HEAD(igt_prop_caches);
+
+static struct igt_prop_cache *igt_get_prop_cache(int fd)
+{
+	struct igt_prop_cache *cache;
+	struct stat st;
+
+	igt_assert(fstat(fd, &st) == 0);
+
+	igt_list_for_each_entry(cache, &igt_prop_caches, link)
+		if (cache->rdev == st.st_rdev && cache->ino == st.st_ino)
+			return cache;
+
+	cache = calloc(1, sizeof(*cache));
+	igt_assert(cache);
+	cache->rdev = st.st_rdev;
+	cache->ino = st.st_ino;
+	cache->props = igt_map_create(igt_map_hash_32, igt_map_equal_32);
+	igt_list_add(&cache->link, &igt_prop_caches);
+
+	return cache;
+}
+
+static struct igt_cached_prop *
+igt_get_cached_prop(int fd, struct igt_prop_cache *cache, uint32_t id)
+{
+	struct igt_cached_prop *cached;
+	drmModePropertyPtr prop;
+
+	cached = igt_map_search(cache->props, &id);
+	if (cached)
+		return cached;
+
+	prop = drmModeGetProperty(fd, id);
+	igt_assert(prop);
+
+	cached = calloc(1, sizeof(*cached));
+	igt_assert(cached);
+	cached->id = id;
+	memcpy(cached->name, prop->name, sizeof(cached->name));
+	cached->name[sizeof(cached->name) - 1] = '\0';
+	if (strcmp(cached->name, "rotation") == 0)
+		cached->rotations = igt_plane_rotations(prop);
+	drmModeFreeProperty(prop);
+
+	igt_map_insert(cache->props, &cached->id, cached);
+
+	return cached;
+}
+
+/*
+ * The property name tables are fixed, so each gets a perfect hash on first
+ * use: the seed is picked such that no two names share a slot, leaving a
+ * single strcmp() to tell a name from the table apart from any other.
+ */
+struct igt_prop_name_hash {
+	const char * const *names;
+	int num_names;
+	uint32_t seed;
+	uint32_t mask;
+	uint8_t *slots;
+};
+
+#define IGT_PROP_NAME_NONE 0xff
+
+static struct igt_prop_name_hash igt_prop_name_hashes[] = {
+	{ igt_plane_prop_names, IGT_NUM_PLANE_PROPS },
+	{ igt_colorop_prop_names, IGT_NUM_COLOROP_PROPS },
+	{ igt_crtc_prop_names, IGT_NUM_CRTC_PROPS },
+	{ igt_connector_prop_names, IGT_NUM_CONNECTOR_PROPS },
+};
+
+static uint32_t igt_prop_name_hash(const char *name, uint32_t seed)
+{
+	uint32_t hash = 2166136261u ^ seed;
+
+	while (*name)
+		hash = (hash ^ (uint8_t)*name++) * 16777619u;
+
+	return hash ^ hash >> 16;
+}
+
+static bool igt_prop_name_hash_build(struct igt_prop_name_hash *h,
+				     uint32_t size)
+{
+	for (h->seed = 0; h->seed < 1024; h->seed++) {
+		int i;
+
+		memset(h->slots, IGT_PROP_NAME_NONE, size);
+
+		for (i = 0; i < h->num_names; i++) {
+			uint32_t slot = igt_prop_name_hash(h->names[i], h->seed) &
+					h->mask;
+
+			if (h->slots[slot] != IGT_PROP_NAME_NONE)
+				break;
+
+			h->slots[slot] = i;
+		}
+
+		if (i == h->num_names)
+			return true;
+	}
+
+	return false;
+}
+
+static struct igt_prop_name_hash *
+igt_get_prop_name_hash(const char * const prop_names[], int num_props)
+{
+	struct igt_prop_name_hash *h = NULL;
+	uint32_t size;
+
+	for (int i = 0; i < ARRAY_SIZE(igt_prop_name_hashes); i++) {
+		if (igt_prop_name_hashes[i].names == prop_names) {
+			h = &igt_prop_name_hashes[i];
+			break;
+		}
+	}
+	igt_assert(h && h->num_names == num_props);
+	igt_assert(num_props < IGT_PROP_NAME_NONE);
+
+	if (h->slots)
+		return h;
+
+	/* Four slots per name finds a seed within a few dozen tries */
+	size = 4;
+	while (size < 4 * num_props)
+		size <<= 1;
+
+	for (;; size <<= 1) {
+		h->slots = realloc(h->slots, size);
+		igt_assert(h->slots);
+		h->mask = size - 1;
+
+		if (igt_prop_name_hash_build(h, size))
+			return h;
+	}
+}
+
+static int igt_prop_name_lookup(const struct igt_prop_name_hash *h,
+				const char *name)
+{
+	uint8_t idx = h->slots[igt_prop_name_hash(name, h->seed) & h->mask];
+
+	if (idx == IGT_PROP_NAME_NONE || strcmp(h->names[idx], name))
+		return -1;
+
+	return idx;
+}
+
+/*
+ * Retrieve the IDs of all the properties of the object named in prop_names
+ * and store them into props.
+ */
+static void
+igt_fill_props(igt_display_t *display, uint32_t obj_id, uint32_t obj_type,
+	       uint32_t *props, int num_props, const char * const prop_names[])
+{
+	struct igt_prop_name_hash *h =
+		igt_get_prop_name_hash(prop_names, num_props);
+	struct igt_prop_cache *cache = igt_get_prop_cache(display->drm_fd);
+	drmModeObjectPropertiesPtr obj_props;
+
+	obj_props = drmModeObjectGetProperties(display->drm_fd, obj_id, obj_type);
+	igt_assert(obj_props);
+
+	for (int i = 0; i < obj_props->count_props; i++) {
+		struct igt_cached_prop *prop =
+			igt_get_cached_prop(display->drm_fd, cache,
+					    obj_props->props[i]);
+		int idx = igt_prop_name_lookup(h, prop->name);
+
+		if (idx >= 0)
+			props[idx] = prop->id;
+	}
+
+	drmModeFreeObjectProperties(obj_props);
+}
+
 /**
  * igt_find_colorop:
  * @display: display on which to look for colorop.
@@ -791,39 +992,6 @@ igt_colorop_t *igt_find_colorop(igt_display_t *display, uint32_t id)
 	return NULL;
 }
 
-/*
- * Retrieve all the properies specified in props_name and store them into
- * colorop->props.
- */
-static void
-igt_fill_colorop_props(igt_display_t *display, igt_colorop_t *colorop,
-		       int num_props, const char * const prop_names[])
-{
-	drmModeObjectPropertiesPtr props;
-	int i, j, fd;
-
-	fd = display->drm_fd;
-
-	props = drmModeObjectGetProperties(fd, colorop->id, DRM_MODE_OBJECT_COLOROP);
-	igt_assert(props);
-
-	for (i = 0; i < props->count_props; i++) {
-		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
-
-		for (j = 0; j < num_props; j++) {
-			if (strcmp(prop->name, prop_names[j]) != 0)
-				continue;
-
-			colorop->props[j] = props->props[i];
-			break;
-		}
-
-		drmModeFreeProperty(prop);
-	}
-	drmModeFreeObjectProperties(props);
-}
-
 static void igt_fill_colorop(igt_display_t *display, igt_plane_t *plane,
 			     igt_colorop_t *colorop, uint32_t id,
 			     char *name)
@@ -834,7 +1002,8 @@ static void igt_fill_colorop(igt_display_t *display, igt_plane_t *plane,
 	if (name)
 		memcpy(colorop->name, name, sizeof(colorop->name));
 
-	igt_fill_colorop_props(display, colorop, IGT_NUM_COLOROP_PROPS, igt_colorop_prop_names);
+	igt_fill_props(display, id, DRM_MODE_OBJECT_COLOROP, colorop->props,
+		       IGT_NUM_COLOROP_PROPS, igt_colorop_prop_names);
 }
 
 static void
@@ -879,103 +1048,52 @@ static void
 igt_fill_plane_props(igt_display_t *display, igt_plane_t *plane,
 		     int num_props, const char * const prop_names[])
 {
-	drmModeObjectPropertiesPtr props;
-	int i, j, fd;
-
-	fd = display->drm_fd;
+	uint32_t prop_id;
 
-	props = drmModeObjectGetProperties(fd, plane->drm_plane->plane_id, DRM_MODE_OBJECT_PLANE);
-	igt_assert(props);
+	igt_fill_props(display, plane->drm_plane->plane_id,
+		       DRM_MODE_OBJECT_PLANE, plane->props,
+		       num_props, prop_names);
 
-	for (i = 0; i < props->count_props; i++) {
-		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
-
-		for (j = 0; j < num_props; j++) {
-			if (strcmp(prop->name, prop_names[j]) != 0)
-				continue;
-
-			plane->props[j] = props->props[i];
-			break;
-		}
-
-		if (strcmp(prop->name, "rotation") == 0)
-			plane->rotations = igt_plane_rotations(display, plane, prop);
+	prop_id = plane->props[IGT_PLANE_ROTATION];
+	if (prop_id)
+		plane->rotations =
+			igt_get_cached_prop(display->drm_fd,
+					    igt_get_prop_cache(display->drm_fd),
+					    prop_id)->rotations;
+	if (!plane->rotations)
+		plane->rotations = IGT_ROTATION_0;
 
-		if (strcmp(prop->name, "COLOR_PIPELINE") == 0)
-			igt_fill_plane_color_pipelines(display, plane, prop);
+	/* The pipelines differ from plane to plane, so aren't cached */
+	prop_id = plane->props[IGT_PLANE_COLOR_PIPELINE];
+	if (prop_id) {
+		drmModePropertyPtr prop = drmModeGetProperty(display->drm_fd,
+							     prop_id);
 
+		igt_assert(prop);
+		igt_fill_plane_color_pipelines(display, plane, prop);
 		drmModeFreeProperty(prop);
 	}
-
-	if (!plane->rotations)
-		plane->rotations = IGT_ROTATION_0;
-
-	drmModeFreeObjectProperties(props);
 }
 
 /*
  * Retrieve all the properties specified in props_name and store them into
- * config->atomic_props_crtc and config->atomic_props_connector.
+ * output->props.
  */
 static void
 igt_atomic_fill_connector_props(igt_display_t *display, igt_output_t *output,
 			int num_connector_props, const char * const conn_prop_names[])
 {
-	drmModeObjectPropertiesPtr props;
-	int i, j, fd;
-
-	fd = display->drm_fd;
-
-	props = drmModeObjectGetProperties(fd, output->config.connector->connector_id, DRM_MODE_OBJECT_CONNECTOR);
-	igt_assert(props);
-
-	for (i = 0; i < props->count_props; i++) {
-		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
-
-		for (j = 0; j < num_connector_props; j++) {
-			if (strcmp(prop->name, conn_prop_names[j]) != 0)
-				continue;
-
-			output->props[j] = props->props[i];
-			break;
-		}
-
-		drmModeFreeProperty(prop);
-	}
-
-	drmModeFreeObjectProperties(props);
+	igt_fill_props(display, output->config.connector->connector_id,
+		       DRM_MODE_OBJECT_CONNECTOR, output->props,
+		       num_connector_props, conn_prop_names);
 }
 
 static void
 igt_fill_pipe_props(igt_display_t *display, igt_pipe_t *pipe,
 		    int num_crtc_props, const char * const crtc_prop_names[])
 {
-	drmModeObjectPropertiesPtr props;
-	int i, j, fd;
-
-	fd = display->drm_fd;
-
-	props = drmModeObjectGetProperties(fd, pipe->crtc_id, DRM_MODE_OBJECT_CRTC);
-	igt_assert(props);
-
-	for (i = 0; i < props->count_props; i++) {
-		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
-
-		for (j = 0; j < num_crtc_props; j++) {
-			if (strcmp(prop->name, crtc_prop_names[j]) != 0)
-				continue;
-
-			pipe->props[j] = props->props[i];
-			break;
-		}
-
-		drmModeFreeProperty(prop);
-	}
-
-	drmModeFreeObjectProperties(props);
+	igt_fill_props(display, pipe->crtc_id, DRM_MODE_OBJECT_CRTC,
+		       pipe->props, num_crtc_props, crtc_prop_names);
 }
 
 static igt_plane_t *igt_get_assigned_primary(igt_output_t *output, igt_pipe_t *pipe)
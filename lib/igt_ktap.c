@@ -4,7 +4,9 @@
  * Copyright © 2023 Intel Corporation
  */
 
+#include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,26 +37,299 @@ struct igt_ktap_results {
 	char *case_name;
 	unsigned int sub_last;
 	struct igt_list_head *results;
+
+	/* incomplete line left over from the previous chunk */
+	char *line;
+	size_t line_len;
+	size_t line_size;
 };
 
-/**
- * igt_ktap_parse:
- *
- * This function parses a line of text for KTAP report data
- * and passes results back to IGT kunit layer.
- * https://kernel.org/doc/html/latest/dev-tools/ktap.html
+/* A token of the line being parsed, not NUL-terminated */
+struct ktap_token {
+	const char *str;
+	size_t len;
+};
+
+/*
+ * The matchers below take the remainder [p, end) of the line and return
+ * the position after what they matched, or NULL. They implement the
+ * scanf(3) conversions the KTAP line formats were originally described
+ * with, without requiring the line to be NUL-terminated and without
+ * allocating anything.
  */
-int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
+
+/* "%*[ ]" */
+static const char *match_spaces(const char *p, const char *end)
+{
+	const char *start = p;
+
+	while (p < end && *p == ' ')
+		p++;
+
+	return p > start ? p : NULL;
+}
+
+/* n times "%*1[ ]" */
+static const char *match_indent(const char *p, const char *end, int n)
+{
+	if (end - p < n)
+		return NULL;
+
+	while (n--)
+		if (*p++ != ' ')
+			return NULL;
+
+	return p;
+}
+
+static const char *match_str(const char *p, const char *end, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (!p || end - p < len || memcmp(p, str, len))
+		return NULL;
+
+	return p + len;
+}
+
+static const char *skip_whitespace(const char *p, const char *end)
+{
+	while (p < end && isspace(*p))
+		p++;
+
+	return p;
+}
+
+/* "%u" */
+static const char *match_uint(const char *p, const char *end, unsigned int *n)
+{
+	unsigned long val = 0;
+	bool negative = false;
+	const char *digits;
+
+	if (!p)
+		return NULL;
+
+	p = skip_whitespace(p, end);
+	if (p < end && (*p == '+' || *p == '-'))
+		negative = *p++ == '-';
+
+	for (digits = p; p < end && isdigit(*p); p++) {
+		if (val > (ULONG_MAX - (*p - '0')) / 10)
+			val = ULONG_MAX;
+		else
+			val = val * 10 + *p - '0';
+	}
+
+	if (p == digits)
+		return NULL;
+
+	*n = negative ? -val : val;
+
+	return p;
+}
+
+/* "%ms" */
+static const char *match_word(const char *p, const char *end,
+			      struct ktap_token *word)
+{
+	if (!p)
+		return NULL;
+
+	p = skip_whitespace(p, end);
+	word->str = p;
+
+	while (p < end && !isspace(*p))
+		p++;
+
+	word->len = p - word->str;
+
+	return word->len ? p : NULL;
+}
+
+/* "%m[^\n]" */
+static const char *match_msg(const char *p, const char *end,
+			     struct ktap_token *msg)
+{
+	const char *eol;
+
+	if (!p)
+		return NULL;
+
+	eol = memchr(p, '\n', end - p) ?: end;
+	if (eol == p)
+		return NULL;
+
+	msg->str = p;
+	msg->len = eol - p;
+
+	return eol;
+}
+
+/* " %n" followed by a check for the end of the line */
+static bool match_end(const char *p, const char *end)
+{
+	return p && skip_whitespace(p, end) == end;
+}
+
+static bool token_eq(const struct ktap_token *token, const char *str)
+{
+	return strlen(str) == token->len && !memcmp(str, token->str, token->len);
+}
+
+/* [indent]KTAP version N */
+static bool match_version(const char *p, const char *end, int indent)
+{
+	unsigned int n;
+
+	p = match_indent(p, end, indent);
+	p = match_str(p, end, "KTAP");
+	p = p ? match_spaces(p, end) : NULL;
+	p = match_str(p, end, "version");
+	p = p ? match_spaces(p, end) : NULL;
+	p = match_uint(p, end, &n);
+
+	return match_end(p, end);
+}
+
+/* [indent]1..N */
+static bool match_plan(const char *p, const char *end, int indent,
+		       unsigned int *n)
+{
+	p = match_indent(p, end, indent);
+	p = match_str(p, end, "1..");
+	p = match_uint(p, end, n);
+
+	return match_end(p, end);
+}
+
+/* [indent]# Subtest: NAME */
+static bool match_subtest(const char *p, const char *end, int indent,
+			  struct ktap_token *name)
+{
+	p = match_indent(p, end, indent);
+	p = match_str(p, end, "#");
+	p = p ? match_spaces(p, end) : NULL;
+	p = match_str(p, end, "Subtest:");
+	p = p ? match_spaces(p, end) : NULL;
+	p = match_word(p, end, name);
+
+	return match_end(p, end);
+}
+
+/* [indent](ok|not ok) N, with not separated by the given spaces */
+static const char *match_ok(const char *p, const char *end, int indent,
+			    bool single_space, bool *ok)
+{
+	const char *q;
+
+	p = match_indent(p, end, indent);
+
+	q = match_str(p, end, "not");
+	if (q) {
+		q = single_space ? match_indent(q, end, 1) : match_spaces(q, end);
+		p = match_str(q, end, "ok");
+		*ok = false;
+	} else {
+		p = match_str(p, end, "ok");
+		*ok = true;
+	}
+
+	return p ? match_spaces(p, end) : NULL;
+}
+
+/* parametrized subtest result: "        [not ]ok N description[#\n]" */
+static bool match_sub_result(const char *p, const char *end, unsigned int *n)
+{
+	const char *start;
+	bool ok;
+
+	p = match_ok(p, end, 8, true, &ok);
+	p = match_uint(p, end, n);
+	p = p ? match_spaces(p, end) : NULL;
+	if (!p)
+		return false;
+
+	for (start = p; p < end && *p != '#' && *p != '\n'; p++)
+		;
+
+	return p > start && p < end;
+}
+
+/*
+ * test case result: "    [not ]ok N NAME[ # [SKIP][ MESSAGE]]", returns the
+ * IGT exit code for it, or IGT_EXIT_INVALID.
+ */
+static int match_case_result(const char *p, const char *end, unsigned int *n,
+			     struct ktap_token *name, struct ktap_token *msg)
+{
+	const char *q;
+	bool ok;
+
+	p = match_ok(p, end, 4, true, &ok);
+	p = match_uint(p, end, n);
+	p = p ? match_spaces(p, end) : NULL;
+	p = match_word(p, end, name);
+	if (!p)
+		return IGT_EXIT_INVALID;
+
+	if (match_end(p, end))
+		return ok ? IGT_EXIT_SUCCESS : IGT_EXIT_FAILURE;
+
+	p = match_spaces(p, end);
+	p = match_str(p, end, "#");
+	p = p ? match_spaces(p, end) : NULL;
+	if (!p)
+		return IGT_EXIT_INVALID;
+
+	if (ok) {
+		q = match_str(p, end, "SKIP");
+		if (match_end(q, end))
+			return IGT_EXIT_SKIP;
+
+		q = q ? match_spaces(q, end) : NULL;
+		if (match_msg(q, end, msg))
+			return IGT_EXIT_SKIP;
+	}
+
+	if (!match_msg(p, end, msg))
+		return IGT_EXIT_INVALID;
+
+	return ok ? IGT_EXIT_SUCCESS : IGT_EXIT_FAILURE;
+}
+
+/* test suite result: "[not ]ok N NAME[ #...]" */
+static bool match_suite_result(const char *p, const char *end, unsigned int *n,
+			       struct ktap_token *name)
 {
-	char *suite_name = NULL, *case_name = NULL, *msg = NULL;
+	bool ok;
+
+	p = match_ok(p, end, 0, false, &ok);
+	p = match_uint(p, end, n);
+	p = p ? match_spaces(p, end) : NULL;
+	p = match_word(p, end, name);
+	if (!p)
+		return false;
+
+	if (match_end(p, end))
+		return true;
+
+	p = match_spaces(p, end);
+
+	return match_str(p, end, "#");
+}
+
+static int ktap_parse_line(const char *buf, const char *end,
+			   struct igt_ktap_results *ktap)
+{
+	struct ktap_token case_name = {}, msg = {}, suite_name;
 	struct igt_ktap_result *result;
 	int code = IGT_EXIT_INVALID;
-	unsigned int n, len;
-	char s[2];
+	const char *p;
+	unsigned int n;
 
 	/* KTAP report header */
-	if (igt_debug_on(sscanf(buf, "KTAP%*[ ]version%*[ ]%u %n",
-				&n, &len) == 1 && len == strlen(buf))) {
+	if (match_version(buf, end, 0)) {
 		if (igt_debug_on(ktap->expect != KTAP_START))
 			return -EPROTO;
 
@@ -62,13 +337,12 @@ int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
 		ktap->expect = SUITE_COUNT;
 
 	/* malformed TAP test plan? */
-	} else if (len = 0,
-		   igt_debug_on(sscanf(buf, " 1..%1[ ]", s) == 1)) {
+	} else if (p = match_str(skip_whitespace(buf, end), end, "1.."),
+		   igt_debug_on(p && p < end && *p == ' ')) {
 		return -EINPROGRESS;
 
 	/* valid test plan of a KTAP report */
-	} else if (igt_debug_on(sscanf(buf, "1..%u %n", &n, &len) == 1 &&
-				len == strlen(buf))) {
+	} else if (match_plan(buf, end, 0, &n)) {
 		if (igt_debug_on(ktap->expect != SUITE_COUNT))
 			return -EPROTO;
 
@@ -81,10 +355,7 @@ int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
 		ktap->expect = SUITE_START;
 
 	/* KTAP test suite header */
-	} else if (len = 0,
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]KTAP%*[ ]version%*[ ]%u %n",
-				       &n, &len) == 1 && len == strlen(buf))) {
+	} else if (match_version(buf, end, 4)) {
 		/*
 		 * TODO: drop the following workaround, which addresses a kernel
 		 * side issue of missing lines that provide top level KTAP
@@ -110,23 +381,19 @@ int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
 		ktap->expect = SUITE_NAME;
 
 	/* KTAP test suite name */
-	} else if (len = 0,
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]#%*[ ]Subtest:%*[ ]%ms %n",
-				       &suite_name, &len) == 1 && len == strlen(buf))) {
+	} else if (match_subtest(buf, end, 4, &suite_name)) {
 		if (igt_debug_on(ktap->expect != SUITE_NAME))
 			return -EPROTO;
 
-		ktap->suite_name = suite_name;
-		suite_name = NULL;
+		ktap->suite_name = strndup(suite_name.str, suite_name.len);
+		if (igt_debug_on(!ktap->suite_name))
+			return -ENOMEM;
+
 		ktap->case_count = 0;
 		ktap->expect = CASE_COUNT;
 
 	/* valid test plan of a KTAP test suite */
-	} else if (len = 0, free(suite_name), suite_name = NULL,
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]1..%u %n",
-				       &n, &len) == 1 && len == strlen(buf))) {
+	} else if (match_plan(buf, end, 4, &n)) {
 		if (igt_debug_on(ktap->expect != CASE_COUNT))
 			return -EPROTO;
 
@@ -140,10 +407,7 @@ int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
 		}
 
 	/* KTAP parametrized test case header */
-	} else if (len = 0,
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]KTAP%*[ ]version%*[ ]%u %n",
-				       &n, &len) == 1 && len == strlen(buf))) {
+	} else if (match_version(buf, end, 8)) {
 		if (igt_debug_on(ktap->expect != CASE_RESULT))
 			return -EPROTO;
 
@@ -151,10 +415,7 @@ int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
 		ktap->expect = CASE_NAME;
 
 	/* KTAP parametrized test case name */
-	} else if (len = 0,
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]#%*[ ]Subtest:%*[ ]%ms %n",
-				       &case_name, &len) == 1 && len == strlen(buf))) {
+	} else if (match_subtest(buf, end, 8, &case_name)) {
 		if (igt_debug_on(ktap->expect != CASE_NAME))
 			return -EPROTO;
 
@@ -162,13 +423,7 @@ int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
 		ktap->expect = SUB_RESULT;
 
 	/* KTAP parametrized subtest result */
-	} else if (len = 0, free(case_name), case_name = NULL,
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]ok%*[ ]%u%*[ ]%*[^#\n]%1[#\n]",
-				       &n, s) == 2) ||
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]not%*1[ ]ok%*[ ]%u%*[ ]%*[^#\n]%1[#\n]",
-				       &n, s) == 2)) {
+	} else if (case_name.str = NULL, match_sub_result(buf, end, &n)) {
 		/* at lease one result of a parametrised subtest expected */
 		if (igt_debug_on(ktap->expect == SUB_RESULT &&
 				 ktap->sub_last == 0))
@@ -178,66 +433,19 @@ int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
 		    igt_debug_on(n != ++ktap->sub_last))
 			return -EPROTO;
 
-	/* KTAP test case skip result */
-	} else if ((igt_debug_on(sscanf(buf,
-					"%*1[ ]%*1[ ]%*1[ ]%*1[ ]ok%*[ ]%u%*[ ]%ms%*[ ]#%*[ ]SKIP %n",
-					&n, &case_name, &len) == 2 &&
-				 len == strlen(buf))) ||
-		   (len = 0, free(case_name), case_name = NULL,
-		    igt_debug_on(sscanf(buf,
-					"%*1[ ]%*1[ ]%*1[ ]%*1[ ]ok%*[ ]%u%*[ ]%ms%*[ ]#%*[ ]SKIP%*[ ]%m[^\n]",
-					&n, &case_name, &msg) == 3))) {
-		code = IGT_EXIT_SKIP;
-
-	/* KTAP test case pass result */
-	} else if ((free(case_name), case_name = NULL, free(msg), msg = NULL,
-		    igt_debug_on(sscanf(buf,
-					"%*1[ ]%*1[ ]%*1[ ]%*1[ ]ok%*[ ]%u%*[ ]%ms %n",
-					&n, &case_name, &len) == 2 &&
-				 len == strlen(buf))) ||
-		   (len = 0, free(case_name), case_name = NULL,
-		    igt_debug_on(sscanf(buf,
-					"%*1[ ]%*1[ ]%*1[ ]%*1[ ]ok%*[ ]%u%*[ ]%ms%*[ ]#%*[ ]%m[^\n]",
-					&n, &case_name, &msg) == 3))) {
-		code = IGT_EXIT_SUCCESS;
-
-	/* KTAP test case fail result */
-	} else if ((free(case_name), case_name = NULL, free(msg), msg = NULL,
-		    igt_debug_on(sscanf(buf,
-					"%*1[ ]%*1[ ]%*1[ ]%*1[ ]not%*1[ ]ok%*[ ]%u%*[ ]%ms %n",
-					&n, &case_name, &len) == 2 &&
-				 len == strlen(buf))) ||
-		   (len = 0, free(case_name), case_name = NULL,
-		    igt_debug_on(sscanf(buf,
-					"%*1[ ]%*1[ ]%*1[ ]%*1[ ]not%*1[ ]ok%*[ ]%u%*[ ]%ms%*[ ]#%*[ ]%m[^\n]",
-					&n, &case_name, &msg) == 3))) {
-		code = IGT_EXIT_FAILURE;
+	/* KTAP test case skip, pass or fail result */
+	} else if (code = match_case_result(buf, end, &n, &case_name, &msg),
+		   code != IGT_EXIT_INVALID) {
 
 	/* KTAP test suite result */
-	} else if ((free(case_name), free(msg),
-		    igt_debug_on(sscanf(buf, "ok%*[ ]%u%*[ ]%ms %n",
-					&n, &suite_name, &len) == 2 &&
-				 len == strlen(buf))) ||
-		   (len = 0, free(suite_name), suite_name = NULL,
-		    igt_debug_on(sscanf(buf, "ok%*[ ]%u%*[ ]%ms%*[ ]%1[#]",
-					&n, &suite_name, s) == 3)) ||
-		   (free(suite_name), suite_name = NULL,
-		    igt_debug_on(sscanf(buf,
-					"not%*[ ]ok%*[ ]%u%*[ ]%ms %n",
-					&n, &suite_name, &len) == 2 &&
-				 len == strlen(buf))) ||
-		   (len = 0, free(suite_name), suite_name = NULL,
-		    igt_debug_on(sscanf(buf,
-					"not%*[ ]ok%*[ ]%u%*[ ]%ms%*[ ]%1[#]",
-					&n, &suite_name, s) == 3))) {
+	} else if (case_name.str = NULL, msg.str = NULL,
+		   match_suite_result(buf, end, &n, &suite_name)) {
 		if (igt_debug_on(ktap->expect != SUITE_RESULT) ||
-		    igt_debug_on(strcmp(suite_name, ktap->suite_name)) ||
+		    igt_debug_on(!ktap->suite_name) ||
+		    igt_debug_on(!token_eq(&suite_name, ktap->suite_name)) ||
 		    igt_debug_on(n != ++ktap->suite_last) ||
-		    igt_debug_on(n > ktap->suite_count)) {
-			free(suite_name);
+		    igt_debug_on(n > ktap->suite_count))
 			return -EPROTO;
-		}
-		free(suite_name);
 
 		/* last test suite? */
 		if (igt_debug_on(n == ktap->suite_count))
@@ -258,20 +466,32 @@ int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
 			 code != IGT_EXIT_INVALID) ||
 	    igt_debug_on(code != IGT_EXIT_INVALID &&
 			 ktap->expect != CASE_RESULT) ||
-	    igt_debug_on(!ktap->suite_name) || igt_debug_on(!case_name) ||
+	    igt_debug_on(!ktap->suite_name) || igt_debug_on(!case_name.str) ||
 	    igt_debug_on(ktap->expect == CASE_RESULT && ktap->case_name &&
-			 strcmp(case_name, ktap->case_name)) ||
+			 !token_eq(&case_name, ktap->case_name)) ||
 	    igt_debug_on(n > ktap->case_count) ||
 	    igt_debug_on(n != (ktap->expect == SUB_RESULT ?
-			       ktap->case_last + 1: ++ktap->case_last))) {
-		free(case_name);
-		free(msg);
+			       ktap->case_last + 1: ++ktap->case_last)))
 		return -EPROTO;
+
+	/* Only the results are allocated, not every line parsed */
+	result = calloc(1, sizeof(*result));
+	if (igt_debug_on(!result))
+		return -ENOMEM;
+
+	result->case_name = strndup(case_name.str, case_name.len);
+	if (msg.str)
+		result->msg = strndup(msg.str, msg.len);
+	if (igt_debug_on(!result->case_name || (msg.str && !result->msg))) {
+		free(result->case_name);
+		free(result->msg);
+		free(result);
+		return -ENOMEM;
 	}
 
 	if (ktap->expect == SUB_RESULT) {
 		/* KTAP parametrized test case name */
-		ktap->case_name = case_name;
+		ktap->case_name = result->case_name;
 
 	} else {
 		/* KTAP test case result */
@@ -282,21 +502,122 @@ int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
 			ktap->expect = SUITE_RESULT;
 	}
 
-	if (igt_debug_on((result = calloc(1, sizeof(*result)), !result))) {
-		free(case_name);
-		free(msg);
-		return -ENOMEM;
-	}
-
 	result->suite_name = ktap->suite_name;
-	result->case_name = case_name;
 	result->code = code;
-	result->msg = msg;
 	igt_list_add_tail(&result->link, ktap->results);
 
 	return -EINPROGRESS;
 }
 
+/**
+ * igt_ktap_parse:
+ *
+ * This function parses a line of text for KTAP report data
+ * and passes results back to IGT kunit layer.
+ * https://kernel.org/doc/html/latest/dev-tools/ktap.html
+ */
+int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
+{
+	return ktap_parse_line(buf, buf + strlen(buf), ktap);
+}
+
+static int ktap_parse_record(const char *buf, const char *end, bool kmsg,
+			     struct igt_ktap_results *ktap)
+{
+	if (kmsg) {
+		/* skip kmsg continuation lines */
+		if (*buf == ' ')
+			return -EINPROGRESS;
+
+		/* detect start of log message, continue if not found */
+		buf = memchr(buf, ';', end - buf);
+		if (!buf)
+			return -EINPROGRESS;
+		buf++;
+	}
+
+	return ktap_parse_line(buf, end, ktap);
+}
+
+static int ktap_save_line(struct igt_ktap_results *ktap,
+			  const char *buf, size_t len)
+{
+	if (ktap->line_len + len > ktap->line_size) {
+		size_t size = 2 * ktap->line_size;
+		char *line;
+
+		if (size < ktap->line_len + len)
+			size = ktap->line_len + len;
+
+		line = realloc(ktap->line, size);
+
+		if (igt_debug_on(!line))
+			return -ENOMEM;
+
+		ktap->line = line;
+		ktap->line_size = size;
+	}
+
+	memcpy(ktap->line + ktap->line_len, buf, len);
+	ktap->line_len += len;
+
+	return 0;
+}
+
+/**
+ * igt_ktap_parse_stream:
+ * @buf: chunk of KTAP report data
+ * @len: length of @buf, 0 at the end of the input
+ * @kmsg: whether @buf holds /dev/kmsg records instead of plain lines
+ * @ktap: parser state from igt_ktap_alloc()
+ *
+ * Like igt_ktap_parse(), but parses all the lines of a chunk of input at
+ * once, in place. A line split across chunks is kept until the rest of it
+ * arrives, and parsed at the end of the input if that never happens.
+ *
+ * With @kmsg set, the lines are kernel log records and only their messages
+ * are parsed.
+ *
+ * Returns: 0 once the report is complete, -EINPROGRESS if more input is
+ * expected, or a negative error code. Parsing stops at the first line that
+ * doesn't return -EINPROGRESS.
+ */
+int igt_ktap_parse_stream(const char *buf, size_t len, bool kmsg,
+			  struct igt_ktap_results *ktap)
+{
+	const char *end = buf + len;
+	int ret = -EINPROGRESS;
+
+	if (!len && ktap->line_len) {
+		ret = ktap_parse_record(ktap->line, ktap->line + ktap->line_len,
+					kmsg, ktap);
+		ktap->line_len = 0;
+	}
+
+	while (buf < end && ret == -EINPROGRESS) {
+		const char *eol = memchr(buf, '\n', end - buf);
+
+		if (!eol)
+			return ktap_save_line(ktap, buf, end - buf) ?: ret;
+		eol++;
+
+		if (ktap->line_len) {
+			ret = ktap_save_line(ktap, buf, eol - buf);
+			if (!ret)
+				ret = ktap_parse_record(ktap->line,
+							ktap->line + ktap->line_len,
+							kmsg, ktap);
+			ktap->line_len = 0;
+		} else {
+			ret = ktap_parse_record(buf, eol, kmsg, ktap);
+		}
+
+		buf = eol;
+	}
+
+	return ret;
+}
+
 struct igt_ktap_results *igt_ktap_alloc(struct igt_list_head *results)
 {
 	struct igt_ktap_results *ktap = calloc(1, sizeof(*ktap));
@@ -312,6 +633,7 @@ struct igt_ktap_results *igt_ktap_alloc(struct igt_list_head *results)
 
 void igt_ktap_free(struct igt_ktap_results **ktap)
 {
+	free((*ktap)->line);
 	free(*ktap);
 	*ktap = NULL;
 }
@@ -27,6 +27,9 @@
 
 #define BUF_LEN 4096
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "igt_list.h"
 
 struct igt_ktap_result {
@@ -41,6 +44,8 @@ struct igt_ktap_results;
 
 struct igt_ktap_results *igt_ktap_alloc(struct igt_list_head *results);
 int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap);
+int igt_ktap_parse_stream(const char *buf, size_t len, bool kmsg,
+			  struct igt_ktap_results *ktap);
 void igt_ktap_free(struct igt_ktap_results **ktap);
 
 #endif /* IGT_KTAP_H */
@@ -37,69 +37,161 @@
 
 #include "igt_map.h"
 
-#define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
-
 /*
- * From Knuth -- a good choice for hash/rehash values is p, p-2 where
- * p and p-2 are both prime.  These tables are sized to have an extra 10%
- * free to avoid exponential performance degradation as the hash table fills
+ * The index is a power-of-two array of slots, each holding the full hash of
+ * a key and the position of its entry in the dense table. Collisions are
+ * resolved by Robin Hood linear probing: a key being inserted takes over the
+ * slot of any key closer to its home slot, which keeps probe sequences short
+ * and lets a lookup stop as soon as it meets a slot closer to home than the
+ * distance it has already probed. Removal shifts the following slots back
+ * by one, so no tombstones are ever needed.
  */
 
+#define MIN_SLOTS_SHIFT 3
+
 static const uint32_t deleted_key_value;
 static const void *deleted_key = &deleted_key_value;
 
-static const struct {
-	uint32_t max_entries, size, rehash;
-} hash_sizes[] = {
-	{ 2,		5,		3	  },
-	{ 4,		7,		5	  },
-	{ 8,		13,		11	  },
-	{ 16,		19,		17	  },
-	{ 32,		43,		41        },
-	{ 64,		73,		71        },
-	{ 128,		151,		149       },
-	{ 256,		283,		281       },
-	{ 512,		571,		569       },
-	{ 1024,		1153,		1151      },
-	{ 2048,		2269,		2267      },
-	{ 4096,		4519,		4517      },
-	{ 8192,		9013,		9011      },
-	{ 16384,	18043,		18041     },
-	{ 32768,	36109,		36107     },
-	{ 65536,	72091,		72089     },
-	{ 131072,	144409,		144407    },
-	{ 262144,	288361,		288359    },
-	{ 524288,	576883,		576881    },
-	{ 1048576,	1153459,	1153457   },
-	{ 2097152,	2307163,	2307161   },
-	{ 4194304,	4613893,	4613891   },
-	{ 8388608,	9227641,	9227639   },
-	{ 16777216,	18455029,	18455027  },
-	{ 33554432,	36911011,	36911009  },
-	{ 67108864,	73819861,	73819859  },
-	{ 134217728,	147639589,	147639587 },
-	{ 268435456,	295279081,	295279079 },
-	{ 536870912,	590559793,	590559791 },
-	{ 1073741824,	1181116273,	1181116271},
-	{ 2147483648ul,	2362232233ul,	2362232231ul}
-};
+static int
+entry_is_present(const struct igt_map_entry *entry)
+{
+	return entry->key != NULL && entry->key != deleted_key;
+}
+
+/* Fibonacci hashing, so that weak hash functions still use all slots */
+static uint32_t
+home_slot(const struct igt_map *map, uint32_t hash)
+{
+	return (hash * 0x9e3779b9u) >> (32 - map->slots_shift);
+}
+
+static uint32_t
+probe_distance(const struct igt_map *map, uint32_t hash, uint32_t slot)
+{
+	return (slot - home_slot(map, hash)) & map->slots_mask;
+}
 
+/* Whether the index needs to grow to fit one more present entry */
 static int
-entry_is_free(const struct igt_map_entry *entry)
+slots_full(const struct igt_map *map)
+{
+	return map->entries + 1 > (map->slots_mask + 1) / 8 * 7;
+}
+
+static void
+index_insert(struct igt_map *map, uint32_t hash, uint32_t index)
+{
+	struct igt_map_slot cur = { .hash = hash, .index = index };
+	uint32_t slot = home_slot(map, hash);
+	uint32_t dist = 0;
+
+	for (;;) {
+		struct igt_map_slot *s = &map->slots[slot];
+		uint32_t sdist;
+
+		if (!s->index) {
+			*s = cur;
+			return;
+		}
+
+		sdist = probe_distance(map, s->hash, slot);
+		if (sdist < dist) {
+			struct igt_map_slot tmp = *s;
+
+			*s = cur;
+			cur = tmp;
+			dist = sdist;
+		}
+
+		slot = (slot + 1) & map->slots_mask;
+		dist++;
+	}
+}
+
+static void
+index_fill(struct igt_map *map)
 {
-	return entry->key == NULL;
+	uint32_t i;
+
+	for (i = 0; i < map->used; i++)
+		if (entry_is_present(&map->table[i]))
+			index_insert(map, map->table[i].hash, i + 1);
 }
 
+/* (Re)builds the index from scratch with 2^shift slots */
 static int
-entry_is_deleted(const struct igt_map_entry *entry)
+index_rebuild(struct igt_map *map, uint32_t shift)
 {
-	return entry->key == deleted_key;
+	struct igt_map_slot *slots;
+
+	slots = calloc(1u << shift, sizeof(*slots));
+	if (slots == NULL)
+		return -1;
+
+	free(map->slots);
+	map->slots = slots;
+	map->slots_shift = shift;
+	map->slots_mask = (1u << shift) - 1;
+	index_fill(map);
+
+	return 0;
 }
 
+/*
+ * Squeezes out the removed entries of the dense table, preserving the order
+ * of the remaining ones.
+ */
 static int
-entry_is_present(const struct igt_map_entry *entry)
+table_compact(struct igt_map *map)
 {
-	return entry->key != NULL && entry->key != deleted_key;
+	struct igt_map_slot *slots;
+	uint32_t i, n = 0;
+
+	/* Allocate first, so that the map is left untouched on failure */
+	slots = calloc(map->slots_mask + 1, sizeof(*slots));
+	if (slots == NULL)
+		return -1;
+
+	for (i = 0; i < map->used; i++)
+		if (entry_is_present(&map->table[i]))
+			map->table[n++] = map->table[i];
+
+	map->used = n;
+	map->deleted_entries = 0;
+
+	free(map->slots);
+	map->slots = slots;
+	index_fill(map);
+
+	return 0;
+}
+
+/* Makes sure one more entry can be appended to the table */
+static int
+table_reserve(struct igt_map *map)
+{
+	struct igt_map_entry *table;
+	uint32_t size;
+
+	if (map->used < map->size)
+		return 0;
+
+	/* Reuse the holes left by removals if they are plentiful */
+	if (map->deleted_entries >= map->size / 4)
+		return table_compact(map);
+
+	if (map->size >= UINT32_MAX / 2)
+		return -1;
+
+	size = map->size * 2;
+	table = realloc(map->table, size * sizeof(*table));
+	if (table == NULL)
+		return -1;
+
+	map->table = table;
+	map->size = size;
+
+	return 0;
 }
 
 /**
@@ -118,21 +210,17 @@ igt_map_create(uint32_t (*hash_function)(const void *key),
 {
 	struct igt_map *map;
 
-	map = malloc(sizeof(*map));
+	map = calloc(1, sizeof(*map));
 	if (map == NULL)
 		return NULL;
 
-	map->size_index = 0;
-	map->size = hash_sizes[map->size_index].size;
-	map->rehash = hash_sizes[map->size_index].rehash;
-	map->max_entries = hash_sizes[map->size_index].max_entries;
 	map->hash_function = hash_function;
 	map->key_equals_function = key_equals_function;
-	map->table = calloc(map->size, sizeof(*map->table));
-	map->entries = 0;
-	map->deleted_entries = 0;
+	map->size = 1u << (MIN_SLOTS_SHIFT - 1);
+	map->table = malloc(map->size * sizeof(*map->table));
 
-	if (map->table == NULL) {
+	if (map->table == NULL || index_rebuild(map, MIN_SLOTS_SHIFT)) {
+		free(map->table);
 		free(map);
 		return NULL;
 	}
@@ -162,6 +250,7 @@ igt_map_destroy(struct igt_map *map,
 			delete_function(entry);
 		}
 	}
+	free(map->slots);
 	free(map->table);
 	free(map);
 }
@@ -220,59 +309,25 @@ struct igt_map_entry *
 igt_map_search_pre_hashed(struct igt_map *map, uint32_t hash,
 			  const void *key)
 {
-	uint32_t start_hash_address = hash % map->size;
-	uint32_t hash_address = start_hash_address;
+	uint32_t slot = home_slot(map, hash);
+	uint32_t dist = 0;
 
-	do {
-		uint32_t double_hash;
+	for (;;) {
+		const struct igt_map_slot *s = &map->slots[slot];
 
-		struct igt_map_entry *entry = map->table + hash_address;
-
-		if (entry_is_free(entry)) {
+		if (!s->index || probe_distance(map, s->hash, slot) < dist)
 			return NULL;
-		} else if (entry_is_present(entry) && entry->hash == hash) {
-			if (map->key_equals_function(key, entry->key)) {
-				return entry;
-			}
-		}
-
-		double_hash = 1 + hash % map->rehash;
-
-		hash_address = (hash_address + double_hash) % map->size;
-	} while (hash_address != start_hash_address);
-
-	return NULL;
-}
-
-static void
-igt_map_rehash(struct igt_map *map, int new_size_index)
-{
-	struct igt_map old_map;
-	struct igt_map_entry *table, *entry;
-
-	if (new_size_index >= ARRAY_SIZE(hash_sizes))
-		return;
-
-	table = calloc(hash_sizes[new_size_index].size, sizeof(*map->table));
-	if (table == NULL)
-		return;
 
-	old_map = *map;
+		if (s->hash == hash) {
+			struct igt_map_entry *entry = &map->table[s->index - 1];
 
-	map->table = table;
-	map->size_index = new_size_index;
-	map->size = hash_sizes[map->size_index].size;
-	map->rehash = hash_sizes[map->size_index].rehash;
-	map->max_entries = hash_sizes[map->size_index].max_entries;
-	map->entries = 0;
-	map->deleted_entries = 0;
+			if (map->key_equals_function(key, entry->key))
+				return entry;
+		}
 
-	igt_map_foreach(&old_map, entry) {
-		igt_map_insert_pre_hashed(map, entry->hash,
-					     entry->key, entry->data);
+		slot = (slot + 1) & map->slots_mask;
+		dist++;
 	}
-
-	free(old_map.table);
 }
 
 /**
@@ -325,68 +380,44 @@ struct igt_map_entry *
 igt_map_insert_pre_hashed(struct igt_map *map, uint32_t hash,
 			  const void *key, void *data)
 {
-	uint32_t start_hash_address, hash_address;
-	struct igt_map_entry *available_entry = NULL;
+	struct igt_map_entry *entry;
 
-	if (map->entries >= map->max_entries) {
-		igt_map_rehash(map, map->size_index + 1);
-	} else if (map->deleted_entries + map->entries >= map->max_entries) {
-		igt_map_rehash(map, map->size_index);
+	/* Implement replacement when another insert happens
+	 * with a matching key.  This is a relatively common
+	 * feature of hash tables, with the alternative
+	 * generally being "insert the new value as well, and
+	 * return it first when the key is searched for".
+	 *
+	 * Note that the hash table doesn't have a delete
+	 * callback.  If freeing of old data pointers is
+	 * required to avoid memory leaks, perform a search
+	 * before inserting.
+	 */
+	entry = igt_map_search_pre_hashed(map, hash, key);
+	if (entry) {
+		entry->key = key;
+		entry->data = data;
+		return entry;
 	}
 
-	start_hash_address = hash % map->size;
-	hash_address = start_hash_address;
-	do {
-		struct igt_map_entry *entry = map->table + hash_address;
-		uint32_t double_hash;
-
-		if (!entry_is_present(entry)) {
-			/* Stash the first available entry we find */
-			if (available_entry == NULL)
-				available_entry = entry;
-			if (entry_is_free(entry))
-				break;
-		}
-
-		/* Implement replacement when another insert happens
-		 * with a matching key.  This is a relatively common
-		 * feature of hash tables, with the alternative
-		 * generally being "insert the new value as well, and
-		 * return it first when the key is searched for".
-		 *
-		 * Note that the hash table doesn't have a delete
-		 * callback.  If freeing of old data pointers is
-		 * required to avoid memory leaks, perform a search
-		 * before inserting.
-		 */
-		if (!entry_is_deleted(entry) &&
-		    entry->hash == hash &&
-		    map->key_equals_function(key, entry->key)) {
-			entry->key = key;
-			entry->data = data;
-			return entry;
-		}
-
+	/* We could fail here if a required resize failed. An unchecked-malloc
+	 * application could ignore this result.
+	 */
+	if (slots_full(map) && index_rebuild(map, map->slots_shift + 1))
+		return NULL;
 
-		double_hash = 1 + hash % map->rehash;
+	if (table_reserve(map))
+		return NULL;
 
-		hash_address = (hash_address + double_hash) % map->size;
-	} while (hash_address != start_hash_address);
+	entry = &map->table[map->used++];
+	entry->hash = hash;
+	entry->key = key;
+	entry->data = data;
+	map->entries++;
 
-	if (available_entry) {
-		if (entry_is_deleted(available_entry))
-			map->deleted_entries--;
-		available_entry->hash = hash;
-		available_entry->key = key;
-		available_entry->data = data;
-		map->entries++;
-		return available_entry;
-	}
+	index_insert(map, hash, map->used);
 
-	/* We could hit here if a required resize failed. An unchecked-malloc
-	 * application could ignore this result.
-	 */
-	return NULL;
+	return entry;
 }
 
 /**
@@ -422,18 +453,50 @@ igt_map_remove(struct igt_map *map, const void *key,
  *
  * Function deletes the given hash entry.
  *
- * Note that deletion doesn't otherwise modify the table, so an iteration over
+ * Note that deletion doesn't move the other entries, so an iteration over
  * the map deleting entries is safe.
  */
 void
 igt_map_remove_entry(struct igt_map *map, struct igt_map_entry *entry)
 {
+	uint32_t index, slot, next;
+
 	if (!entry)
 		return;
 
+	/* Only an entry still in this map has a slot to find */
+	assert(entry >= map->table && entry < map->table + map->used &&
+	       entry_is_present(entry));
+
+	index = entry - map->table + 1;
+	slot = home_slot(map, entry->hash);
+	while (map->slots[slot].index != index) {
+		if (!map->slots[slot].index)
+			return;
+		slot = (slot + 1) & map->slots_mask;
+	}
+
+	/* Backward shift deletion: pull the following displaced slots in */
+	for (;;) {
+		next = (slot + 1) & map->slots_mask;
+		if (!map->slots[next].index ||
+		    !probe_distance(map, map->slots[next].hash, next))
+			break;
+
+		map->slots[slot] = map->slots[next];
+		slot = next;
+	}
+	map->slots[slot].index = 0;
+
 	entry->key = deleted_key;
 	map->entries--;
 	map->deleted_entries++;
+
+	/* Trailing holes can simply be forgotten */
+	while (map->used && !entry_is_present(&map->table[map->used - 1])) {
+		map->used--;
+		map->deleted_entries--;
+	}
 }
 
 /**
@@ -441,8 +504,9 @@ igt_map_remove_entry(struct igt_map *map, struct igt_map_entry *entry)
  * @map: igt_map pointer
  * @entry: pointer to map entry, %NULL for the first map entry
  *
- * This function is an iterator over the hash table.
- * Note that an iteration over the table is O(table_size) not O(entries).
+ * This function is an iterator over the hash table, in insertion order.
+ * Entries are stored densely, so an iteration over the table is
+ * O(entries + recently removed entries).
  *
  * Returns: pointer to the next entry
  */
@@ -454,7 +518,7 @@ igt_map_next_entry(struct igt_map *map, struct igt_map_entry *entry)
 	else
 		entry = entry + 1;
 
-	for (; entry != map->table + map->size; entry++) {
+	for (; entry < map->table + map->used; entry++) {
 		if (entry_is_present(entry)) {
 			return entry;
 		}
@@ -480,12 +544,14 @@ igt_map_random_entry(struct igt_map *map,
 		     int (*predicate)(struct igt_map_entry *entry))
 {
 	struct igt_map_entry *entry;
-	uint32_t i = random() % map->size;
+	uint32_t i;
 
 	if (map->entries == 0)
 		return NULL;
 
-	for (entry = map->table + i; entry != map->table + map->size; entry++) {
+	i = random() % map->used;
+
+	for (entry = map->table + i; entry != map->table + map->used; entry++) {
 		if (entry_is_present(entry) &&
 		    (!predicate || predicate(entry))) {
 			return entry;
@@ -32,13 +32,21 @@
 
 /**
  * SECTION:igt_map
- * @short_description: a linear-reprobing hashmap implementation
+ * @short_description: a Robin Hood hashmap implementation
  * @title: IGT Map
  * @include: igt_map.h
  *
- * Implements an open-addressing, linear-reprobing hash table.
+ * Implements an open-addressing hash table using Robin Hood linear probing.
+ * Entries are kept in a dense array in insertion order, which is also the
+ * iteration order, while a separate power-of-two index stores the hash of
+ * each key next to the position of its entry. Lookups only call the key
+ * comparison function on a full hash match, and removal shifts the following
+ * index slots back instead of leaving tombstones.
  *
- * For more information, see:
+ * Removing an entry never moves the other ones, so entry pointers stay valid
+ * until the next insertion.
+ *
+ * For more information on the original design, see:
  * http://cgit.freedesktop.org/~anholt/hash_table/tree/README
  *
  * Example usage:
@@ -102,16 +110,25 @@ struct igt_map_entry {
 	void *data;
 };
 
+struct igt_map_slot {
+	uint32_t hash;
+	uint32_t index; /* position in igt_map.table plus one, 0 if free */
+};
+
 struct igt_map {
+	/* dense array of entries, in insertion order */
 	struct igt_map_entry *table;
 	uint32_t (*hash_function)(const void *key);
 	int (*key_equals_function)(const void *a, const void *b);
-	uint32_t size;
-	uint32_t rehash;
-	uint32_t max_entries;
-	uint32_t size_index;
+	uint32_t size;		/* allocated entries in table */
+	uint32_t used;		/* entries in table, including removed ones */
 	uint32_t entries;
 	uint32_t deleted_entries;
+
+	/* Robin Hood index over the present entries */
+	struct igt_map_slot *slots;
+	uint32_t slots_shift;
+	uint32_t slots_mask;
 };
 
 struct igt_map *
@@ -151,9 +168,10 @@ igt_map_random_entry(struct igt_map *map,
  * Macro is a loop, which iterates through each map entry. Inside a
  * loop block current element is accessible by the @entry pointer.
  *
- * This foreach function is safe against deletion (which just replaces
- * an entry's data with the deleted marker), but not against insertion
- * (which may rehash the table, making entry a dangling pointer).
+ * Entries are visited in insertion order. This foreach function is safe
+ * against deletion (which just replaces an entry's key with the deleted
+ * marker), but not against insertion (which may reallocate or compact the
+ * table, making entry a dangling pointer).
  */
 #define igt_map_foreach(map, entry)				\
 	for (entry = igt_map_next_entry(map, NULL);		\
@@ -18,6 +18,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <poll.h>
+#include <ctype.h>
+#include <sys/epoll.h>
 
 #include "drmtest.h"
 #include "igt_aux.h"
@@ -306,28 +308,78 @@ void igt_pipe_crc_free(igt_pipe_crc_t *pipe_crc)
 	free(pipe_crc);
 }
 
-static bool pipe_crc_init_from_string(igt_pipe_crc_t *pipe_crc, igt_crc_t *crc,
-				      const char *line)
+/*
+ * Parses a hexadecimal number the way strtoul(p, NULL, 16) would for the
+ * fields of a CRC line: leading blanks and a 0x prefix are skipped. The
+ * kernel prints the fields with "%#10x", which leaves out the prefix and
+ * pads with blanks for 0.
+ */
+static bool parse_crc_hex(const char **p, const char *end, uint32_t *val)
+{
+	const char *s = *p;
+	uint64_t v = 0;
+	int digits = 0;
+
+	while (s < end && *s == ' ')
+		s++;
+
+	if (end - s > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X') &&
+	    isxdigit(s[2]))
+		s += 2;
+
+	for (; s < end && isxdigit(*s); s++, digits++) {
+		char c = *s | 0x20;
+
+		v = v << 4 | (c <= '9' ? c - '0' : c - 'a' + 10);
+	}
+
+	if (!digits)
+		return false;
+
+	*val = v;
+	*p = s;
+	return true;
+}
+
+/*
+ * Parses one line of the crtc-N/crc/data debugfs file, from @line up to
+ * the newline at @end: the frame counter, or XXXXXXXXXX if there is none,
+ * followed by up to DRM_MAX_CRC_NR CRC values.
+ */
+static bool parse_crc_line(igt_crc_t *crc, const char *line, const char *end)
 {
+	const char *p = line;
 	int i;
-	const char *buf;
 
-	if (strncmp(line, "XXXXXXXXXX", 10) == 0)
+	if (end - p >= 10 && strncmp(p, "XXXXXXXXXX", 10) == 0) {
 		crc->has_valid_frame = false;
-	else {
+		crc->frame = 0;
+		p += 10;
+	} else {
 		crc->has_valid_frame = true;
-		crc->frame = strtoul(line, NULL, 16);
+		if (!parse_crc_hex(&p, end, &crc->frame))
+			return false;
 	}
 
-	buf = line + 10;
-	for (i = 0; *buf != '\n'; i++, buf += 11)
-		crc->crc[i] = strtoul(buf, NULL, 16);
+	for (i = 0; p < end; i++) {
+		if (i == DRM_MAX_CRC_NR || *p != ' ' ||
+		    !parse_crc_hex(&p, end, &crc->crc[i]))
+			return false;
+	}
 
 	crc->n_words = i;
 
 	return true;
 }
 
+static bool pipe_crc_init_from_string(igt_pipe_crc_t *pipe_crc, igt_crc_t *crc,
+				      const char *line)
+{
+	const char *end = strchr(line, '\n');
+
+	return parse_crc_line(crc, line, end ?: line + strlen(line));
+}
+
 static int read_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out)
 {
 	ssize_t bytes_read;
@@ -592,3 +644,322 @@ void igt_pipe_crc_collect_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out_crc)
 	igt_pipe_crc_get_single(pipe_crc, out_crc);
 	igt_pipe_crc_stop(pipe_crc);
 }
+
+#define CRC_BATCH_SIZE 4096
+
+struct crc_source {
+	int fd;
+	bool eof;
+
+	/* Frame counter of the first CRC, tuples are relative to it */
+	bool has_base;
+	uint32_t base_frame;
+	int next_slot;
+
+	size_t len;
+	char buf[CRC_BATCH_SIZE];
+};
+
+struct _igt_crc_collector {
+	int epoll_fd;
+
+	int n_sources;
+	struct crc_source *sources;
+	igt_pipe_crc_t **pipe_crcs;
+
+	/* max_tuples slots of n_sources CRCs each */
+	int max_tuples;
+	igt_crc_t *crcs;
+	int *filled;
+
+	/* Slots before resolved are either complete or can't be anymore */
+	int resolved;
+	int n_tuples;
+	int *tuples;
+};
+
+/**
+ * igt_crc_collector_new:
+ * @fds: CRC data file descriptors to collect from
+ * @n_fds: number of descriptors in @fds
+ * @max_tuples: maximum number of CRC tuples to collect
+ *
+ * Sets up collecting CRCs from several sources at once, in the format of
+ * the crtc-N/crc/data debugfs files. Usually igt_pipe_crc_collector_new()
+ * is what you want, this is useful to feed the collector from elsewhere.
+ *
+ * The descriptors remain owned by the caller.
+ *
+ * Returns: A CRC collector to pass to igt_crc_collector_collect().
+ */
+igt_crc_collector_t *
+igt_crc_collector_new(const int *fds, int n_fds, int max_tuples)
+{
+	igt_crc_collector_t *collector;
+	int i;
+
+	igt_assert(n_fds > 0 && max_tuples > 0);
+
+	collector = calloc(1, sizeof(*collector));
+	igt_assert(collector);
+
+	collector->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	igt_assert(collector->epoll_fd >= 0);
+
+	collector->n_sources = n_fds;
+	collector->sources = calloc(n_fds, sizeof(*collector->sources));
+	collector->max_tuples = max_tuples;
+	collector->crcs = calloc((size_t)max_tuples * n_fds, sizeof(igt_crc_t));
+	collector->filled = calloc(max_tuples, sizeof(int));
+	collector->tuples = calloc(max_tuples, sizeof(int));
+	igt_assert(collector->sources && collector->crcs &&
+		   collector->filled && collector->tuples);
+
+	for (i = 0; i < n_fds; i++) {
+		struct epoll_event ev = {
+			.events = EPOLLIN,
+			.data.u32 = i,
+		};
+
+		collector->sources[i].fd = fds[i];
+		igt_assert(epoll_ctl(collector->epoll_fd, EPOLL_CTL_ADD,
+				     fds[i], &ev) == 0);
+	}
+
+	return collector;
+}
+
+/**
+ * igt_pipe_crc_collector_new:
+ * @pipe_crcs: pipe CRC objects to collect from
+ * @n_pipes: number of pipe CRC objects in @pipe_crcs
+ * @max_tuples: maximum number of CRC tuples to collect
+ *
+ * Sets up collecting CRCs from all of @pipe_crcs at once, which must have
+ * been started with igt_pipe_crc_start(), and stay so until the collector
+ * is freed with igt_crc_collector_free().
+ *
+ * This is a lot cheaper than gathering the CRCs pipe by pipe with
+ * igt_pipe_crc_get_crcs() in tests using several pipes: a single epoll
+ * wait covers all the pipes, and the CRCs are stored in arrays sized
+ * for @max_tuples up front.
+ *
+ * Returns: A CRC collector to pass to igt_crc_collector_collect().
+ */
+igt_crc_collector_t *
+igt_pipe_crc_collector_new(igt_pipe_crc_t **pipe_crcs, int n_pipes,
+			   int max_tuples)
+{
+	igt_crc_collector_t *collector;
+	int fds[n_pipes];
+	int i;
+
+	for (i = 0; i < n_pipes; i++) {
+		igt_assert(pipe_crcs[i]->crc_fd != -1);
+		fds[i] = pipe_crcs[i]->crc_fd;
+	}
+
+	collector = igt_crc_collector_new(fds, n_pipes, max_tuples);
+
+	collector->pipe_crcs = malloc(n_pipes * sizeof(*pipe_crcs));
+	igt_assert(collector->pipe_crcs);
+	memcpy(collector->pipe_crcs, pipe_crcs, n_pipes * sizeof(*pipe_crcs));
+
+	return collector;
+}
+
+/**
+ * igt_crc_collector_free:
+ * @collector: CRC collector
+ *
+ * Frees all resources associated with @collector.
+ */
+void igt_crc_collector_free(igt_crc_collector_t *collector)
+{
+	if (!collector)
+		return;
+
+	close(collector->epoll_fd);
+	free(collector->sources);
+	free(collector->pipe_crcs);
+	free(collector->crcs);
+	free(collector->filled);
+	free(collector->tuples);
+	free(collector);
+}
+
+static void collector_resolve(igt_crc_collector_t *collector)
+{
+	int i, next = collector->max_tuples;
+
+	/* A slot can't be filled anymore once every source is past it */
+	for (i = 0; i < collector->n_sources; i++) {
+		const struct crc_source *src = &collector->sources[i];
+
+		if (!src->eof && src->next_slot < next)
+			next = src->next_slot;
+	}
+
+	for (; collector->resolved < next; collector->resolved++) {
+		int slot = collector->resolved;
+
+		if (collector->filled[slot] == collector->n_sources)
+			collector->tuples[collector->n_tuples++] = slot;
+		else
+			igt_debug("Dropping incomplete CRC tuple %d (%d/%d CRCs)\n",
+				  slot, collector->filled[slot],
+				  collector->n_sources);
+	}
+}
+
+static void collector_add(igt_crc_collector_t *collector, int idx,
+			  const igt_crc_t *crc)
+{
+	struct crc_source *src = &collector->sources[idx];
+	int slot = src->next_slot;
+
+	if (crc->has_valid_frame) {
+		if (!src->has_base) {
+			src->base_frame = crc->frame;
+			src->has_base = true;
+		}
+
+		/* Frames missed by the source leave holes in its tuples */
+		slot = (int32_t)(crc->frame - src->base_frame);
+		if (slot < src->next_slot) {
+			igt_debug("Ignoring CRC for frame %u out of order on source %d\n",
+				  crc->frame, idx);
+			return;
+		}
+	}
+
+	if (slot >= collector->max_tuples) {
+		src->next_slot = collector->max_tuples;
+		return;
+	}
+
+	if (collector->pipe_crcs)
+		crc_sanity_checks(collector->pipe_crcs[idx], (igt_crc_t *)crc);
+
+	collector->crcs[(size_t)slot * collector->n_sources + idx] = *crc;
+	collector->filled[slot]++;
+	src->next_slot = slot + 1;
+}
+
+/* Reads a batch of CRC lines from the source and parses all complete ones */
+static void collector_read(igt_crc_collector_t *collector, int idx)
+{
+	struct crc_source *src = &collector->sources[idx];
+	const char *line, *nl, *end;
+	ssize_t ret;
+
+	ret = read(src->fd, src->buf + src->len, sizeof(src->buf) - src->len);
+	if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+
+	if (ret <= 0) {
+		if (ret < 0)
+			igt_debug("Reading CRCs from source %d failed: %m\n", idx);
+		src->eof = true;
+		epoll_ctl(collector->epoll_fd, EPOLL_CTL_DEL, src->fd, NULL);
+		return;
+	}
+
+	src->len += ret;
+	end = src->buf + src->len;
+
+	for (line = src->buf; (nl = memchr(line, '\n', end - line)); line = nl + 1) {
+		igt_crc_t crc;
+
+		if (parse_crc_line(&crc, line, nl))
+			collector_add(collector, idx, &crc);
+		else
+			igt_debug("Ignoring malformed CRC line on source %d: %.*s\n",
+				  idx, (int)(nl - line), line);
+	}
+
+	src->len = end - line;
+	if (src->len == sizeof(src->buf)) {
+		igt_debug("Discarding overlong CRC line on source %d\n", idx);
+		src->len = 0;
+	}
+	memmove(src->buf, line, src->len);
+}
+
+/**
+ * igt_crc_collector_collect:
+ * @collector: CRC collector
+ * @n_tuples: number of CRC tuples to wait for
+ * @timeout_ms: how long to wait for them at most, -1 to wait forever and 0
+ * to only take the CRCs already available
+ *
+ * Collects CRCs from all the sources of @collector until @n_tuples frame
+ * aligned tuples are complete. Tuple N holds the CRC of each source for
+ * the Nth frame since the first CRC that source delivered, so frames
+ * missed by any of them are skipped. CRCs without a valid frame counter
+ * are aligned by their order of arrival instead.
+ *
+ * This can be called repeatedly to keep collecting until the @max_tuples
+ * passed when creating @collector are used up.
+ *
+ * Returns: The number of complete tuples collected so far, which is less
+ * than @n_tuples if the sources ran dry, missed frames or the timeout
+ * expired.
+ */
+int igt_crc_collector_collect(igt_crc_collector_t *collector, int n_tuples,
+			      int timeout_ms)
+{
+	struct epoll_event events[16];
+	struct timespec start = {};
+	int i, n;
+
+	igt_gettime(&start);
+
+	if (n_tuples > collector->max_tuples)
+		n_tuples = collector->max_tuples;
+
+	while (collector->n_tuples < n_tuples &&
+	       collector->resolved < collector->max_tuples) {
+		int timeout = timeout_ms;
+
+		if (timeout_ms > 0) {
+			uint64_t elapsed = igt_nsec_elapsed(&start) / 1000000;
+
+			if (elapsed >= timeout_ms)
+				break;
+			timeout = timeout_ms - elapsed;
+		}
+
+		n = epoll_wait(collector->epoll_fd, events,
+			       ARRAY_SIZE(events), timeout);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+
+		for (i = 0; i < n; i++)
+			collector_read(collector, events[i].data.u32);
+
+		collector_resolve(collector);
+	}
+
+	return collector->n_tuples;
+}
+
+/**
+ * igt_crc_collector_get_tuple:
+ * @collector: CRC collector
+ * @index: index of the tuple, less than what igt_crc_collector_collect()
+ * returned
+ *
+ * Returns: An array of one CRC for each source of @collector, in the order
+ * the sources were passed in, all for the same frame.
+ */
+const igt_crc_t *
+igt_crc_collector_get_tuple(igt_crc_collector_t *collector, int index)
+{
+	igt_assert(index >= 0 && index < collector->n_tuples);
+
+	return &collector->crcs[(size_t)collector->tuples[index] *
+				collector->n_sources];
+}
@@ -19,6 +19,14 @@ enum pipe;
  */
 typedef struct _igt_pipe_crc igt_pipe_crc_t;
 
+/**
+ * igt_crc_collector_t:
+ *
+ * Collects frame aligned CRCs from several pipes at once. Needs to be set up
+ * with igt_pipe_crc_collector_new() for a set of started pipe CRC objects.
+ */
+typedef struct _igt_crc_collector igt_crc_collector_t;
+
 #define DRM_MAX_CRC_NR 10
 /**
  * igt_crc_t:
@@ -65,4 +73,15 @@ void igt_pipe_crc_get_for_frame(int drm_fd, igt_pipe_crc_t *pipe_crc,
 
 void igt_pipe_crc_collect_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out_crc);
 
+igt_crc_collector_t *
+igt_crc_collector_new(const int *fds, int n_fds, int max_tuples);
+igt_crc_collector_t *
+igt_pipe_crc_collector_new(igt_pipe_crc_t **pipe_crcs, int n_pipes,
+			   int max_tuples);
+void igt_crc_collector_free(igt_crc_collector_t *collector);
+int igt_crc_collector_collect(igt_crc_collector_t *collector, int n_tuples,
+			      int timeout_ms);
+const igt_crc_t *
+igt_crc_collector_get_tuple(igt_crc_collector_t *collector, int index);
+
 #endif /* __IGT_PIPE_CRC_H__ */
@@ -23,6 +23,8 @@
  */
 
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -64,6 +66,31 @@
  *
  *	igt_stats_fini(&stats);
  * ]|
+ *
+ * By default every pushed sample is kept, so that quantiles are exact. For
+ * long running measurements where that is not affordable, an #igt_stats_t
+ * initialized with igt_stats_init_sketch() only keeps a log-linear histogram
+ * of the samples: pushing is O(1), memory usage is bounded and quantiles are
+ * approximated to within the requested relative precision. Sketches (e.g. one
+ * per thread) can be combined with igt_stats_merge().
+ *
+ * Pushing into an #igt_stats_t is not thread-safe. Multi-threaded benchmarks
+ * can instead record into an #igt_stats_collector, which hands each thread
+ * its own private #igt_stats_t, and merge everything once done:
+ *
+ * |[
+ *	collector = igt_stats_collector_create(7);
+ *
+ *	// in each worker thread
+ *	igt_stats_t *local = igt_stats_collector_local(collector);
+ *	while (!done)
+ *		igt_stats_push(local, measure());
+ *
+ *	// once all workers are joined
+ *	igt_stats_init_sketch(&stats, 7);
+ *	igt_stats_collector_merge(collector, &stats);
+ *	igt_stats_collector_destroy(collector);
+ * ]|
  */
 
 static unsigned int get_new_capacity(int need)
@@ -83,6 +110,9 @@ static void igt_stats_ensure_capacity(igt_stats_t *stats,
 	unsigned int new_n_values = stats->n_values + n_additional_values;
 	unsigned int new_capacity;
 
+	if (stats->is_sketch)
+		return;
+
 	if (new_n_values <= stats->capacity)
 		return;
 
@@ -137,6 +167,77 @@ void igt_stats_init_with_size(igt_stats_t *stats, unsigned int capacity)
 	stats->range[1] = -HUGE_VAL;
 }
 
+/*
+ * The sketch is a log-linear histogram (as popularised by HdrHistogram):
+ * values below 2^precision get a bucket each, above that every power of two
+ * is split into 2^precision linear sub-buckets. The bucket of a value thus
+ * spans at most value / 2^precision.
+ */
+static unsigned int sketch_index(unsigned int precision, uint64_t value)
+{
+	unsigned int msb;
+
+	if (value < 1ull << precision)
+		return value;
+
+	msb = 63 - __builtin_clzll(value);
+	return (msb - precision + 1) << precision |
+		((value >> (msb - precision)) & ((1u << precision) - 1));
+}
+
+static uint64_t sketch_bucket_low(unsigned int precision, unsigned int idx)
+{
+	unsigned int group = idx >> precision;
+	uint64_t sub = idx & ((1u << precision) - 1);
+
+	if (!group)
+		return sub;
+
+	return ((1ull << precision) | sub) << (group - 1);
+}
+
+static uint64_t sketch_bucket_width(unsigned int precision, unsigned int idx)
+{
+	unsigned int group = idx >> precision;
+
+	return group ? 1ull << (group - 1) : 1;
+}
+
+/**
+ * igt_stats_init_sketch:
+ * @stats: An #igt_stats_t instance
+ * @precision: Number of significant bits to keep for each sample, 1 to 12
+ *
+ * Like igt_stats_init() but instead of storing every sample, @stats only
+ * keeps a histogram of the values. Quantile based results (median, quartiles,
+ * IQR, IQM, trimean) are then approximations with a relative error below
+ * 2^-@precision, while min, max, mean and variance remain exact. Memory usage
+ * is fixed at init time, (65 - @precision) * 2^@precision counters, and
+ * pushing a value is O(1).
+ *
+ * Only integer samples are supported in this mode, and the array of pushed
+ * values is not available.
+ *
+ * igt_stats_fini() must be called once finished with @stats.
+ */
+void igt_stats_init_sketch(igt_stats_t *stats, unsigned int precision)
+{
+	igt_assert(precision >= 1 && precision <= 12);
+
+	memset(stats, 0, sizeof(*stats));
+
+	stats->is_sketch = true;
+	stats->sketch_precision = precision;
+	stats->n_buckets = (65 - precision) << precision;
+	stats->buckets = calloc(stats->n_buckets, sizeof(*stats->buckets));
+	igt_assert(stats->buckets);
+
+	stats->min = U64_MAX;
+	stats->max = 0;
+	stats->range[0] = HUGE_VAL;
+	stats->range[1] = -HUGE_VAL;
+}
+
 /**
  * igt_stats_fini:
  * @stats: An #igt_stats_t instance
@@ -147,6 +248,7 @@ void igt_stats_fini(igt_stats_t *stats)
 {
 	free(stats->values_u64);
 	free(stats->sorted_u64);
+	free(stats->buckets);
 }
 
 
@@ -207,6 +309,25 @@ void igt_stats_set_population(igt_stats_t *stats, bool full_population)
  */
 void igt_stats_push(igt_stats_t *stats, uint64_t value)
 {
+	if (stats->is_sketch) {
+		double delta = value - stats->mean;
+
+		stats->buckets[sketch_index(stats->sketch_precision, value)]++;
+		stats->n_values++;
+
+		/* Welford's online update, values are not kept around */
+		stats->mean += delta / stats->n_values;
+		stats->m2 += delta * (value - stats->mean);
+		stats->n_mean_values = stats->n_values;
+		stats->mean_variance_valid = false;
+
+		if (value < stats->min)
+			stats->min = value;
+		if (value > stats->max)
+			stats->max = value;
+		return;
+	}
+
 	if (stats->is_float) {
 		igt_stats_push_float(stats, value);
 		return;
@@ -232,9 +353,13 @@ void igt_stats_push(igt_stats_t *stats, uint64_t value)
  *
  * Adds a new value to the @stats dataset and converts the igt_stats from
  * an integer collection to a floating point one.
+ *
+ * Not supported by sketches, see igt_stats_init_sketch().
  */
 void igt_stats_push_float(igt_stats_t *stats, double value)
 {
+	igt_assert(!stats->is_sketch);
+
 	igt_stats_ensure_capacity(stats, 1);
 
 	if (!stats->is_float) {
@@ -276,6 +401,85 @@ void igt_stats_push_array(igt_stats_t *stats,
 		igt_stats_push(stats, values[i]);
 }
 
+static void igt_stats_knuth_mean_variance(igt_stats_t *stats);
+
+/*
+ * Combines two partial mean/M2 pairs, see Chan et al. "Updating Formulae and
+ * a Pairwise Algorithm for Computing Sample Variances" (1979).
+ */
+static void merge_mean_m2(double *mean, double *m2, double n,
+			  double other_mean, double other_m2, double other_n)
+{
+	double delta = other_mean - *mean;
+	double total = n + other_n;
+
+	if (!other_n)
+		return;
+
+	*mean += delta * other_n / total;
+	*m2 += other_m2 + delta * delta * n * other_n / total;
+}
+
+/**
+ * igt_stats_merge:
+ * @stats: An #igt_stats_t instance
+ * @other: An #igt_stats_t instance to add to @stats
+ *
+ * Adds all the values of @other to the @stats dataset, @other is left
+ * untouched. Typically used to combine the results of per-thread
+ * #igt_stats_t once the measurement is over.
+ *
+ * A sketch (see igt_stats_init_sketch()) can be merged into another sketch of
+ * the same precision, which is a O(number of buckets) operation, and an exact
+ * integer dataset can be merged into a sketch. A sketch cannot be merged into
+ * an exact dataset.
+ */
+void igt_stats_merge(igt_stats_t *stats, igt_stats_t *other)
+{
+	unsigned int i;
+
+	igt_assert_f(!other->is_sketch || stats->is_sketch,
+		     "cannot merge a sketch into an exact dataset\n");
+
+	if (!other->is_sketch) {
+		if (stats->is_sketch)
+			igt_assert(!other->is_float);
+
+		/* bring both running mean/M2 up to date before combining them */
+		igt_stats_knuth_mean_variance(stats);
+		igt_stats_knuth_mean_variance(other);
+
+		igt_stats_ensure_capacity(stats, other->n_values);
+		for (i = 0; i < other->n_values; i++) {
+			if (other->is_float)
+				igt_stats_push_float(stats, other->values_f[i]);
+			else
+				igt_stats_push(stats, other->values_u64[i]);
+		}
+
+		/* a sketch already accounted for the values in push() */
+		if (stats->is_sketch)
+			return;
+	} else {
+		igt_assert_eq(stats->sketch_precision, other->sketch_precision);
+
+		for (i = 0; i < stats->n_buckets; i++)
+			stats->buckets[i] += other->buckets[i];
+
+		stats->n_values += other->n_values;
+	}
+
+	merge_mean_m2(&stats->mean, &stats->m2, stats->n_mean_values,
+		      other->mean, other->m2, other->n_mean_values);
+	stats->n_mean_values = stats->n_values;
+	stats->mean_variance_valid = false;
+
+	if (other->min < stats->min)
+		stats->min = other->min;
+	if (other->max > stats->max)
+		stats->max = other->max;
+}
+
 /**
  * igt_stats_get_min:
  * @stats: An #igt_stats_t instance
@@ -364,6 +568,102 @@ static void igt_stats_ensure_sorted_values(igt_stats_t *stats)
 	stats->sorted_array_valid = true;
 }
 
+/*
+ * Value of the sample of the given rank (0 based) in the sorted sketch.
+ * Within a bucket, samples are assumed to be evenly spread.
+ */
+static double sketch_value_at(igt_stats_t *stats, uint64_t rank)
+{
+	unsigned int precision = stats->sketch_precision;
+	unsigned int first = sketch_index(precision, stats->min);
+	unsigned int last = sketch_index(precision, stats->max);
+	uint64_t seen = 0;
+	unsigned int i;
+
+	if (rank == 0)
+		return stats->min;
+	if (rank >= stats->n_values - 1)
+		return stats->max;
+
+	for (i = first; i <= last; i++) {
+		uint64_t count = stats->buckets[i];
+		uint64_t width;
+		double value;
+
+		if (rank >= seen + count) {
+			seen += count;
+			continue;
+		}
+
+		width = sketch_bucket_width(precision, i);
+		if (width == 1)
+			return sketch_bucket_low(precision, i);
+
+		value = sketch_bucket_low(precision, i) +
+			width * (rank - seen + .5) / count;
+		if (value < stats->min)
+			value = stats->min;
+		if (value > stats->max)
+			value = stats->max;
+
+		return value;
+	}
+
+	return stats->max;
+}
+
+static double sketch_quantile(igt_stats_t *stats, double q)
+{
+	double rank = q * (stats->n_values - 1);
+	uint64_t lo = floor(rank);
+	double v = sketch_value_at(stats, lo);
+
+	if (rank > lo)
+		v += (rank - lo) * (sketch_value_at(stats, lo + 1) - v);
+
+	return v;
+}
+
+/*
+ * Mean of the samples of rank [start, end), each bucket contributing its
+ * midpoint (clamped to the dataset range) for the overlapping samples.
+ */
+static double sketch_mean_between(igt_stats_t *stats,
+				  uint64_t start, uint64_t end)
+{
+	unsigned int precision = stats->sketch_precision;
+	unsigned int first = sketch_index(precision, stats->min);
+	unsigned int last = sketch_index(precision, stats->max);
+	uint64_t seen = 0;
+	double sum = 0.;
+	unsigned int i;
+
+	if (start >= end)
+		return 0.;
+
+	for (i = first; i <= last && seen < end; i++) {
+		uint64_t count = stats->buckets[i];
+		uint64_t lo = seen > start ? seen : start;
+		uint64_t hi = seen + count < end ? seen + count : end;
+		double mid;
+
+		seen += count;
+		if (lo >= hi)
+			continue;
+
+		mid = sketch_bucket_low(precision, i) +
+			(sketch_bucket_width(precision, i) - 1) / 2.;
+		if (mid < stats->min)
+			mid = stats->min;
+		if (mid > stats->max)
+			mid = stats->max;
+
+		sum += mid * (hi - lo);
+	}
+
+	return sum / (end - start);
+}
+
 /*
  * We use Tukey's hinge for our quartiles determination.
  * ends (end, lower_end) are exclusive.
@@ -436,6 +736,16 @@ void igt_stats_get_quartiles(igt_stats_t *stats,
 		return;
 	}
 
+	if (stats->is_sketch) {
+		if (q1)
+			*q1 = sketch_quantile(stats, .25);
+		if (q2)
+			*q2 = sketch_quantile(stats, .5);
+		if (q3)
+			*q3 = sketch_quantile(stats, .75);
+		return;
+	}
+
 	ret = igt_stats_get_median_internal(stats, 0, stats->n_values,
 					    &lower_end, &upper_start);
 	if (q2)
@@ -475,10 +785,48 @@ double igt_stats_get_iqr(igt_stats_t *stats)
  */
 double igt_stats_get_median(igt_stats_t *stats)
 {
+	if (stats->is_sketch)
+		return stats->n_values ? sketch_quantile(stats, .5) : 0.;
+
 	return igt_stats_get_median_internal(stats, 0, stats->n_values,
 					     NULL, NULL);
 }
 
+/**
+ * igt_stats_get_quantile:
+ * @stats: An #igt_stats_t instance
+ * @q: The quantile to retrieve, between 0 and 1
+ *
+ * Retrieves the @q quantile of the @stats dataset, e.g. 0.99 for the 99th
+ * percentile, linearly interpolating between the two closest data points.
+ *
+ * Returns 0 for an empty dataset.
+ */
+double igt_stats_get_quantile(igt_stats_t *stats, double q)
+{
+	double rank;
+	unsigned int lo;
+	double v;
+
+	igt_assert(q >= 0. && q <= 1.);
+
+	if (!stats->n_values)
+		return 0.;
+
+	if (stats->is_sketch)
+		return sketch_quantile(stats, q);
+
+	igt_stats_ensure_sorted_values(stats);
+
+	rank = q * (stats->n_values - 1);
+	lo = floor(rank);
+	v = sorted_value(stats, lo);
+	if (rank > lo)
+		v += (rank - lo) * (sorted_value(stats, lo + 1) - v);
+
+	return v;
+}
+
 /*
  * Algorithm popularised by Knuth in:
  *
@@ -489,13 +837,18 @@ double igt_stats_get_median(igt_stats_t *stats)
  */
 static void igt_stats_knuth_mean_variance(igt_stats_t *stats)
 {
-	double mean = 0., m2 = 0.;
+	double mean = stats->mean, m2 = stats->m2;
 	unsigned int i;
 
 	if (stats->mean_variance_valid)
 		return;
 
-	for (i = 0; i < stats->n_values; i++) {
+	/*
+	 * The running mean and M2 are kept between calls so that only the
+	 * values pushed since are folded in (sketches do it at push() time
+	 * already), and so that datasets can be merged without another pass.
+	 */
+	for (i = stats->n_mean_values; i < stats->n_values; i++) {
 		double delta = unsorted_value(stats, i) - mean;
 
 		mean += delta / (i + 1);
@@ -503,6 +856,8 @@ static void igt_stats_knuth_mean_variance(igt_stats_t *stats)
 	}
 
 	stats->mean = mean;
+	stats->m2 = m2;
+	stats->n_mean_values = stats->n_values;
 	if (stats->n_values > 1 && !stats->is_population)
 		stats->variance = m2 / (stats->n_values - 1);
 	else
@@ -579,6 +934,11 @@ double igt_stats_get_iqm(igt_stats_t *stats)
 	unsigned int q1, q3, i;
 	double mean;
 
+	if (stats->is_sketch)
+		return sketch_mean_between(stats,
+					   stats->n_values / 4,
+					   stats->n_values - stats->n_values / 4);
+
 	igt_stats_ensure_sorted_values(stats);
 
 	q1 = (stats->n_values + 3) / 4;
@@ -671,3 +1031,173 @@ double igt_mean_get_variance(struct igt_mean *m)
 	return m->sq / m->count;
 }
 
+
+/**
+ * igt_mean_merge:
+ * @m: tracking structure
+ * @other: tracking structure to add to @m
+ *
+ * Adds all the values tracked by @other to @m, as if they had been passed to
+ * igt_mean_add() on @m. Used to combine per-thread #igt_mean.
+ */
+void igt_mean_merge(struct igt_mean *m, const struct igt_mean *other)
+{
+	merge_mean_m2(&m->mean, &m->sq, m->count,
+		      other->mean, other->sq, other->count);
+	m->count += other->count;
+	if (other->min < m->min)
+		m->min = other->min;
+	if (other->max > m->max)
+		m->max = other->max;
+}
+
+struct igt_stats_shard {
+	struct igt_stats_shard *next;
+	pthread_t owner;
+	igt_stats_t stats;
+};
+
+/**
+ * igt_stats_collector:
+ *
+ * Opaque structure gathering samples from several threads, each thread
+ * pushing into its own #igt_stats_t without any locking. Created with
+ * igt_stats_collector_create().
+ */
+struct igt_stats_collector {
+	/* push-only list, entries are never unlinked until destroy */
+	_Atomic(struct igt_stats_shard *) shards;
+	unsigned int precision;
+	uint64_t id;
+};
+
+static _Atomic(uint64_t) collector_id;
+
+/* one entry cache of the calling thread's shard, keyed by the unique id */
+static __thread struct {
+	uint64_t id;
+	igt_stats_t *stats;
+} local_shard;
+
+/**
+ * igt_stats_collector_create:
+ * @precision: 0 to keep every sample, else the precision of the per-thread
+ *	       sketches (see igt_stats_init_sketch())
+ *
+ * Creates a collector, see igt_stats_collector_local() and
+ * igt_stats_collector_merge(). Must be freed with
+ * igt_stats_collector_destroy().
+ *
+ * Returns: the new collector.
+ */
+struct igt_stats_collector *igt_stats_collector_create(unsigned int precision)
+{
+	struct igt_stats_collector *collector;
+
+	collector = calloc(1, sizeof(*collector));
+	igt_assert(collector);
+
+	collector->precision = precision;
+	collector->id = atomic_fetch_add(&collector_id, 1) + 1;
+
+	return collector;
+}
+
+/**
+ * igt_stats_collector_destroy:
+ * @collector: An #igt_stats_collector instance
+ *
+ * Frees @collector and all of the per-thread datasets. Any #igt_stats_t
+ * returned by igt_stats_collector_local() is invalid afterwards.
+ */
+void igt_stats_collector_destroy(struct igt_stats_collector *collector)
+{
+	struct igt_stats_shard *shard, *next;
+
+	for (shard = atomic_load(&collector->shards); shard; shard = next) {
+		next = shard->next;
+		igt_stats_fini(&shard->stats);
+		free(shard);
+	}
+
+	free(collector);
+}
+
+/**
+ * igt_stats_collector_local:
+ * @collector: An #igt_stats_collector instance
+ *
+ * Retrieves the dataset private to the calling thread, creating it on first
+ * use. The calling thread may push into it with the usual igt_stats_push()
+ * at no extra cost; no other thread must touch it until
+ * igt_stats_collector_merge().
+ *
+ * Returns: the calling thread's #igt_stats_t for @collector.
+ */
+igt_stats_t *igt_stats_collector_local(struct igt_stats_collector *collector)
+{
+	pthread_t self = pthread_self();
+	struct igt_stats_shard *shard, *head;
+
+	if (local_shard.id == collector->id)
+		return local_shard.stats;
+
+	head = atomic_load_explicit(&collector->shards, memory_order_acquire);
+	for (shard = head; shard; shard = shard->next)
+		if (pthread_equal(shard->owner, self))
+			goto out;
+
+	shard = calloc(1, sizeof(*shard));
+	igt_assert(shard);
+
+	shard->owner = self;
+	if (collector->precision)
+		igt_stats_init_sketch(&shard->stats, collector->precision);
+	else
+		igt_stats_init(&shard->stats);
+
+	do
+		shard->next = head;
+	while (!atomic_compare_exchange_weak_explicit(&collector->shards,
+						      &head, shard,
+						      memory_order_release,
+						      memory_order_acquire));
+
+out:
+	local_shard.id = collector->id;
+	local_shard.stats = &shard->stats;
+
+	return &shard->stats;
+}
+
+/**
+ * igt_stats_collector_push:
+ * @collector: An #igt_stats_collector instance
+ * @value: An integer value
+ *
+ * Thread-safe equivalent of igt_stats_push(), adding @value to the calling
+ * thread's dataset of @collector.
+ */
+void igt_stats_collector_push(struct igt_stats_collector *collector,
+			      uint64_t value)
+{
+	igt_stats_push(igt_stats_collector_local(collector), value);
+}
+
+/**
+ * igt_stats_collector_merge:
+ * @collector: An #igt_stats_collector instance
+ * @stats: An initialized #igt_stats_t instance
+ *
+ * Adds the values of every per-thread dataset of @collector to @stats, see
+ * igt_stats_merge(). Must only be called once the threads have stopped
+ * pushing, e.g. after they have been joined.
+ */
+void igt_stats_collector_merge(struct igt_stats_collector *collector,
+			       igt_stats_t *stats)
+{
+	struct igt_stats_shard *shard;
+
+	for (shard = atomic_load(&collector->shards); shard; shard = shard->next)
+		igt_stats_merge(stats, &shard->stats);
+}
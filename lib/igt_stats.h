@@ -58,10 +58,21 @@ typedef struct {
 		uint64_t *sorted_u64;
 		double *sorted_f;
 	};
+
+	/* sketch mode, see igt_stats_init_sketch() */
+	unsigned int is_sketch : 1;
+	unsigned int sketch_precision;
+	unsigned int n_buckets;
+	uint64_t *buckets;
+
+	/* running mean/M2 over the first n_mean_values samples */
+	unsigned int n_mean_values;
+	double m2;
 } igt_stats_t;
 
 void igt_stats_init(igt_stats_t *stats);
 void igt_stats_init_with_size(igt_stats_t *stats, unsigned int capacity);
+void igt_stats_init_sketch(igt_stats_t *stats, unsigned int precision);
 void igt_stats_fini(igt_stats_t *stats);
 bool igt_stats_is_population(igt_stats_t *stats);
 void igt_stats_set_population(igt_stats_t *stats, bool full_population);
@@ -69,6 +80,7 @@ void igt_stats_push(igt_stats_t *stats, uint64_t value);
 void igt_stats_push_float(igt_stats_t *stats, double value);
 void igt_stats_push_array(igt_stats_t *stats,
 			  const uint64_t *values, unsigned int n_values);
+void igt_stats_merge(igt_stats_t *stats, igt_stats_t *other);
 uint64_t igt_stats_get_min(igt_stats_t *stats);
 uint64_t igt_stats_get_max(igt_stats_t *stats);
 uint64_t igt_stats_get_range(igt_stats_t *stats);
@@ -79,6 +91,7 @@ double igt_stats_get_iqm(igt_stats_t *stats);
 double igt_stats_get_mean(igt_stats_t *stats);
 double igt_stats_get_trimean(igt_stats_t *stats);
 double igt_stats_get_median(igt_stats_t *stats);
+double igt_stats_get_quantile(igt_stats_t *stats, double q);
 double igt_stats_get_variance(igt_stats_t *stats);
 double igt_stats_get_std_deviation(igt_stats_t *stats);
 double igt_stats_get_std_error(igt_stats_t *stats);
@@ -100,5 +113,16 @@ void igt_mean_init(struct igt_mean *m);
 void igt_mean_add(struct igt_mean *m, double v);
 double igt_mean_get(struct igt_mean *m);
 double igt_mean_get_variance(struct igt_mean *m);
+void igt_mean_merge(struct igt_mean *m, const struct igt_mean *other);
+
+struct igt_stats_collector;
+
+struct igt_stats_collector *igt_stats_collector_create(unsigned int precision);
+void igt_stats_collector_destroy(struct igt_stats_collector *collector);
+igt_stats_t *igt_stats_collector_local(struct igt_stats_collector *collector);
+void igt_stats_collector_push(struct igt_stats_collector *collector,
+			      uint64_t value);
+void igt_stats_collector_merge(struct igt_stats_collector *collector,
+			       igt_stats_t *stats);
 
 #endif /* __IGT_STATS_H__ */
@@ -28,6 +28,8 @@
 #include <sys/sysmacros.h>
 #endif
 #include <sys/mount.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -59,6 +61,8 @@
  * provides basic support for like igt_sysfs_open().
  */
 
+static char sysfs_root[PATH_MAX] = "/sys";
+
 enum {
 	GT,
 	RPS,
@@ -147,6 +151,32 @@ const char *igt_sysfs_path_id_to_name(const char *path, enum i915_attr_id id)
 	return name;
 }
 
+/**
+ * igt_sysfs_set_root:
+ * @root: directory to use in place of /sys, or NULL to restore it
+ *
+ * Makes igt_sysfs_open() and the other helpers looking up device directories
+ * find them under @root, and igt_debugfs_mount() return @root/kernel/debug.
+ * This allows exercising the sysfs and debugfs helpers, e.g. in library
+ * tests and benchmarks, against a fake sysfs tree populated with regular
+ * files in a temporary directory.
+ */
+void igt_sysfs_set_root(const char *root)
+{
+	snprintf(sysfs_root, sizeof(sysfs_root), "%s", root ?: "/sys");
+}
+
+/**
+ * igt_sysfs_root:
+ *
+ * Returns:
+ * The directory set by igt_sysfs_set_root(), /sys by default.
+ */
+const char *igt_sysfs_root(void)
+{
+	return sysfs_root;
+}
+
 /**
  * igt_sysfs_has_attr:
  * @dir: sysfs directory fd
@@ -183,8 +213,8 @@ char *igt_sysfs_path(int device, char *path, int pathlen)
 	if (igt_debug_on(fstat(device, &st)) || igt_debug_on(!S_ISCHR(st.st_mode)))
 		return NULL;
 
-	snprintf(path, pathlen, "/sys/dev/char/%d:%d",
-		 major(st.st_rdev), minor(st.st_rdev));
+	snprintf(path, pathlen, "%s/dev/char/%d:%d",
+		 sysfs_root, major(st.st_rdev), minor(st.st_rdev));
 
 	if (igt_debug_on(access(path, F_OK)))
 		return NULL;
@@ -204,7 +234,7 @@ char *igt_sysfs_path(int device, char *path, int pathlen)
  */
 int igt_sysfs_open(int device)
 {
-	char path[80];
+	char path[PATH_MAX];
 
 	if (igt_debug_on(!igt_sysfs_path(device, path, sizeof(path))))
 		return -1;
@@ -233,11 +263,11 @@ char *xe_sysfs_gt_path(int xe_device, int gt, char *path, int pathlen)
 		return NULL;
 
 	if (IS_PONTEVECCHIO(intel_get_drm_devid(xe_device)))
-		snprintf(path, pathlen, "/sys/dev/char/%d:%d/device/tile%d/gt%d",
-			 major(st.st_rdev), minor(st.st_rdev), gt, gt);
+		snprintf(path, pathlen, "%s/dev/char/%d:%d/device/tile%d/gt%d",
+			 sysfs_root, major(st.st_rdev), minor(st.st_rdev), gt, gt);
 	else
-		snprintf(path, pathlen, "/sys/dev/char/%d:%d/device/tile0/gt%d",
-			 major(st.st_rdev), minor(st.st_rdev), gt);
+		snprintf(path, pathlen, "%s/dev/char/%d:%d/device/tile0/gt%d",
+			 sysfs_root, major(st.st_rdev), minor(st.st_rdev), gt);
 
 	if (!access(path, F_OK))
 		return path;
@@ -257,7 +287,7 @@ char *xe_sysfs_gt_path(int xe_device, int gt, char *path, int pathlen)
  */
 int xe_sysfs_gt_open(int xe_device, int gt)
 {
-	char path[96];
+	char path[PATH_MAX];
 
 	if (!xe_sysfs_gt_path(xe_device, gt, path, sizeof(path)))
 		return -1;
@@ -330,8 +360,8 @@ xe_sysfs_engine_path(int xe_device, int gt, int class, char *path, int pathlen)
 	if (igt_debug_on(fstat(xe_device, &st)) || igt_debug_on(!S_ISCHR(st.st_mode)))
 		return NULL;
 
-	snprintf(path, pathlen, "/sys/dev/char/%d:%d/device/tile%d/gt%d/engines/%s",
-		 major(st.st_rdev), minor(st.st_rdev), tile, gt, xe_engine_class_to_str(class));
+	snprintf(path, pathlen, "%s/dev/char/%d:%d/device/tile%d/gt%d/engines/%s",
+		 sysfs_root, major(st.st_rdev), minor(st.st_rdev), tile, gt, xe_engine_class_to_str(class));
 
 	if (!access(path, F_OK))
 		return path;
@@ -352,7 +382,7 @@ xe_sysfs_engine_path(int xe_device, int gt, int class, char *path, int pathlen)
  */
 int xe_sysfs_engine_open(int xe_device, int gt, int class)
 {
-	char path[96];
+	char path[PATH_MAX];
 
 	if (!xe_sysfs_engine_path(xe_device, gt, class, path, sizeof(path)))
 		return -1;
@@ -384,8 +414,8 @@ char *igt_sysfs_gt_path(int device, int gt, char *path, int pathlen)
 	if (igt_debug_on(fstat(device, &st)) || igt_debug_on(!S_ISCHR(st.st_mode)))
 		return NULL;
 
-	snprintf(path, pathlen, "/sys/dev/char/%d:%d/gt/gt%d",
-		 major(st.st_rdev), minor(st.st_rdev), gt);
+	snprintf(path, pathlen, "%s/dev/char/%d:%d/gt/gt%d",
+		 sysfs_root, major(st.st_rdev), minor(st.st_rdev), gt);
 
 	if (!access(path, F_OK))
 		return path;
@@ -407,7 +437,7 @@ char *igt_sysfs_gt_path(int device, int gt, char *path, int pathlen)
  */
 int igt_sysfs_gt_open(int device, int gt)
 {
-	char path[96];
+	char path[PATH_MAX];
 
 	if (!igt_sysfs_gt_path(device, gt, path, sizeof(path)))
 		return -1;
@@ -428,7 +458,7 @@ int igt_sysfs_gt_open(int device, int gt)
 int igt_sysfs_get_num_gt(int device)
 {
 	int num_gts = 0;
-	char path[96];
+	char path[PATH_MAX];
 
 	while (igt_sysfs_gt_path(device, num_gts, path, sizeof(path)))
 		++num_gts;
@@ -449,9 +479,10 @@ int igt_sysfs_get_num_gt(int device)
  */
 int igt_sysfs_drm_module_params_open(void)
 {
-	char path[] = "/sys/module/drm/parameters";
+	char path[PATH_MAX];
 
-	if (access(path, F_OK))
+	if (snprintf(path, sizeof(path), "%s/module/drm/parameters",
+		     sysfs_root) >= sizeof(path) || access(path, F_OK))
 		return -1;
 
 	return open(path, O_RDONLY);
@@ -1032,6 +1063,359 @@ void igt_sysfs_set_boolean(int dir, const char *attr, bool value)
 		     "Failed to write %u to %s attribute (%s)\n", value, attr, strerror(errno));
 }
 
+struct igt_sysfs_attr {
+	int fd;
+	/* A regular file standing in for the attribute, see igt_sysfs_set_root() */
+	bool truncate;
+	char name[];
+};
+
+/**
+ * igt_sysfs_attr_open:
+ * @dir: sysfs directory
+ * @attr: name of the sysfs node to open
+ *
+ * This opens the sysfs file once, for the igt_sysfs_attr_*() helpers to
+ * access it repeatedly through the returned handle. Each access then takes
+ * a single pread() or pwrite() at offset 0, instead of the open(), read() or
+ * write() and close() of igt_sysfs_get_u32() and friends. As sysfs samples
+ * the attribute afresh on every read from the start of the file, this suits
+ * polling frequencies and residencies in a loop.
+ *
+ * Returns:
+ * The handle, to be freed with igt_sysfs_attr_close(), or NULL on failure.
+ */
+struct igt_sysfs_attr *igt_sysfs_attr_open(int dir, const char *attr)
+{
+	struct igt_sysfs_attr *a;
+	struct statfs fs;
+	int fd;
+
+	/* Not all attributes are both readable and writable */
+	fd = openat(dir, attr, O_RDWR);
+	if (fd < 0 && errno == EACCES)
+		fd = openat(dir, attr, O_RDONLY);
+	if (fd < 0 && errno == EACCES)
+		fd = openat(dir, attr, O_WRONLY);
+	if (igt_debug_on(fd < 0))
+		return NULL;
+
+	a = malloc(sizeof(*a) + strlen(attr) + 1);
+	if (igt_debug_on(!a)) {
+		close(fd);
+		return NULL;
+	}
+
+	a->fd = fd;
+	a->truncate = !fstatfs(fd, &fs) && fs.f_type != SYSFS_MAGIC;
+	strcpy(a->name, attr);
+
+	return a;
+}
+
+/**
+ * igt_sysfs_attr_close:
+ * @attr: handle from igt_sysfs_attr_open()
+ *
+ * Closes the sysfs file and frees the handle.
+ */
+void igt_sysfs_attr_close(struct igt_sysfs_attr *attr)
+{
+	if (!attr)
+		return;
+
+	close(attr->fd);
+	free(attr);
+}
+
+/**
+ * igt_sysfs_attr_read:
+ * @attr: handle from igt_sysfs_attr_open()
+ * @data: the block to read into
+ * @len: the maximum length to read
+ *
+ * This reads up to @len bytes of the current value of the sysfs file to
+ * @data, with a single pread() from its start.
+ *
+ * Returns:
+ * The length read, -errno on failure.
+ */
+int igt_sysfs_attr_read(struct igt_sysfs_attr *attr, void *data, int len)
+{
+	ssize_t ret;
+
+	do {
+		ret = pread(attr->fd, data, len, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret < 0 ? -errno : ret;
+}
+
+/**
+ * igt_sysfs_attr_write:
+ * @attr: handle from igt_sysfs_attr_open()
+ * @data: the block to write from
+ * @len: the length to write
+ *
+ * This writes @len bytes from @data to the sysfs file, from its start. As
+ * with igt_sysfs_write(), no null char is added if len is 0.
+ *
+ * Returns:
+ * The number of bytes written, or -errno on error.
+ */
+int igt_sysfs_attr_write(struct igt_sysfs_attr *attr, const void *data, int len)
+{
+	ssize_t ret;
+
+	do {
+		ret = pwrite(attr->fd, data, len, 0);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0)
+		return -errno;
+
+	/* Don't leave the old value's tail in a file standing in for sysfs */
+	if (attr->truncate)
+		igt_ignore_warn(ftruncate(attr->fd, ret));
+
+	return ret;
+}
+
+/**
+ * igt_sysfs_attr_printf:
+ * @attr: handle from igt_sysfs_attr_open()
+ * @fmt: printf format string
+ * @...: Additional paramaters to store the scaned input values
+ *
+ * printf() wrapper for sysfs attribute handles, see igt_sysfs_printf().
+ *
+ * Returns:
+ * Number of characters written, negative value on error.
+ */
+int igt_sysfs_attr_printf(struct igt_sysfs_attr *attr, const char *fmt, ...)
+{
+	char stack[128], *buf = stack;
+	va_list ap;
+	int ret, len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(stack, sizeof(stack), fmt, ap);
+	va_end(ap);
+	if (igt_debug_on(len < 0))
+		return -EINVAL;
+
+	if (len >= sizeof(stack)) {
+		buf = malloc(len + 1);
+		if (igt_debug_on(!buf))
+			return -ENOMEM;
+
+		va_start(ap, fmt);
+		vsnprintf(buf, len + 1, fmt, ap);
+		va_end(ap);
+	}
+
+	/* Always issue a write, the null char if nothing else */
+	ret = igt_sysfs_attr_write(attr, buf, len ?: 1);
+	if (!len && ret == 1)
+		ret = 0;
+
+	if (buf != stack)
+		free(buf);
+
+	return ret;
+}
+
+/**
+ * __igt_sysfs_attr_get_u64:
+ * @attr: handle from igt_sysfs_attr_open()
+ * @value: pointer for storing read value
+ *
+ * Convenience wrapper to read a unsigned 64bit integer through a sysfs
+ * attribute handle.
+ *
+ * Returns:
+ * True if value successfully read, false otherwise.
+ */
+bool __igt_sysfs_attr_get_u64(struct igt_sysfs_attr *attr, uint64_t *value)
+{
+	char buf[32], *end;
+	int len;
+
+	len = igt_sysfs_attr_read(attr, buf, sizeof(buf) - 1);
+	if (igt_debug_on(len <= 0))
+		return false;
+	buf[len] = '\0';
+
+	*value = strtoull(buf, &end, 10);
+	if (igt_debug_on(end == buf))
+		return false;
+
+	return true;
+}
+
+/**
+ * igt_sysfs_attr_get_u64:
+ * @attr: handle from igt_sysfs_attr_open()
+ *
+ * Convenience wrapper to read a unsigned 64bit integer through a sysfs
+ * attribute handle. It asserts on failure.
+ *
+ * Returns:
+ * Read value.
+ */
+uint64_t igt_sysfs_attr_get_u64(struct igt_sysfs_attr *attr)
+{
+	uint64_t value;
+
+	igt_assert_f(__igt_sysfs_attr_get_u64(attr, &value),
+		     "Failed to read %s attribute (%s)\n", attr->name, strerror(errno));
+
+	return value;
+}
+
+/**
+ * __igt_sysfs_attr_get_u32:
+ * @attr: handle from igt_sysfs_attr_open()
+ * @value: pointer for storing read value
+ *
+ * Convenience wrapper to read a unsigned 32bit integer through a sysfs
+ * attribute handle.
+ *
+ * Returns:
+ * True if value successfully read, false otherwise.
+ */
+bool __igt_sysfs_attr_get_u32(struct igt_sysfs_attr *attr, uint32_t *value)
+{
+	uint64_t v;
+
+	if (!__igt_sysfs_attr_get_u64(attr, &v) || igt_debug_on(v > UINT32_MAX))
+		return false;
+
+	*value = v;
+	return true;
+}
+
+/**
+ * igt_sysfs_attr_get_u32:
+ * @attr: handle from igt_sysfs_attr_open()
+ *
+ * Convenience wrapper to read a unsigned 32bit integer through a sysfs
+ * attribute handle. It asserts on failure.
+ *
+ * Returns:
+ * Read value.
+ */
+uint32_t igt_sysfs_attr_get_u32(struct igt_sysfs_attr *attr)
+{
+	uint32_t value;
+
+	igt_assert_f(__igt_sysfs_attr_get_u32(attr, &value),
+		     "Failed to read %s attribute (%s)\n", attr->name, strerror(errno));
+
+	return value;
+}
+
+/**
+ * __igt_sysfs_attr_set_u64:
+ * @attr: handle from igt_sysfs_attr_open()
+ * @value: value to set
+ *
+ * Convenience wrapper to write a unsigned 64bit integer through a sysfs
+ * attribute handle.
+ *
+ * Returns:
+ * True if successfully written, false otherwise.
+ */
+bool __igt_sysfs_attr_set_u64(struct igt_sysfs_attr *attr, uint64_t value)
+{
+	return igt_sysfs_attr_printf(attr, "%"PRIu64, value) > 0;
+}
+
+/**
+ * igt_sysfs_attr_set_u64:
+ * @attr: handle from igt_sysfs_attr_open()
+ * @value: value to set
+ *
+ * Convenience wrapper to write a unsigned 64bit integer through a sysfs
+ * attribute handle. It asserts on failure.
+ */
+void igt_sysfs_attr_set_u64(struct igt_sysfs_attr *attr, uint64_t value)
+{
+	igt_assert_f(__igt_sysfs_attr_set_u64(attr, value),
+		     "Failed to write %"PRIu64" to %s attribute (%s)\n",
+		     value, attr->name, strerror(errno));
+}
+
+/**
+ * __igt_sysfs_attr_set_u32:
+ * @attr: handle from igt_sysfs_attr_open()
+ * @value: value to set
+ *
+ * Convenience wrapper to write a unsigned 32bit integer through a sysfs
+ * attribute handle.
+ *
+ * Returns:
+ * True if successfully written, false otherwise.
+ */
+bool __igt_sysfs_attr_set_u32(struct igt_sysfs_attr *attr, uint32_t value)
+{
+	return igt_sysfs_attr_printf(attr, "%u", value) > 0;
+}
+
+/**
+ * igt_sysfs_attr_set_u32:
+ * @attr: handle from igt_sysfs_attr_open()
+ * @value: value to set
+ *
+ * Convenience wrapper to write a unsigned 32bit integer through a sysfs
+ * attribute handle. It asserts on failure.
+ */
+void igt_sysfs_attr_set_u32(struct igt_sysfs_attr *attr, uint32_t value)
+{
+	igt_assert_f(__igt_sysfs_attr_set_u32(attr, value),
+		     "Failed to write %u to %s attribute (%s)\n",
+		     value, attr->name, strerror(errno));
+}
+
+/**
+ * __igt_sysfs_attr_get_u64_array:
+ * @attrs: handles from igt_sysfs_attr_open()
+ * @count: number of handles in @attrs
+ * @values: array for storing the @count read values
+ *
+ * Reads a set of related attributes, e.g. the rc6 residencies of a gt,
+ * back to back with one pread() each, so that the values are sampled as
+ * close together as possible.
+ *
+ * Returns:
+ * True if all values successfully read, false otherwise.
+ */
+bool __igt_sysfs_attr_get_u64_array(struct igt_sysfs_attr * const *attrs,
+				    int count, uint64_t *values)
+{
+	for (int i = 0; i < count; i++) {
+		if (!__igt_sysfs_attr_get_u64(attrs[i], &values[i]))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * igt_sysfs_attr_get_u64_array:
+ * @attrs: handles from igt_sysfs_attr_open()
+ * @count: number of handles in @attrs
+ * @values: array for storing the @count read values
+ *
+ * Reads a set of related attributes like __igt_sysfs_attr_get_u64_array().
+ * It asserts on failure.
+ */
+void igt_sysfs_attr_get_u64_array(struct igt_sysfs_attr * const *attrs,
+				  int count, uint64_t *values)
+{
+	for (int i = 0; i < count; i++)
+		values[i] = igt_sysfs_attr_get_u64(attrs[i]);
+}
+
 static void bind_con(const char *name, bool enable)
 {
 	const char *path = "/sys/class/vtconsole";
@@ -1310,8 +1694,8 @@ char *xe_sysfs_tile_path(int xe_device, int tile, char *path, int pathlen)
 	if (igt_debug_on(fstat(xe_device, &st)) || igt_debug_on(!S_ISCHR(st.st_mode)))
 		return NULL;
 
-	snprintf(path, pathlen, "/sys/dev/char/%d:%d/device/tile%d",
-		 major(st.st_rdev), minor(st.st_rdev), tile);
+	snprintf(path, pathlen, "%s/dev/char/%d:%d/device/tile%d",
+		 sysfs_root, major(st.st_rdev), minor(st.st_rdev), tile);
 
 	if (!access(path, F_OK))
 		return path;
@@ -1330,7 +1714,7 @@ char *xe_sysfs_tile_path(int xe_device, int tile, char *path, int pathlen)
  */
 int xe_sysfs_tile_open(int xe_device, int tile)
 {
-	char path[96];
+	char path[PATH_MAX];
 
 	if (!xe_sysfs_tile_path(xe_device, tile, path, sizeof(path)))
 		return -1;
@@ -1351,7 +1735,7 @@ int xe_sysfs_tile_open(int xe_device, int tile)
 int xe_sysfs_get_num_tiles(int xe_device)
 {
 	int num_tiles = 0;
-	char path[96];
+	char path[PATH_MAX];
 
 	while (xe_sysfs_tile_path(xe_device, num_tiles, path, sizeof(path)))
 		++num_tiles;
@@ -98,6 +98,9 @@ enum i915_attr_id {
 	SYSFS_NUM_ATTR,
 };
 
+void igt_sysfs_set_root(const char *root);
+const char *igt_sysfs_root(void);
+
 char *igt_sysfs_path(int device, char *path, int pathlen);
 int igt_sysfs_open(int device);
 char *igt_sysfs_gt_path(int device, int gt, char *path, int pathlen);
@@ -135,6 +138,31 @@ bool igt_sysfs_get_boolean(int dir, const char *attr);
 bool __igt_sysfs_set_boolean(int dir, const char *attr, bool value);
 void igt_sysfs_set_boolean(int dir, const char *attr, bool value);
 
+struct igt_sysfs_attr;
+
+struct igt_sysfs_attr *igt_sysfs_attr_open(int dir, const char *attr);
+void igt_sysfs_attr_close(struct igt_sysfs_attr *attr);
+
+int igt_sysfs_attr_read(struct igt_sysfs_attr *attr, void *data, int len);
+int igt_sysfs_attr_write(struct igt_sysfs_attr *attr, const void *data, int len);
+int igt_sysfs_attr_printf(struct igt_sysfs_attr *attr, const char *fmt, ...)
+	__attribute__((format(printf,2,3)));
+
+bool __igt_sysfs_attr_get_u32(struct igt_sysfs_attr *attr, uint32_t *value);
+uint32_t igt_sysfs_attr_get_u32(struct igt_sysfs_attr *attr);
+bool __igt_sysfs_attr_set_u32(struct igt_sysfs_attr *attr, uint32_t value);
+void igt_sysfs_attr_set_u32(struct igt_sysfs_attr *attr, uint32_t value);
+
+bool __igt_sysfs_attr_get_u64(struct igt_sysfs_attr *attr, uint64_t *value);
+uint64_t igt_sysfs_attr_get_u64(struct igt_sysfs_attr *attr);
+bool __igt_sysfs_attr_set_u64(struct igt_sysfs_attr *attr, uint64_t value);
+void igt_sysfs_attr_set_u64(struct igt_sysfs_attr *attr, uint64_t value);
+
+bool __igt_sysfs_attr_get_u64_array(struct igt_sysfs_attr * const *attrs,
+				    int count, uint64_t *values);
+void igt_sysfs_attr_get_u64_array(struct igt_sysfs_attr * const *attrs,
+				  int count, uint64_t *values);
+
 void bind_fbcon(bool enable);
 void fbcon_blink_enable(bool enable);
 
@@ -0,0 +1,545 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "igt_aux.h"
+#include "igt_core.h"
+#include "igt_thread.h"
+#include "igt_threadpool.h"
+
+/**
+ * SECTION:igt_threadpool
+ * @short_description: Pool of worker threads for CPU bound test setup
+ * @title: Thread pool
+ * @include: igt_threadpool.h
+ *
+ * A fixed set of worker threads to spread work like painting framebuffers or
+ * computing reference CRCs over all the CPUs. Tasks are submitted with
+ * igt_threadpool_submit() and their results collected with
+ * igt_future_wait(), or an index range is split across the workers with
+ * igt_threadpool_for().
+ *
+ * Each worker owns a deque of tasks. Tasks submitted from within a task go
+ * onto the bottom of the submitting worker's deque, where it picks them up
+ * again newest first, while idle workers steal the oldest tasks from the top
+ * of someone else's deque. A worker waiting on a future keeps running tasks
+ * in the meantime, so tasks may freely submit and wait on subtasks.
+ *
+ * Tasks may use igt_assert() and friends like any other thread: a failed
+ * assertion completes the task's future with a NULL result, a replacement
+ * worker takes over, and the failure is raised on the main thread by the
+ * next igt_future_wait() or igt_threadpool_for(), or at the end of the
+ * subtest otherwise. Once the test starts exiting no further tasks are run.
+ *
+ * The workers don't survive igt_fork(), so a pool used from a test child
+ * runs each task in the submitting thread instead.
+ */
+
+struct deque {
+	pthread_mutex_t lock;
+	struct igt_future **tasks;
+	/* Free running, masked with size - 1 */
+	unsigned int top, bottom, size;
+};
+
+struct worker {
+	struct igt_threadpool *pool;
+	struct deque deque;
+	unsigned int id;
+};
+
+struct igt_threadpool {
+	pthread_mutex_t lock;
+	pthread_cond_t work, done;
+	atomic_uint queued;
+	atomic_uint next;
+	unsigned int helpers, alive;
+	bool stop;
+
+	pid_t pid;
+	unsigned int nthreads;
+	struct worker workers[];
+};
+
+struct igt_future {
+	struct igt_threadpool *pool;
+	void *(*fn)(void *data);
+	void *data;
+	void *result;
+	atomic_bool done;
+};
+
+static __thread struct worker *self;
+static atomic_bool exiting;
+
+static bool deque_push(struct deque *d, struct igt_future *f)
+{
+	pthread_mutex_lock(&d->lock);
+
+	if (d->bottom - d->top == d->size) {
+		unsigned int size = d->size ? 2 * d->size : 64;
+		struct igt_future **tasks;
+
+		tasks = malloc(size * sizeof(*tasks));
+		if (!tasks) {
+			pthread_mutex_unlock(&d->lock);
+			return false;
+		}
+
+		for (unsigned int i = d->top; i != d->bottom; i++)
+			tasks[i & (size - 1)] = d->tasks[i & (d->size - 1)];
+
+		free(d->tasks);
+		d->tasks = tasks;
+		d->size = size;
+	}
+
+	d->tasks[d->bottom++ & (d->size - 1)] = f;
+
+	pthread_mutex_unlock(&d->lock);
+
+	return true;
+}
+
+static struct igt_future *deque_pop(struct deque *d)
+{
+	struct igt_future *f = NULL;
+
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom != d->top)
+		f = d->tasks[--d->bottom & (d->size - 1)];
+	pthread_mutex_unlock(&d->lock);
+
+	return f;
+}
+
+static struct igt_future *deque_steal(struct deque *d)
+{
+	struct igt_future *f = NULL;
+
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom != d->top)
+		f = d->tasks[d->top++ & (d->size - 1)];
+	pthread_mutex_unlock(&d->lock);
+
+	return f;
+}
+
+static struct worker *pool_worker(struct igt_threadpool *pool)
+{
+	return self && self->pool == pool ? self : NULL;
+}
+
+static bool has_work(struct igt_threadpool *pool)
+{
+	return atomic_load(&pool->queued) && !atomic_load(&exiting);
+}
+
+static struct igt_future *find_task(struct igt_threadpool *pool,
+				    struct worker *w)
+{
+	struct igt_future *f = NULL;
+
+	if (!has_work(pool))
+		return NULL;
+
+	f = deque_pop(&w->deque);
+	for (unsigned int i = 1; !f && i < pool->nthreads; i++)
+		f = deque_steal(&pool->workers[(w->id + i) % pool->nthreads].deque);
+
+	if (f)
+		atomic_fetch_sub(&pool->queued, 1);
+
+	return f;
+}
+
+static void complete(struct igt_future *f, void *result)
+{
+	struct igt_threadpool *pool = f->pool;
+
+	f->result = result;
+
+	/* The waiter may free the future as soon as it's done */
+	pthread_mutex_lock(&pool->lock);
+	atomic_store(&f->done, true);
+	pthread_cond_broadcast(&pool->done);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void task_exited(void *arg)
+{
+	complete(arg, NULL);
+}
+
+static void run_task(struct igt_future *f)
+{
+	void *result;
+
+	pthread_cleanup_push(task_exited, f);
+	result = f->fn(f->data);
+	pthread_cleanup_pop(0);
+
+	complete(f, result);
+}
+
+static void *worker(void *arg);
+
+static int spawn_worker(struct worker *w)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	int err;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	err = pthread_create(&thread, &attr, worker, w);
+	pthread_attr_destroy(&attr);
+
+	return err;
+}
+
+static void worker_exited(void *arg)
+{
+	struct worker *w = arg;
+	struct igt_threadpool *pool = w->pool;
+
+	/* A task failed and took the thread down with it, start a replacement */
+	pthread_mutex_lock(&pool->lock);
+	if (pool->stop || spawn_worker(w)) {
+		if (!--pool->alive && !pool->stop)
+			igt_warn("All thread pool workers are gone\n");
+		pthread_cond_broadcast(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	struct igt_threadpool *pool = w->pool;
+	char name[16];
+
+	self = w;
+	snprintf(name, sizeof(name), "igt-pool/%u", w->id);
+	pthread_setname_np(pthread_self(), name);
+
+	pthread_cleanup_push(worker_exited, w);
+	for (;;) {
+		struct igt_future *f = find_task(pool, w);
+
+		if (f) {
+			run_task(f);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		while (!has_work(pool) && !pool->stop)
+			pthread_cond_wait(&pool->work, &pool->lock);
+		if (pool->stop && !has_work(pool))
+			break;
+		pthread_mutex_unlock(&pool->lock);
+	}
+	pthread_cleanup_pop(0);
+
+	pool->alive--;
+	pthread_cond_broadcast(&pool->done);
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static void threadpool_exit_handler(int sig)
+{
+	/* Leave the workers idle while the exit handlers tear things down */
+	atomic_store(&exiting, true);
+}
+
+static void install_exit_handler(void)
+{
+	igt_install_exit_handler(threadpool_exit_handler);
+}
+
+/**
+ * igt_threadpool_create:
+ * @nthreads: number of worker threads, or 0 for one per online CPU
+ *
+ * Starts a pool of worker threads, which sit idle until tasks are submitted.
+ *
+ * Returns: The new pool, to be released with igt_threadpool_destroy().
+ */
+struct igt_threadpool *igt_threadpool_create(unsigned int nthreads)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	struct igt_threadpool *pool;
+
+	if (!nthreads)
+		nthreads = max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+
+	pool = calloc(1, sizeof(*pool) + nthreads * sizeof(*pool->workers));
+	igt_assert(pool);
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->pid = getpid();
+	pool->nthreads = nthreads;
+
+	pthread_once(&once, install_exit_handler);
+
+	pthread_mutex_lock(&pool->lock);
+	for (unsigned int i = 0; i < nthreads; i++) {
+		struct worker *w = &pool->workers[i];
+
+		w->pool = pool;
+		w->id = i;
+		pthread_mutex_init(&w->deque.lock, NULL);
+
+		if (!spawn_worker(w))
+			pool->alive++;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	igt_assert_f(pool->alive, "Failed to start any thread pool workers\n");
+	igt_debug("Started a thread pool of %u/%u workers\n",
+		  pool->alive, nthreads);
+
+	return pool;
+}
+
+/**
+ * igt_threadpool_destroy:
+ * @pool: pool to destroy
+ *
+ * Runs whatever tasks are still queued, stops the workers and frees the
+ * pool. Futures must still be waited on to free them.
+ */
+void igt_threadpool_destroy(struct igt_threadpool *pool)
+{
+	if (!pool)
+		return;
+
+	/*
+	 * In a test child the conditions still count the parent's idle
+	 * workers as waiters, destroying them would block forever.
+	 */
+	if (pool->pid == getpid()) {
+		pthread_mutex_lock(&pool->lock);
+		pool->stop = true;
+		pthread_cond_broadcast(&pool->work);
+		while (pool->alive)
+			pthread_cond_wait(&pool->done, &pool->lock);
+		pthread_mutex_unlock(&pool->lock);
+
+		for (unsigned int i = 0; i < pool->nthreads; i++)
+			pthread_mutex_destroy(&pool->workers[i].deque.lock);
+		pthread_cond_destroy(&pool->done);
+		pthread_cond_destroy(&pool->work);
+		pthread_mutex_destroy(&pool->lock);
+	}
+
+	for (unsigned int i = 0; i < pool->nthreads; i++)
+		free(pool->workers[i].deque.tasks);
+	free(pool);
+}
+
+/**
+ * igt_threadpool_size:
+ * @pool: pool to query
+ *
+ * Returns: The number of worker threads in @pool.
+ */
+unsigned int igt_threadpool_size(const struct igt_threadpool *pool)
+{
+	return pool->nthreads;
+}
+
+/**
+ * igt_threadpool_submit:
+ * @pool: pool to run the task
+ * @fn: task function
+ * @data: argument passed to @fn
+ *
+ * Queues @fn to be called with @data on one of the workers of @pool.
+ *
+ * Returns: A future for the value returned by @fn, which must be passed to
+ * igt_future_wait().
+ */
+struct igt_future *igt_threadpool_submit(struct igt_threadpool *pool,
+					 void *(*fn)(void *data), void *data)
+{
+	struct worker *w = pool_worker(pool);
+	struct igt_future *f;
+
+	f = calloc(1, sizeof(*f));
+	igt_assert(f);
+	f->pool = pool;
+	f->fn = fn;
+	f->data = data;
+
+	if (pool->pid != getpid()) {
+		f->result = fn(data);
+		atomic_store(&f->done, true);
+		return f;
+	}
+
+	if (!w)
+		w = &pool->workers[atomic_fetch_add(&pool->next, 1) %
+				   pool->nthreads];
+	igt_assert(deque_push(&w->deque, f));
+
+	pthread_mutex_lock(&pool->lock);
+	atomic_fetch_add(&pool->queued, 1);
+	pthread_cond_signal(&pool->work);
+	if (pool->helpers)
+		pthread_cond_broadcast(&pool->done);
+	pthread_mutex_unlock(&pool->lock);
+
+	return f;
+}
+
+static void *__igt_future_wait(struct igt_future *f)
+{
+	struct igt_threadpool *pool = f->pool;
+	struct worker *w = pool_worker(pool);
+	void *result;
+
+	while (!atomic_load(&f->done)) {
+		struct igt_future *task;
+
+		if (w && (task = find_task(pool, w))) {
+			run_task(task);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		pool->helpers += !!w;
+		while (!atomic_load(&f->done) && !(w && has_work(pool)))
+			pthread_cond_wait(&pool->done, &pool->lock);
+		pool->helpers -= !!w;
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	result = f->result;
+	free(f);
+
+	return result;
+}
+
+/**
+ * igt_future_wait:
+ * @future: future returned by igt_threadpool_submit()
+ *
+ * Waits for the task behind @future to finish and frees the future. Called
+ * from one of the pool's own workers this runs other queued tasks in the
+ * meantime. On the main thread a failure in any of the threads fails the
+ * test here.
+ *
+ * Returns: The value returned by the task, or NULL if it failed.
+ */
+void *igt_future_wait(struct igt_future *future)
+{
+	void *result = __igt_future_wait(future);
+
+	if (igt_thread_is_main())
+		igt_thread_assert_no_failures();
+
+	return result;
+}
+
+struct range {
+	void (*fn)(unsigned long idx, void *data);
+	void *data;
+	atomic_ulong next;
+	unsigned long end, grain;
+	atomic_bool failed;
+};
+
+static void range_failed(void *arg)
+{
+	struct range *r = arg;
+
+	atomic_store(&r->failed, true);
+}
+
+static void *range_worker(void *arg)
+{
+	struct range *r = arg;
+
+	pthread_cleanup_push(range_failed, r);
+	while (!atomic_load(&r->failed)) {
+		unsigned long idx = atomic_fetch_add(&r->next, r->grain);
+		unsigned long end;
+
+		if (idx >= r->end)
+			break;
+
+		end = r->end - idx > r->grain ? idx + r->grain : r->end;
+		for (; idx < end; idx++)
+			r->fn(idx, r->data);
+	}
+	pthread_cleanup_pop(0);
+
+	return NULL;
+}
+
+/**
+ * igt_threadpool_for:
+ * @pool: pool to run the loop
+ * @start: first index
+ * @end: index one past the last
+ * @grain: number of consecutive indices handed out at a time, or 0 to pick
+ * one based on the size of the range and of @pool
+ * @fn: loop body
+ * @data: argument passed to @fn
+ *
+ * Calls @fn for every index in [@start, @end) in parallel across the
+ * workers of @pool, returning once all calls have finished. Once a call
+ * fails no more chunks of the range are started; on the main thread the
+ * failure is then raised here.
+ */
+void igt_threadpool_for(struct igt_threadpool *pool,
+			unsigned long start, unsigned long end,
+			unsigned long grain,
+			void (*fn)(unsigned long idx, void *data), void *data)
+{
+	struct range r = {
+		.fn = fn,
+		.data = data,
+		.next = start,
+		.end = end,
+	};
+	struct igt_future **runners;
+	unsigned long chunks;
+	unsigned int n;
+
+	if (start >= end)
+		return;
+
+	if (!grain)
+		grain = max((end - start) / (4 * pool->nthreads), 1ul);
+	r.grain = grain;
+
+	chunks = (end - start - 1) / grain + 1;
+	n = min(chunks, (unsigned long)pool->nthreads);
+
+	runners = malloc(n * sizeof(*runners));
+	igt_assert(runners);
+
+	for (unsigned int i = 0; i < n; i++)
+		runners[i] = igt_threadpool_submit(pool, range_worker, &r);
+
+	/* Everyone must be done with the range before it goes out of scope */
+	for (unsigned int i = 0; i < n; i++)
+		__igt_future_wait(runners[i]);
+	free(runners);
+
+	if (igt_thread_is_main())
+		igt_thread_assert_no_failures();
+}
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#ifndef __IGT_THREADPOOL_H__
+#define __IGT_THREADPOOL_H__
+
+struct igt_threadpool;
+struct igt_future;
+
+struct igt_threadpool *igt_threadpool_create(unsigned int nthreads);
+void igt_threadpool_destroy(struct igt_threadpool *pool);
+unsigned int igt_threadpool_size(const struct igt_threadpool *pool);
+
+struct igt_future *igt_threadpool_submit(struct igt_threadpool *pool,
+					 void *(*fn)(void *data), void *data);
+void *igt_future_wait(struct igt_future *future);
+
+void igt_threadpool_for(struct igt_threadpool *pool,
+			unsigned long start, unsigned long end,
+			unsigned long grain,
+			void (*fn)(unsigned long idx, void *data), void *data);
+
+#endif /* __IGT_THREADPOOL_H__ */
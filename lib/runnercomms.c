@@ -4,12 +4,17 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "igt_aux.h"
@@ -24,9 +29,22 @@
  * This library provides means for the tests to communicate to
  * igt_runner with a formally specified protocol, avoiding
  * shortcomings and pain points of text-based communication.
+ *
+ * Packets are written to a ring buffer shared with igt_runner when
+ * it provides one, see struct runnercomms_ring, and sent as datagrams
+ * on the runner socket otherwise.
  */
 
 static sig_atomic_t runner_socket_fd = -1;
+static struct runnercomms_ring *runner_ring;
+static int runner_doorbell_fd = -1;
+
+/* Ring records being written by this process, see log_to_runner_sig_safe() */
+static atomic_int ring_writers;
+
+/* Give up on the ring if the runner hasn't made room in 10 seconds */
+#define RING_WAIT_US 50
+#define RING_WAIT_MS 10000
 
 /**
  * set_runner_socket:
@@ -53,6 +71,42 @@ void set_runner_socket(int fd)
 	runner_socket_fd = fd;
 }
 
+/**
+ * set_runner_ring:
+ * @ringfd: memfd holding a struct runnercomms_ring
+ * @doorbellfd: eventfd to wake up the runner with
+ *
+ * Maps the shared memory ring set up by igt_runner and uses it for
+ * all packets sent afterwards. The socket set with set_runner_socket()
+ * is still used for packets that cannot go through the ring.
+ */
+void set_runner_ring(int ringfd, int doorbellfd)
+{
+	struct stat sb;
+
+	if (fstat(doorbellfd, &sb))
+		return;
+
+	runner_ring = runnercomms_ring_map(ringfd);
+	if (runner_ring)
+		runner_doorbell_fd = doorbellfd;
+}
+
+/**
+ * set_runner_capture:
+ * @fd: file to append the packets to
+ *
+ * Writes all packets sent afterwards to @fd instead of sending them to
+ * igt_runner, for the parent process to pass them on later. Used by the
+ * children running subtests in parallel, to keep the reporting in order.
+ */
+void set_runner_capture(int fd)
+{
+	runner_ring = NULL;
+	runner_doorbell_fd = -1;
+	runner_socket_fd = fd;
+}
+
 /**
  * runner_connected:
  *
@@ -67,6 +121,155 @@ bool runner_connected(void)
 	return runner_socket_fd >= 0;
 }
 
+static struct runnercomms_record *record_at(struct runnercomms_ring *ring, uint32_t pos)
+{
+	return (struct runnercomms_record *)(ring->data + (pos & (ring->size - 1)));
+}
+
+static uint32_t record_length(uint32_t size)
+{
+	return (sizeof(struct runnercomms_record) + size + 7) & ~7u;
+}
+
+static bool ring_lock(struct runnercomms_ring *ring)
+{
+	int err = pthread_mutex_lock(&ring->lock);
+
+	/* #head is advanced last, so there is nothing to clean up */
+	if (err == EOWNERDEAD)
+		err = pthread_mutex_consistent(&ring->lock);
+
+	return err == 0;
+}
+
+/*
+ * Reserves a record with room for @size octets after its header,
+ * returning it or NULL if the ring cannot be used, and setting @pos
+ * to its position. Must be followed by ring_commit().
+ */
+static struct runnercomms_record *ring_reserve(struct runnercomms_ring *ring,
+					       uint32_t size, uint32_t *pos)
+{
+	uint32_t len = record_length(size);
+	unsigned int waits = 0;
+
+	if (size > ring->size / 4)
+		return NULL;
+
+	atomic_fetch_add(&ring_writers, 1);
+
+	while (!atomic_load_explicit(&ring->broken, memory_order_relaxed)) {
+		struct timespec ts = { .tv_nsec = RING_WAIT_US * 1000 };
+		struct runnercomms_record *record;
+		uint32_t head, off, pad, used;
+
+		if (!ring_lock(ring))
+			break;
+
+		head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+		off = head & (ring->size - 1);
+		pad = off + len > ring->size ? ring->size - off : 0;
+		used = head - atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+		if (used + pad + len <= ring->size) {
+			if (pad) {
+				record = record_at(ring, head);
+				record->owner = getpid();
+				atomic_store_explicit(&record->header,
+						      pad | RUNNERCOMMS_RECORD_PAD,
+						      memory_order_relaxed);
+				head += pad;
+			}
+
+			record = record_at(ring, head);
+			record->owner = getpid();
+			atomic_store_explicit(&record->header,
+					      len | RUNNERCOMMS_RECORD_BUSY,
+					      memory_order_relaxed);
+
+			/* Publishes the headers, pairs with reader_peek() */
+			atomic_store_explicit(&ring->head, head + len,
+					      memory_order_release);
+			pthread_mutex_unlock(&ring->lock);
+
+			*pos = head;
+			return record;
+		}
+
+		pthread_mutex_unlock(&ring->lock);
+
+		/* Full, wait for the runner to catch up */
+		if (++waits > ring->wait_ms * 1000 / RING_WAIT_US) {
+			atomic_store(&ring->broken, 1);
+			break;
+		}
+
+		nanosleep(&ts, NULL);
+	}
+
+	atomic_fetch_sub(&ring_writers, 1);
+	return NULL;
+}
+
+/*
+ * Completes @record as a packet, or as a RUNNERCOMMS_RECORD_MARKER or
+ * RUNNERCOMMS_RECORD_PAD record as given in @type.
+ */
+static void ring_commit(struct runnercomms_ring *ring, int doorbellfd,
+			struct runnercomms_record *record, uint32_t type)
+{
+	uint32_t len = atomic_load_explicit(&record->header, memory_order_relaxed);
+
+	/* Pairs with the doorbell check in runnercomms_ring_arm() */
+	atomic_store(&record->header, (len & ~RUNNERCOMMS_RECORD_FLAGS) | type);
+	if (atomic_exchange(&ring->doorbell, 0)) {
+		uint64_t one = 1;
+
+		write(doorbellfd, &one, sizeof(one));
+	}
+
+	atomic_fetch_sub(&ring_writers, 1);
+}
+
+static struct runnerpacket *record_packet(struct runnercomms_record *record)
+{
+	return (struct runnerpacket *)(record + 1);
+}
+
+/*
+ * Sends @packet through the socket. With a ring, the packet is tagged
+ * for the runner to put it in order with the records in the ring.
+ */
+static void send_datagram(const struct runnerpacket *packet)
+{
+	struct runnercomms_datagram_tag tag = {
+		.magic = RUNNERCOMMS_DATAGRAM_MAGIC,
+	};
+	struct iovec iov[] = {
+		{ .iov_base = &tag, .iov_len = sizeof(tag) },
+		{ .iov_base = (void *)packet, .iov_len = packet->size },
+	};
+	struct runnercomms_record *marker;
+
+	if (!runner_ring) {
+		write(runner_socket_fd, packet, packet->size);
+		return;
+	}
+
+	marker = ring_reserve(runner_ring, 0, &tag.pos);
+	if (!marker) {
+		tag.pos = atomic_load(&runner_ring->head);
+		writev(runner_socket_fd, iov, 2);
+		return;
+	}
+
+	/* Don't leave the runner waiting for a datagram that never comes */
+	tag.marked = 1;
+	ring_commit(runner_ring, runner_doorbell_fd, marker,
+		    writev(runner_socket_fd, iov, 2) < 0 ?
+		    RUNNERCOMMS_RECORD_PAD : RUNNERCOMMS_RECORD_MARKER);
+}
+
 /**
  * send_to_runner:
  * @packet: packet to send
@@ -76,8 +279,58 @@ bool runner_connected(void)
  */
 void send_to_runner(struct runnerpacket *packet)
 {
-	if (runner_connected())
-		write(runner_socket_fd, packet, packet->size);
+	if (runner_connected() &&
+	    !(runner_ring && runnercomms_ring_send(runner_ring, runner_doorbell_fd, packet)))
+		send_datagram(packet);
+	free(packet);
+}
+
+static void fill_log_packet(struct runnerpacket *packet, uint32_t size,
+			    int32_t tid, uint8_t stream,
+			    const char *text, size_t len)
+{
+	packet->size = size;
+	packet->type = PACKETTYPE_LOG;
+	packet->senderpid = getpid();
+	packet->sendertid = tid;
+
+	packet->data[0] = stream;
+	memcpy(packet->data + sizeof(stream), text, len);
+	packet->data[sizeof(stream) + len] = '\0';
+}
+
+/**
+ * log_to_runner:
+ * @stream: 1 for stdout, 2 for stderr
+ * @text: log text, does not need to be nul-terminated
+ * @len: length of @text
+ *
+ * Sends a #PACKETTYPE_LOG packet to igt_runner. Unlike
+ * send_to_runner(runnerpacket_log()), the packet is built directly in
+ * the shared ring when there is one, without any allocation.
+ */
+void log_to_runner(uint8_t stream, const char *text, size_t len)
+{
+	uint32_t size = sizeof(struct runnerpacket) + sizeof(stream) + len + 1;
+	struct runnercomms_record *record;
+	struct runnerpacket *packet;
+	uint32_t pos;
+
+	if (!runner_connected())
+		return;
+
+	if (runner_ring && (record = ring_reserve(runner_ring, size, &pos))) {
+		fill_log_packet(record_packet(record), size, gettid(), stream, text, len);
+		ring_commit(runner_ring, runner_doorbell_fd, record, 0);
+		return;
+	}
+
+	packet = malloc(size);
+	if (!packet)
+		return;
+
+	fill_log_packet(packet, size, gettid(), stream, text, len);
+	send_datagram(packet);
 	free(packet);
 }
 
@@ -467,28 +720,497 @@ uint32_t socket_dump_canary(void)
 
 void log_to_runner_sig_safe(const char *str, size_t len)
 {
-	size_t prlen = len;
-
-	struct runnerpacket_log_sig_safe p = {
-					      .size = sizeof(struct runnerpacket) + sizeof(uint8_t),
-					      .type = PACKETTYPE_LOG,
-					      .senderpid = getpid(),
-					      .sendertid = 0, /* gettid() not signal safe */
-					      .stream = STDERR_FILENO,
+	struct {
+		struct runnercomms_datagram_tag tag;
+		struct runnerpacket_log_sig_safe p;
+	} __attribute__((packed)) d = {
+		.tag = {
+			.magic = RUNNERCOMMS_DATAGRAM_MAGIC,
+		},
+		.p = {
+			.size = sizeof(struct runnerpacket) + sizeof(uint8_t),
+			.type = PACKETTYPE_LOG,
+			.senderpid = getpid(),
+			.sendertid = 0, /* gettid() not signal safe */
+			.stream = STDERR_FILENO,
+		},
 	};
+	size_t prlen = len;
 
-	if (len > sizeof(p.data) - 1)
-		prlen = sizeof(p.data) - 1;
-	memcpy(p.data, str, prlen);
-	p.size += prlen + 1;
+	/*
+	 * Stay off the ring if we might have interrupted a packet being
+	 * written: the handler may never return to complete it, and
+	 * nothing after it would reach the runner. That also means no
+	 * thread of ours holds the ring lock.
+	 */
+	if (runner_ring && !atomic_load(&ring_writers)) {
+		uint32_t size = sizeof(struct runnerpacket) + sizeof(uint8_t) + len + 1;
+		struct runnercomms_record *record;
+		uint32_t pos;
+
+		record = ring_reserve(runner_ring, size, &pos);
+		if (record) {
+			/* gettid() not signal safe */
+			fill_log_packet(record_packet(record), size, 0, STDERR_FILENO, str, len);
+			ring_commit(runner_ring, runner_doorbell_fd, record, 0);
+			return;
+		}
+	}
 
-	write(runner_socket_fd, &p, p.size);
+	if (len > sizeof(d.p.data) - 1)
+		prlen = sizeof(d.p.data) - 1;
+	memcpy(d.p.data, str, prlen);
+	d.p.size += prlen + 1;
+
+	/* No marker record here, we may hold the ring lock already */
+	if (runner_ring) {
+		d.tag.pos = atomic_load(&runner_ring->head);
+		write(runner_socket_fd, &d, sizeof(d.tag) + d.p.size);
+	} else {
+		write(runner_socket_fd, &d.p, d.p.size);
+	}
 
 	len -= prlen;
 	if (len)
 		log_to_runner_sig_safe(str + prlen, len);
 }
 
+/**
+ * runnercomms_ring_create:
+ * @size: size of the data area in octets, a power of two
+ * @fd: set to the memfd backing the ring
+ *
+ * Creates a shared memory ring for a test to send packets with. Pass
+ * @fd to the test for runnercomms_ring_map().
+ *
+ * Returns: The mapped ring, or NULL on failure with @fd set to -1.
+ */
+struct runnercomms_ring *runnercomms_ring_create(uint32_t size, int *fd)
+{
+	struct runnercomms_ring *ring;
+	pthread_mutexattr_t attr;
+	int err;
+
+	assert(size >= 4096 && !(size & (size - 1)));
+
+	*fd = memfd_create("igt_runner comms", 0);
+	if (*fd < 0)
+		return NULL;
+
+	if (ftruncate(*fd, sizeof(*ring) + size))
+		goto err;
+
+	ring = mmap(NULL, sizeof(*ring) + size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, *fd, 0);
+	if (ring == MAP_FAILED)
+		goto err;
+
+	ring->magic = RUNNERCOMMS_RING_MAGIC;
+	ring->size = size;
+	ring->wait_ms = RING_WAIT_MS;
+	atomic_init(&ring->broken, 0);
+	atomic_init(&ring->doorbell, 0);
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+
+	/* Robust, for a test process killed while reserving */
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	err = pthread_mutex_init(&ring->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	if (err) {
+		munmap(ring, sizeof(*ring) + size);
+		goto err;
+	}
+
+	return ring;
+
+err:
+	close(*fd);
+	*fd = -1;
+	return NULL;
+}
+
+/**
+ * runnercomms_ring_map:
+ * @fd: memfd created by runnercomms_ring_create()
+ *
+ * Returns: The mapped ring, or NULL if @fd doesn't hold a valid ring.
+ */
+struct runnercomms_ring *runnercomms_ring_map(int fd)
+{
+	struct runnercomms_ring *ring;
+	struct stat sb;
+
+	if (fstat(fd, &sb) || sb.st_size < sizeof(*ring))
+		return NULL;
+
+	ring = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ring == MAP_FAILED)
+		return NULL;
+
+	if (ring->magic != RUNNERCOMMS_RING_MAGIC ||
+	    ring->size < 4096 || ring->size & (ring->size - 1) ||
+	    sb.st_size < sizeof(*ring) + ring->size) {
+		munmap(ring, sb.st_size);
+		return NULL;
+	}
+
+	return ring;
+}
+
+/**
+ * runnercomms_ring_unmap:
+ * @ring: ring to unmap
+ */
+void runnercomms_ring_unmap(struct runnercomms_ring *ring)
+{
+	if (ring)
+		munmap(ring, sizeof(*ring) + ring->size);
+}
+
+/**
+ * runnercomms_ring_send:
+ * @ring: ring to write to
+ * @doorbellfd: eventfd to wake up the runner with
+ * @packet: packet to send
+ *
+ * Copies @packet into @ring. Waits for the runner to make room if the
+ * ring is full. Does not free @packet.
+ *
+ * Returns: false if the packet must be sent through the socket
+ * instead, because it is too large or the ring is broken.
+ */
+bool runnercomms_ring_send(struct runnercomms_ring *ring, int doorbellfd,
+			   const struct runnerpacket *packet)
+{
+	struct runnercomms_record *record;
+	uint32_t pos;
+
+	record = ring_reserve(ring, packet->size, &pos);
+	if (!record)
+		return false;
+
+	memcpy(record_packet(record), packet, packet->size);
+	ring_commit(ring, doorbellfd, record, 0);
+
+	return true;
+}
+
+/**
+ * runnercomms_ring_pending:
+ * @ring: ring to read from
+ *
+ * Returns: The number of octets reserved by producers but not yet
+ * released by the runner.
+ */
+uint32_t runnercomms_ring_pending(struct runnercomms_ring *ring)
+{
+	return atomic_load(&ring->head) - atomic_load(&ring->tail);
+}
+
+/**
+ * runnercomms_ring_arm:
+ * @ring: ring to read from
+ *
+ * Asks the producers to ring the doorbell for the next packet they
+ * complete. To be called by the runner before waiting on the doorbell.
+ *
+ * Returns: false if a completed packet is already waiting, in which
+ * case the doorbell is not armed and the runner should not wait.
+ */
+bool runnercomms_ring_arm(struct runnercomms_ring *ring)
+{
+	uint32_t tail, header;
+
+	/* Nobody rings a broken ring, what's left is read on every wakeup */
+	if (atomic_load(&ring->broken))
+		return true;
+
+	/* Pairs with ring_commit() */
+	atomic_store(&ring->doorbell, 1);
+	tail = atomic_load(&ring->tail);
+	if (tail == atomic_load(&ring->head))
+		return true;
+
+	header = atomic_load(&record_at(ring, tail)->header);
+	if (!(header & RUNNERCOMMS_RECORD_BUSY)) {
+		atomic_store(&ring->doorbell, 0);
+		return false;
+	}
+
+	return true;
+}
+
+/* Whether @pid is gone, and won't complete the records it reserved */
+static bool process_exited(pid_t pid)
+{
+	char path[32], buf[512];
+	const char *state;
+	ssize_t r;
+	int fd;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return errno == ENOENT;
+
+	r = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (r < 0)
+		return errno == ESRCH;
+	buf[r] = '\0';
+
+	/* A killed child stays a zombie until the test reaps it */
+	state = strrchr(buf, ')');
+	return state && (state[2] == 'Z' || state[2] == 'X');
+}
+
+/**
+ * runnercomms_reader_init:
+ * @reader: reader to initialize
+ * @ring: ring to read from, or NULL if the test only has the socket
+ *
+ * Initializes @reader for reading the packets of a test, starting
+ * from the first record not yet released in @ring.
+ */
+void runnercomms_reader_init(struct runnercomms_reader *reader,
+			     struct runnercomms_ring *ring)
+{
+	memset(reader, 0, sizeof(*reader));
+
+	reader->ring = ring;
+	if (ring)
+		reader->cursor = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
+
+/**
+ * runnercomms_reader_fini:
+ * @reader: reader to clean up
+ *
+ * Frees the datagrams still held by @reader.
+ */
+void runnercomms_reader_fini(struct runnercomms_reader *reader)
+{
+	unsigned int i;
+
+	for (i = 0; i < reader->ndatagrams; i++)
+		free(reader->datagrams[i]);
+	free(reader->datagrams);
+
+	reader->datagrams = NULL;
+	reader->ndatagrams = reader->returned = reader->allocated = 0;
+}
+
+/**
+ * runnercomms_reader_add_datagram:
+ * @reader: reader to hand the datagram to
+ * @buf: datagram received from the test
+ * @len: length of the datagram
+ *
+ * Keeps a copy of a datagram starting with a struct
+ * runnercomms_datagram_tag, to be returned by runnercomms_reader_next()
+ * in its turn.
+ *
+ * Returns: false if @buf is not tagged, in which case the caller
+ * handles it as a plain packet right away.
+ */
+bool runnercomms_reader_add_datagram(struct runnercomms_reader *reader,
+				     const void *buf, size_t len)
+{
+	const struct runnercomms_datagram_tag *tag = buf;
+	const struct runnerpacket *packet = (const void *)(tag + 1);
+	void *copy;
+
+	if (len < sizeof(*tag) || tag->magic != RUNNERCOMMS_DATAGRAM_MAGIC)
+		return false;
+
+	if (len < sizeof(*tag) + sizeof(*packet) ||
+	    packet->size != len - sizeof(*tag)) {
+		reader->dropped++;
+		return true;
+	}
+
+	if (reader->ndatagrams == reader->allocated) {
+		unsigned int allocated = reader->allocated ? 2 * reader->allocated : 16;
+		void **datagrams;
+
+		datagrams = realloc(reader->datagrams, allocated * sizeof(*datagrams));
+		if (!datagrams) {
+			reader->dropped++;
+			return true;
+		}
+
+		reader->datagrams = datagrams;
+		reader->allocated = allocated;
+	}
+
+	copy = malloc(len);
+	if (!copy) {
+		reader->dropped++;
+		return true;
+	}
+
+	memcpy(copy, buf, len);
+	reader->datagrams[reader->ndatagrams++] = copy;
+
+	return true;
+}
+
+/*
+ * Skips to the next completed packet or marker record, returning it
+ * or NULL if there is none yet. Leaves the cursor at the returned
+ * record.
+ */
+static struct runnercomms_record *reader_peek(struct runnercomms_reader *reader)
+{
+	struct runnercomms_ring *ring = reader->ring;
+	uint32_t head;
+
+	if (!ring || reader->stalled)
+		return NULL;
+
+	/* Pairs with ring_reserve() publishing the headers */
+	head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	while (reader->cursor != head) {
+		struct runnercomms_record *record = record_at(ring, reader->cursor);
+		uint32_t off = reader->cursor & (ring->size - 1);
+		const struct runnerpacket *packet = record_packet(record);
+		uint32_t header, len;
+
+		header = atomic_load_explicit(&record->header, memory_order_acquire);
+		len = header & ~RUNNERCOMMS_RECORD_FLAGS;
+		if (len < sizeof(*record) || len > ring->size - off ||
+		    len > head - reader->cursor) {
+			/* Garbage in the ring, leave it for good */
+			atomic_store(&ring->broken, 1);
+			reader->stalled = true;
+			return NULL;
+		}
+
+		if (header & RUNNERCOMMS_RECORD_BUSY) {
+			if (!process_exited(record->owner))
+				return NULL;
+
+			/* Killed while writing it, e.g. by igt_kill_children() */
+			reader->lost++;
+		} else if (header & RUNNERCOMMS_RECORD_MARKER) {
+			return record;
+		} else if (!(header & RUNNERCOMMS_RECORD_PAD)) {
+			if (len >= record_length(sizeof(*packet)) &&
+			    packet->size >= sizeof(*packet) &&
+			    record_length(packet->size) == len)
+				return record;
+
+			reader->dropped++;
+		}
+
+		reader->cursor += len;
+	}
+
+	return NULL;
+}
+
+static const struct runnerpacket *take_datagram(struct runnercomms_reader *reader,
+						unsigned int i)
+{
+	const struct runnercomms_datagram_tag *tag = reader->datagrams[i];
+
+	memmove(&reader->datagrams[reader->returned + 1],
+		&reader->datagrams[reader->returned],
+		(i - reader->returned) * sizeof(*reader->datagrams));
+	reader->datagrams[reader->returned++] = (void *)tag;
+
+	return (const struct runnerpacket *)(tag + 1);
+}
+
+/**
+ * runnercomms_reader_next:
+ * @reader: reader to read from
+ * @final: the test has exited, don't keep datagrams waiting for ring
+ * records that will never be completed
+ *
+ * Returns the next packet of the test, from the ring or from the
+ * datagrams passed to runnercomms_reader_add_datagram(), in the order
+ * they were sent. The packet stays valid, and in the ring, until it is
+ * released with runnercomms_reader_release().
+ *
+ * If the next packet is a datagram that the ring says was already
+ * sent, #want_datagram is set, and the caller should read the socket
+ * again.
+ *
+ * Returns: The next packet, or NULL if there is none yet.
+ */
+const struct runnerpacket *runnercomms_reader_next(struct runnercomms_reader *reader,
+						   bool final)
+{
+	struct runnercomms_record *record;
+	unsigned int i;
+
+	reader->want_datagram = false;
+
+	record = reader_peek(reader);
+
+	/* Datagrams sent before the next record was reserved go first */
+	for (i = reader->returned; i < reader->ndatagrams; i++) {
+		const struct runnercomms_datagram_tag *tag = reader->datagrams[i];
+		int32_t ahead = tag->pos - reader->cursor;
+
+		if (final || !reader->ring || reader->stalled ||
+		    ahead < 0 || (ahead == 0 && !tag->marked))
+			return take_datagram(reader, i);
+	}
+
+	if (!record)
+		return NULL;
+
+	if (atomic_load_explicit(&record->header, memory_order_relaxed) &
+	    RUNNERCOMMS_RECORD_MARKER) {
+		for (i = reader->returned; i < reader->ndatagrams; i++) {
+			const struct runnercomms_datagram_tag *tag = reader->datagrams[i];
+
+			if (tag->marked && tag->pos == reader->cursor) {
+				reader->cursor += sizeof(*record);
+				return take_datagram(reader, i);
+			}
+		}
+
+		/* Completed after sending, so it is in the socket already */
+		reader->want_datagram = true;
+		return NULL;
+	}
+
+	reader->cursor += record_length(record_packet(record)->size);
+
+	return record_packet(record);
+}
+
+/**
+ * runnercomms_reader_release:
+ * @reader: reader to release the packets of
+ *
+ * Frees the datagrams returned by runnercomms_reader_next() so far,
+ * and hands the space of the ring records read back to the producers.
+ */
+void runnercomms_reader_release(struct runnercomms_reader *reader)
+{
+	unsigned int i;
+
+	for (i = 0; i < reader->returned; i++)
+		free(reader->datagrams[i]);
+
+	memmove(reader->datagrams, reader->datagrams + reader->returned,
+		(reader->ndatagrams - reader->returned) * sizeof(*reader->datagrams));
+	reader->ndatagrams -= reader->returned;
+	reader->returned = 0;
+
+	if (reader->ring)
+		atomic_store_explicit(&reader->ring->tail, reader->cursor,
+				      memory_order_release);
+}
+
 /**
  * comms_read_dump:
  * @fd: Open fd to a comms dump file
@@ -6,6 +6,8 @@
 #ifndef IGT_RUNNERCOMMS_H
 #define IGT_RUNNERCOMMS_H
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -107,8 +109,11 @@ typedef union runnerpacket_read_helper {
 } runnerpacket_read_helper;
 
 void set_runner_socket(int fd);
+void set_runner_ring(int ringfd, int doorbellfd);
+void set_runner_capture(int fd);
 bool runner_connected(void);
 void send_to_runner(struct runnerpacket *packet);
+void log_to_runner(uint8_t stream, const char *text, size_t len);
 
 runnerpacket_read_helper read_runnerpacket(const struct runnerpacket *packet);
 
@@ -223,6 +228,127 @@ _Static_assert(offsetof(struct runnerpacket_log_sig_safe, data) == 4 * 4 + 1, "s
 
 void log_to_runner_sig_safe(const char *str, size_t len);
 
+/*
+ * Shared memory ring
+ *
+ * Instead of sending every packet as its own datagram, igt_runner can
+ * hand the test a ring buffer in shared memory (a memfd, passed in
+ * IGT_RUNNER_COMMS_RING_FD) and an eventfd doorbell (passed in
+ * IGT_RUNNER_COMMS_DOORBELL_FD). Packets are then written straight
+ * into the ring, and the runner only needs to be woken up once for a
+ * whole batch of them. The datagram socket stays connected as a
+ * fallback: packets that do not fit in the ring, or all packets after
+ * the ring was marked broken, are sent through it instead.
+ *
+ * The ring is a struct runnercomms_ring followed by its data area of
+ * #size octets. #head and #tail are free-running positions in the data
+ * area, taken modulo #size. Producers (any thread or forked process of
+ * the test) reserve space under #lock, the runner is the only consumer
+ * and advances #tail. Only the records between #tail and #head are
+ * valid.
+ *
+ * Every record starts at an 8 octet aligned position with a struct
+ * runnercomms_record: the length of the record in octets (header
+ * included, a multiple of 8) or'ed with the RUNNERCOMMS_RECORD_* flags,
+ * and the pid of the process that reserved it. A producer writes the
+ * header with RUNNERCOMMS_RECORD_BUSY before advancing #head, copies a
+ * runnerpacket after the header and then stores the length without
+ * the flag, with release semantics. If the producer dies before that,
+ * the runner skips the record once it sees the process is gone. A
+ * record never wraps around the end of the data area, a
+ * RUNNERCOMMS_RECORD_PAD record fills the gap instead.
+ *
+ * A packet sent through the socket while the ring is in use starts
+ * with a struct runnercomms_datagram_tag, for the runner to put it in
+ * order with the ring records. If it could, the producer reserved an
+ * empty RUNNERCOMMS_RECORD_MARKER record first and completed it after
+ * sending, and the tag holds the position of the marker. Otherwise
+ * the tag holds #head as it was before sending, and the packet goes
+ * after all the records reserved before that.
+ *
+ * Before going to sleep the runner sets #doorbell, and the first
+ * producer to complete a record after that clears it and writes to
+ * the doorbell eventfd.
+ */
+#define RUNNERCOMMS_RING_MAGIC ('I' << 24 | 'G' << 16 | 'T' << 8 | 'R')
+#define RUNNERCOMMS_RING_SIZE (1u << 20)
+
+#define RUNNERCOMMS_RECORD_BUSY 0x1
+#define RUNNERCOMMS_RECORD_PAD 0x2
+#define RUNNERCOMMS_RECORD_MARKER 0x4
+#define RUNNERCOMMS_RECORD_FLAGS 0x7
+
+struct runnercomms_record {
+	atomic_uint header; /* Length or'ed with RUNNERCOMMS_RECORD_* */
+	int32_t owner; /* pid of the producer */
+};
+
+struct runnercomms_ring {
+	uint32_t magic; /* RUNNERCOMMS_RING_MAGIC */
+	uint32_t size; /* Size of the data area in octets, power of two */
+	uint32_t wait_ms; /* How long producers wait for room before giving up */
+	atomic_uint broken; /* Non-zero if packets must go to the socket */
+	atomic_uint doorbell; /* Non-zero if the runner waits for a doorbell */
+	pthread_mutex_t lock; /* Robust and process-shared, held to reserve */
+
+	atomic_uint head __attribute__((aligned(64)));
+	atomic_uint tail __attribute__((aligned(64)));
+
+	char data[] __attribute__((aligned(64)));
+};
+
+#define RUNNERCOMMS_DATAGRAM_MAGIC ('I' << 24 | 'G' << 16 | 'T' << 8 | 'D')
+
+struct runnercomms_datagram_tag {
+	uint32_t magic; /* RUNNERCOMMS_DATAGRAM_MAGIC */
+	uint32_t pos; /* Position of the marker record, or of #head */
+	uint32_t marked; /* Non-zero if there is a marker record at #pos */
+};
+
+struct runnercomms_ring *runnercomms_ring_create(uint32_t size, int *fd);
+struct runnercomms_ring *runnercomms_ring_map(int fd);
+void runnercomms_ring_unmap(struct runnercomms_ring *ring);
+
+bool runnercomms_ring_send(struct runnercomms_ring *ring, int doorbellfd,
+			   const struct runnerpacket *packet);
+
+uint32_t runnercomms_ring_pending(struct runnercomms_ring *ring);
+bool runnercomms_ring_arm(struct runnercomms_ring *ring);
+
+/*
+ * Ring reader
+ *
+ * Used by igt_runner to read the packets of a test in the order they
+ * were sent, from the ring and from the tagged datagrams received on
+ * the socket.
+ */
+struct runnercomms_reader {
+	struct runnercomms_ring *ring;
+	uint32_t cursor; /* Position of the next record to read */
+	bool stalled; /* Garbage found in the ring, not reading it anymore */
+	bool want_datagram; /* Waiting for the datagram of a marker record */
+
+	/*
+	 * Copies of the tagged datagrams received, in arrival order.
+	 * The first #returned ones were handed out and are freed by
+	 * runnercomms_reader_release().
+	 */
+	void **datagrams;
+	unsigned int ndatagrams, returned, allocated;
+
+	unsigned int dropped; /* Malformed packets skipped */
+	unsigned int lost; /* Records left unfinished by a dead process */
+};
+
+void runnercomms_reader_init(struct runnercomms_reader *reader,
+			     struct runnercomms_ring *ring);
+void runnercomms_reader_fini(struct runnercomms_reader *reader);
+bool runnercomms_reader_add_datagram(struct runnercomms_reader *reader,
+				     const void *buf, size_t len);
+const struct runnerpacket *runnercomms_reader_next(struct runnercomms_reader *reader,
+						   bool final);
+void runnercomms_reader_release(struct runnercomms_reader *reader);
+
 /*
  * Comms dump reader
  *
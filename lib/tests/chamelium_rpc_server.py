@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+#
+# Copyright © 2024 Intel Corporation
+#
+# Stand-in for the Chamelium XML-RPC server, answering a few of its methods
+# after a configurable delay to emulate the round trip to a real board.
+# Prints the port it listens on, then serves until stdin is closed.
+
+import argparse
+import socketserver
+import sys
+import threading
+import time
+from xmlrpc.server import SimpleXMLRPCServer
+
+
+class Server(socketserver.ThreadingMixIn, SimpleXMLRPCServer):
+    daemon_threads = True
+
+    def __init__(self, latency, **kwargs):
+        super().__init__(('127.0.0.1', 0), logRequests=False,
+                         allow_none=True, **kwargs)
+        self.latency = latency
+
+    # Once per request, however many calls a multicall holds
+    def _marshaled_dispatch(self, *args, **kwargs):
+        time.sleep(self.latency)
+        return super()._marshaled_dispatch(*args, **kwargs)
+
+
+class Chamelium:
+    def GetSupportedInputs(self):
+        return [1, 2, 3, 4]
+
+    def IsPlugged(self, port_id):
+        return port_id % 2 == 1
+
+    def GetMaxFrameLimit(self, port_id, width, height):
+        return port_id * 1000000 + width * 1000 + height
+
+    def ComputePixelChecksum(self, port_id, x, y, width, height):
+        return [port_id, x, y, width or 0, height or 0]
+
+    def Fail(self):
+        raise RuntimeError('Failing as asked')
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--latency', type=float, default=0.0,
+                        help='seconds to wait before answering a request')
+    parser.add_argument('--no-multicall', action='store_true',
+                        help='do not implement system.multicall')
+    args = parser.parse_args()
+
+    server = Server(args.latency)
+    server.register_instance(Chamelium())
+    if not args.no_multicall:
+        server.register_multicall_functions()
+
+    thread = threading.Thread(target=server.serve_forever, daemon=True)
+    thread.start()
+
+    print(server.server_address[1], flush=True)
+    sys.stdin.read()
+    server.shutdown()
+
+
+if __name__ == '__main__':
+    main()
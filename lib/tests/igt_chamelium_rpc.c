@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_chamelium.h"
+#include "igt_rc.h"
+
+/* Round trip the stand-in server emulates for every request */
+#define LATENCY_MS 50
+#define N_CALLS 16
+
+struct server {
+	pid_t pid;
+	int stdin_fd;
+	int port;
+};
+
+static void start_server(struct server *server, const char *option)
+{
+	int in[2], out[2];
+	FILE *file;
+
+	igt_assert_eq(pipe(in), 0);
+	igt_assert_eq(pipe(out), 0);
+
+	server->pid = fork();
+	igt_assert(server->pid >= 0);
+	if (server->pid == 0) {
+		char latency[16];
+
+		snprintf(latency, sizeof(latency), "%f", LATENCY_MS / 1000.);
+		dup2(in[0], STDIN_FILENO);
+		dup2(out[1], STDOUT_FILENO);
+		close(in[1]);
+		close(out[0]);
+
+		execlp("python3", "python3", CHAMELIUM_RPC_SERVER,
+		       "--latency", latency, option, NULL);
+		_exit(127);
+	}
+
+	close(in[0]);
+	close(out[1]);
+	server->stdin_fd = in[1];
+
+	file = fdopen(out[0], "r");
+	igt_assert(file);
+	igt_require_f(fscanf(file, "%d", &server->port) == 1,
+		      "Chamelium stand-in server failed to start\n");
+	fclose(file);
+}
+
+static void stop_server(struct server *server)
+{
+	int status;
+
+	close(server->stdin_fd);
+	igt_assert_eq(waitpid(server->pid, &status, 0), server->pid);
+	igt_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static struct chamelium *connect_server(const struct server *server)
+{
+	struct chamelium *chamelium;
+	char url[64];
+
+	if (!igt_key_file)
+		igt_key_file = g_key_file_new();
+
+	snprintf(url, sizeof(url), "http://127.0.0.1:%d", server->port);
+	g_key_file_set_string(igt_key_file, "Chamelium", "URL", url);
+
+	chamelium = chamelium_init_rpc_only();
+	igt_assert(chamelium);
+
+	return chamelium;
+}
+
+static int max_frame_limit(int i)
+{
+	return 1000000 + i * 1000 + i;
+}
+
+static uint64_t calls_blocking(struct chamelium *chamelium)
+{
+	struct timespec start = {};
+
+	igt_nsec_elapsed(&start);
+
+	for (int i = 0; i < N_CALLS; i++) {
+		struct chamelium_rpc *rpc;
+
+		rpc = chamelium_rpc_start(chamelium, "GetMaxFrameLimit",
+					  "(iii)", 1, i, i);
+		igt_assert_eq(chamelium_rpc_wait_int(rpc), max_frame_limit(i));
+	}
+
+	return igt_nsec_elapsed(&start);
+}
+
+static uint64_t calls_async(struct chamelium *chamelium, bool batch)
+{
+	struct chamelium_rpc *rpc[N_CALLS];
+	struct timespec start = {};
+
+	igt_nsec_elapsed(&start);
+
+	if (batch)
+		chamelium_rpc_batch_begin(chamelium);
+
+	for (int i = 0; i < N_CALLS; i++)
+		rpc[i] = chamelium_rpc_start(chamelium, "GetMaxFrameLimit",
+					     "(iii)", 1, i, i);
+
+	if (batch)
+		chamelium_rpc_batch_end(chamelium);
+
+	/* Waiting out of order on purpose */
+	for (int i = N_CALLS - 1; i >= 0; i--)
+		igt_assert_eq(chamelium_rpc_wait_int(rpc[i]),
+			      max_frame_limit(i));
+
+	return igt_nsec_elapsed(&start);
+}
+
+static void test_async(struct chamelium *chamelium, bool batch)
+{
+	uint64_t blocking, async;
+
+	blocking = calls_blocking(chamelium);
+	async = calls_async(chamelium, batch);
+
+	igt_info("%d calls: %.1fms blocking, %.1fms %s\n", N_CALLS,
+		 blocking / 1e6, async / 1e6, batch ? "batched" : "pipelined");
+}
+
+static void test_mixed(struct chamelium *chamelium)
+{
+	struct chamelium_rpc *plugged, *unplugged;
+
+	/* Blocking calls drain whatever is in flight first */
+	chamelium_rpc_batch_begin(chamelium);
+	plugged = chamelium_rpc_start(chamelium, "IsPlugged", "(i)", 1);
+	unplugged = chamelium_rpc_start(chamelium, "IsPlugged", "(i)", 2);
+	igt_assert(chamelium_wait_reachable(chamelium, 1));
+	chamelium_rpc_batch_end(chamelium);
+
+	igt_assert(chamelium_rpc_wait_bool(plugged));
+	igt_assert(!chamelium_rpc_wait_bool(unplugged));
+}
+
+static void test_fault(const struct server *server, bool batch)
+{
+	bool *checked;
+
+	checked = mmap(NULL, sizeof(*checked), PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	igt_assert(checked != MAP_FAILED);
+
+	/* A connection of its own, the child doesn't return */
+	igt_fork(child, 1) {
+		struct chamelium *chamelium = connect_server(server);
+		struct chamelium_rpc *plugged, *fail;
+
+		if (batch)
+			chamelium_rpc_batch_begin(chamelium);
+		plugged = chamelium_rpc_start(chamelium, "IsPlugged", "(i)", 1);
+		fail = chamelium_rpc_start(chamelium, "Fail", "()");
+		if (batch)
+			chamelium_rpc_batch_end(chamelium);
+
+		/* The fault is only for the call that raised it */
+		igt_assert(chamelium_rpc_wait_bool(plugged));
+		*checked = true;
+
+		chamelium_rpc_wait(fail);
+	}
+
+	igt_assert_eq(__igt_waitchildren(), IGT_EXIT_FAILURE);
+	igt_assert(*checked);
+	munmap(checked, sizeof(*checked));
+}
+
+igt_main
+{
+	struct chamelium *chamelium;
+	struct server server;
+
+	igt_subtest_group {
+		igt_fixture {
+			start_server(&server, NULL);
+			chamelium = connect_server(&server);
+		}
+
+		igt_subtest("pipelined")
+			test_async(chamelium, false);
+
+		igt_subtest("multicall")
+			test_async(chamelium, true);
+
+		igt_subtest("mixed")
+			test_mixed(chamelium);
+
+		igt_subtest("fault")
+			test_fault(&server, false);
+
+		igt_subtest("multicall-fault")
+			test_fault(&server, true);
+
+		igt_fixture {
+			chamelium_deinit_rpc_only(chamelium);
+			stop_server(&server);
+		}
+	}
+
+	igt_subtest_group {
+		igt_fixture {
+			start_server(&server, "--no-multicall");
+			chamelium = connect_server(&server);
+		}
+
+		/* Falls back to pipelining the calls of the batch */
+		igt_subtest("multicall-unsupported")
+			test_async(chamelium, true);
+
+		igt_subtest("multicall-unsupported-fault")
+			test_fault(&server, true);
+
+		igt_fixture {
+			chamelium_deinit_rpc_only(chamelium);
+			stop_server(&server);
+		}
+	}
+}
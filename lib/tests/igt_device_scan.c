@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <ftw.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_device_scan.h"
+
+IGT_TEST_DESCRIPTION("Scan devices from a fake sysfs tree, directly and "
+		     "through the scan cache");
+
+#define PF "devices/pci0000:00/0000:00:02.0"
+#define VF "devices/pci0000:00/0000:00:02.1"
+
+static char root[] = "/tmp/igt_device_scan.XXXXXX";
+static char cache[PATH_MAX];
+
+static void __attribute__((format(printf, 1, 0)))
+make_path(const char *fmt, va_list ap, char *path)
+{
+	int len;
+
+	len = snprintf(path, PATH_MAX, "%s/", root);
+	vsnprintf(path + len, PATH_MAX - len, fmt, ap);
+}
+
+static void __attribute__((format(printf, 1, 2)))
+make_dir(const char *fmt, ...)
+{
+	char path[PATH_MAX], *sep;
+	va_list ap;
+
+	va_start(ap, fmt);
+	make_path(fmt, ap, path);
+	va_end(ap);
+
+	for (sep = path + strlen(root) + 1; (sep = strchr(sep, '/')); sep++) {
+		*sep = '\0';
+		mkdir(path, 0755);
+		*sep = '/';
+	}
+	mkdir(path, 0755);
+}
+
+static void write_file(const char *name, const char *contents)
+{
+	char path[PATH_MAX];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", root, name);
+	f = fopen(path, "w");
+	igt_assert(f);
+	fputs(contents, f);
+	igt_assert_eq(fclose(f), 0);
+}
+
+static void make_link(const char *name, const char *target)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", root, name);
+	igt_assert_eq(symlink(target, path), 0);
+}
+
+static void add_pci_device(const char *dir, const char *uevent, int minor)
+{
+	char path[PATH_MAX], contents[64];
+
+	make_dir("%s/drm/card%d", dir, minor);
+	make_dir("%s/drm/renderD%d", dir, minor + 128);
+
+	snprintf(path, sizeof(path), "%s/uevent", dir);
+	write_file(path, uevent);
+	snprintf(path, sizeof(path), "%s/subsystem", dir);
+	make_link(path, "../../../bus/pci");
+	snprintf(path, sizeof(path), "%s/driver", dir);
+	make_link(path, "../../../bus/pci/drivers/xe");
+
+	snprintf(path, sizeof(path), "%s/drm/card%d/uevent", dir, minor);
+	snprintf(contents, sizeof(contents),
+		 "MAJOR=226\nMINOR=%d\nDEVNAME=dri/card%d\n", minor, minor);
+	write_file(path, contents);
+	snprintf(path, sizeof(path), "%s/drm/card%d/subsystem", dir, minor);
+	make_link(path, "../../../../../class/drm");
+	snprintf(path, sizeof(path), "class/drm/card%d", minor);
+	snprintf(contents, sizeof(contents), "../../%s/drm/card%d", dir, minor);
+	make_link(path, contents);
+
+	snprintf(path, sizeof(path), "%s/drm/renderD%d/uevent", dir, minor + 128);
+	snprintf(contents, sizeof(contents),
+		 "MAJOR=226\nMINOR=%d\nDEVNAME=dri/renderD%d\n",
+		 minor + 128, minor + 128);
+	write_file(path, contents);
+	snprintf(path, sizeof(path), "%s/drm/renderD%d/subsystem", dir, minor + 128);
+	make_link(path, "../../../../../class/drm");
+	snprintf(path, sizeof(path), "class/drm/renderD%d", minor + 128);
+	snprintf(contents, sizeof(contents), "../../%s/drm/renderD%d", dir, minor + 128);
+	make_link(path, contents);
+}
+
+static void create_tree(void)
+{
+	igt_assert(mkdtemp(root));
+
+	make_dir("kernel");
+	make_dir("class/drm");
+	make_dir("bus/pci/drivers/xe");
+	write_file("kernel/uevent_seqnum", "1\n");
+
+	add_pci_device(PF, "DRIVER=xe\nPCI_ID=8086:56A0\n"
+		       "PCI_SLOT_NAME=0000:00:02.0\n", 0);
+	write_file(PF "/sriov_numvfs", "1\n");
+
+	add_pci_device(VF, "DRIVER=xe\nPCI_ID=8086:56A0\n"
+		       "PCI_SLOT_NAME=0000:00:02.1\n", 1);
+	make_link(VF "/physfn", "../0000:00:02.0");
+
+	snprintf(cache, sizeof(cache), "%s/cache", root);
+	setenv("IGT_DEVICE_SCAN_SYSFS", root, 1);
+	setenv("IGT_DEVICE_SCAN_CACHE", cache, 1);
+}
+
+static void bump_seqnum(void)
+{
+	static int seqnum = 1;
+	char contents[16];
+
+	snprintf(contents, sizeof(contents), "%d\n", ++seqnum);
+	write_file("kernel/uevent_seqnum", contents);
+}
+
+static void set_pci_id(const char *dir, const char *slot, const char *id)
+{
+	char path[PATH_MAX], contents[128];
+
+	snprintf(path, sizeof(path), "%s/uevent", dir);
+	snprintf(contents, sizeof(contents),
+		 "DRIVER=xe\nPCI_ID=8086:%s\nPCI_SLOT_NAME=%s\n", id, slot);
+	write_file(path, contents);
+}
+
+/* Every subtest starts from its own device ids and an empty cache */
+static void reset_tree(const char *pf_id, const char *vf_id)
+{
+	set_pci_id(PF, "0000:00:02.0", pf_id);
+	set_pci_id(VF, "0000:00:02.1", vf_id);
+	bump_seqnum();
+
+	unlink(cache);
+	setenv("IGT_DEVICE_SCAN_CACHE", cache, 1);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+			struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static void match(const char *filter, const char *slot)
+{
+	struct igt_device_card card;
+
+	igt_assert_f(igt_device_card_match_pci(filter, &card),
+		     "%s didn't match\n", filter);
+	igt_assert_f(!strcmp(card.pci_slot_name, slot),
+		     "%s matched %s, expected %s\n",
+		     filter, card.pci_slot_name, slot);
+}
+
+static void check_devices(const char *device)
+{
+	struct igt_device_card card;
+	char filter[PATH_MAX];
+
+	snprintf(filter, sizeof(filter), "pci:vendor=intel,device=%s,card=0", device);
+	match(filter, "0000:00:02.0");
+	igt_assert(igt_device_card_match(filter, &card));
+	igt_assert_eq(card.pci_vendor, 0x8086);
+	igt_assert(!strcmp(card.card, "/dev/dri/card0"));
+	igt_assert(!strcmp(card.render, "/dev/dri/renderD128"));
+
+	snprintf(filter, sizeof(filter), "pci:vendor=intel,device=%s,card=1", device);
+	match(filter, "0000:00:02.1");
+
+	snprintf(filter, sizeof(filter), "sys:%s/" VF, root);
+	match(filter, "0000:00:02.1");
+	match("drm:/dev/dri/renderD129", "0000:00:02.1");
+
+	/*
+	 * Decided by the sriov_numvfs and physfn sysattrs, taken from the
+	 * snapshot when read before it was saved, else from sysfs on demand
+	 */
+	snprintf(filter, sizeof(filter), "sriov:vendor=intel,device=%s", device);
+	match(filter, "0000:00:02.0");
+	snprintf(filter, sizeof(filter), "sriov:vendor=intel,device=%s,vf=0", device);
+	match(filter, "0000:00:02.1");
+}
+
+igt_main
+{
+	struct igt_device_card card;
+	struct stat st;
+
+	igt_fixture
+		create_tree();
+
+	igt_subtest("scan") {
+		reset_tree("56A0", "56A0");
+		igt_devices_scan(true);
+		check_devices("56a0");
+		igt_assert_eq(stat(cache, &st), 0);
+	}
+
+	igt_subtest("cached") {
+		reset_tree("56A0", "56A0");
+		igt_devices_scan(true);
+		igt_assert_eq(stat(cache, &st), 0);
+
+		/* Without a new uevent the change goes unnoticed */
+		set_pci_id(PF, "0000:00:02.0", "56A1");
+		igt_devices_scan(true);
+		check_devices("56a0");
+
+		bump_seqnum();
+		igt_devices_scan(true);
+		igt_assert(igt_device_card_match("pci:device=56a1", &card));
+		igt_assert(!strcmp(card.pci_slot_name, "0000:00:02.0"));
+		igt_assert(!igt_device_card_match("pci:device=56a0,card=1", &card));
+	}
+
+	igt_subtest("corrupt-cache") {
+		reset_tree("56A1", "56A0");
+		write_file("cache", "igt_device_scan 1\tgarbage\n");
+		igt_devices_scan(true);
+		match("pci:device=56a1", "0000:00:02.0");
+
+		igt_devices_scan(true);
+		match("pci:device=56a1", "0000:00:02.0");
+		match("sriov:vendor=intel,vf=0", "0000:00:02.1");
+	}
+
+	igt_subtest("filters") {
+		reset_tree("56A1", "56A0");
+		igt_devices_scan(true);
+
+		match("pci:device=integrated", "0000:00:02.0");
+		match("pci:device=discrete", "0000:00:02.1");
+		match("pci:vendor=8086,device=dg2,card=1", "0000:00:02.1");
+		igt_assert(!igt_device_card_match("pci:vendor=1234", &card));
+		igt_assert(!igt_device_card_match("pci:card=x", &card));
+
+		igt_assert_eq(igt_device_filter_add("pci:vendor=intel,card=all"), 2);
+		match(igt_device_filter_get(0), "0000:00:02.0");
+		match(igt_device_filter_get(1), "0000:00:02.1");
+		igt_device_filter_free_all();
+
+		/* The same filter has to be evaluated again after a rescan */
+		match("pci:vendor=8086,device=56A0", "0000:00:02.1");
+		set_pci_id(VF, "0000:00:02.1", "56A2");
+		bump_seqnum();
+		igt_devices_scan(true);
+		igt_assert(!igt_device_card_match("pci:vendor=8086,device=56A0", &card));
+		match("pci:vendor=8086,device=56a2", "0000:00:02.1");
+	}
+
+	igt_subtest("no-cache") {
+		reset_tree("56A1", "56A0");
+		setenv("IGT_DEVICE_SCAN_CACHE", "", 1);
+		igt_devices_scan(true);
+		match("pci:device=56a1", "0000:00:02.0");
+		igt_assert_eq(stat(cache, &st), -1);
+	}
+
+	igt_fixture {
+		igt_devices_free();
+		nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+	}
+}
@@ -77,6 +77,33 @@ __noreturn static void igt_fork_vs_assert(void)
 	igt_exit();
 }
 
+__noreturn static void igt_fork_many(void)
+{
+	igt_simple_init(fake_argc, fake_argv);
+
+	igt_fork(i, 256)
+		usleep(1000);
+
+	igt_waitchildren();
+
+	igt_exit();
+}
+
+__noreturn static void igt_fork_many_vs_assert(void)
+{
+	igt_simple_init(fake_argc, fake_argv);
+
+	/* The others have to be killed for this to finish in time */
+	igt_fork(i, 256) {
+		igt_assert(i != 128);
+		sleep(60);
+	}
+
+	igt_waitchildren_timeout(30, "library test");
+
+	igt_exit();
+}
+
 __noreturn static void igt_fork_leak(void)
 {
 	igt_simple_init(fake_argc, fake_argv);
@@ -165,6 +192,7 @@ __noreturn static void subtest_leak(void)
 
 int main(int argc, char **argv)
 {
+	struct timespec start = {};
 	int ret;
 
 	for (fork_type_dyn = 0;	fork_type_dyn <= 1; ++fork_type_dyn) {
@@ -195,5 +223,16 @@ int main(int argc, char **argv)
 		internal_assert_wexited(ret, IGT_EXIT_FAILURE); /* not asserted! */
 	}
 
+	printf("\ncheck that many children are all reaped\n");
+	ret = do_fork(igt_fork_many);
+	internal_assert_wexited(ret, IGT_EXIT_SUCCESS);
+
+	printf("\ncheck that igt_assert in one of many children is forwarded\n");
+	igt_nsec_elapsed(&start);
+	ret = do_fork(igt_fork_many_vs_assert);
+	internal_assert_wexited(ret, IGT_EXIT_FAILURE);
+	/* The others got killed right away, not by the 30s timeout */
+	internal_assert(igt_seconds_elapsed(&start) < 20);
+
 	printf("SUCCESS all tests passed\n");
 }
@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: MIT
+/*
+* Copyright © 2024 Intel Corporation
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_core.h"
+#include "drmtest.h"
+#include "gpgpu_shader.h"
+
+IGT_TEST_DESCRIPTION("Check that shaders from the gpgpu shader cache match freshly built ones");
+
+#define NVARIANTS 16
+
+static const uint32_t gen_vers[] = { 1200, 1250, 1260, 1270, 2000 };
+
+/* Variants differ in their number of writes and in the values written */
+static struct gpgpu_shader *build(uint32_t gen_ver, unsigned int variant)
+{
+	struct gpgpu_shader *shdr = __gpgpu_shader_create(gen_ver);
+	unsigned int i;
+
+	for (i = 0; i <= variant % 4; i++)
+		gpgpu_shader__write_dword(shdr, 0xc0ffee00 + variant, i);
+	gpgpu_shader__eot(shdr);
+	gpgpu_shader_finalize(shdr);
+
+	return shdr;
+}
+
+static void check_code(const struct gpgpu_shader *shdr,
+		       const struct gpgpu_shader *ref)
+{
+	igt_assert_eq(shdr->size, ref->size);
+	igt_assert(!memcmp(shdr->code, ref->code, 4 * ref->size));
+}
+
+static void cached_vs_uncached(void)
+{
+	struct gpgpu_shader *ref[ARRAY_SIZE(gen_vers)][NVARIANTS];
+	unsigned int g, v, limit;
+
+	limit = gpgpu_shader_cache_set_limit(0);
+	for (g = 0; g < ARRAY_SIZE(gen_vers); g++)
+		for (v = 0; v < NVARIANTS; v++) {
+			ref[g][v] = build(gen_vers[g], v);
+			igt_assert(ref[g][v]->max_size);
+		}
+	gpgpu_shader_cache_set_limit(limit);
+
+	for (g = 0; g < ARRAY_SIZE(gen_vers); g++) {
+		for (v = 0; v < NVARIANTS; v++) {
+			struct gpgpu_shader *miss, *hit;
+
+			miss = build(gen_vers[g], v);
+			hit = build(gen_vers[g], v);
+
+			/* The second one is the first one's code, shared */
+			igt_assert_eq(miss->max_size, 0);
+			igt_assert(hit->code == miss->code);
+
+			check_code(miss, ref[g][v]);
+			check_code(hit, ref[g][v]);
+
+			gpgpu_shader_destroy(miss);
+			gpgpu_shader_destroy(hit);
+		}
+	}
+
+	for (g = 0; g < ARRAY_SIZE(gen_vers); g++)
+		for (v = 0; v < NVARIANTS; v++)
+			gpgpu_shader_destroy(ref[g][v]);
+}
+
+static void cache_full(void)
+{
+	struct gpgpu_shader *ref, *shdr;
+	unsigned int limit;
+
+	/* Once one shader is in, nothing more fits and a new one gets its own code */
+	limit = gpgpu_shader_cache_set_limit(1);
+	gpgpu_shader_destroy(build(1260, NVARIANTS));
+	shdr = build(1260, NVARIANTS + 1);
+	igt_assert(shdr->max_size);
+
+	gpgpu_shader_cache_set_limit(0);
+	ref = build(1260, NVARIANTS + 1);
+	gpgpu_shader_cache_set_limit(limit);
+
+	check_code(shdr, ref);
+
+	gpgpu_shader_destroy(shdr);
+	gpgpu_shader_destroy(ref);
+}
+
+igt_main
+{
+	igt_describe("Check cached shaders match the ones built without the cache");
+	igt_subtest("cached-vs-uncached")
+		cached_vs_uncached();
+
+	igt_describe("Check shaders are still built right once the cache is full");
+	igt_subtest("cache-full")
+		cache_full();
+}
@@ -230,6 +230,107 @@ static void ktap_top_version(void)
 	igt_ktap_free(&ktap);
 }
 
+static const char ktap_report[] =
+	"KTAP version 1\n"
+	"1..2\n"
+	"    KTAP version 1\n"
+	"    # Subtest: test_suite_1\n"
+	"    1..2\n"
+	"    ok 1 test_case_1\n"
+	"    not ok 2 test_case_2 # failure message\n"
+	"not ok 1 test_suite_1\n"
+	"    KTAP version 1\n"
+	"    # Subtest: test_suite_2\n"
+	"    1..1\n"
+	"    ok 1 test_case_1 # SKIP with a message\n"
+	"ok 2 test_suite_2\n";
+
+static void check_report_results(struct igt_list_head *results)
+{
+	static const struct {
+		const char *suite_name, *case_name, *msg;
+		int code;
+	} expected[] = {
+		{ "test_suite_1", "test_case_1", NULL, IGT_EXIT_SUCCESS },
+		{ "test_suite_1", "test_case_2", "failure message", IGT_EXIT_FAILURE },
+		{ "test_suite_2", "test_case_1", "with a message", IGT_EXIT_SKIP },
+	};
+	struct igt_ktap_result *result, *rn;
+	int i = 0;
+
+	igt_assert_eq(igt_list_length(results), 3);
+
+	igt_list_for_each_entry_safe(result, rn, results, link) {
+		igt_list_del(&result->link);
+
+		igt_assert_eq(strcmp(result->suite_name, expected[i].suite_name), 0);
+		igt_assert_eq(strcmp(result->case_name, expected[i].case_name), 0);
+		if (expected[i].msg)
+			igt_assert_eq(strcmp(result->msg, expected[i].msg), 0);
+		else
+			igt_assert(!result->msg);
+		igt_assert_eq(result->code, expected[i].code);
+
+		/* suite names are shared by the results of a suite */
+		if (i == 1 || i == 2)
+			free(result->suite_name);
+		free(result->case_name);
+		free(result->msg);
+		free(result);
+		i++;
+	}
+}
+
+static void ktap_stream(size_t chunk)
+{
+	struct igt_ktap_results *ktap;
+	size_t len = strlen(ktap_report), i;
+	int ret = -EINPROGRESS;
+	IGT_LIST_HEAD(results);
+
+	ktap = igt_ktap_alloc(&results);
+	igt_require(ktap);
+
+	for (i = 0; i < len && ret == -EINPROGRESS; i += chunk)
+		ret = igt_ktap_parse_stream(ktap_report + i,
+					    chunk < len - i ? chunk : len - i,
+					    false, ktap);
+	igt_assert_eq(ret, 0);
+
+	igt_ktap_free(&ktap);
+
+	check_report_results(&results);
+}
+
+static void ktap_stream_kmsg(void)
+{
+	struct igt_ktap_results *ktap;
+	const char *line, *eol;
+	int ret = -EINPROGRESS;
+	IGT_LIST_HEAD(results);
+	unsigned int seq = 0;
+
+	ktap = igt_ktap_alloc(&results);
+	igt_require(ktap);
+
+	/* one kmsg record per line of the report, with a continuation line */
+	for (line = ktap_report; *line && ret == -EINPROGRESS; line = eol + 1) {
+		char *record;
+
+		eol = strchr(line, '\n');
+		igt_assert_lt(0, asprintf(&record, "6,%u,%u,-;%.*s\n SUBSYSTEM=kunit\n",
+					  seq, seq * 1000, (int)(eol - line), line));
+		ret = igt_ktap_parse_stream(record, strlen(record), true, ktap);
+		free(record);
+		seq++;
+	}
+	igt_assert_eq(ret, 0);
+
+	igt_ktap_free(&ktap);
+
+	check_report_results(&results);
+}
+
 igt_main
 {
 	igt_subtest("list")
@@ -243,4 +344,13 @@ igt_main
 
 	igt_subtest("top-ktap-version")
 		ktap_top_version();
+
+	igt_subtest("stream")
+		ktap_stream(sizeof(ktap_report));
+
+	igt_subtest("stream-split")
+		ktap_stream(1);
+
+	igt_subtest("stream-kmsg")
+		ktap_stream_kmsg();
 }
@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: MIT
+/*
+* Copyright © 2024 Intel Corporation
+*/
+
+#include <stdlib.h>
+
+#include "igt_core.h"
+#include "igt_map.h"
+
+IGT_TEST_DESCRIPTION("Exercise the igt_map hash table");
+
+#define NKEYS 10000
+
+static uint32_t keys[NKEYS];
+
+/* A deliberately poor hash function, to exercise long probe sequences */
+static uint32_t hash_collide(const void *key)
+{
+	return *(uint32_t *)key & ~0xf;
+}
+
+static void check_contents(struct igt_map *map, const uint8_t *present)
+{
+	struct igt_map_entry *entry;
+	unsigned int i, count = 0;
+
+	for (i = 0; i < NKEYS; i++) {
+		uint32_t *data = igt_map_search(map, &keys[i]);
+
+		if (present[i]) {
+			igt_assert_f(data == &keys[i], "key %u not found\n", i);
+			count++;
+		} else {
+			igt_assert_f(data == NULL, "removed key %u found\n", i);
+		}
+	}
+
+	igt_assert_eq(map->entries, count);
+
+	i = 0;
+	igt_map_foreach(map, entry) {
+		igt_assert(present[(uint32_t *)entry->key - keys]);
+		i++;
+	}
+	igt_assert_eq(i, count);
+}
+
+static void churn(uint32_t (*hash)(const void *key))
+{
+	uint8_t *present = calloc(NKEYS, sizeof(*present));
+	struct igt_map *map;
+	unsigned int i, round;
+
+	map = igt_map_create(hash, igt_map_equal_32);
+	igt_assert(map);
+
+	for (round = 0; round < 8; round++) {
+		for (i = 0; i < NKEYS; i++) {
+			if (random() % 2) {
+				if (!present[i])
+					igt_assert(igt_map_insert(map, &keys[i], &keys[i]));
+				present[i] = 1;
+			} else {
+				if (present[i])
+					igt_map_remove(map, &keys[i], NULL);
+				present[i] = 0;
+			}
+		}
+
+		check_contents(map, present);
+	}
+
+	igt_map_destroy(map, NULL);
+	free(present);
+}
+
+static void insertion_order(void)
+{
+	struct igt_map_entry *entry;
+	struct igt_map *map;
+	unsigned int i, prev;
+
+	map = igt_map_create(igt_map_hash_32, igt_map_equal_32);
+
+	for (i = 0; i < NKEYS; i++)
+		igt_map_insert(map, &keys[i], &keys[i]);
+
+	/* Remove every other key while iterating */
+	i = 0;
+	igt_map_foreach(map, entry) {
+		igt_assert(entry->key == &keys[i]);
+		if (i % 2)
+			igt_map_remove_entry(map, entry);
+		i++;
+	}
+	igt_assert_eq(i, NKEYS);
+	igt_assert_eq(map->entries, NKEYS / 2);
+
+	/* Reinserted keys go to the end of the iteration order */
+	for (i = 1; i < NKEYS; i += 2)
+		igt_map_insert(map, &keys[i], &keys[i]);
+
+	prev = 0;
+	i = 0;
+	igt_map_foreach(map, entry) {
+		unsigned int cur = (uint32_t *)entry->key - keys;
+
+		if (i == NKEYS / 2)
+			prev = 1;
+		igt_assert_eq(cur, prev);
+		prev += 2;
+		i++;
+	}
+	igt_assert_eq(i, NKEYS);
+
+	igt_map_destroy(map, NULL);
+}
+
+static void replace(void)
+{
+	struct igt_map_entry *entry;
+	struct igt_map *map;
+	uint32_t key = keys[7];
+	int data;
+
+	map = igt_map_create(igt_map_hash_32, igt_map_equal_32);
+
+	entry = igt_map_insert(map, &keys[7], &keys[7]);
+	igt_assert(igt_map_insert(map, &key, &data) == entry);
+	igt_assert(entry->key == &key);
+	igt_assert(igt_map_search(map, &keys[7]) == &data);
+	igt_assert_eq(map->entries, 1);
+
+	igt_map_remove_entry(map, entry);
+	igt_assert(igt_map_search(map, &keys[7]) == NULL);
+	igt_assert(igt_map_random_entry(map, NULL) == NULL);
+	igt_assert_eq(map->entries, 0);
+
+	igt_map_destroy(map, NULL);
+}
+
+igt_main
+{
+	igt_fixture {
+		unsigned int i;
+
+		srandom(0x1234);
+		for (i = 0; i < NKEYS; i++)
+			keys[i] = i * 4096;
+	}
+
+	igt_describe("Check lookups after random insertions and removals");
+	igt_subtest("churn")
+		churn(igt_map_hash_32);
+
+	igt_describe("Check lookups with many colliding hashes");
+	igt_subtest("churn-collisions")
+		churn(hash_collide);
+
+	igt_describe("Check iteration follows insertion order and tolerates removals");
+	igt_subtest("insertion-order")
+		insertion_order();
+
+	igt_describe("Check inserting an existing key replaces its entry");
+	igt_subtest("replace")
+		replace();
+}
@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "runnercomms.h"
+#include "igt_tests_common.h"
+
+static char prog[] = "igt_parallel_subtests";
+static char arg_jobs[] = "--jobs";
+static char arg_count[] = "4";
+static char *fake_argv[] = { prog, arg_jobs, arg_count };
+static int fake_argc = ARRAY_SIZE(fake_argv);
+
+static int shared;
+
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ll + ts.tv_nsec / 1000;
+}
+
+__noreturn static void parallel_subtests(void)
+{
+	igt_subtest_init(fake_argc, fake_argv);
+
+	igt_fixture
+		shared = 1;
+
+	/* Finishing in the reverse order they are started */
+	for (int i = 4; i > 0; i--) {
+		igt_parallel_safe();
+		igt_subtest_f("sleep-%d", i) {
+			long long start = now_us();
+
+			igt_info("sleep-%d sees %d\n", i, shared);
+			shared = 0;
+			usleep(i * 100000);
+			igt_info("sleep-%d done\n", i);
+			igt_info("sleep-%d ran %lld-%lld\n", i, start, now_us());
+		}
+	}
+
+	igt_parallel_safe();
+	igt_subtest_with_dynamic("dynamic") {
+		igt_dynamic("first")
+			usleep(100000);
+		igt_dynamic("second")
+			igt_assert(false);
+	}
+
+	igt_parallel_safe();
+	igt_subtest("skip")
+		igt_skip("Skipping\n");
+
+	/* Waits for the others, which only changed their own copy as jobs */
+	igt_subtest("sequential")
+		igt_info("shared is %d\n", shared);
+
+	igt_exit();
+}
+
+static const char *order[] = {
+	"Starting subtest: sleep-4",
+	"sleep-4 sees 1",
+	"sleep-4 done",
+	"Subtest sleep-4: SUCCESS",
+	"Starting subtest: sleep-3",
+	"Subtest sleep-3: SUCCESS",
+	"Starting subtest: sleep-2",
+	"Subtest sleep-2: SUCCESS",
+	"Starting subtest: sleep-1",
+	"Subtest sleep-1: SUCCESS",
+	"Starting subtest: dynamic",
+	"Starting dynamic subtest: first",
+	"Dynamic subtest first: SUCCESS",
+	"Starting dynamic subtest: second",
+	"Dynamic subtest second: FAIL",
+	"Subtest dynamic: FAIL",
+	"Starting subtest: skip",
+	"Subtest skip: SKIP",
+	"Starting subtest: sequential",
+	"shared is",
+	"Subtest sequential: SUCCESS",
+};
+
+static void check_order(const char *out)
+{
+	for (int i = 0; i < ARRAY_SIZE(order); i++) {
+		const char *next = strstr(out, order[i]);
+
+		internal_assert(next);
+		out = next + strlen(order[i]);
+	}
+}
+
+/* Whether any two of the sleep subtests were running at the same time */
+static bool overlapped(const char *out)
+{
+	long long start[4], end[4];
+
+	for (int i = 0; i < 4; i++) {
+		char tag[32];
+		const char *line;
+
+		snprintf(tag, sizeof(tag), "sleep-%d ran ", i + 1);
+		line = strstr(out, tag);
+		internal_assert(line);
+		internal_assert(sscanf(line + strlen(tag), "%lld-%lld",
+				       &start[i], &end[i]) == 2);
+	}
+
+	for (int i = 0; i < 4; i++) {
+		for (int j = i + 1; j < 4; j++) {
+			if (start[i] < end[j] && start[j] < end[i])
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static void read_packets(int sock, pid_t pid, int *status,
+			 char *out, size_t size)
+{
+	bool exited = false;
+	char buf[4096];
+	size_t len = 0;
+
+	/* Turns the packets back into the same lines as without the runner */
+	for (;;) {
+		runnerpacket_read_helper helper;
+
+		if (recv(sock, buf, sizeof(buf), MSG_DONTWAIT) <= 0) {
+			if (exited)
+				break;
+
+			exited = waitpid(pid, status, WNOHANG) == pid;
+			if (!exited)
+				usleep(1000);
+			continue;
+		}
+
+		helper = read_runnerpacket((struct runnerpacket *)buf);
+		switch (helper.type) {
+		case PACKETTYPE_LOG:
+			len += snprintf(out + len, size - len, "%s",
+					helper.log.text);
+			break;
+		case PACKETTYPE_SUBTEST_START:
+			len += snprintf(out + len, size - len,
+					"Starting subtest: %s\n",
+					helper.subteststart.name);
+			break;
+		case PACKETTYPE_SUBTEST_RESULT:
+			len += snprintf(out + len, size - len,
+					"Subtest %s: %s\n",
+					helper.subtestresult.name,
+					helper.subtestresult.result);
+			break;
+		case PACKETTYPE_DYNAMIC_SUBTEST_START:
+			len += snprintf(out + len, size - len,
+					"Starting dynamic subtest: %s\n",
+					helper.dynamicsubteststart.name);
+			break;
+		case PACKETTYPE_DYNAMIC_SUBTEST_RESULT:
+			len += snprintf(out + len, size - len,
+					"Dynamic subtest %s: %s\n",
+					helper.dynamicsubtestresult.name,
+					helper.dynamicsubtestresult.result);
+			break;
+		}
+		internal_assert(len < size);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static char out[65536];
+	int status, outfd;
+	pid_t pid;
+
+	/* Output in order, with the subtests running side by side */ {
+		pid = do_fork_bg_with_pipes(parallel_subtests, &outfd, NULL);
+		read_whole_pipe(outfd, out, sizeof(out));
+
+		internal_assert(safe_wait(pid, &status) != -1);
+		internal_assert_wexited(status, IGT_EXIT_FAILURE);
+		internal_assert(overlapped(out));
+
+		check_order(out);
+		internal_assert(strstr(out, "sleep-1 sees 1"));
+		internal_assert(strstr(out, "shared is 1"));
+		close(outfd);
+	}
+
+	/* The same results running one subtest at a time */ {
+		memset(out, 0, sizeof(out));
+		arg_count[0] = '1';
+
+		pid = do_fork_bg_with_pipes(parallel_subtests, &outfd, NULL);
+		read_whole_pipe(outfd, out, sizeof(out));
+
+		internal_assert(safe_wait(pid, &status) != -1);
+		internal_assert_wexited(status, IGT_EXIT_FAILURE);
+		internal_assert(!overlapped(out));
+
+		check_order(out);
+		internal_assert(strstr(out, "sleep-1 sees 0"));
+		internal_assert(strstr(out, "shared is 0"));
+		close(outfd);
+		arg_count[0] = '4';
+	}
+
+	/* Packets reach the runner in order too */ {
+		char fd[16];
+		int sv[2];
+
+		memset(out, 0, sizeof(out));
+		internal_assert(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == 0);
+		snprintf(fd, sizeof(fd), "%d", sv[1]);
+		setenv("IGT_RUNNER_SOCKET_FD", fd, 1);
+
+		pid = do_fork_bg_with_pipes(parallel_subtests, NULL, NULL);
+		unsetenv("IGT_RUNNER_SOCKET_FD");
+		close(sv[1]);
+
+		read_packets(sv[0], pid, &status, out, sizeof(out));
+		internal_assert_wexited(status, IGT_EXIT_FAILURE);
+
+		check_order(out);
+		internal_assert(strstr(out, "shared is 1"));
+		close(sv[0]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_pipe_crc.h"
+
+#define N_PIPES 3
+
+/*
+ * Pipes standing in for the crtc-N/crc/data debugfs files, fed with lines
+ * in the format the kernel uses.
+ */
+static int fds[N_PIPES][2];
+
+static void open_fake_crcs(void)
+{
+	for (int i = 0; i < N_PIPES; i++) {
+		igt_assert_eq(pipe2(fds[i], O_NONBLOCK), 0);
+		igt_assert(fcntl(fds[i][0], F_SETPIPE_SZ, 1 << 20) > 0);
+	}
+}
+
+static void close_fake_crcs(void)
+{
+	for (int i = 0; i < N_PIPES; i++) {
+		close(fds[i][0]);
+		if (fds[i][1] != -1)
+			close(fds[i][1]);
+	}
+}
+
+static void write_crc(int pipe, uint32_t frame, int n_words)
+{
+	char line[128];
+	int len;
+
+	len = snprintf(line, sizeof(line), "%#10x", frame);
+	for (int i = 0; i < n_words; i++)
+		len += snprintf(line + len, sizeof(line) - len, " %#10x",
+				frame * 16 + pipe * 4 + i);
+	line[len++] = '\n';
+
+	igt_assert_eq(write(fds[pipe][1], line, len), len);
+}
+
+static void check_tuple(const igt_crc_t *crcs, uint32_t frame, int n_words,
+			const uint32_t *base)
+{
+	for (int pipe = 0; pipe < N_PIPES; pipe++) {
+		uint32_t expected = base ? base[pipe] + frame : frame;
+
+		igt_assert(crcs[pipe].has_valid_frame);
+		igt_assert_eq_u32(crcs[pipe].frame, expected);
+		igt_assert_eq(crcs[pipe].n_words, n_words);
+		for (int i = 0; i < n_words; i++)
+			igt_assert_eq_u32(crcs[pipe].crc[i],
+					  expected * 16 + pipe * 4 + i);
+	}
+}
+
+static igt_crc_collector_t *new_collector(int max_tuples)
+{
+	int read_fds[N_PIPES];
+
+	for (int i = 0; i < N_PIPES; i++)
+		read_fds[i] = fds[i][0];
+
+	return igt_crc_collector_new(read_fds, N_PIPES, max_tuples);
+}
+
+static void aligned(void)
+{
+	igt_crc_collector_t *collector;
+	const uint32_t base[N_PIPES] = { 0, 100, 0xfffffff0 };
+
+	open_fake_crcs();
+	collector = new_collector(64);
+
+	/* Each pipe counts its own frames, written a pipe at a time */
+	for (int pipe = 0; pipe < N_PIPES; pipe++)
+		for (uint32_t frame = 0; frame < 40; frame++)
+			write_crc(pipe, base[pipe] + frame, 5);
+
+	igt_assert_lte(32, igt_crc_collector_collect(collector, 32, 1000));
+
+	/* Keep collecting what's left */
+	igt_assert_eq(igt_crc_collector_collect(collector, 64, 0), 40);
+	for (int i = 0; i < 40; i++)
+		check_tuple(igt_crc_collector_get_tuple(collector, i), i, 5, base);
+
+	igt_crc_collector_free(collector);
+	close_fake_crcs();
+}
+
+static void missed_frames(void)
+{
+	igt_crc_collector_t *collector;
+
+	open_fake_crcs();
+	collector = new_collector(16);
+
+	/* Pipe 1 misses frames 2 and 3, pipe 2 misses frame 5 */
+	for (uint32_t frame = 0; frame < 8; frame++) {
+		write_crc(0, frame, 1);
+		if (frame != 2 && frame != 3)
+			write_crc(1, frame, 1);
+		if (frame != 5)
+			write_crc(2, frame, 1);
+	}
+
+	for (int i = 0; i < N_PIPES; i++) {
+		close(fds[i][1]);
+		fds[i][1] = -1;
+	}
+
+	igt_assert_eq(igt_crc_collector_collect(collector, 16, -1), 5);
+	check_tuple(igt_crc_collector_get_tuple(collector, 0), 0, 1, NULL);
+	check_tuple(igt_crc_collector_get_tuple(collector, 1), 1, 1, NULL);
+	check_tuple(igt_crc_collector_get_tuple(collector, 2), 4, 1, NULL);
+	check_tuple(igt_crc_collector_get_tuple(collector, 3), 6, 1, NULL);
+	check_tuple(igt_crc_collector_get_tuple(collector, 4), 7, 1, NULL);
+
+	igt_crc_collector_free(collector);
+	close_fake_crcs();
+}
+
+static void split_lines(void)
+{
+	const char *lines[N_PIPES] = {
+		"0x00000007 0xdeadbeef 0x00000001\n",
+		"XXXXXXXXXX 0x0000abcd          0\n",
+		"         0 0x12345678 0xffffffff\n",
+	};
+	igt_crc_collector_t *collector;
+	const igt_crc_t *crcs;
+
+	open_fake_crcs();
+	collector = new_collector(4);
+
+	/* Lines arriving a few bytes at a time are put back together */
+	for (int pipe = 0; pipe < N_PIPES; pipe++) {
+		const char *line = lines[pipe];
+
+		igt_assert_eq(write(fds[pipe][1], line, 5), 5);
+		igt_assert_eq(igt_crc_collector_collect(collector, 1, 0), 0);
+		igt_assert_eq(write(fds[pipe][1], line + 5, strlen(line) - 5),
+			      strlen(line) - 5);
+	}
+
+	/* Malformed lines are skipped */
+	igt_assert_eq(write(fds[0][1], "0x00000008 0xzz\n", 16), 16);
+
+	igt_assert_eq(igt_crc_collector_collect(collector, 1, 1000), 1);
+	crcs = igt_crc_collector_get_tuple(collector, 0);
+
+	igt_assert(crcs[0].has_valid_frame);
+	igt_assert_eq_u32(crcs[0].frame, 7);
+	igt_assert_eq(crcs[0].n_words, 2);
+	igt_assert_eq_u32(crcs[0].crc[0], 0xdeadbeef);
+	igt_assert_eq_u32(crcs[0].crc[1], 1);
+
+	igt_assert(!crcs[1].has_valid_frame);
+	igt_assert_eq(crcs[1].n_words, 2);
+	igt_assert_eq_u32(crcs[1].crc[0], 0xabcd);
+	igt_assert_eq_u32(crcs[1].crc[1], 0);
+
+	igt_assert(crcs[2].has_valid_frame);
+	igt_assert_eq_u32(crcs[2].frame, 0);
+	igt_assert_eq_u32(crcs[2].crc[0], 0x12345678);
+	igt_assert_eq_u32(crcs[2].crc[1], 0xffffffff);
+
+	igt_crc_collector_free(collector);
+	close_fake_crcs();
+}
+
+static void timeout(void)
+{
+	igt_crc_collector_t *collector;
+	struct timespec start = {};
+
+	open_fake_crcs();
+	collector = new_collector(4);
+
+	write_crc(0, 0, 1);
+	write_crc(1, 0, 1);
+
+	igt_gettime(&start);
+	igt_assert_eq(igt_crc_collector_collect(collector, 1, 50), 0);
+	igt_assert(igt_nsec_elapsed(&start) >= 40 * 1000 * 1000);
+
+	write_crc(2, 0, 1);
+	igt_assert_eq(igt_crc_collector_collect(collector, 1, 50), 1);
+
+	igt_crc_collector_free(collector);
+	close_fake_crcs();
+}
+
+igt_main
+{
+	igt_subtest("aligned")
+		aligned();
+
+	igt_subtest("missed-frames")
+		missed_frames();
+
+	igt_subtest("split-lines")
+		split_lines();
+
+	igt_subtest("timeout")
+		timeout();
+}
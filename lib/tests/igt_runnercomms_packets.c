@@ -3,6 +3,11 @@
  * Copyright © 2022 Intel Corporation
  */
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
 #include "runnercomms.h"
 
 #include "igt_core.h"
@@ -214,6 +219,159 @@ struct {
 		      { NULL, NULL }
 };
 
+/*
+ * A stand-in for the comms side of igt_runner's monitor_output(), with
+ * a forked child sending numbered log lines through the ring.
+ */
+struct fake_runner {
+	struct runnercomms_ring *ring;
+	struct runnercomms_reader reader;
+	int ringfd, doorbellfd, socketfd;
+	pid_t child;
+
+	unsigned int received, datagrams;
+	char buf[64 * 1024];
+};
+
+static void send_lines(unsigned int count, unsigned int big_every)
+{
+	char text[2048];
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		/* Odd lengths for the padding, and some too big for the ring */
+		size_t len = big_every && i % big_every == big_every - 1 ? 1500 : i % 61;
+		int n = snprintf(text, sizeof(text), "%u ", i);
+
+		memset(text + n, 'x', len);
+		log_to_runner(STDOUT_FILENO, text, n + len);
+	}
+}
+
+static void fake_runner_start(struct fake_runner *r, uint32_t size, uint32_t wait_ms)
+{
+	memset(r, 0, sizeof(*r));
+
+	r->ring = runnercomms_ring_create(size, &r->ringfd);
+	igt_assert(r->ring);
+	r->ring->wait_ms = wait_ms;
+
+	r->doorbellfd = eventfd(0, EFD_NONBLOCK);
+	igt_assert_fd(r->doorbellfd);
+
+	runnercomms_reader_init(&r->reader, r->ring);
+}
+
+static void fake_runner_fork(struct fake_runner *r,
+			     unsigned int count, unsigned int big_every)
+{
+	int sv[2];
+
+	igt_assert_eq(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv), 0);
+
+	r->child = fork();
+	igt_assert(r->child >= 0);
+	if (!r->child) {
+		close(sv[0]);
+		set_runner_socket(sv[1]);
+		set_runner_ring(r->ringfd, r->doorbellfd);
+		send_lines(count, big_every);
+		_exit(0);
+	}
+
+	close(sv[1]);
+	r->socketfd = sv[0];
+}
+
+static void fake_runner_read_socket(struct fake_runner *r)
+{
+	ssize_t s;
+
+	while ((s = recv(r->socketfd, r->buf, sizeof(r->buf), MSG_DONTWAIT)) > 0) {
+		igt_assert(runnercomms_reader_add_datagram(&r->reader, r->buf, s));
+		r->datagrams++;
+	}
+}
+
+/* Reads everything there is, checking the lines are in order */
+static void fake_runner_read(struct fake_runner *r)
+{
+	const struct runnerpacket *packet;
+	bool reread = false;
+
+	fake_runner_read_socket(r);
+
+	while (true) {
+		runnerpacket_read_helper helper;
+
+		packet = runnercomms_reader_next(&r->reader, false);
+		if (!packet) {
+			if (!r->reader.want_datagram || reread)
+				break;
+
+			fake_runner_read_socket(r);
+			reread = true;
+			continue;
+		}
+
+		helper = read_runnerpacket(packet);
+		igt_assert_eq(helper.type, PACKETTYPE_LOG);
+		igt_assert_eq(atoi(helper.log.text), r->received);
+		r->received++;
+	}
+
+	runnercomms_reader_release(&r->reader);
+}
+
+static bool fake_runner_child_done(struct fake_runner *r)
+{
+	int status;
+
+	if (waitpid(r->child, &status, WNOHANG) != r->child)
+		return false;
+
+	igt_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	return true;
+}
+
+/* Runs until the child exits, reading the ring only if @read_ring */
+static void fake_runner_run(struct fake_runner *r, bool read_ring)
+{
+	bool done;
+
+	do {
+		struct pollfd pfd[] = {
+			{ .fd = r->socketfd, .events = POLLIN },
+			{ .fd = r->doorbellfd, .events = POLLIN },
+		};
+		uint64_t doorbell;
+
+		done = fake_runner_child_done(r);
+
+		if (!read_ring || runnercomms_ring_arm(r->ring))
+			poll(pfd, 2, 10);
+		read(r->doorbellfd, &doorbell, sizeof(doorbell));
+
+		if (read_ring)
+			fake_runner_read(r);
+		else
+			fake_runner_read_socket(r);
+	} while (!done);
+
+	fake_runner_read(r);
+}
+
+static void fake_runner_stop(struct fake_runner *r)
+{
+	igt_assert_eq(runnercomms_ring_pending(r->ring), 0);
+
+	runnercomms_reader_fini(&r->reader);
+	runnercomms_ring_unmap(r->ring);
+	close(r->ringfd);
+	close(r->doorbellfd);
+	close(r->socketfd);
+}
+
 igt_main
 {
 	igt_subtest("create-and-parse-normal") {
@@ -260,4 +418,78 @@ igt_main
 
 		free(packet);
 	}
+
+	igt_subtest("ring-wraparound") {
+		struct fake_runner r;
+
+		fake_runner_start(&r, 4096, 10000);
+		fake_runner_fork(&r, 5000, 0);
+		fake_runner_run(&r, true);
+
+		igt_assert_eq(r.received, 5000);
+		igt_assert_eq(r.datagrams, 0);
+		igt_assert(r.reader.cursor > 16 * 4096);
+
+		fake_runner_stop(&r);
+	}
+
+	igt_subtest("ring-full-fallback") {
+		struct fake_runner r;
+
+		/* Nobody reads the ring, the child gives up on it quickly */
+		fake_runner_start(&r, 4096, 1);
+		fake_runner_fork(&r, 1000, 0);
+		fake_runner_run(&r, false);
+
+		igt_assert_eq(r.received, 1000);
+		igt_assert(r.datagrams > 0 && r.datagrams < 1000);
+		igt_assert(atomic_load(&r.ring->broken));
+
+		fake_runner_stop(&r);
+	}
+
+	igt_subtest("ring-datagram-order") {
+		struct fake_runner r;
+
+		fake_runner_start(&r, 4096, 10000);
+		fake_runner_fork(&r, 1000, 3);
+		fake_runner_run(&r, true);
+
+		igt_assert_eq(r.received, 1000);
+		igt_assert_eq(r.datagrams, 1000 / 3);
+
+		fake_runner_stop(&r);
+	}
+
+	igt_subtest("ring-dead-producer") {
+		struct runnercomms_record *record;
+		struct fake_runner r;
+		siginfo_t info;
+		uint32_t head;
+		pid_t dead;
+
+		fake_runner_start(&r, 4096, 10000);
+
+		/* A record left busy by a process killed while writing it */
+		dead = fork();
+		igt_assert(dead >= 0);
+		if (!dead)
+			_exit(0);
+		igt_assert_eq(waitid(P_PID, dead, &info, WEXITED | WNOWAIT), 0);
+
+		head = atomic_load(&r.ring->head);
+		record = (struct runnercomms_record *)(r.ring->data + head);
+		record->owner = dead;
+		atomic_store(&record->header, 64 | RUNNERCOMMS_RECORD_BUSY);
+		atomic_store(&r.ring->head, head + 64);
+
+		fake_runner_fork(&r, 100, 0);
+		fake_runner_run(&r, true);
+
+		igt_assert_eq(r.received, 100);
+		igt_assert_eq(r.reader.lost, 1);
+
+		fake_runner_stop(&r);
+		waitpid(dead, NULL, 0);
+	}
 }
@@ -22,6 +22,8 @@
  *
  */
 
+#include <pthread.h>
+
 #include "igt_core.h"
 #include "igt_stats.h"
 
@@ -228,6 +230,267 @@ static void test_reallocation(void)
 	igt_stats_fini(&stats);
 }
 
+static void test_quantile(void)
+{
+	igt_stats_t stats;
+
+	igt_stats_init(&stats);
+	push_fixture_1(&stats);
+
+	igt_assert_eq_double(igt_stats_get_quantile(&stats, 0.), 2);
+	igt_assert_eq_double(igt_stats_get_quantile(&stats, .5), 6);
+	igt_assert_eq_double(igt_stats_get_quantile(&stats, .625), 7);
+	igt_assert_eq_double(igt_stats_get_quantile(&stats, 1.), 10);
+
+	igt_stats_fini(&stats);
+}
+
+static uint64_t lcg_next(uint64_t *state)
+{
+	*state = *state * 6364136223846793005ull + 1442695040888963407ull;
+	return *state >> 33;
+}
+
+static double rel_error(double approx, double exact)
+{
+	return fabs(approx - exact) / exact;
+}
+
+/* Small values each get their own bucket, the sketch must be exact */
+static void test_sketch_exact(void)
+{
+	static const uint64_t s1[] =
+		{ 47, 49, 6, 7, 15, 36, 39, 40, 41, 42, 43 };
+	igt_stats_t stats;
+
+	igt_stats_init_sketch(&stats, 7);
+	igt_stats_push_array(&stats, s1, ARRAY_SIZE(s1));
+
+	igt_assert(stats.values_u64 == NULL);
+	igt_assert_eq(stats.n_values, ARRAY_SIZE(s1));
+	igt_assert(igt_stats_get_min(&stats) == 6);
+	igt_assert(igt_stats_get_max(&stats) == 49);
+	igt_assert_eq_double(igt_stats_get_median(&stats), 40);
+	igt_assert_eq_double(igt_stats_get_quantile(&stats, .5), 40);
+	igt_assert(rel_error(igt_stats_get_mean(&stats), 365 / 11.) < 1e-12);
+
+	igt_stats_fini(&stats);
+}
+
+/* Compare a sketch against the exact dataset on a long-tailed distribution */
+static void test_sketch_accuracy(void)
+{
+	static const double quantiles[] = { .01, .1, .25, .5, .75, .9, .99 };
+	igt_stats_t exact, sketch;
+	uint64_t state = 0x1234;
+	double q1, q2, q3, e1, e2, e3;
+	unsigned int i;
+
+	igt_stats_init_with_size(&exact, 100000);
+	igt_stats_init_sketch(&sketch, 7);
+
+	for (i = 0; i < 100000; i++) {
+		uint64_t v = 1000 + lcg_next(&state) % 100000;
+
+		/* a latency-like tail of outliers */
+		if (i % 16 == 0)
+			v *= 50;
+
+		igt_stats_push(&exact, v);
+		igt_stats_push(&sketch, v);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(quantiles); i++)
+		igt_assert_f(rel_error(igt_stats_get_quantile(&sketch, quantiles[i]),
+				       igt_stats_get_quantile(&exact, quantiles[i])) < 1. / 128,
+			     "q%.2f: sketch %f, exact %f\n", quantiles[i],
+			     igt_stats_get_quantile(&sketch, quantiles[i]),
+			     igt_stats_get_quantile(&exact, quantiles[i]));
+
+	igt_stats_get_quartiles(&sketch, &q1, &q2, &q3);
+	igt_stats_get_quartiles(&exact, &e1, &e2, &e3);
+	igt_assert(rel_error(q1, e1) < 1. / 128);
+	igt_assert(rel_error(q2, e2) < 1. / 128);
+	igt_assert(rel_error(q3, e3) < 1. / 128);
+	igt_assert(rel_error(igt_stats_get_iqm(&sketch),
+			     igt_stats_get_iqm(&exact)) < 1. / 128);
+	igt_assert(rel_error(igt_stats_get_trimean(&sketch),
+			     igt_stats_get_trimean(&exact)) < 1. / 128);
+
+	igt_assert(igt_stats_get_min(&sketch) == igt_stats_get_min(&exact));
+	igt_assert(igt_stats_get_max(&sketch) == igt_stats_get_max(&exact));
+	igt_assert(rel_error(igt_stats_get_mean(&sketch),
+			     igt_stats_get_mean(&exact)) < 1e-9);
+	igt_assert(rel_error(igt_stats_get_variance(&sketch),
+			     igt_stats_get_variance(&exact)) < 1e-9);
+
+	igt_stats_fini(&sketch);
+	igt_stats_fini(&exact);
+}
+
+/* Merging per-thread sketches must give the same result as a single one */
+static void test_sketch_merge(void)
+{
+	igt_stats_t whole, part[4], exact;
+	uint64_t state = 0x5678;
+	unsigned int i;
+
+	igt_stats_init_sketch(&whole, 5);
+	for (i = 0; i < ARRAY_SIZE(part); i++)
+		igt_stats_init_sketch(&part[i], 5);
+	igt_stats_init(&exact);
+
+	for (i = 0; i < 10000; i++) {
+		uint64_t v = lcg_next(&state) % 1000000;
+
+		igt_stats_push(&whole, v);
+		if (i < 100)
+			igt_stats_push(&exact, v);
+		else
+			igt_stats_push(&part[i % ARRAY_SIZE(part)], v);
+	}
+
+	for (i = 1; i < ARRAY_SIZE(part); i++)
+		igt_stats_merge(&part[0], &part[i]);
+	igt_stats_merge(&part[0], &exact);
+
+	igt_assert_eq(part[0].n_values, whole.n_values);
+	igt_assert(igt_stats_get_min(&part[0]) == igt_stats_get_min(&whole));
+	igt_assert(igt_stats_get_max(&part[0]) == igt_stats_get_max(&whole));
+	igt_assert_eq_double(igt_stats_get_median(&part[0]),
+			     igt_stats_get_median(&whole));
+	igt_assert_eq_double(igt_stats_get_iqm(&part[0]),
+			     igt_stats_get_iqm(&whole));
+	igt_assert(rel_error(igt_stats_get_mean(&part[0]),
+			     igt_stats_get_mean(&whole)) < 1e-9);
+	igt_assert(rel_error(igt_stats_get_variance(&part[0]),
+			     igt_stats_get_variance(&whole)) < 1e-9);
+
+	for (i = 0; i < ARRAY_SIZE(part); i++)
+		igt_stats_fini(&part[i]);
+	igt_stats_fini(&whole);
+	igt_stats_fini(&exact);
+}
+
+static void test_merge(void)
+{
+	igt_stats_t whole, a, b;
+	unsigned int i;
+
+	igt_stats_init(&whole);
+	igt_stats_init(&a);
+	igt_stats_init(&b);
+
+	for (i = 0; i < 1000; i++) {
+		igt_stats_push(&whole, i * i);
+		igt_stats_push(i < 300 ? &a : &b, i * i);
+
+		/* fold part of the values into the running mean already */
+		if (i == 100 || i == 500)
+			igt_stats_get_mean(i == 100 ? &a : &b);
+	}
+
+	igt_stats_merge(&a, &b);
+
+	igt_assert_eq(a.n_values, whole.n_values);
+	igt_assert(igt_stats_get_min(&a) == 0);
+	igt_assert(igt_stats_get_max(&a) == 999 * 999);
+	igt_assert_eq_double(igt_stats_get_median(&a),
+			     igt_stats_get_median(&whole));
+	igt_assert(rel_error(igt_stats_get_mean(&a),
+			     igt_stats_get_mean(&whole)) < 1e-12);
+	igt_assert(rel_error(igt_stats_get_variance(&a),
+			     igt_stats_get_variance(&whole)) < 1e-12);
+
+	igt_stats_fini(&whole);
+	igt_stats_fini(&a);
+	igt_stats_fini(&b);
+}
+
+static void test_mean_merge(void)
+{
+	struct igt_mean whole, part[3], empty;
+	unsigned int i;
+
+	igt_mean_init(&whole);
+	igt_mean_init(&empty);
+	for (i = 0; i < ARRAY_SIZE(part); i++)
+		igt_mean_init(&part[i]);
+
+	for (i = 0; i < 999; i++) {
+		igt_mean_add(&whole, i / 7.);
+		igt_mean_add(&part[i * ARRAY_SIZE(part) / 999], i / 7.);
+	}
+
+	/* merging an empty tracker is a no-op, and so is merging into one */
+	igt_mean_merge(&part[1], &empty);
+	igt_mean_merge(&empty, &part[0]);
+	for (i = 1; i < ARRAY_SIZE(part); i++)
+		igt_mean_merge(&empty, &part[i]);
+	part[0] = empty;
+
+	igt_assert_eq(part[0].count, whole.count);
+	igt_assert_eq_double(part[0].min, whole.min);
+	igt_assert_eq_double(part[0].max, whole.max);
+	igt_assert(rel_error(igt_mean_get(&part[0]),
+			     igt_mean_get(&whole)) < 1e-12);
+	igt_assert(rel_error(igt_mean_get_variance(&part[0]),
+			     igt_mean_get_variance(&whole)) < 1e-12);
+}
+
+#define COLLECTOR_THREADS 8
+#define COLLECTOR_SAMPLES 10000
+
+static void *collector_thread(void *arg)
+{
+	struct igt_stats_collector *collector = arg;
+	igt_stats_t *local = igt_stats_collector_local(collector);
+	unsigned int i;
+
+	igt_assert(igt_stats_collector_local(collector) == local);
+
+	for (i = 0; i < COLLECTOR_SAMPLES; i++) {
+		if (i & 1)
+			igt_stats_push(local, i);
+		else
+			igt_stats_collector_push(collector, i);
+	}
+
+	return NULL;
+}
+
+static void test_collector(unsigned int precision)
+{
+	struct igt_stats_collector *collector;
+	pthread_t threads[COLLECTOR_THREADS];
+	igt_stats_t stats;
+	unsigned int i;
+
+	collector = igt_stats_collector_create(precision);
+
+	for (i = 0; i < COLLECTOR_THREADS; i++)
+		pthread_create(&threads[i], NULL, collector_thread, collector);
+	for (i = 0; i < COLLECTOR_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	if (precision)
+		igt_stats_init_sketch(&stats, precision);
+	else
+		igt_stats_init(&stats);
+	igt_stats_collector_merge(collector, &stats);
+	igt_stats_collector_destroy(collector);
+
+	igt_assert_eq(stats.n_values, COLLECTOR_THREADS * COLLECTOR_SAMPLES);
+	igt_assert(igt_stats_get_min(&stats) == 0);
+	igt_assert(igt_stats_get_max(&stats) == COLLECTOR_SAMPLES - 1);
+	igt_assert(rel_error(igt_stats_get_mean(&stats),
+			     (COLLECTOR_SAMPLES - 1) / 2.) < 1e-12);
+	igt_assert(rel_error(igt_stats_get_median(&stats),
+			     (COLLECTOR_SAMPLES - 1) / 2.) < 1. / 128);
+
+	igt_stats_fini(&stats);
+}
+
 igt_simple_main
 {
 	test_init_zero();
@@ -240,4 +503,12 @@ igt_simple_main
 	test_invalidate_mean();
 	test_std_deviation();
 	test_reallocation();
+	test_quantile();
+	test_sketch_exact();
+	test_sketch_accuracy();
+	test_sketch_merge();
+	test_merge();
+	test_mean_merge();
+	test_collector(0);
+	test_collector(7);
 }
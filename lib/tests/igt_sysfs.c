@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "igt_debugfs.h"
+#include "igt_sysfs.h"
+
+IGT_TEST_DESCRIPTION("Exercise the sysfs helpers against a fake sysfs");
+
+static char root[] = "/tmp/igt_sysfs.XXXXXX";
+static char devdir[80];
+
+static void fake_attr(const char *name, const char *value)
+{
+	char path[PATH_MAX];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/%s", devdir, name);
+	file = fopen(path, "w");
+	igt_assert(file);
+	fputs(value, file);
+	fclose(file);
+}
+
+static void fake_dir(const char *name)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s%s", root, name);
+	igt_assert_eq(mkdir(path, 0755), 0);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+			struct FTW *ftw)
+{
+	return remove(path);
+}
+
+igt_main
+{
+	int device = -1, dir = -1;
+
+	igt_fixture {
+		char path[PATH_MAX];
+		struct stat st;
+
+		/* Any char device does, its sysfs is looked up by major:minor */
+		device = open("/dev/null", O_RDONLY);
+		igt_assert_lte(0, device);
+		igt_assert_eq(fstat(device, &st), 0);
+
+		igt_assert(mkdtemp(root));
+		fake_dir("/dev");
+		fake_dir("/dev/char");
+		snprintf(path, sizeof(path), "/dev/char/%d:%d",
+			 major(st.st_rdev), minor(st.st_rdev));
+		fake_dir(path);
+		fake_dir("/kernel");
+		fake_dir("/kernel/debug");
+
+		snprintf(devdir, sizeof(devdir), "%s/dev/char/%d:%d",
+			 root, major(st.st_rdev), minor(st.st_rdev));
+		fake_attr("gt_cur_freq_mhz", "300\n");
+		fake_attr("gt_max_freq_mhz", "1100\n");
+		fake_attr("rc6_residency_ms", "18446744073709551615\n");
+		fake_attr("garbage", "MHz\n");
+
+		igt_sysfs_set_root(root);
+		dir = igt_sysfs_open(device);
+		igt_assert_lte(0, dir);
+	}
+
+	igt_subtest("root") {
+		char path[PATH_MAX];
+
+		fake_attr("gt_cur_freq_mhz", "300\n");
+		igt_assert(igt_sysfs_path(device, path, sizeof(path)));
+		igt_assert_eq(strcmp(path, devdir), 0);
+		igt_assert_eq(igt_sysfs_get_u32(dir, "gt_cur_freq_mhz"), 300);
+		igt_assert(!strncmp(igt_debugfs_mount(), root, strlen(root)));
+
+		igt_sysfs_set_root(NULL);
+		igt_assert_eq(strcmp(igt_sysfs_root(), "/sys"), 0);
+		igt_sysfs_set_root(root);
+	}
+
+	igt_subtest("attr-read") {
+		struct igt_sysfs_attr *attr;
+		uint32_t value;
+
+		fake_attr("gt_cur_freq_mhz", "300\n");
+		attr = igt_sysfs_attr_open(dir, "gt_cur_freq_mhz");
+		igt_assert(attr);
+
+		/* Every read samples the attribute afresh */
+		igt_assert_eq(igt_sysfs_attr_get_u32(attr), 300);
+		igt_sysfs_set_u32(dir, "gt_cur_freq_mhz", 350);
+		igt_assert_eq(igt_sysfs_attr_get_u32(attr), 350);
+		igt_assert_eq(igt_sysfs_attr_get_u32(attr), 350);
+		igt_sysfs_attr_close(attr);
+
+		attr = igt_sysfs_attr_open(dir, "rc6_residency_ms");
+		igt_assert_eq_u64(igt_sysfs_attr_get_u64(attr), UINT64_MAX);
+		igt_assert(!__igt_sysfs_attr_get_u32(attr, &value));
+		igt_sysfs_attr_close(attr);
+
+		attr = igt_sysfs_attr_open(dir, "garbage");
+		igt_assert(!__igt_sysfs_attr_get_u32(attr, &value));
+		igt_sysfs_attr_close(attr);
+
+		igt_assert(!igt_sysfs_attr_open(dir, "missing"));
+	}
+
+	igt_subtest("attr-write") {
+		struct igt_sysfs_attr *attr;
+		char *value;
+
+		fake_attr("gt_max_freq_mhz", "1100\n");
+		attr = igt_sysfs_attr_open(dir, "gt_max_freq_mhz");
+		igt_assert(attr);
+
+		/* No tail of the longer value left behind */
+		igt_sysfs_attr_set_u32(attr, 900);
+		igt_assert_eq(igt_sysfs_get_u32(dir, "gt_max_freq_mhz"), 900);
+		igt_assert_eq(igt_sysfs_attr_get_u32(attr), 900);
+
+		igt_sysfs_attr_set_u64(attr, 1ull << 40);
+		igt_assert_eq_u64(igt_sysfs_attr_get_u64(attr), 1ull << 40);
+
+		igt_assert_eq(igt_sysfs_attr_printf(attr, "%s", ""), 0);
+		igt_assert_eq(igt_sysfs_attr_printf(attr, "%0200d", 7), 200);
+		value = igt_sysfs_get(dir, "gt_max_freq_mhz");
+		igt_assert_eq(strlen(value), 200);
+		free(value);
+
+		igt_sysfs_attr_close(attr);
+	}
+
+	igt_subtest("attr-array") {
+		const char *names[] = {
+			"gt_cur_freq_mhz", "gt_max_freq_mhz", "rc6_residency_ms",
+		};
+		struct igt_sysfs_attr *attrs[ARRAY_SIZE(names) + 1];
+		uint64_t values[ARRAY_SIZE(attrs)];
+
+		fake_attr("gt_cur_freq_mhz", "300\n");
+		fake_attr("gt_max_freq_mhz", "1100\n");
+		for (int i = 0; i < ARRAY_SIZE(names); i++) {
+			attrs[i] = igt_sysfs_attr_open(dir, names[i]);
+			igt_assert(attrs[i]);
+		}
+		attrs[ARRAY_SIZE(names)] = igt_sysfs_attr_open(dir, "garbage");
+
+		igt_sysfs_attr_get_u64_array(attrs, ARRAY_SIZE(names), values);
+		igt_assert_eq_u64(values[0], 300);
+		igt_assert_eq_u64(values[1], 1100);
+		igt_assert_eq_u64(values[2], UINT64_MAX);
+
+		igt_assert(!__igt_sysfs_attr_get_u64_array(attrs, ARRAY_SIZE(attrs),
+							   values));
+
+		for (int i = 0; i < ARRAY_SIZE(attrs); i++)
+			igt_sysfs_attr_close(attrs[i]);
+	}
+
+	igt_fixture {
+		close(dir);
+		close(device);
+		igt_sysfs_set_root(NULL);
+		nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+	}
+}
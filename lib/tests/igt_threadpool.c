@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "igt_threadpool.h"
+#include "igt_tests_common.h"
+
+char prog[] = "igt_threadpool";
+char *fake_argv[] = { prog };
+int fake_argc = ARRAY_SIZE(fake_argv);
+
+#define RANGE 100000
+
+static struct igt_threadpool *pool;
+static atomic_int visits[RANGE];
+
+static void *square(void *data)
+{
+	unsigned long x = (unsigned long)data;
+
+	return (void *)(x * x);
+}
+
+static void *fib(void *data)
+{
+	unsigned long n = (unsigned long)data;
+	struct igt_future *a, *b;
+	void *x, *y;
+
+	if (n < 2)
+		return data;
+
+	/* Far more tasks than workers, all of them waiting on others */
+	a = igt_threadpool_submit(pool, fib, (void *)(n - 1));
+	b = igt_threadpool_submit(pool, fib, (void *)(n - 2));
+
+	x = igt_future_wait(a);
+	y = igt_future_wait(b);
+
+	return (void *)((unsigned long)x + (unsigned long)y);
+}
+
+static unsigned long run_fib(unsigned long n)
+{
+	void *ret = igt_future_wait(igt_threadpool_submit(pool, fib, (void *)n));
+
+	return (unsigned long)ret;
+}
+
+static void visit(unsigned long idx, void *data)
+{
+	atomic_fetch_add(&visits[idx], 1);
+}
+
+static void *failure_task(void *data)
+{
+	igt_assert(false);
+	return data;
+}
+
+static void failure_body(unsigned long idx, void *data)
+{
+	igt_assert(idx != 10);
+	usleep(100);
+}
+
+static void check_for(unsigned long start, unsigned long end,
+		      unsigned long grain)
+{
+	for (int i = 0; i < RANGE; i++)
+		visits[i] = 0;
+
+	igt_threadpool_for(pool, start, end, grain, visit, NULL);
+
+	for (unsigned long i = 0; i < RANGE; i++)
+		igt_assert_eq(visits[i], i >= start && i < end);
+}
+
+__noreturn static void threadpool_subtests(void)
+{
+	igt_subtest_init(fake_argc, fake_argv);
+
+	igt_fixture
+		pool = igt_threadpool_create(4);
+
+	igt_subtest("submit") {
+		struct igt_future *futures[1000];
+
+		for (unsigned long i = 0; i < ARRAY_SIZE(futures); i++)
+			futures[i] = igt_threadpool_submit(pool, square, (void *)i);
+
+		for (unsigned long i = 0; i < ARRAY_SIZE(futures); i++) {
+			void *ret = igt_future_wait(futures[i]);
+
+			igt_assert_eq_u64((unsigned long)ret, i * i);
+		}
+	}
+
+	igt_subtest("nested")
+		igt_assert_eq_u64(run_fib(20), 6765);
+
+	igt_subtest("for") {
+		check_for(0, RANGE, 0);
+		check_for(10, RANGE, 1);
+		check_for(10, RANGE - 10, 7);
+		check_for(0, RANGE, RANGE);
+		check_for(5, 5, 0);
+	}
+
+	igt_subtest("task-failure")
+		igt_future_wait(igt_threadpool_submit(pool, failure_task, NULL));
+
+	/* Gives up on the rest of the range rather than running all of it */
+	igt_subtest("for-failure")
+		igt_threadpool_for(pool, 0, RANGE, 1, failure_body, NULL);
+
+	/* The failed workers have been replaced */
+	igt_subtest("after-failure")
+		igt_assert_eq_u64(run_fib(15), 610);
+
+	igt_subtest("fork") {
+		/* Without the workers, tasks run in the submitting child */
+		igt_fork(child, 2)
+			igt_assert_eq_u64(run_fib(10), 55);
+		igt_waitchildren();
+	}
+
+	igt_fixture
+		igt_threadpool_destroy(pool);
+
+	igt_exit();
+}
+
+int main(int argc, char **argv)
+{
+	static char out[65536];
+	int status;
+	int outfd;
+	pid_t pid;
+
+	pid = do_fork_bg_with_pipes(threadpool_subtests, &outfd, NULL);
+
+	read_whole_pipe(outfd, out, sizeof(out));
+
+	internal_assert(safe_wait(pid, &status) != -1);
+	internal_assert_wexited(status, IGT_EXIT_FAILURE);
+
+	internal_assert(strstr(out, "Subtest submit: SUCCESS"));
+	internal_assert(strstr(out, "Subtest nested: SUCCESS"));
+	internal_assert(strstr(out, "Subtest for: SUCCESS"));
+	internal_assert(strstr(out, "Subtest task-failure: FAIL"));
+	internal_assert(strstr(out, "Subtest for-failure: FAIL"));
+	internal_assert(strstr(out, "Subtest after-failure: SUCCESS"));
+	internal_assert(strstr(out, "Subtest fork: SUCCESS"));
+	internal_assert(matches(out, "\\[thread:.*\\] Stack trace"));
+
+	close(outfd);
+
+	return 0;
+}
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Feeds a sample stream recorded by intel-gpu-overlay -c perf.record=<file>
+ * through the gpu-perf sample processing, to measure it without a GPU.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gpu-perf.h"
+
+static uint64_t elapsed_ns(const struct timespec *start,
+			   const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000000ull +
+		end->tv_nsec - start->tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	struct gpu_perf gp;
+	struct gpu_perf_comm *comm;
+	uint64_t samples = 0, updates = 0, time = 0;
+	int n, err;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <recording>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	err = gpu_perf_replay_init(&gp, argv[1]);
+	if (err) {
+		fprintf(stderr, "Could not replay %s: %s\n",
+			argv[1], strerror(err));
+		return EXIT_FAILURE;
+	}
+
+	while ((n = gpu_perf_replay(&gp))) {
+		struct timespec start, end;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		gpu_perf_update(&gp);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		time += elapsed_ns(&start, &end);
+		samples += n;
+		updates++;
+	}
+
+	printf("%llu samples in %llu updates: %.1fms, %.1fns per sample\n",
+	       (unsigned long long)samples, (unsigned long long)updates,
+	       time / 1e6, samples ? (double)time / samples : 0.);
+
+	for (comm = gp.comm; comm; comm = comm->next) {
+		uint64_t requests = 0;
+
+		for (n = 0; n < MAX_RINGS; n++)
+			requests += comm->nr_requests[n];
+
+		printf("%8d %-16s %10llu requests, %6u syncs, %.1fms waits\n",
+		       comm->pid, comm->name, (unsigned long long)requests,
+		       comm->nr_sema, comm->wait_time / 1e6);
+	}
+
+	for (n = 0; n < MAX_RINGS; n++) {
+		if (gp.ctx_switch[n] || gp.flip_complete[n])
+			printf("ring/plane %2d: %u context switches, %u flips\n",
+			       n, gp.ctx_switch[n], gp.flip_complete[n]);
+	}
+
+	return EXIT_SUCCESS;
+}
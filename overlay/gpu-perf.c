@@ -22,6 +22,7 @@
  *
  */
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/types.h>
@@ -34,6 +35,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <assert.h>
+#include <time.h>
 
 #include "igt_perf.h"
 
@@ -52,6 +54,8 @@
 
 #define N_PAGES 32
 
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
 struct sample_event {
 	struct perf_event_header header;
 	uint32_t pid, tid;
@@ -240,6 +244,7 @@ static int perf_tracepoint_open(struct gpu_perf *gp, int tp_id,
 		if (read(fd[n], track, sizeof(track)) < 0)
 			return errno;
 		sample[n].id = track[1];
+		sample[n].tp = tp_id;
 		sample[n].func = func;
 	}
 
@@ -278,6 +283,80 @@ err:
 	return EINVAL;
 }
 
+/*
+ * Recordings of the sample streams, for gpu_perf_replay_init(). A header
+ * with the layout of the tracepoints and the ids of the events is followed
+ * by the samples as they were processed, interleaved with the comm of each
+ * new client before its first sample.
+ */
+#define RECORD_MAGIC "GPUPERF"
+#define RECORD_VERSION 1
+#define RECORD_COMM UINT32_MAX
+
+static const size_t tracepoint_fields[] = {
+	offsetof(struct tracepoint, device_field),
+	offsetof(struct tracepoint, ctx_field),
+	offsetof(struct tracepoint, class_field),
+	offsetof(struct tracepoint, instance_field),
+	offsetof(struct tracepoint, seqno_field),
+	offsetof(struct tracepoint, global_seqno_field),
+	offsetof(struct tracepoint, plane_field),
+};
+#define N_TRACEPOINT_FIELDS ARRAY_SIZE(tracepoint_fields)
+
+struct record_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nr_cpus;
+	uint32_t nr_events;
+	uint32_t nr_tracepoints;
+	struct record_tracepoint {
+		int32_t event_id;
+		int32_t offset[N_TRACEPOINT_FIELDS];
+	} tracepoints[TP_NB];
+};
+
+struct record_event {
+	uint64_t id;
+	int32_t tp;
+	uint32_t pad;
+};
+
+struct record_entry {
+	uint32_t cpu;
+	uint32_t size;
+};
+
+static int *tracepoint_field(struct tracepoint *tp, int n)
+{
+	return (int *)((char *)tp + tracepoint_fields[n]);
+}
+
+static void record_entry(struct gpu_perf *gp, uint32_t cpu,
+			 const void *data, uint32_t size)
+{
+	struct record_entry entry = { .cpu = cpu, .size = size };
+
+	if (fwrite(&entry, sizeof(entry), 1, gp->record) != 1 ||
+	    fwrite(data, size, 1, gp->record) != 1) {
+		fclose(gp->record);
+		gp->record = NULL;
+	}
+}
+
+static void record_comm(struct gpu_perf *gp, const struct gpu_perf_comm *comm)
+{
+	struct {
+		int32_t pid;
+		char name[sizeof(comm->name)];
+	} entry;
+
+	entry.pid = comm->pid;
+	strcpy(entry.name, comm->name);
+	record_entry(gp, RECORD_COMM, &entry,
+		     offsetof(typeof(entry), name) + strlen(entry.name) + 1);
+}
+
 static int get_comm(pid_t pid, char *comm, int len)
 {
 	char filename[1024];
@@ -289,7 +368,7 @@ static int get_comm(pid_t pid, char *comm, int len)
 	fd = open(filename, 0);
 	if (fd >= 0) {
 		len = read(fd, comm, len-1);
-		if (len >= 0)
+		if (len > 0)
 			comm[len-1] = '\0';
 		close(fd);
 	} else
@@ -298,36 +377,190 @@ static int get_comm(pid_t pid, char *comm, int len)
 	return len;
 }
 
-static struct gpu_perf_comm *
-lookup_comm(struct gpu_perf *gp, pid_t pid)
+/*
+ * Every request_add, ring_sync and wait_begin sample looks up the comm of
+ * its client, so they are kept in a hash table by pid on top of the
+ * gp->comm list. Pids that can't be looked up in /proc (any more) are
+ * cached as well, but only retried once a second and not added to the list.
+ */
+#define COMM_HASH_MIN_BITS 6
+#define COMM_UNKNOWN_MAX 256
+
+static unsigned hash_pid(pid_t pid, int bits)
+{
+	return ((uint32_t)pid * 0x9e3779b1u) >> (32 - bits);
+}
+
+static void comm_hash_resize(struct gpu_perf *gp, int bits)
+{
+	struct gpu_perf_comm **hash, *comm, *next;
+	int n;
+
+	hash = calloc(1u << bits, sizeof(*hash));
+	if (hash == NULL)
+		return;
+
+	for (n = 0; gp->comm_hash && n < 1 << gp->comm_hash_bits; n++) {
+		for (comm = gp->comm_hash[n]; comm; comm = next) {
+			unsigned h = hash_pid(comm->pid, bits);
+
+			next = comm->hash_next;
+			comm->hash_next = hash[h];
+			hash[h] = comm;
+		}
+	}
+
+	free(gp->comm_hash);
+	gp->comm_hash = hash;
+	gp->comm_hash_bits = bits;
+}
+
+static struct gpu_perf_comm *comm_hash_find(struct gpu_perf *gp, pid_t pid)
 {
 	struct gpu_perf_comm *comm;
 
-	if (pid == 0)
+	if (gp->comm_hash == NULL)
 		return NULL;
 
-	for (comm = gp->comm; comm != NULL; comm = comm->next) {
+	for (comm = gp->comm_hash[hash_pid(pid, gp->comm_hash_bits)];
+	     comm != NULL; comm = comm->hash_next) {
 		if (comm->pid == pid)
 			break;
 	}
-	if (comm == NULL) {
-		comm = calloc(1, sizeof(*comm));
+
+	return comm;
+}
+
+static struct gpu_perf_comm *comm_hash_add(struct gpu_perf *gp, pid_t pid)
+{
+	struct gpu_perf_comm *comm;
+	unsigned h;
+
+	if (gp->comm_hash == NULL)
+		comm_hash_resize(gp, COMM_HASH_MIN_BITS);
+	else if (gp->nr_comm >= 1 << gp->comm_hash_bits)
+		comm_hash_resize(gp, gp->comm_hash_bits + 1);
+	if (gp->comm_hash == NULL)
+		return NULL;
+
+	comm = calloc(1, sizeof(*comm));
+	if (comm == NULL)
+		return NULL;
+
+	/* Not looked up yet, as far as lookup_comm() is concerned */
+	comm->pid = pid;
+	comm->unknown = 1;
+	gp->nr_unknown++;
+
+	h = hash_pid(pid, gp->comm_hash_bits);
+	comm->hash_next = gp->comm_hash[h];
+	gp->comm_hash[h] = comm;
+	gp->nr_comm++;
+
+	return comm;
+}
+
+static void comm_hash_remove(struct gpu_perf *gp, struct gpu_perf_comm *comm)
+{
+	struct gpu_perf_comm **prev;
+
+	prev = &gp->comm_hash[hash_pid(comm->pid, gp->comm_hash_bits)];
+	while (*prev != comm)
+		prev = &(*prev)->hash_next;
+	*prev = comm->hash_next;
+
+	if (comm->unknown)
+		gp->nr_unknown--;
+	if (gp->last_comm == comm)
+		gp->last_comm = NULL;
+	gp->nr_comm--;
+}
+
+/* Mark a cached comm as known and show it to the user */
+static void comm_set_known(struct gpu_perf *gp, struct gpu_perf_comm *comm)
+{
+	comm->unknown = 0;
+	gp->nr_unknown--;
+
+	comm->next = gp->comm;
+	gp->comm = comm;
+}
+
+static void expire_unknown_comms(struct gpu_perf *gp)
+{
+	time_t now;
+	int n;
+
+	if (gp->nr_unknown < COMM_UNKNOWN_MAX)
+		return;
+
+	now = time(NULL);
+	for (n = 0; n < 1 << gp->comm_hash_bits; n++) {
+		struct gpu_perf_comm *comm, *next;
+
+		for (comm = gp->comm_hash[n]; comm; comm = next) {
+			next = comm->hash_next;
+			if (comm->unknown && comm->unknown != now) {
+				comm_hash_remove(gp, comm);
+				free(comm);
+			}
+		}
+	}
+}
+
+static struct gpu_perf_comm *
+lookup_comm(struct gpu_perf *gp, pid_t pid)
+{
+	struct gpu_perf_comm *comm;
+
+	if (pid == 0)
+		return NULL;
+
+	/* Samples tend to come in bursts from the same client */
+	comm = gp->last_comm;
+	if (comm == NULL || comm->pid != pid) {
+		comm = comm_hash_find(gp, pid);
+		if (comm == NULL)
+			comm = comm_hash_add(gp, pid);
 		if (comm == NULL)
 			return NULL;
+	}
+
+	if (comm->unknown) {
+		time_t now = time(NULL);
+
+		if (comm->unknown == now)
+			return NULL;
 
-		if (get_comm(pid, comm->name, sizeof(comm->name)) < 0) {
-			free(comm);
+		/* A replay only knows the comms that were recorded */
+		if (gp->replay ||
+		    get_comm(pid, comm->name, sizeof(comm->name)) < 0) {
+			comm->unknown = now;
 			return NULL;
 		}
 
-		comm->pid = pid;
-		comm->next = gp->comm;
-		gp->comm = comm;
+		comm_set_known(gp, comm);
+		if (gp->record)
+			record_comm(gp, comm);
 	}
 
+	gp->last_comm = comm;
 	return comm;
 }
 
+/**
+ * gpu_perf_comm_free:
+ * @gp: the gpu_perf the comm was reported by
+ * @comm: comm already unlinked from gp->comm
+ *
+ * Drops @comm from the cache of comms and frees it.
+ */
+void gpu_perf_comm_free(struct gpu_perf *gp, struct gpu_perf_comm *comm)
+{
+	comm_hash_remove(gp, comm);
+	free(comm);
+}
+
 static int request_add(struct gpu_perf *gp, const void *event)
 {
 	const struct sample_event *sample = event;
@@ -420,6 +653,69 @@ static int wait_end(struct gpu_perf *gp, const void *event)
 	return 0;
 }
 
+
+static int (* const tp_handler[TP_NB])(struct gpu_perf *, const void *) = {
+	[TP_GEM_REQUEST_ADD]         = request_add,
+	[TP_GEM_REQUEST_WAIT_BEGIN]  = wait_begin,
+	[TP_GEM_REQUEST_WAIT_END]    = wait_end,
+	[TP_FLIP_COMPLETE]           = flip_complete,
+	[TP_GEM_RING_SYNC_TO]        = ring_sync,
+	[TP_GEM_RING_SWITCH_CONTEXT] = ctx_switch,
+};
+
+static unsigned hash_id(uint64_t id, int bits)
+{
+	return (id * 0x9e3779b97f4a7c15ull) >> (64 - bits);
+}
+
+/* Open addressed table of the indices into gp->sample by event id */
+static void sample_hash_init(struct gpu_perf *gp)
+{
+	int n = gp->nr_cpus * gp->nr_events;
+	int bits = 4;
+
+	while (1 << bits < 2 * n)
+		bits++;
+
+	gp->sample_hash = malloc(sizeof(int) << bits);
+	if (gp->sample_hash == NULL)
+		return;
+
+	memset(gp->sample_hash, -1, sizeof(int) << bits);
+	gp->sample_hash_bits = bits;
+
+	while (n--) {
+		unsigned h = hash_id(gp->sample[n].id, bits);
+
+		while (gp->sample_hash[h] != -1)
+			h = (h + 1) & ((1 << bits) - 1);
+		gp->sample_hash[h] = n;
+	}
+}
+
+static const struct gpu_perf_sample *
+find_sample(const struct gpu_perf *gp, uint64_t id)
+{
+	int bits = gp->sample_hash_bits;
+	unsigned h;
+
+	if (gp->sample_hash == NULL) {
+		for (int n = 0; n < gp->nr_cpus * gp->nr_events; n++) {
+			if (gp->sample[n].id == id)
+				return &gp->sample[n];
+		}
+		return NULL;
+	}
+
+	for (h = hash_id(id, bits); gp->sample_hash[h] != -1;
+	     h = (h + 1) & ((1 << bits) - 1)) {
+		if (gp->sample[gp->sample_hash[h]].id == id)
+			return &gp->sample[gp->sample_hash[h]];
+	}
+
+	return NULL;
+}
+
 void gpu_perf_init(struct gpu_perf *gp, unsigned flags)
 {
 	memset(gp, 0, sizeof(*gp));
@@ -440,95 +736,332 @@ void gpu_perf_init(struct gpu_perf *gp, unsigned flags)
 
 	if (perf_mmap(gp))
 		return;
+
+	sample_hash_init(gp);
 }
 
 static int process_sample(struct gpu_perf *gp, int cpu,
 			  const struct perf_event_header *header)
 {
 	const struct sample_event *sample = (const struct sample_event *)header;
-	int n, update = 0;
+	const struct gpu_perf_sample *s;
+	int update;
 
-	/* hash me! */
-	for (n = 0; n < gp->nr_events; n++) {
-		int m = n * gp->nr_cpus + cpu;
-		if (gp->sample[m].id != sample->id)
-			continue;
+	s = find_sample(gp, sample->id);
+	if (s == NULL)
+		return 0;
+
+	update = s->func(gp, sample);
+
+	/* After any new comm it looked up */
+	if (gp->record)
+		record_entry(gp, cpu, header, header->size);
+
+	return update;
+}
+
+/*
+ * Processes everything in the ring of @cpu in one go, with a single update
+ * of data_tail at the end for the kernel to reuse the space.
+ */
+static int drain_ring(struct gpu_perf *gp, int cpu)
+{
+	struct perf_event_mmap_page *mmap = gp->map[cpu];
+	const uint8_t *data = (uint8_t *)mmap + gp->page_size;
+	const uint64_t size = N_PAGES * gp->page_size;
+	const uint64_t mask = size - 1;
+	uint64_t head, tail;
+	int update = 0;
+
+	tail = mmap->data_tail;
+	head = mmap->data_head;
+	rmb();
+
+	while (head - tail >= sizeof(struct perf_event_header)) {
+		const struct perf_event_header *header;
+		uint64_t offset = tail & mask;
+
+		header = (const struct perf_event_header *)(data + offset);
+		assert(header->size > 0);
+		if (header->size > head - tail)
+			break;
+
+		/* Only records wrapping around the end need to be copied */
+		if (offset + header->size > size) {
+			int before = size - offset;
 
-		update = gp->sample[m].func(gp, sample);
-		break;
+			if (header->size > gp->buffer_size) {
+				uint8_t *b = realloc(gp->buffer, header->size);
+				if (b == NULL)
+					break;
+
+				gp->buffer = b;
+				gp->buffer_size = header->size;
+			}
+
+			memcpy(gp->buffer, header, before);
+			memcpy(gp->buffer + before, data, header->size - before);
+
+			header = (struct perf_event_header *)gp->buffer;
+		}
+
+		if (header->type == PERF_RECORD_SAMPLE)
+			update += process_sample(gp, cpu, header);
+		tail += header->size;
 	}
 
+	mmap->data_tail = tail;
+	wmb();
+
 	return update;
 }
 
 int gpu_perf_update(struct gpu_perf *gp)
 {
-	const int size = N_PAGES * gp->page_size;
-	const int mask = size - 1;
-	uint8_t *buffer = NULL;
-	int buffer_size = 0;
 	int n, update = 0;
 
 	if (gp->map == NULL)
 		return 0;
 
-	for (n = 0; n < gp->nr_cpus; n++) {
-		struct perf_event_mmap_page *mmap = gp->map[n];
-		const uint8_t *data;
-		uint64_t head, tail;
-		int wrap = 0;
+	for (n = 0; n < gp->nr_cpus; n++)
+		update += drain_ring(gp, n);
 
-		tail = mmap->data_tail;
-		head = mmap->data_head;
-		rmb();
+	expire_unknown_comms(gp);
+
+	return update;
+}
+
+/**
+ * gpu_perf_record:
+ * @gp: gpu_perf set up with gpu_perf_init()
+ * @filename: file to record to
+ *
+ * Records the samples processed by every gpu_perf_update() from now on,
+ * along with the comms of the clients, so that they can be replayed with
+ * gpu_perf_replay_init() without a GPU.
+ *
+ * Returns: 0 on success, or an errno.
+ */
+int gpu_perf_record(struct gpu_perf *gp, const char *filename)
+{
+	struct record_header header = {
+		.magic = RECORD_MAGIC,
+		.version = RECORD_VERSION,
+		.nr_cpus = gp->nr_cpus,
+		.nr_events = gp->nr_events,
+		.nr_tracepoints = TP_NB,
+	};
+	struct gpu_perf_comm *comm;
+	int n, f;
+
+	if (gp->map == NULL)
+		return ENODEV;
+
+	gp->record = fopen(filename, "w");
+	if (gp->record == NULL)
+		return errno;
+
+	for (n = 0; n < TP_NB; n++) {
+		struct tracepoint *tp = &tracepoints[n];
+
+		header.tracepoints[n].event_id = tp->event_id;
+		for (f = 0; f < N_TRACEPOINT_FIELDS; f++)
+			header.tracepoints[n].offset[f] =
+				tp->fields[*tracepoint_field(tp, f)].offset;
+	}
+	fwrite(&header, sizeof(header), 1, gp->record);
+
+	for (n = 0; n < gp->nr_cpus * gp->nr_events; n++) {
+		struct record_event event = {
+			.id = gp->sample[n].id,
+			.tp = gp->sample[n].tp,
+		};
+
+		fwrite(&event, sizeof(event), 1, gp->record);
+	}
 
-		if (head < tail) {
-			wrap = 1;
-			tail &= mask;
-			head &= mask;
-			head += size;
+	for (comm = gp->comm; comm; comm = comm->next)
+		record_comm(gp, comm);
+
+	if (gp->record == NULL || fflush(gp->record) || ferror(gp->record))
+		return EIO;
+
+	return 0;
+}
+
+struct gpu_perf_replay {
+	FILE *file;
+	struct record_entry entry;
+	uint8_t *data;
+	uint32_t data_size;
+	bool pending;
+};
+
+/**
+ * gpu_perf_replay_init:
+ * @gp: gpu_perf to set up
+ * @filename: recording from gpu_perf_record()
+ *
+ * Sets up @gp like gpu_perf_init() does, but with rings in memory that are
+ * fed by gpu_perf_replay() instead of the kernel.
+ *
+ * Returns: 0 on success, or an errno.
+ */
+int gpu_perf_replay_init(struct gpu_perf *gp, const char *filename)
+{
+	const int size = (1 + N_PAGES) * getpagesize();
+	struct record_header header;
+	int n, f;
+
+	memset(gp, 0, sizeof(*gp));
+	gp->page_size = getpagesize();
+
+	gp->replay = calloc(1, sizeof(*gp->replay));
+	if (gp->replay == NULL)
+		return ENOMEM;
+
+	gp->replay->file = fopen(filename, "r");
+	if (gp->replay->file == NULL)
+		return errno;
+
+	if (fread(&header, sizeof(header), 1, gp->replay->file) != 1 ||
+	    memcmp(header.magic, RECORD_MAGIC, sizeof(header.magic)) ||
+	    header.version != RECORD_VERSION ||
+	    header.nr_tracepoints != TP_NB ||
+	    header.nr_cpus == 0 || header.nr_cpus > 4096 ||
+	    header.nr_events > TP_NB)
+		return EINVAL;
+
+	for (n = 0; n < TP_NB; n++) {
+		struct tracepoint *tp = &tracepoints[n];
+
+		tp->event_id = header.tracepoints[n].event_id;
+		tp->n_fields = N_TRACEPOINT_FIELDS;
+		for (f = 0; f < N_TRACEPOINT_FIELDS; f++) {
+			tp->fields[f].offset = header.tracepoints[n].offset[f];
+			*tracepoint_field(tp, f) = f;
 		}
+	}
 
-		data = (uint8_t *)mmap + gp->page_size;
-		while (head - tail >= sizeof (struct perf_event_header)) {
-			const struct perf_event_header *header;
+	gp->nr_cpus = header.nr_cpus;
+	gp->nr_events = header.nr_events;
+	gp->sample = calloc(gp->nr_cpus * gp->nr_events, sizeof(*gp->sample));
+	gp->map = calloc(gp->nr_cpus, sizeof(void *));
+	if (gp->sample == NULL || gp->map == NULL)
+		return ENOMEM;
 
-			header = (const struct perf_event_header *)(data + (tail & mask));
-			assert(header->size > 0);
-			if (header->size > head - tail)
-				break;
+	for (n = 0; n < gp->nr_cpus * gp->nr_events; n++) {
+		struct record_event event;
+
+		if (fread(&event, sizeof(event), 1, gp->replay->file) != 1 ||
+		    event.tp < 0 || event.tp >= TP_NB)
+			return EINVAL;
+
+		gp->sample[n].id = event.id;
+		gp->sample[n].tp = event.tp;
+		gp->sample[n].func = tp_handler[event.tp];
+	}
+
+	for (n = 0; n < gp->nr_cpus; n++) {
+		if (posix_memalign(&gp->map[n], gp->page_size, size))
+			return ENOMEM;
+		memset(gp->map[n], 0, size);
+	}
 
-			if ((const uint8_t *)header + header->size > data + size) {
-				int before;
+	sample_hash_init(gp);
 
-				if (header->size > buffer_size) {
-					uint8_t *b = realloc(buffer, header->size);
-					if (b == NULL)
-						break;
+	return 0;
+}
+
+static void replay_comm(struct gpu_perf *gp, const void *data, uint32_t size)
+{
+	struct gpu_perf_comm *comm;
+	int32_t pid;
+
+	if (size <= sizeof(pid))
+		return;
 
-					buffer = b;
-					buffer_size = header->size;
-				}
+	memcpy(&pid, data, sizeof(pid));
+	comm = comm_hash_find(gp, pid) ?: comm_hash_add(gp, pid);
+	if (comm == NULL)
+		return;
 
-				before = data + size - (const uint8_t *)header;
+	size = min(size - sizeof(pid), sizeof(comm->name));
+	memcpy(comm->name, (const char *)data + sizeof(pid), size);
+	comm->name[size - 1] = '\0';
 
-				memcpy(buffer, header, before);
-				memcpy(buffer + before, data, header->size - before);
+	if (comm->unknown)
+		comm_set_known(gp, comm);
+}
 
-				header = (struct perf_event_header *)buffer;
+/**
+ * gpu_perf_replay:
+ * @gp: gpu_perf set up with gpu_perf_replay_init()
+ *
+ * Fills the rings with the next samples of the recording, for the
+ * following gpu_perf_update() to process.
+ *
+ * Returns: The number of samples added, 0 at the end of the recording.
+ */
+int gpu_perf_replay(struct gpu_perf *gp)
+{
+	struct gpu_perf_replay *replay = gp->replay;
+	const uint64_t size = N_PAGES * gp->page_size;
+	const uint64_t mask = size - 1;
+	int count = 0;
+
+	for (;;) {
+		struct perf_event_mmap_page *mmap;
+		uint64_t head, offset;
+		uint8_t *data;
+		int before;
+
+		if (!replay->pending) {
+			if (fread(&replay->entry, sizeof(replay->entry), 1,
+				  replay->file) != 1)
+				break;
+
+			if (replay->entry.size > replay->data_size) {
+				uint8_t *b = realloc(replay->data, replay->entry.size);
+				if (b == NULL)
+					break;
+
+				replay->data = b;
+				replay->data_size = replay->entry.size;
+			}
+
+			if (fread(replay->data, replay->entry.size, 1,
+				  replay->file) != 1)
+				break;
+
+			if (replay->entry.cpu == RECORD_COMM) {
+				replay_comm(gp, replay->data, replay->entry.size);
+				continue;
 			}
 
-			if (header->type == PERF_RECORD_SAMPLE)
-				update += process_sample(gp, n, header);
-			tail += header->size;
+			if (replay->entry.cpu >= gp->nr_cpus ||
+			    replay->entry.size > size)
+				continue;
+
+			replay->pending = true;
 		}
 
-		if (wrap)
-			tail &= mask;
-		mmap->data_tail = tail;
-		wmb();
+		/* Leave the rest for after the next gpu_perf_update() */
+		mmap = gp->map[replay->entry.cpu];
+		head = mmap->data_head;
+		if (head + replay->entry.size - mmap->data_tail > size)
+			break;
+
+		data = (uint8_t *)mmap + gp->page_size;
+		offset = head & mask;
+		before = min(size - offset, (uint64_t)replay->entry.size);
+		memcpy(data + offset, replay->data, before);
+		memcpy(data, replay->data + before, replay->entry.size - before);
+		mmap->data_head = head + replay->entry.size;
+
+		replay->pending = false;
+		count++;
 	}
 
-	free(buffer);
-	return update;
+	return count;
 }
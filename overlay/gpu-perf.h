@@ -27,6 +27,9 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
 
 #define MAX_RINGS 16
 
@@ -39,14 +42,24 @@ struct gpu_perf {
 	void **map;
 	struct gpu_perf_sample {
 		uint64_t id;
+		int tp;
 		int (*func)(struct gpu_perf *, const void *);
 	} *sample;
+	int *sample_hash;
+	int sample_hash_bits;
+
+	uint8_t *buffer;
+	int buffer_size;
+
+	FILE *record;
+	struct gpu_perf_replay *replay;
 
 	unsigned flip_complete[MAX_RINGS];
 	unsigned ctx_switch[MAX_RINGS];
 
 	struct gpu_perf_comm {
 		struct gpu_perf_comm *next;
+		struct gpu_perf_comm *hash_next;
 		char name[256];
 		pid_t pid;
 		bool active;
@@ -57,7 +70,13 @@ struct gpu_perf {
 		uint32_t nr_sema;
 
 		time_t show;
+		time_t unknown;
 	} *comm;
+	struct gpu_perf_comm **comm_hash;
+	struct gpu_perf_comm *last_comm;
+	int comm_hash_bits;
+	int nr_comm;
+	int nr_unknown;
 	struct gpu_perf_time {
 		struct gpu_perf_time *next;
 		struct gpu_perf_comm *comm;
@@ -69,5 +88,10 @@ struct gpu_perf {
 
 void gpu_perf_init(struct gpu_perf *gp, unsigned flags);
 int gpu_perf_update(struct gpu_perf *gp);
+void gpu_perf_comm_free(struct gpu_perf *gp, struct gpu_perf_comm *comm);
+
+int gpu_perf_record(struct gpu_perf *gp, const char *filename);
+int gpu_perf_replay_init(struct gpu_perf *gp, const char *filename);
+int gpu_perf_replay(struct gpu_perf *gp);
 
 #endif /* GPU_PERF_H */
@@ -305,6 +305,7 @@ kms_overlay_create(struct config *config, int *width, int *height)
 
 	priv->base.show = kms_overlay_show;
 	priv->base.hide = kms_overlay_hide;
+	priv->base.damage = NULL;
 
 	priv->visible = false;
 	priv->x = 0;
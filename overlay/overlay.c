@@ -71,6 +71,17 @@ static void overlay_show(cairo_surface_t *surface)
 	overlay->show(overlay);
 }
 
+static void overlay_damage(cairo_surface_t *surface, int x, int y, int w, int h)
+{
+	struct overlay *overlay;
+
+	overlay = cairo_surface_get_user_data(surface, &overlay_key);
+	if (overlay == NULL || overlay->damage == NULL)
+		return;
+
+	overlay->damage(overlay, x, y, w, h);
+}
+
 #if 0
 static void overlay_position(cairo_surface_t *surface, enum position p)
 {
@@ -195,6 +206,8 @@ static void show_gpu_top(struct overlay_context *ctx, struct overlay_gpu_top *gt
 	int rewind;
 	int do_rewind;
 
+	overlay_damage(ctx->surface, 0, 0, ctx->width/2, ctx->height/2);
+
 	update = gpu_top_update(&gt->gpu_top);
 
 	cairo_rectangle(ctx->cr, PAD-.5, PAD-.5, ctx->width/2-SIZE_PAD+1, ctx->height/2-SIZE_PAD+1);
@@ -275,10 +288,18 @@ static void show_gpu_top(struct overlay_context *ctx, struct overlay_gpu_top *gt
 }
 
 static void init_gpu_perf(struct overlay_context *ctx,
-			  struct overlay_gpu_perf *gp)
+			  struct overlay_gpu_perf *gp,
+			  struct config *config)
 {
+	const char *record;
+
 	gpu_perf_init(&gp->gpu_perf, 0);
 
+	/* For replaying with intel-gpu-overlay-replay */
+	record = config_get_value(config, "perf", "record");
+	if (record && *record && gpu_perf_record(&gp->gpu_perf, record))
+		fprintf(stderr, "Could not record to %s\n", record);
+
 	gp->show_ctx = 0;
 	gp->show_flips = 0;
 }
@@ -325,6 +346,8 @@ static void show_gpu_perf(struct overlay_context *ctx, struct overlay_gpu_perf *
 	int has_ctx = 0;
 	int has_flips = 0;
 
+	overlay_damage(ctx->surface, ctx->width/2, 0, ctx->width - ctx->width/2, ctx->height/2);
+
 	gpu_perf_update(&gp->gpu_perf);
 
 	for (n = 0; n < MAX_RINGS; n++) {
@@ -491,7 +514,7 @@ skip_comm:
 				chart_fini(comm->user_data);
 				free(comm->user_data);
 			}
-			free(comm);
+			gpu_perf_comm_free(&gp->gpu_perf, comm);
 		} else
 			prev = &comm->next;
 	}
@@ -582,6 +605,8 @@ static void show_gpu_freq(struct overlay_context *ctx, struct overlay_gpu_freq *
 	int has_irqs = gem_interrupts_update(&gf->irqs) == 0;
 	cairo_pattern_t *linear;
 
+	overlay_damage(ctx->surface, 0, ctx->height/2, ctx->width/2, ctx->height - ctx->height/2);
+
 	cairo_rectangle(ctx->cr, PAD-.5, ctx->height/2+HALF_PAD-.5, ctx->width/2-SIZE_PAD+1, ctx->height/2-SIZE_PAD+1);
 	cairo_set_source_rgb(ctx->cr, .15, .15, .15);
 	cairo_set_line_width(ctx->cr, 1);
@@ -749,6 +774,9 @@ static void show_gem_objects(struct overlay_context *ctx, struct overlay_gem_obj
 	cairo_pattern_t *linear;
 	int x, y, y1, y2;
 
+	/* The whole quadrant was cleared, even if there's nothing to show */
+	overlay_damage(ctx->surface, ctx->width/2, ctx->height/2, ctx->width - ctx->width/2, ctx->height - ctx->height/2);
+
 	if (go->error == 0)
 		go->error = gem_objects_update(&go->gem_objects);
 	if (go->error)
@@ -926,7 +954,7 @@ int main(int argc, char **argv)
 	debugfs_init();
 
 	init_gpu_top(&ctx, &ctx.gpu_top);
-	init_gpu_perf(&ctx, &ctx.gpu_perf);
+	init_gpu_perf(&ctx, &ctx.gpu_perf, &config);
 	init_gpu_freq(&ctx, &ctx.gpu_freq);
 	init_gem_objects(&ctx, &ctx.gem_objects);
 
@@ -57,6 +57,7 @@ struct overlay {
 	cairo_surface_t *surface;
 	void (*show)(struct overlay *);
 	void (*hide)(struct overlay *);
+	void (*damage)(struct overlay *, int x, int y, int w, int h);
 };
 
 extern const cairo_user_data_key_t overlay_key;
@@ -22,108 +22,469 @@
  *
  */
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "rgb2yuv.h"
 
-static int RGB2YUV_YR[256], RGB2YUV_YG[256], RGB2YUV_YB[256];
-static int RGB2YUV_UR[256], RGB2YUV_UG[256], RGB2YUV_UBVR[256];
-static int RGB2YUV_VG[256], RGB2YUV_VB[256];
+/*
+ * BT.601 studio range, in 15-bit fixed point for an 8-bit RGB input:
+ *
+ *   Y = ( 65.481 R + 128.553 G +  24.966 B) / 256 + 16
+ *   U = (-37.797 R -  74.203 G + 112.000 B) / 256 + 128
+ *   V = (112.000 R -  93.786 G -  18.214 B) / 256 + 128
+ *
+ * Chroma is computed from the sum of each 2x2 block of pixels, hence
+ * the 2 extra bits of shift. All coefficients fit in a signed 16-bit
+ * multiplier for pmaddwd.
+ */
+#define Y_R 8382
+#define Y_G 16455
+#define Y_B 3196
+#define U_R -4838
+#define U_G -9498
+#define U_B 14336
+#define V_R 14336
+#define V_G -12005
+#define V_B -2331
 
-void rgb2yuv_init(void)
+#define Y_SHIFT 15
+#define Y_OFFSET (16 << Y_SHIFT)
+#define UV_SHIFT (Y_SHIFT + 2)
+#define UV_OFFSET (128 << UV_SHIFT)
+
+/* Converts pairs of pixels from two rows, with one chroma sample per pair */
+typedef void (*convert_fn)(const uint16_t *rgb0, const uint16_t *rgb1,
+			   uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+			   int pairs);
+
+static convert_fn convert;
+
+static inline void rgb565_expand(uint16_t p, int *r, int *g, int *b)
+{
+	*r = (p >> 11) & 0x1f;
+	*g = (p >>  5) & 0x3f;
+	*b = (p >>  0) & 0x1f;
+
+	*r = *r << 3 | *r >> 2;
+	*g = *g << 2 | *g >> 4;
+	*b = *b << 3 | *b >> 2;
+}
+
+static inline uint8_t rgb565_to_y(uint16_t p)
+{
+	int r, g, b;
+
+	rgb565_expand(p, &r, &g, &b);
+	return (Y_R * r + Y_G * g + Y_B * b + Y_OFFSET) >> Y_SHIFT;
+}
+
+static void convert_c(const uint16_t *rgb0, const uint16_t *rgb1,
+		      uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		      int pairs)
 {
 	int i;
 
-	for (i = 0; i < 256; i++)
-		RGB2YUV_YR[i] = 65.481 * (i << 8);
+	for (i = 0; i < pairs; i++) {
+		int sr = 0, sg = 0, sb = 0;
+		int k;
+
+		for (k = 0; k < 2; k++) {
+			int r, g, b;
 
-	for (i = 0; i < 256; i++)
-		RGB2YUV_YG[i] = 128.553 * (i << 8);
+			rgb565_expand(rgb0[2*i + k], &r, &g, &b);
+			y0[2*i + k] = (Y_R * r + Y_G * g + Y_B * b + Y_OFFSET) >> Y_SHIFT;
+			sr += r; sg += g; sb += b;
 
-	for (i = 0; i < 256; i++)
-		RGB2YUV_YB[i] = 24.966 * (i << 8);
+			rgb565_expand(rgb1[2*i + k], &r, &g, &b);
+			y1[2*i + k] = (Y_R * r + Y_G * g + Y_B * b + Y_OFFSET) >> Y_SHIFT;
+			sr += r; sg += g; sb += b;
+		}
 
-	for (i = 0; i < 256; i++)
-		RGB2YUV_UR[i] = 37.797 * (i << 8);
+		u[i] = (U_R * sr + U_G * sg + U_B * sb + UV_OFFSET) >> UV_SHIFT;
+		v[i] = (V_R * sr + V_G * sg + V_B * sb + UV_OFFSET) >> UV_SHIFT;
+	}
+}
 
-	for (i = 0; i < 256; i++)
-		RGB2YUV_UG[i] = 74.203 * (i << 8);
+#if defined(__x86_64__) && !defined(__clang__)
+#include <emmintrin.h>
 
-	for (i = 0; i < 256; i++)
-		RGB2YUV_VG[i] = 93.786 * (i << 8);
+/*
+ * The offsets are folded into the multiply-adds as 16384 * (offset >> 14),
+ * pairing up the blue channel with a constant 16384.
+ */
+#define OFFSET_LANE 16384
 
-	for (i = 0; i < 256; i++)
-		RGB2YUV_VB[i] = 18.214 * (i << 8);
+static inline void sse2_expand(__m128i p, __m128i *r, __m128i *g, __m128i *b)
+{
+	__m128i r5 = _mm_srli_epi16(p, 11);
+	__m128i g6 = _mm_and_si128(_mm_srli_epi16(p, 5), _mm_set1_epi16(0x3f));
+	__m128i b5 = _mm_and_si128(p, _mm_set1_epi16(0x1f));
 
-	for (i = 0; i < 256; i++)
-		RGB2YUV_UBVR[i] = 112 * (i << 8);
+	*r = _mm_or_si128(_mm_slli_epi16(r5, 3), _mm_srli_epi16(r5, 2));
+	*g = _mm_or_si128(_mm_slli_epi16(g6, 2), _mm_srli_epi16(g6, 4));
+	*b = _mm_or_si128(_mm_slli_epi16(b5, 3), _mm_srli_epi16(b5, 2));
 }
 
-int rgb2yuv(cairo_surface_t *surface, XvImage *image, uint8_t *yuv)
+/* a * r + b * g + c * b + offset for 16-bit lanes, as 16-bit lanes */
+static inline __m128i sse2_dot(__m128i r, __m128i g, __m128i b,
+			       __m128i rg_coeff, __m128i b_coeff, int shift)
 {
-	uint8_t *data = cairo_image_surface_get_data(surface);
-	int rgb_stride = cairo_image_surface_get_stride(surface);
-	int width = cairo_image_surface_get_width(surface);
-	int height = cairo_image_surface_get_height(surface);
-	int y_stride = image->pitches[0];
-	int uv_stride = image->pitches[1];
-	uint8_t *tmp, *tl, *tr, *bl, *br;
-	int i, j;
-
-	tmp = malloc(2*width*height);
-	if (tmp == NULL)
-		return 0;
+	__m128i k = _mm_set1_epi16(OFFSET_LANE);
+	__m128i lo, hi;
 
-	tl = tmp;
-	bl = tmp + width*height;
+	lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r, g), rg_coeff),
+			   _mm_madd_epi16(_mm_unpacklo_epi16(b, k), b_coeff));
+	hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r, g), rg_coeff),
+			   _mm_madd_epi16(_mm_unpackhi_epi16(b, k), b_coeff));
 
-	for (i = 0; i < height; i++) {
-		uint16_t *rgb = (uint16_t *)(data + i * rgb_stride);
-		for (j = 0; j < width; j++) {
-			uint8_t r = (rgb[j] >> 11) & 0x1f;
-			uint8_t g = (rgb[j] >>  5) & 0x3f;
-			uint8_t b = (rgb[j] >>  0) & 0x1f;
+	return _mm_packs_epi32(_mm_srai_epi32(lo, shift),
+			       _mm_srai_epi32(hi, shift));
+}
 
-			r = r<<3 | r>>2;
-			g = g<<2 | g>>4;
-			b = b<<3 | b>>2;
+static inline __m128i sse2_coeff(int a, int b)
+{
+	return _mm_set1_epi32((uint16_t)a | (uint32_t)(uint16_t)b << 16);
+}
 
-			yuv[j] = (RGB2YUV_YR[r] + RGB2YUV_YG[g] + RGB2YUV_YB[b] + 1048576) >> 16;
-			*tl++ = (-RGB2YUV_UR[r] - RGB2YUV_UG[g] + RGB2YUV_UBVR[b] + 8388608) >> 16;
-			*bl++ = (RGB2YUV_UBVR[r] - RGB2YUV_VG[g] - RGB2YUV_VB[b] + 8388608) >> 16;
-		}
-		yuv += y_stride;
+/* Sums adjacent lanes of two vectors of 8, giving a vector of 8 sums */
+static inline __m128i sse2_pair_sum(__m128i a, __m128i b)
+{
+	__m128i one = _mm_set1_epi16(1);
+
+	return _mm_packs_epi32(_mm_madd_epi16(a, one), _mm_madd_epi16(b, one));
+}
+
+static void convert_sse2(const uint16_t *rgb0, const uint16_t *rgb1,
+			 uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+			 int pairs)
+{
+	const __m128i y_rg = sse2_coeff(Y_R, Y_G);
+	const __m128i y_b = sse2_coeff(Y_B, Y_OFFSET / OFFSET_LANE);
+	const __m128i u_rg = sse2_coeff(U_R, U_G);
+	const __m128i u_b = sse2_coeff(U_B, UV_OFFSET / OFFSET_LANE);
+	const __m128i v_rg = sse2_coeff(V_R, V_G);
+	const __m128i v_b = sse2_coeff(V_B, UV_OFFSET / OFFSET_LANE);
+	int i;
+
+	for (i = 0; i + 8 <= pairs; i += 8) {
+		__m128i r[4], g[4], b[4], y[4], sr, sg, sb, cu, cv;
+		int k;
+
+		sse2_expand(_mm_loadu_si128((const __m128i *)(rgb0 + 2*i)), &r[0], &g[0], &b[0]);
+		sse2_expand(_mm_loadu_si128((const __m128i *)(rgb0 + 2*i + 8)), &r[1], &g[1], &b[1]);
+		sse2_expand(_mm_loadu_si128((const __m128i *)(rgb1 + 2*i)), &r[2], &g[2], &b[2]);
+		sse2_expand(_mm_loadu_si128((const __m128i *)(rgb1 + 2*i + 8)), &r[3], &g[3], &b[3]);
+
+		for (k = 0; k < 4; k++)
+			y[k] = sse2_dot(r[k], g[k], b[k], y_rg, y_b, Y_SHIFT);
+
+		_mm_storeu_si128((__m128i *)(y0 + 2*i), _mm_packus_epi16(y[0], y[1]));
+		_mm_storeu_si128((__m128i *)(y1 + 2*i), _mm_packus_epi16(y[2], y[3]));
+
+		sr = sse2_pair_sum(_mm_add_epi16(r[0], r[2]), _mm_add_epi16(r[1], r[3]));
+		sg = sse2_pair_sum(_mm_add_epi16(g[0], g[2]), _mm_add_epi16(g[1], g[3]));
+		sb = sse2_pair_sum(_mm_add_epi16(b[0], b[2]), _mm_add_epi16(b[1], b[3]));
+
+		cu = sse2_dot(sr, sg, sb, u_rg, u_b, UV_SHIFT);
+		cv = sse2_dot(sr, sg, sb, v_rg, v_b, UV_SHIFT);
+		cu = _mm_packus_epi16(cu, cv);
+
+		_mm_storel_epi64((__m128i *)(u + i), cu);
+		_mm_storel_epi64((__m128i *)(v + i), _mm_srli_si128(cu, 8));
 	}
 
-	tl = tmp; tr = tl + 1;
-	bl = tl + width; br = bl + 1;
-	for (i = 0; i < height/2; i ++) {
-		for (j = 0; j < width/2; j ++) {
-			yuv[j] = ((int)*tl + *tr + *bl + *br) >> 2;
-			tl += 2; tr += 2;
-			bl += 2; br += 2;
-		}
-		yuv += uv_stride;
+	convert_c(rgb0 + 2*i, rgb1 + 2*i, y0 + 2*i, y1 + 2*i, u + i, v + i,
+		  pairs - i);
+}
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include <immintrin.h>
+
+static inline void avx2_expand(__m256i p, __m256i *r, __m256i *g, __m256i *b)
+{
+	__m256i r5 = _mm256_srli_epi16(p, 11);
+	__m256i g6 = _mm256_and_si256(_mm256_srli_epi16(p, 5), _mm256_set1_epi16(0x3f));
+	__m256i b5 = _mm256_and_si256(p, _mm256_set1_epi16(0x1f));
+
+	*r = _mm256_or_si256(_mm256_slli_epi16(r5, 3), _mm256_srli_epi16(r5, 2));
+	*g = _mm256_or_si256(_mm256_slli_epi16(g6, 2), _mm256_srli_epi16(g6, 4));
+	*b = _mm256_or_si256(_mm256_slli_epi16(b5, 3), _mm256_srli_epi16(b5, 2));
+}
+
+/*
+ * Same as sse2_dot(), the unpack, multiply-add and pack steps all work
+ * within 128-bit lanes, so the order of the 16-bit lanes is preserved.
+ */
+static inline __m256i avx2_dot(__m256i r, __m256i g, __m256i b,
+			       __m256i rg_coeff, __m256i b_coeff, int shift)
+{
+	__m256i k = _mm256_set1_epi16(OFFSET_LANE);
+	__m256i lo, hi;
+
+	lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(r, g), rg_coeff),
+			      _mm256_madd_epi16(_mm256_unpacklo_epi16(b, k), b_coeff));
+	hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(r, g), rg_coeff),
+			      _mm256_madd_epi16(_mm256_unpackhi_epi16(b, k), b_coeff));
+
+	return _mm256_packs_epi32(_mm256_srai_epi32(lo, shift),
+				  _mm256_srai_epi32(hi, shift));
+}
+
+static inline __m256i avx2_coeff(int a, int b)
+{
+	return _mm256_set1_epi32((uint16_t)a | (uint32_t)(uint16_t)b << 16);
+}
+
+/* Packing interleaves the 128-bit lanes of a and b, put them back in order */
+static inline __m256i avx2_fixup(__m256i x)
+{
+	return _mm256_permute4x64_epi64(x, 0xd8);
+}
+
+static inline __m256i avx2_pair_sum(__m256i a, __m256i b)
+{
+	__m256i one = _mm256_set1_epi16(1);
+
+	return avx2_fixup(_mm256_packs_epi32(_mm256_madd_epi16(a, one),
+					     _mm256_madd_epi16(b, one)));
+}
 
-		tl += width; tr += width;
-		bl += width; br += width;
+static void convert_avx2(const uint16_t *rgb0, const uint16_t *rgb1,
+			 uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+			 int pairs)
+{
+	const __m256i y_rg = avx2_coeff(Y_R, Y_G);
+	const __m256i y_b = avx2_coeff(Y_B, Y_OFFSET / OFFSET_LANE);
+	const __m256i u_rg = avx2_coeff(U_R, U_G);
+	const __m256i u_b = avx2_coeff(U_B, UV_OFFSET / OFFSET_LANE);
+	const __m256i v_rg = avx2_coeff(V_R, V_G);
+	const __m256i v_b = avx2_coeff(V_B, UV_OFFSET / OFFSET_LANE);
+	int i;
+
+	for (i = 0; i + 16 <= pairs; i += 16) {
+		__m256i r[4], g[4], b[4], y[4], sr, sg, sb, cu, cv;
+		int k;
+
+		avx2_expand(_mm256_loadu_si256((const __m256i *)(rgb0 + 2*i)), &r[0], &g[0], &b[0]);
+		avx2_expand(_mm256_loadu_si256((const __m256i *)(rgb0 + 2*i + 16)), &r[1], &g[1], &b[1]);
+		avx2_expand(_mm256_loadu_si256((const __m256i *)(rgb1 + 2*i)), &r[2], &g[2], &b[2]);
+		avx2_expand(_mm256_loadu_si256((const __m256i *)(rgb1 + 2*i + 16)), &r[3], &g[3], &b[3]);
+
+		for (k = 0; k < 4; k++)
+			y[k] = avx2_dot(r[k], g[k], b[k], y_rg, y_b, Y_SHIFT);
+
+		_mm256_storeu_si256((__m256i *)(y0 + 2*i),
+				    avx2_fixup(_mm256_packus_epi16(y[0], y[1])));
+		_mm256_storeu_si256((__m256i *)(y1 + 2*i),
+				    avx2_fixup(_mm256_packus_epi16(y[2], y[3])));
+
+		sr = avx2_pair_sum(_mm256_add_epi16(r[0], r[2]), _mm256_add_epi16(r[1], r[3]));
+		sg = avx2_pair_sum(_mm256_add_epi16(g[0], g[2]), _mm256_add_epi16(g[1], g[3]));
+		sb = avx2_pair_sum(_mm256_add_epi16(b[0], b[2]), _mm256_add_epi16(b[1], b[3]));
+
+		cu = avx2_dot(sr, sg, sb, u_rg, u_b, UV_SHIFT);
+		cv = avx2_dot(sr, sg, sb, v_rg, v_b, UV_SHIFT);
+		cu = avx2_fixup(_mm256_packus_epi16(cu, cv));
+
+		_mm_storeu_si128((__m128i *)(u + i), _mm256_castsi256_si128(cu));
+		_mm_storeu_si128((__m128i *)(v + i), _mm256_extracti128_si256(cu, 1));
+	}
+
+	convert_sse2(rgb0 + 2*i, rgb1 + 2*i, y0 + 2*i, y1 + 2*i, u + i, v + i,
+		     pairs - i);
+}
+
+#pragma GCC pop_options
+#endif
+
+void rgb2yuv_init(void)
+{
+	convert = convert_c;
+
+#if defined(__x86_64__) && !defined(__clang__)
+	convert = convert_sse2;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		convert = convert_avx2;
+#endif
+}
+
+#define MAX_DAMAGE 16
+#define CHUNK 64
+
+struct rgb2yuv {
+	int width, height;
+
+	/* The RGB data as of the last conversion, to skip unchanged parts */
+	uint16_t *prev;
+	bool valid;
+
+	int num_damage;
+	struct rgb2yuv_box {
+		int x1, y1, x2, y2;
+	} damage[MAX_DAMAGE];
+};
+
+struct rgb2yuv *rgb2yuv_create(int width, int height)
+{
+	struct rgb2yuv *cvt;
+
+	cvt = calloc(1, sizeof(*cvt));
+	if (cvt == NULL)
+		return NULL;
+
+	cvt->prev = malloc(sizeof(uint16_t) * width * height);
+	if (cvt->prev == NULL) {
+		free(cvt);
+		return NULL;
+	}
+
+	cvt->width = width;
+	cvt->height = height;
+	rgb2yuv_damage(cvt, 0, 0, width, height);
+
+	return cvt;
+}
+
+void rgb2yuv_destroy(struct rgb2yuv *cvt)
+{
+	if (cvt == NULL)
+		return;
+
+	free(cvt->prev);
+	free(cvt);
+}
+
+/*
+ * Marks a part of the surface as redrawn since the last rgb2yuv(), with
+ * the edges rounded out to the 2x2 chroma blocks.
+ */
+void rgb2yuv_damage(struct rgb2yuv *cvt, int x, int y, int w, int h)
+{
+	struct rgb2yuv_box box = {
+		.x1 = x < 0 ? 0 : x & ~1,
+		.y1 = y < 0 ? 0 : y & ~1,
+		.x2 = (x + w + 1) & ~1,
+		.y2 = (y + h + 1) & ~1,
+	};
+	int i;
+
+	if (box.x2 > cvt->width)
+		box.x2 = cvt->width;
+	if (box.y2 > cvt->height)
+		box.y2 = cvt->height;
+	if (box.x1 >= box.x2 || box.y1 >= box.y2)
+		return;
+
+	if (cvt->num_damage < MAX_DAMAGE) {
+		cvt->damage[cvt->num_damage++] = box;
+		return;
 	}
 
-	tl = tmp + width*height; tr = tl + 1;
-	bl = tl + width; br = bl + 1;
-	for (i = 0; i < height/2; i++) {
-		for (j = 0; j < width/2; j++) {
-			yuv[j] = ((int)*tl + *tr + *bl + *br) >> 2;
-			tl += 2; tr += 2;
-			bl += 2; br += 2;
+	/* Too many, fall back to their extents */
+	for (i = 0; i < cvt->num_damage; i++) {
+		if (cvt->damage[i].x1 < box.x1)
+			box.x1 = cvt->damage[i].x1;
+		if (cvt->damage[i].y1 < box.y1)
+			box.y1 = cvt->damage[i].y1;
+		if (cvt->damage[i].x2 > box.x2)
+			box.x2 = cvt->damage[i].x2;
+		if (cvt->damage[i].y2 > box.y2)
+			box.y2 = cvt->damage[i].y2;
+	}
+	cvt->damage[0] = box;
+	cvt->num_damage = 1;
+}
+
+struct planes {
+	uint8_t *y, *u, *v;
+	int y_stride, uv_stride;
+};
+
+static void convert_box(struct rgb2yuv *cvt, const uint8_t *data, int stride,
+			const struct planes *yuv, const struct rgb2yuv_box *box)
+{
+	int width = cvt->width;
+	int x, y;
+
+	for (y = box->y1; y < box->y2; y += 2) {
+		const uint16_t *rgb0 = (const uint16_t *)(data + y * stride);
+		uint16_t *prev0 = cvt->prev + y * width;
+		uint8_t *y0 = yuv->y + y * yuv->y_stride;
+
+		if (y + 1 == cvt->height) {
+			/* Odd last row, no chroma for it */
+			for (x = box->x1; x < box->x2; x++)
+				y0[x] = rgb565_to_y(rgb0[x]);
+			memcpy(prev0 + box->x1, rgb0 + box->x1,
+			       sizeof(uint16_t) * (box->x2 - box->x1));
+			continue;
 		}
-		yuv += uv_stride;
 
-		tl += width; tr += width;
-		bl += width; br += width;
+		for (x = box->x1; x < box->x2; x += CHUNK) {
+			const uint16_t *rgb1 = (const uint16_t *)((const uint8_t *)rgb0 + stride);
+			uint16_t *prev1 = prev0 + width;
+			uint8_t *y1 = y0 + yuv->y_stride;
+			int n = box->x2 - x < CHUNK ? box->x2 - x : CHUNK;
+			size_t len = sizeof(uint16_t) * n;
+
+			if (cvt->valid &&
+			    memcmp(prev0 + x, rgb0 + x, len) == 0 &&
+			    memcmp(prev1 + x, rgb1 + x, len) == 0)
+				continue;
+
+			convert(rgb0 + x, rgb1 + x, y0 + x, y1 + x,
+				yuv->u + y / 2 * yuv->uv_stride + x / 2,
+				yuv->v + y / 2 * yuv->uv_stride + x / 2,
+				n / 2);
+
+			/* Odd last column, no chroma for it */
+			if (n & 1) {
+				y0[x + n - 1] = rgb565_to_y(rgb0[x + n - 1]);
+				y1[x + n - 1] = rgb565_to_y(rgb1[x + n - 1]);
+			}
+
+			memcpy(prev0 + x, rgb0 + x, len);
+			memcpy(prev1 + x, rgb1 + x, len);
+		}
 	}
+}
+
+/*
+ * Converts the damaged parts of an RGB565 surface to the planar YUV 4:2:0
+ * image, straight into its planes.
+ */
+int rgb2yuv(struct rgb2yuv *cvt, cairo_surface_t *surface,
+	    XvImage *image, uint8_t *yuv)
+{
+	uint8_t *data = cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+	struct planes planes = {
+		.y = yuv + image->offsets[0],
+		.u = yuv + image->offsets[1],
+		.v = yuv + image->offsets[2],
+		.y_stride = image->pitches[0],
+		.uv_stride = image->pitches[1],
+	};
+	int i;
+
+	if (cairo_image_surface_get_width(surface) != cvt->width ||
+	    cairo_image_surface_get_height(surface) != cvt->height)
+		return 0;
+
+	cairo_surface_flush(surface);
+
+	for (i = 0; i < cvt->num_damage; i++)
+		convert_box(cvt, data, stride, &planes, &cvt->damage[i]);
+
+	cvt->num_damage = 0;
+	cvt->valid = true;
 
-	free(tmp);
 	return 1;
 }
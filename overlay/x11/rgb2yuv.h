@@ -30,7 +30,12 @@
 #include <cairo.h>
 #include <stdint.h>
 
+struct rgb2yuv;
+
 void rgb2yuv_init(void);
-int rgb2yuv(cairo_surface_t *rgb, XvImage *image, uint8_t *yuv);
+struct rgb2yuv *rgb2yuv_create(int width, int height);
+void rgb2yuv_destroy(struct rgb2yuv *cvt);
+void rgb2yuv_damage(struct rgb2yuv *cvt, int x, int y, int w, int h);
+int rgb2yuv(struct rgb2yuv *cvt, cairo_surface_t *rgb, XvImage *image, uint8_t *yuv);
 
 #endif /* RGB2YUV_H */
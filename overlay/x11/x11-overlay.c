@@ -57,6 +57,8 @@ struct x11_overlay {
 	XvImage *image;
 	void *map, *mem;
 	int size;
+	struct rgb2yuv *rgb2yuv;
+	int damage_y1, damage_y2;
 	unsigned name;
 	int x, y;
 	int visible;
@@ -75,10 +77,17 @@ static void x11_overlay_show(struct overlay *overlay)
 {
 	struct x11_overlay *priv = to_x11_overlay(overlay);
 
-	if (priv->image->id == FOURCC_XVMC)
-		rgb2yuv(priv->base.surface, priv->image, priv->map);
-	else
-		memcpy(priv->map, priv->mem, priv->size);
+	if (priv->image->id == FOURCC_XVMC) {
+		rgb2yuv(priv->rgb2yuv, priv->base.surface, priv->image, priv->map);
+	} else if (priv->damage_y1 < priv->damage_y2) {
+		int stride = priv->image->pitches[0];
+
+		memcpy((char *)priv->map + priv->damage_y1 * stride,
+		       (char *)priv->mem + priv->damage_y1 * stride,
+		       (priv->damage_y2 - priv->damage_y1) * stride);
+	}
+	priv->damage_y1 = priv->image->height;
+	priv->damage_y2 = 0;
 
 	if (!priv->visible) {
 		XvPutImage(priv->dpy, priv->port, DefaultRootWindow(priv->dpy),
@@ -92,6 +101,20 @@ static void x11_overlay_show(struct overlay *overlay)
 	}
 }
 
+static void x11_overlay_damage(struct overlay *overlay,
+			       int x, int y, int w, int h)
+{
+	struct x11_overlay *priv = to_x11_overlay(overlay);
+
+	if (priv->rgb2yuv)
+		rgb2yuv_damage(priv->rgb2yuv, x, y, w, h);
+
+	if (y < priv->damage_y1)
+		priv->damage_y1 = y < 0 ? 0 : y;
+	if (y + h > priv->damage_y2)
+		priv->damage_y2 = y + h > priv->image->height ? priv->image->height : y + h;
+}
+
 static void x11_overlay_hide(struct overlay *overlay)
 {
 	struct x11_overlay *priv = to_x11_overlay(overlay);
@@ -107,6 +130,7 @@ static void x11_overlay_destroy(void *data)
 	struct x11_overlay *priv = data;
 	munmap(priv->map, priv->size);
 	free(priv->mem);
+	rgb2yuv_destroy(priv->rgb2yuv);
 	XCloseDisplay(priv->dpy);
 	free(priv);
 }
@@ -254,9 +278,17 @@ x11_overlay_create(struct config *config, int *width, int *height)
 	if (priv == NULL)
 		goto err_surface;
 
+	priv->rgb2yuv = NULL;
+	if (image->id == FOURCC_XVMC) {
+		priv->rgb2yuv = rgb2yuv_create(image->width, image->height);
+		if (priv->rgb2yuv == NULL)
+			goto err_priv;
+	}
+
 	priv->base.surface = surface;
 	priv->base.show = x11_overlay_show;
 	priv->base.hide = x11_overlay_hide;
+	priv->base.damage = x11_overlay_damage;
 
 	priv->dpy = dpy;
 	priv->gc = XCreateGC(dpy, DefaultRootWindow(dpy), 0, NULL);
@@ -266,6 +298,8 @@ x11_overlay_create(struct config *config, int *width, int *height)
 	priv->size = create.size;
 	priv->name = flink.name;
 	priv->visible = false;
+	priv->damage_y1 = 0;
+	priv->damage_y2 = image->height;
 
 	priv->x = x;
 	priv->y = y;
@@ -283,6 +317,8 @@ x11_overlay_create(struct config *config, int *width, int *height)
 	*height = image->height;
 	return surface;
 
+err_priv:
+	free(priv);
 err_surface:
 	cairo_surface_destroy(surface);
 err_mem:
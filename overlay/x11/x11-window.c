@@ -151,6 +151,7 @@ x11_window_create(struct config *config, int *width, int *height)
 
 	priv->base.show = x11_window_show;
 	priv->base.hide = x11_window_hide;
+	priv->base.damage = NULL;
 
 	priv->dpy = dpy;
 	priv->win = win;
@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/select.h>
@@ -21,6 +22,7 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/utsname.h>
 #include <sys/wait.h>
 #include <dirent.h>
@@ -32,6 +34,7 @@
 #include "igt_core.h"
 #include "igt_taints.h"
 #include "executor.h"
+#include "kmsg.h"
 #include "output_strings.h"
 #include "runnercomms.h"
 
@@ -594,11 +597,10 @@ static long dump_dmesg(int kmsgfd, int outfd)
 	 */
 
 	int comparefd;
-	unsigned flags;
-	unsigned long long seq, cmpseq, usec;
+	struct kmsg_record record;
+	unsigned long long cmpseq;
 	bool underflow_once = false;
-	char cont;
-	char buf[2048];
+	char buf[2048 + 1];
 	ssize_t r;
 	long written = 0;
 
@@ -623,16 +625,16 @@ static long dump_dmesg(int kmsgfd, int outfd)
 				}
 			} else {
 				buf[r] = '\0';
-				if (sscanf(buf, "%u,%llu,%llu,%c;",
-					   &flags, &cmpseq, &usec, &cont) == 4) {
+				if (kmsg_parse_record(buf, &record)) {
 					/* Reading comparison record done. */
+					cmpseq = record.seq;
 					close(comparefd);
 					comparefd = -1;
 				}
 			}
 		}
 
-		r = read(kmsgfd, buf, sizeof(buf));
+		r = read(kmsgfd, buf, sizeof(buf) - 1);
 		if (r < 0) {
 			if (errno == EPIPE) {
 				if (!underflow_once) {
@@ -655,15 +657,15 @@ static long dump_dmesg(int kmsgfd, int outfd)
 
 		write(outfd, buf, r);
 		written += r;
+		buf[r] = '\0';
 
-		if (comparefd < 0 && sscanf(buf, "%u,%llu,%llu,%c;",
-					    &flags, &seq, &usec, &cont) == 4) {
+		if (comparefd < 0 && kmsg_parse_record(buf, &record)) {
 			/*
 			 * Comparison record has been read, compare
 			 * the sequence number to see if we have read
 			 * enough.
 			 */
-			if (seq >= cmpseq)
+			if (record.seq >= cmpseq)
 				return written;
 		}
 	}
@@ -846,7 +848,7 @@ static int next_kill_signal(int killed)
 	}
 }
 
-static void write_packet_with_canary(int fd, struct runnerpacket *packet, bool sync)
+static void write_packet_with_canary(int fd, const struct runnerpacket *packet, bool sync)
 {
 	uint32_t canary = socket_dump_canary();
 
@@ -856,9 +858,49 @@ static void write_packet_with_canary(int fd, struct runnerpacket *packet, bool s
 		fdatasync(fd);
 }
 
+/*
+ * Packets read from the comms ring, written to the dump with a single
+ * writev() instead of two writes each. They point into the ring, so the
+ * batch must be flushed before the ring space is released.
+ */
+struct comms_batch {
+	uint32_t canary;
+	int count;
+	struct iovec iov[256];
+};
+
+static void flush_comms_batch(int fd, struct comms_batch *batch, bool sync)
+{
+	if (!batch->count)
+		return;
+
+	writev(fd, batch->iov, batch->count);
+	if (sync)
+		fdatasync(fd);
+
+	batch->count = 0;
+}
+
+static void add_to_comms_batch(int fd, struct comms_batch *batch,
+			       const struct runnerpacket *packet, bool sync)
+{
+	if (batch->count == sizeof(batch->iov) / sizeof(batch->iov[0]))
+		flush_comms_batch(fd, batch, sync);
+
+	batch->canary = socket_dump_canary();
+	batch->iov[batch->count].iov_base = &batch->canary;
+	batch->iov[batch->count].iov_len = sizeof(batch->canary);
+	batch->iov[batch->count + 1].iov_base = (void *)packet;
+	batch->iov[batch->count + 1].iov_len = packet->size;
+	batch->count += 2;
+}
+
 /* TODO: Refactor this macro from here and from various tests to lib */
 #define KB(x) ((x) * 1024)
 
+/* How often to look for the datagram of a marker record again */
+#define RING_DATAGRAM_WAIT_US 10000
+
 /*
  * Returns:
  *  =0 - Success
@@ -867,6 +909,7 @@ static void write_packet_with_canary(int fd, struct runnerpacket *packet, bool s
  */
 static int monitor_output(pid_t child,
 			  int outfd, int errfd, int socketfd,
+			  struct runnercomms_ring *ring, int doorbellfd,
 			  int kmsgfd, int sigfd,
 			  int *outputs,
 			  double *time_spent,
@@ -888,6 +931,7 @@ static int monitor_output(pid_t child,
 	int wd_timeout;
 	int killed = 0; /* 0 if not killed, signal number otherwise */
 	struct timespec time_beg, time_now, time_last_activity, time_last_subtest, time_killed;
+	struct runnercomms_reader reader;
 	unsigned long taints = 0;
 	bool aborting = false;
 	size_t disk_usage = 0;
@@ -901,6 +945,8 @@ static int monitor_output(pid_t child,
 		nfds = errfd;
 	if (socketfd > nfds)
 		nfds = socketfd;
+	if (doorbellfd > nfds)
+		nfds = doorbellfd;
 	if (kmsgfd > nfds)
 		nfds = kmsgfd;
 	if (sigfd > nfds)
@@ -933,6 +979,8 @@ static int monitor_output(pid_t child,
 	bufsize = KB(256);
 	buf = malloc(bufsize);
 
+	runnercomms_reader_init(&reader, ring);
+
 	while (outfd >= 0 || errfd >= 0 || sigfd >= 0) {
 		const char *timeout_reason;
 		struct timeval tv = { .tv_sec = interval_length };
@@ -949,6 +997,23 @@ static int monitor_output(pid_t child,
 		if (sigfd >= 0)
 			FD_SET(sigfd, &set);
 
+		if (ring) {
+			FD_SET(doorbellfd, &set);
+
+			/*
+			 * Don't sleep if packets arrived since the last
+			 * drain. If instead the next record is a marker
+			 * whose datagram hasn't shown up, its arrival on
+			 * the socket wakes us, but don't wait for long
+			 * in case it never comes.
+			 */
+			if (!runnercomms_ring_arm(ring)) {
+				tv.tv_sec = 0;
+				tv.tv_usec = reader.want_datagram ?
+					RING_DATAGRAM_WAIT_US : 0;
+			}
+		}
+
 		n = select(nfds, &set, NULL, NULL, &tv);
 		ping_watchdogs();
 
@@ -1076,46 +1141,89 @@ static int monitor_output(pid_t child,
 			}
 		}
 
-		if (socketfd >= 0 && FD_ISSET(socketfd, &set)) {
-			struct runnerpacket *packet;
+		if (ring || (socketfd >= 0 && FD_ISSET(socketfd, &set))) {
+			const struct runnerpacket *packet;
+			struct comms_batch batch;
+			bool socket_drained = socketfd < 0 || !FD_ISSET(socketfd, &set);
+			bool socket_reread = false;
+			bool from_reader;
 
-			time_last_activity = time_now;
+			batch.count = 0;
 
-			/* Fully drain everything */
+			if (ring && FD_ISSET(doorbellfd, &set)) {
+				uint64_t doorbell;
+
+				read(doorbellfd, &doorbell, sizeof(doorbell));
+			}
+
+			/*
+			 * Fully drain everything. Datagrams sent while
+			 * the ring is in use are tagged, and the reader
+			 * puts them back in order with the ring records,
+			 * so read the socket first.
+			 */
 			while (true) {
-				s = recv(socketfd, buf, bufsize, MSG_DONTWAIT);
+				from_reader = false;
 
-				if (s < 0) {
-					if (errno == EAGAIN)
-						break;
+				if (!socket_drained) {
+					s = recv(socketfd, buf, bufsize, MSG_DONTWAIT);
 
-					errf("Error reading from communication socket: %m\n");
+					if (s < 0) {
+						socket_drained = true;
+						if (errno == EAGAIN)
+							continue;
 
-					close(socketfd);
-					socketfd = -1;
-					goto socket_end;
-				}
+						errf("Error reading from communication socket: %m\n");
 
-				packet = (struct runnerpacket *)buf;
-				if (s < sizeof(*packet) || s != packet->size) {
-					struct runnerpacket *message, *override;
+						close(socketfd);
+						socketfd = -1;
+						continue;
+					}
 
-					errf("Socket communication error: Received %zd bytes, expected %zd\n",
-					     s, s >= sizeof(packet->size) ? packet->size : sizeof(*packet));
-					message = runnerpacket_log(STDOUT_FILENO,
-								   "\nrunner: Socket communication error, invalid packet size. "
-								   "Packet is discarded, test result and logs might be incorrect.\n");
-					write_packet_with_canary(outputs[_F_SOCKET], message, false);
-					free(message);
+					if (runnercomms_reader_add_datagram(&reader, buf, s))
+						continue;
 
-					override = runnerpacket_resultoverride("warn");
-					write_packet_with_canary(outputs[_F_SOCKET], override, settings->sync);
-					free(override);
+					/* Keep the dump in order */
+					flush_comms_batch(outputs[_F_SOCKET], &batch, settings->sync);
 
-					/* Continue using socket comms, hope for the best. */
-					goto socket_end;
+					packet = (struct runnerpacket *)buf;
+					if (s < sizeof(*packet) || s != packet->size) {
+						struct runnerpacket *message, *override;
+
+						errf("Socket communication error: Received %zd bytes, expected %zd\n",
+						     s, s >= sizeof(packet->size) ? packet->size : sizeof(*packet));
+						message = runnerpacket_log(STDOUT_FILENO,
+									   "\nrunner: Socket communication error, invalid packet size. "
+									   "Packet is discarded, test result and logs might be incorrect.\n");
+						write_packet_with_canary(outputs[_F_SOCKET], message, false);
+						free(message);
+
+						override = runnerpacket_resultoverride("warn");
+						write_packet_with_canary(outputs[_F_SOCKET], override, settings->sync);
+						free(override);
+
+						/* Continue using socket comms, hope for the best. */
+						socket_drained = true;
+						continue;
+					}
+				} else {
+					packet = runnercomms_reader_next(&reader, false);
+					if (!packet) {
+						/* Sent after we emptied the socket, read it once more */
+						if (reader.want_datagram && !socket_reread && socketfd >= 0) {
+							socket_reread = true;
+							socket_drained = false;
+							continue;
+						}
+
+						break;
+					}
+
+					from_reader = true;
 				}
 
+				time_last_activity = time_now;
+
 				/*
 				 * runner sends EXEC itself before executing
 				 * the test, other types indicate the test
@@ -1143,6 +1251,7 @@ static int monitor_output(pid_t child,
 						 */
 						*abortreason = need_to_abort_time_sensitive(settings);
 						if (*abortreason) {
+							flush_comms_batch(outputs[_F_SOCKET], &batch, false);
 							write_packet_with_canary(outputs[_F_SOCKET],
 										 runnerpacket_log(STDOUT_FILENO, "\nThis test caused an abort condition: "),
 										 false);
@@ -1159,7 +1268,10 @@ static int monitor_output(pid_t child,
 					}
 				}
 
-				write_packet_with_canary(outputs[_F_SOCKET], packet, settings->sync);
+				if (from_reader)
+					add_to_comms_batch(outputs[_F_SOCKET], &batch, packet, settings->sync);
+				else
+					write_packet_with_canary(outputs[_F_SOCKET], packet, settings->sync);
 				disk_usage += packet->size;
 
 				if (packet->type == PACKETTYPE_SUBTEST_RESULT ||
@@ -1212,8 +1324,41 @@ static int monitor_output(pid_t child,
 					}
 				}
 			}
+
+			flush_comms_batch(outputs[_F_SOCKET], &batch, settings->sync);
+			runnercomms_reader_release(&reader);
+
+			if (reader.lost) {
+				struct runnerpacket *message;
+
+				errf("Ring communication error: %u packets left unfinished by killed processes\n",
+				     reader.lost);
+				message = runnerpacket_log(STDOUT_FILENO,
+							   "\nrunner: A process was killed in the middle of sending a packet. "
+							   "Packet is discarded, logs might be incomplete.\n");
+				write_packet_with_canary(outputs[_F_SOCKET], message, settings->sync);
+				free(message);
+
+				reader.lost = 0;
+			}
+
+			if (reader.dropped) {
+				struct runnerpacket *message, *override;
+
+				errf("Ring communication error: %u malformed packets\n", reader.dropped);
+				message = runnerpacket_log(STDOUT_FILENO,
+							   "\nrunner: Ring communication error, invalid packet size. "
+							   "Packet is discarded, test result and logs might be incorrect.\n");
+				write_packet_with_canary(outputs[_F_SOCKET], message, false);
+				free(message);
+
+				override = runnerpacket_resultoverride("warn");
+				write_packet_with_canary(outputs[_F_SOCKET], override, settings->sync);
+				free(override);
+
+				reader.dropped = 0;
+			}
 		}
-	socket_end:
 
 		if (kmsgfd >= 0 && FD_ISSET(kmsgfd, &set)) {
 			long dmesgwritten;
@@ -1396,11 +1541,42 @@ static int monitor_output(pid_t child,
 				}
 
 				if (socket_comms_used) {
+					const struct runnerpacket *packet;
 					struct runnerpacket *exitpacket;
 					char timestr[32];
 
 					snprintf(timestr, sizeof(timestr), "%.3f", time);
 
+					/*
+					 * Datagrams still waiting for their
+					 * turn are waiting for the ring
+					 * records stuck below.
+					 */
+					while ((packet = runnercomms_reader_next(&reader, true)))
+						write_packet_with_canary(outputs[_F_SOCKET], packet, false);
+					runnercomms_reader_release(&reader);
+
+					/*
+					 * The ring was drained above, anything
+					 * left is stuck behind a packet the
+					 * test never completed.
+					 */
+					if (ring && runnercomms_ring_pending(ring)) {
+						struct runnerpacket *message, *override;
+
+						errf("Ring communication error: %u bytes of unfinished packets\n",
+						     runnercomms_ring_pending(ring));
+						message = runnerpacket_log(STDOUT_FILENO,
+									   "\nrunner: Test exited in the middle of sending a packet. "
+									   "Later packets are lost, test result and logs might be incorrect.\n");
+						write_packet_with_canary(outputs[_F_SOCKET], message, false);
+						free(message);
+
+						override = runnerpacket_resultoverride("warn");
+						write_packet_with_canary(outputs[_F_SOCKET], override, false);
+						free(override);
+					}
+
 					if (timeoutresult) {
 						struct runnerpacket *override;
 
@@ -1463,6 +1639,7 @@ static int monitor_output(pid_t child,
 					fdatasync(outputs[_F_DMESG]);
 
 				close_watchdogs(settings);
+				runnercomms_reader_fini(&reader);
 				free(buf);
 				free(outbuf);
 				close(outfd);
@@ -1488,6 +1665,7 @@ static int monitor_output(pid_t child,
 	if (settings->sync)
 		fdatasync(outputs[_F_DMESG]);
 
+	runnercomms_reader_fini(&reader);
 	free(buf);
 	free(outbuf);
 	close(outfd);
@@ -1503,6 +1681,7 @@ static int monitor_output(pid_t child,
 
 static void __attribute__((noreturn))
 execute_test_process(int outfd, int errfd, int socketfd,
+		     struct runnercomms_ring *ring, int doorbellfd,
 		     struct settings *settings,
 		     struct job_list_entry *entry)
 {
@@ -1558,7 +1737,8 @@ execute_test_process(int outfd, int errfd, int socketfd,
 		struct runnerpacket *packet;
 
 		packet = runnerpacket_exec(argv);
-		write(socketfd, packet, packet->size);
+		if (!(ring && runnercomms_ring_send(ring, doorbellfd, packet)))
+			write(socketfd, packet, packet->size);
 	}
 
 	execv(argv[0], argv);
@@ -1645,6 +1825,8 @@ static int execute_next_entry(struct execute_state *state,
 	int errpipe[2] = { -1, -1 };
 	int socket[2] = { -1, -1 };
 	int outfd, errfd, socketfd;
+	struct runnercomms_ring *ring = NULL;
+	int ringfd = -1, doorbellfd = -1;
 	char name[32];
 	pid_t child;
 	int result;
@@ -1680,6 +1862,19 @@ static int execute_next_entry(struct execute_state *state,
 		goto out_pipe;
 	}
 
+	/* Without the ring, everything goes through the socket */
+	if (!getenv("IGT_RUNNER_DISABLE_SOCKET_COMMUNICATION"))
+		ring = runnercomms_ring_create(RUNNERCOMMS_RING_SIZE, &ringfd);
+	if (ring) {
+		doorbellfd = eventfd(0, EFD_NONBLOCK);
+		if (doorbellfd < 0) {
+			runnercomms_ring_unmap(ring);
+			close(ringfd);
+			ring = NULL;
+			ringfd = -1;
+		}
+	}
+
 	if ((kmsgfd = open("/dev/kmsg", O_RDONLY | O_CLOEXEC | O_NONBLOCK)) < 0) {
 		errf("Warning: Cannot open /dev/kmsg\n");
 	} else {
@@ -1734,10 +1929,18 @@ static int execute_next_entry(struct execute_state *state,
 		if (socketfd >= 0 && !getenv("IGT_RUNNER_DISABLE_SOCKET_COMMUNICATION")) {
 			snprintf(envstring, sizeof(envstring), "%d", socketfd);
 			setenv("IGT_RUNNER_SOCKET_FD", envstring, 1);
+
+			if (ring) {
+				snprintf(envstring, sizeof(envstring), "%d", ringfd);
+				setenv("IGT_RUNNER_COMMS_RING_FD", envstring, 1);
+				snprintf(envstring, sizeof(envstring), "%d", doorbellfd);
+				setenv("IGT_RUNNER_COMMS_DOORBELL_FD", envstring, 1);
+			}
 		}
 		setenv("IGT_SENTINEL_ON_STDERR", "1", 1);
 
-		execute_test_process(outfd, errfd, socketfd, settings, entry);
+		execute_test_process(outfd, errfd, socketfd, ring, doorbellfd,
+				     settings, entry);
 		/* unreachable */
 	}
 
@@ -1747,15 +1950,20 @@ static int execute_next_entry(struct execute_state *state,
 	close(outpipe[1]);
 	close(errpipe[1]);
 	close(socket[1]);
-	outpipe[1] = errpipe[1] = socket[1] = -1;
+	close(ringfd);
+	outpipe[1] = errpipe[1] = socket[1] = ringfd = -1;
 
 	result = monitor_output(child, outfd, errfd, socketfd,
+				ring, doorbellfd,
 				kmsgfd, sigfd,
 				outputs, time_spent, settings,
 				abortreason, abort_already_written);
 
 out_kmsgfd:
 	close(kmsgfd);
+	runnercomms_ring_unmap(ring);
+	close(ringfd);
+	close(doorbellfd);
 out_pipe:
 	close_outputs(outputs);
 	close(outpipe[0]);
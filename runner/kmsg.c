@@ -0,0 +1,438 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "kmsg.h"
+#include "output_strings.h"
+
+/*
+ * Parses the decimal number at *p like scanf("%llu") would and
+ * advances *p past it.
+ */
+static bool parse_number(char **p, unsigned long long *val)
+{
+	char *end;
+
+	*val = strtoull(*p, &end, 10);
+	if (end == *p)
+		return false;
+
+	*p = end;
+	return true;
+}
+
+/**
+ * kmsg_parse_record:
+ * @line: nul-terminated kernel log record
+ * @record: filled with the fields of @line
+ *
+ * Equivalent to sscanf(line, "%u,%llu,%llu,%c;", ...) but without
+ * going through the format string machinery for every record, which
+ * shows up when parsing the logs of a drm.debug enabled run.
+ *
+ * The message of the record starts after the first ';'. If there is
+ * none, #message in @record is set to NULL.
+ *
+ * Returns: Whether the record header could be parsed.
+ */
+bool kmsg_parse_record(char *line, struct kmsg_record *record)
+{
+	unsigned long long flags;
+	char *p = line;
+
+	if (!parse_number(&p, &flags) || *p++ != ',' ||
+	    !parse_number(&p, &record->seq) || *p++ != ',' ||
+	    !parse_number(&p, &record->ts_usec) || *p++ != ',' ||
+	    *p == '\0')
+		return false;
+
+	record->flags = flags;
+	record->continuation = *p;
+
+	record->message = strchr(p, ';');
+	if (record->message)
+		record->message++;
+
+	return true;
+}
+
+/*
+ * Markers the test library writes to the kernel log with igt_kmsg().
+ * They share a common prefix, so all of them are found with a single
+ * strstr() pass.
+ */
+static const struct {
+	const char *str;
+	unsigned flag;
+} markers[] = {
+	{ STARTING_SUBTEST_DMESG, KMSG_SUBTEST_START },
+	{ STARTING_DYNAMIC_SUBTEST_DMESG, KMSG_DYNAMIC_SUBTEST_START },
+};
+
+/*
+ * One top-level alternative of the filter regexp. The regexp can only
+ * match if #literal is found in the message, and when the
+ * alternative is nothing but that literal there's no need to run the
+ * regexp at all.
+ */
+struct kmsg_filter_alternative {
+	char *literal; /* NULL if no required literal could be found */
+	bool exact;
+	GRegex *re; /* NULL if exact */
+};
+
+struct kmsg_classifier {
+	char marker_prefix[32];
+
+	size_t num_alternatives;
+	struct kmsg_filter_alternative *alternatives;
+};
+
+/* Returns the closing ']' of the bracket expression at p */
+static const char *skip_class(const char *p)
+{
+	p++;
+	if (*p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+
+	for (; *p; p++) {
+		if (*p == '\\') {
+			if (!*++p)
+				return NULL;
+		} else if (*p == '[' && p[1] == ':') {
+			p = strstr(p + 2, ":]");
+			if (!p)
+				return NULL;
+			p++;
+		} else if (*p == ']') {
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+/* Returns the closing ')' of the group at p */
+static const char *skip_group(const char *p)
+{
+	int depth = 0;
+
+	for (; *p; p++) {
+		if (*p == '\\') {
+			if (!*++p)
+				return NULL;
+		} else if (*p == '[') {
+			p = skip_class(p);
+			if (!p)
+				return NULL;
+		} else if (*p == '(') {
+			depth++;
+		} else if (*p == ')' && --depth == 0) {
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Finds the longest run of characters that any match of the
+ * alternative [s, e) must contain. Being conservative is fine, the
+ * regexp still has the last word.
+ */
+static char *required_literal(const char *s, const char *e, bool *exact)
+{
+	char *best = calloc(1, e - s + 1);
+	char *cur = calloc(1, e - s + 1);
+	size_t bestlen = 0, curlen = 0;
+	const char *p;
+
+	*exact = true;
+
+	for (p = s; p <= e; p++) {
+		bool literal = p < e;
+		char c = *p;
+
+		if (p == e) {
+			/* Flush the last run */
+		} else if (c == '\\') {
+			c = *++p;
+			if (isalnum(c))
+				literal = false;
+		} else if (c == '.' || c == '^' || c == '$') {
+			literal = false;
+		} else if (c == '[') {
+			p = skip_class(p);
+			literal = false;
+		} else if (c == '(') {
+			p = skip_group(p);
+			literal = false;
+		} else if (c == '*' || c == '?' || c == '{') {
+			/* The preceding character is optional */
+			if (curlen)
+				curlen--;
+			if (c == '{') {
+				const char *close = strchr(p, '}');
+
+				p = close && close < e ? close : e - 1;
+			}
+			literal = false;
+		} else if (c == '+') {
+			/* The preceding character is required, but may repeat */
+			literal = false;
+		}
+
+		if (literal) {
+			cur[curlen++] = c;
+			continue;
+		}
+
+		if (p < e)
+			*exact = false;
+
+		if (curlen > bestlen) {
+			memcpy(best, cur, curlen);
+			best[curlen] = '\0';
+			bestlen = curlen;
+		}
+		curlen = 0;
+	}
+
+	free(cur);
+
+	if (!bestlen && !*exact) {
+		free(best);
+		return NULL;
+	}
+
+	return best;
+}
+
+/*
+ * Whether the regexp can be matched one top-level alternative at a
+ * time. Inline options, backreferences and \Q...\E quoting would
+ * need a real regexp parser to be taken apart.
+ */
+static bool can_split(const char *regex)
+{
+	const char *p;
+
+	if (strstr(regex, "(?"))
+		return false;
+
+	for (p = regex; (p = strchr(p, '\\')) != NULL; p += 2) {
+		if (isdigit(p[1]) || p[1] == 'g' || p[1] == 'k' || p[1] == 'Q')
+			return false;
+		if (!p[1])
+			break;
+	}
+
+	return true;
+}
+
+static bool add_alternatives(struct kmsg_classifier *classifier,
+			     const char *s, const char *e);
+
+static bool add_alternative(struct kmsg_classifier *classifier,
+			    const char *s, const char *e)
+{
+	struct kmsg_filter_alternative *alt;
+
+	/* A group spanning the whole alternative holds more alternatives */
+	if (e - s >= 2 && s[0] == '(' && s[1] != '?' && skip_group(s) == e - 1)
+		return add_alternatives(classifier, s + 1, e - 1);
+
+	classifier->alternatives = realloc(classifier->alternatives,
+					   (classifier->num_alternatives + 1) *
+					   sizeof(*classifier->alternatives));
+	alt = &classifier->alternatives[classifier->num_alternatives++];
+	memset(alt, 0, sizeof(*alt));
+
+	alt->literal = required_literal(s, e, &alt->exact);
+	if (!alt->exact) {
+		char *regex = strndup(s, e - s);
+
+		alt->re = g_regex_new(regex, G_REGEX_OPTIMIZE, 0, NULL);
+		free(regex);
+		if (!alt->re)
+			return false;
+	}
+
+	return true;
+}
+
+/* Splits [s, e) at the top-level '|' */
+static bool add_alternatives(struct kmsg_classifier *classifier,
+			     const char *s, const char *e)
+{
+	const char *p, *alt = s;
+
+	for (p = s; p < e; p++) {
+		if (*p == '\\') {
+			p++;
+		} else if (*p == '[') {
+			p = skip_class(p);
+			if (!p || p >= e)
+				return false;
+		} else if (*p == '(') {
+			p = skip_group(p);
+			if (!p || p >= e)
+				return false;
+		} else if (*p == '|') {
+			if (!add_alternative(classifier, alt, p))
+				return false;
+			alt = p + 1;
+		}
+	}
+
+	return add_alternative(classifier, alt, e);
+}
+
+static void free_alternatives(struct kmsg_classifier *classifier)
+{
+	size_t i;
+
+	for (i = 0; i < classifier->num_alternatives; i++) {
+		free(classifier->alternatives[i].literal);
+		if (classifier->alternatives[i].re)
+			g_regex_unref(classifier->alternatives[i].re);
+	}
+
+	free(classifier->alternatives);
+	classifier->alternatives = NULL;
+	classifier->num_alternatives = 0;
+}
+
+/**
+ * kmsg_classifier_create:
+ * @filter: regexp for kmsg_classify() to match messages against
+ *
+ * Precompiles a classifier for kernel log messages: the subtest
+ * markers and the @filter regexp (the dmesg warning whitelist or
+ * blacklist) are checked in one go by kmsg_classify().
+ *
+ * @filter is split into its top-level alternatives, each guarded by
+ * a literal it requires, so the regexp engine only runs on the few
+ * messages that could match at all. Regexps using features that make
+ * the split unsafe (inline options, backreferences, quoting) are
+ * used as they are.
+ *
+ * Returns: The classifier, or NULL if @filter does not compile.
+ */
+struct kmsg_classifier *kmsg_classifier_create(const char *filter)
+{
+	struct kmsg_classifier *classifier = calloc(1, sizeof(*classifier));
+	size_t prefixlen = strlen(markers[0].str);
+	size_t i;
+
+	for (i = 1; i < sizeof(markers) / sizeof(markers[0]); i++) {
+		size_t n = 0;
+
+		while (n < prefixlen && markers[0].str[n] == markers[i].str[n])
+			n++;
+		prefixlen = n;
+	}
+	if (prefixlen >= sizeof(classifier->marker_prefix))
+		prefixlen = sizeof(classifier->marker_prefix) - 1;
+	memcpy(classifier->marker_prefix, markers[0].str, prefixlen);
+
+	if (!can_split(filter) ||
+	    !add_alternatives(classifier, filter, filter + strlen(filter))) {
+		struct kmsg_filter_alternative *alt;
+
+		free_alternatives(classifier);
+
+		alt = calloc(1, sizeof(*alt));
+		alt->re = g_regex_new(filter, G_REGEX_OPTIMIZE, 0, NULL);
+		if (!alt->re) {
+			free(alt);
+			free(classifier);
+			return NULL;
+		}
+
+		classifier->alternatives = alt;
+		classifier->num_alternatives = 1;
+	}
+
+	return classifier;
+}
+
+void kmsg_classifier_destroy(struct kmsg_classifier *classifier)
+{
+	if (!classifier)
+		return;
+
+	free_alternatives(classifier);
+	free(classifier);
+}
+
+static bool filter_matches(const struct kmsg_classifier *classifier,
+			   const char *message)
+{
+	size_t i;
+
+	for (i = 0; i < classifier->num_alternatives; i++) {
+		const struct kmsg_filter_alternative *alt =
+			&classifier->alternatives[i];
+
+		if (alt->literal && !strstr(message, alt->literal))
+			continue;
+
+		if (alt->exact || g_regex_match(alt->re, message, 0, NULL))
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * kmsg_classify:
+ * @classifier: classifier from kmsg_classifier_create()
+ * @message: kernel log message
+ * @filter: whether to match @message against the filter regexp
+ * @subtest: set to the subtest name for #KMSG_SUBTEST_START
+ * @dynamic_subtest: set to the dynamic subtest name for
+ * #KMSG_DYNAMIC_SUBTEST_START
+ *
+ * Returns: A mask of #KMSG_SUBTEST_START if @message contains
+ * #STARTING_SUBTEST_DMESG, #KMSG_DYNAMIC_SUBTEST_START if it contains
+ * #STARTING_DYNAMIC_SUBTEST_DMESG, and #KMSG_FILTER_MATCH if @filter is
+ * set and the filter regexp matches @message.
+ */
+unsigned kmsg_classify(const struct kmsg_classifier *classifier,
+		       const char *message, bool filter,
+		       const char **subtest, const char **dynamic_subtest)
+{
+	unsigned all = KMSG_SUBTEST_START | KMSG_DYNAMIC_SUBTEST_START;
+	unsigned ret = 0;
+	const char *p = message;
+	size_t i;
+
+	while ((ret & all) != all &&
+	       (p = strstr(p, classifier->marker_prefix)) != NULL) {
+		for (i = 0; i < sizeof(markers) / sizeof(markers[0]); i++) {
+			size_t len = strlen(markers[i].str);
+
+			if (ret & markers[i].flag || strncmp(p, markers[i].str, len))
+				continue;
+
+			ret |= markers[i].flag;
+			if (markers[i].flag == KMSG_SUBTEST_START)
+				*subtest = p + len;
+			else
+				*dynamic_subtest = p + len;
+		}
+
+		p++;
+	}
+
+	if (filter && filter_matches(classifier, message))
+		ret |= KMSG_FILTER_MATCH;
+
+	return ret;
+}
@@ -0,0 +1,39 @@
+#ifndef RUNNER_KMSG_H
+#define RUNNER_KMSG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * A kernel log record as read from /dev/kmsg, in the
+ * "flags,seq,usec,continuation[,...];message" format.
+ */
+struct kmsg_record {
+	unsigned flags; /* Log level in the low 3 bits, facility above */
+	unsigned long long seq;
+	unsigned long long ts_usec;
+	char continuation;
+	char *message; /* Points into the parsed line */
+};
+
+bool kmsg_parse_record(char *line, struct kmsg_record *record);
+
+/*
+ * Classification of kernel log messages, see kmsg_classify().
+ */
+enum {
+	KMSG_SUBTEST_START = 1 << 0,
+	KMSG_DYNAMIC_SUBTEST_START = 1 << 1,
+	KMSG_FILTER_MATCH = 1 << 2,
+};
+
+struct kmsg_classifier;
+
+struct kmsg_classifier *kmsg_classifier_create(const char *filter);
+void kmsg_classifier_destroy(struct kmsg_classifier *classifier);
+
+unsigned kmsg_classify(const struct kmsg_classifier *classifier,
+		       const char *message, bool filter,
+		       const char **subtest, const char **dynamic_subtest);
+
+#endif
@@ -17,6 +17,7 @@
 #include "resultgen.h"
 #include "settings.h"
 #include "executor.h"
+#include "kmsg.h"
 #include "output_strings.h"
 
 #define INCOMPLETE_EXITCODE -1234
@@ -149,12 +150,29 @@ static const char *next_line(const char *line, const char *bufend)
 		return NULL;
 }
 
+/* Buffers grown with append_line() are allocated in powers of two */
+static size_t append_capacity(size_t len)
+{
+	size_t capacity = 64;
+
+	while (capacity < len)
+		capacity *= 2;
+
+	return capacity;
+}
+
 static void append_line(char **buf, size_t *buflen, const char *line)
 {
 	size_t linelen = strlen(line);
 
-	*buf = realloc(*buf, *buflen + linelen + 1);
-	strcpy(*buf + *buflen, line);
+	/*
+	 * Appending to dmesg is done once per kernel log record, and
+	 * a drm.debug enabled run has millions of them. Don't
+	 * reallocate every time.
+	 */
+	if (!*buf || append_capacity(*buflen + 1) < *buflen + linelen + 1)
+		*buf = realloc(*buf, append_capacity(*buflen + linelen + 1));
+	memcpy(*buf + *buflen, line, linelen + 1);
 	*buflen += linelen;
 }
 
@@ -829,32 +847,23 @@ static const char igt_dmesg_whitelist[] =
 static const char igt_piglit_style_dmesg_blacklist[] =
 	"(\\[drm:|drm_|intel_|i915_|\\[drm\\])";
 
-static bool init_regex_whitelist(struct settings* settings, GRegex **re)
+static struct kmsg_classifier *init_dmesg_classifier(struct settings *settings)
 {
-	GError *err = NULL;
+	struct kmsg_classifier *classifier;
 	const char *regex = settings->piglit_style_dmesg ?
 		igt_piglit_style_dmesg_blacklist :
 		igt_dmesg_whitelist;
 
-	*re = g_regex_new(regex, G_REGEX_OPTIMIZE, 0, &err);
-	if (err) {
+	classifier = kmsg_classifier_create(regex);
+	if (!classifier)
 		fprintf(stderr, "Cannot compile dmesg regexp\n");
-		g_error_free(err);
-		return false;
-	}
 
-	return true;
+	return classifier;
 }
 
-static bool parse_dmesg_line(char* line,
-			     unsigned *flags, unsigned long long *ts_usec,
-			     char *continuation, char **message)
+static bool parse_dmesg_line(char* line, struct kmsg_record *record)
 {
-	unsigned long long seq;
-	int s;
-
-	s = sscanf(line, "%u,%llu,%llu,%c;", flags, &seq, ts_usec, continuation);
-	if (s != 4) {
+	if (!kmsg_parse_record(line, record)) {
 		/*
 		 * Machine readable key/value pairs begin with
 		 * a space. We ignore them.
@@ -865,41 +874,46 @@ static bool parse_dmesg_line(char* line,
 		return false;
 	}
 
-	*message = strchr(line, ';');
-	if (*message == NULL) {
+	if (record->message == NULL) {
 		fprintf(stderr, "No ; found in kmsg record, this shouldn't happen\n");
 		return false;
 	}
-	(*message)++;
 
 	return true;
 }
 
+/*
+ * Formats the record into *formatted, reusing the buffer of *size
+ * octets from the previous line if it's large enough.
+ */
 static void generate_formatted_dmesg_line(char *message,
 					  unsigned flags,
 					  unsigned long long ts_usec,
-					  char **formatted)
+					  char **formatted, size_t *size)
 {
 	char prefix[512];
 	size_t messagelen;
 	size_t prefixlen;
 	char *p, *f;
 
-	snprintf(prefix, sizeof(prefix),
-		 "<%u> [%llu.%06llu] ",
-		 flags & 0x07,
-		 ts_usec / 1000000,
-		 ts_usec % 1000000);
+	prefixlen = snprintf(prefix, sizeof(prefix),
+			     "<%u> [%llu.%06llu] ",
+			     flags & 0x07,
+			     ts_usec / 1000000,
+			     ts_usec % 1000000);
 
 	messagelen = strlen(message);
-	prefixlen = strlen(prefix);
 
 	/*
 	 * Decoding the hex escapes only makes the string shorter, so
 	 * we can use the original length
 	 */
-	*formatted = malloc(strlen(prefix) + messagelen + 1);
-	strcpy(*formatted, prefix);
+	if (*size < prefixlen + messagelen + 1) {
+		*size = append_capacity(prefixlen + messagelen + 1);
+		free(*formatted);
+		*formatted = malloc(*size);
+	}
+	memcpy(*formatted, prefix, prefixlen);
 
 	f = *formatted + prefixlen;
 	for (p = message; *p; p++, f++) {
@@ -966,10 +980,10 @@ static bool fill_from_dmesg(int fd,
 			    struct subtest_list *subtests,
 			    struct json_object *tests)
 {
-	char *line = NULL;
+	char *line = NULL, *formatted = NULL;
 	char *warnings = NULL, *dynamic_warnings = NULL;
 	char *dmesg = NULL, *dynamic_dmesg = NULL;
-	size_t linelen = 0;
+	size_t linelen = 0, formattedsize = 0;
 	size_t warningslen = 0, dynamic_warnings_len = 0;
 	size_t dmesglen = 0, dynamic_dmesg_len = 0;
 	struct json_object *current_test = NULL;
@@ -978,30 +992,37 @@ static bool fill_from_dmesg(int fd,
 	char piglit_name[256];
 	char dynamic_piglit_name[256];
 	size_t i;
-	GRegex *re;
+	struct kmsg_classifier *classifier;
 
 	if (!f) {
 		return false;
 	}
 
-	if (!init_regex_whitelist(settings, &re)) {
+	classifier = init_dmesg_classifier(settings);
+	if (!classifier) {
 		fclose(f);
 		return false;
 	}
 
 	while (getline(&line, &linelen, f) > 0) {
-		char *formatted;
-		unsigned flags;
-		unsigned long long ts_usec;
-		char continuation;
-		char *message, *subtest, *dynamic_subtest;
+		struct kmsg_record record;
+		const char *subtest, *dynamic_subtest;
+		bool warning;
+		unsigned class;
 
-		if (!parse_dmesg_line(line, &flags, &ts_usec, &continuation, &message))
+		if (!parse_dmesg_line(line, &record))
 			continue;
 
-		generate_formatted_dmesg_line(message, flags, ts_usec, &formatted);
+		generate_formatted_dmesg_line(record.message, record.flags, record.ts_usec,
+					      &formatted, &formattedsize);
+
+		/* Look for the subtest markers and match the filter in one go */
+		warning = (record.flags & 0x07) <= settings->dmesg_warn_level &&
+			record.continuation != 'c';
+		class = kmsg_classify(classifier, record.message, warning,
+				      &subtest, &dynamic_subtest);
 
-		if ((subtest = strstr(message, STARTING_SUBTEST_DMESG)) != NULL) {
+		if (class & KMSG_SUBTEST_START) {
 			if (current_test != NULL) {
 				/* Done with the previous subtest, file up */
 				add_dmesg(current_test, dmesg, dmesglen, warnings, warningslen);
@@ -1021,13 +1042,11 @@ static bool fill_from_dmesg(int fd,
 				current_dynamic_test = NULL;
 			}
 
-			subtest += strlen(STARTING_SUBTEST_DMESG);
 			generate_piglit_name(binary, subtest, piglit_name, sizeof(piglit_name));
 			current_test = get_or_create_json_object(tests, piglit_name);
 		}
 
-		if (current_test != NULL &&
-		    (dynamic_subtest = strstr(message, STARTING_DYNAMIC_SUBTEST_DMESG)) != NULL) {
+		if (current_test != NULL && class & KMSG_DYNAMIC_SUBTEST_START) {
 			if (current_dynamic_test != NULL) {
 				/* Done with the previous dynamic subtest, file up */
 				add_dmesg(current_dynamic_test, dynamic_dmesg, dynamic_dmesg_len, dynamic_warnings, dynamic_warnings_len);
@@ -1038,30 +1057,21 @@ static bool fill_from_dmesg(int fd,
 				dynamic_dmesg_len = dynamic_warnings_len = 0;
 			}
 
-			dynamic_subtest += strlen(STARTING_DYNAMIC_SUBTEST_DMESG);
 			generate_piglit_name_for_dynamic(piglit_name, dynamic_subtest, dynamic_piglit_name, sizeof(dynamic_piglit_name));
 			current_dynamic_test = get_or_create_json_object(tests, dynamic_piglit_name);
 		}
 
-		if (settings->piglit_style_dmesg) {
-			if ((flags & 0x07) <= settings->dmesg_warn_level && continuation != 'c' &&
-			    g_regex_match(re, message, 0, NULL)) {
-				append_line(&warnings, &warningslen, formatted);
-				if (current_test != NULL)
-					append_line(&dynamic_warnings, &dynamic_warnings_len, formatted);
-			}
-		} else {
-			if ((flags & 0x07) <= settings->dmesg_warn_level && continuation != 'c' &&
-			    !g_regex_match(re, message, 0, NULL)) {
-				append_line(&warnings, &warningslen, formatted);
-				if (current_test != NULL)
-					append_line(&dynamic_warnings, &dynamic_warnings_len, formatted);
-			}
+		/* The filter is a blacklist in piglit style, a whitelist otherwise */
+		if (warning &&
+		    !!(class & KMSG_FILTER_MATCH) == settings->piglit_style_dmesg) {
+			append_line(&warnings, &warningslen, formatted);
+			if (current_test != NULL)
+				append_line(&dynamic_warnings, &dynamic_warnings_len, formatted);
 		}
 		append_line(&dmesg, &dmesglen, formatted);
 		append_line(&dynamic_dmesg, &dynamic_dmesg_len, formatted);
-		free(formatted);
 	}
+	free(formatted);
 	free(line);
 
 	if (current_test != NULL) {
@@ -1099,7 +1109,7 @@ static bool fill_from_dmesg(int fd,
 	free(dynamic_dmesg);
 	free(warnings);
 	free(dynamic_warnings);
-	g_regex_unref(re);
+	kmsg_classifier_destroy(classifier);
 	fclose(f);
 	return true;
 }
@@ -54,7 +54,9 @@ static void run_test(data_t *data, int valid_outputs)
 {
 	igt_output_t *output;
 	igt_pipe_crc_t *pipe_crcs[IGT_MAX_PIPES] = { 0 };
-	igt_crc_t ref_crcs[IGT_MAX_PIPES], new_crcs[IGT_MAX_PIPES];
+	igt_crc_t ref_crcs[IGT_MAX_PIPES];
+	const igt_crc_t *new_crcs;
+	igt_crc_collector_t *collector;
 	igt_display_t *display = &data->display;
 	uint16_t width = 0, height = 0;
 	igt_pipe_t *pipe;
@@ -119,11 +121,20 @@ static void run_test(data_t *data, int valid_outputs)
 
 	igt_display_commit2(display, COMMIT_ATOMIC);
 
-	/* CRC Verification */
-	for (i = 0; i < valid_outputs; i++) {
-		igt_pipe_crc_collect_crc(pipe_crcs[i], &new_crcs[i]);
+	/* CRC Verification, with the CRCs of all pipes collected at once */
+	for (i = 0; i < valid_outputs; i++)
+		igt_pipe_crc_start(pipe_crcs[i]);
+
+	collector = igt_pipe_crc_collector_new(pipe_crcs, valid_outputs, 1);
+	igt_assert_eq(igt_crc_collector_collect(collector, 1, 5000), 1);
+	new_crcs = igt_crc_collector_get_tuple(collector, 0);
+
+	for (i = 0; i < valid_outputs; i++)
 		igt_assert_crc_equal(&ref_crcs[i], &new_crcs[i]);
-	}
+
+	igt_crc_collector_free(collector);
+	for (i = 0; i < valid_outputs; i++)
+		igt_pipe_crc_stop(pipe_crcs[i]);
 
 	igt_plane_set_fb(plane, NULL);
 	igt_remove_fb(data->drm_fd, &data->fb);
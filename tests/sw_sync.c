@@ -888,24 +888,31 @@ igt_main
 			      sysconf(_SC_NPROCESSORS_ONLN));
 	}
 
+	igt_parallel_safe();
 	igt_subtest("alloc_timeline")
 		test_alloc_timeline();
 
+	igt_parallel_safe();
 	igt_subtest("alloc_fence")
 		test_alloc_fence();
 
+	igt_parallel_safe();
 	igt_subtest("alloc_fence_invalid_timeline")
 		test_alloc_fence_invalid_timeline();
 
+	igt_parallel_safe();
 	igt_subtest("timeline_closed")
 		test_timeline_closed();
 
+	igt_parallel_safe();
 	igt_subtest("timeline_closed_signaled")
 		test_timeline_closed_signaled();
 
+	igt_parallel_safe();
 	igt_subtest("alloc_merge_fence")
 		test_alloc_merge_fence();
 
+	igt_parallel_safe();
 	igt_subtest("sync_busy")
 		test_sync_busy();
 
@@ -915,15 +922,19 @@ igt_main
 	igt_subtest("sync_busy_fork_unixsocket")
 		test_sync_busy_fork_unixsocket();
 
+	igt_parallel_safe();
 	igt_subtest("sync_merge_invalid")
 		test_sync_merge_invalid();
 
+	igt_parallel_safe();
 	igt_subtest("sync_merge")
 		test_sync_merge();
 
+	igt_parallel_safe();
 	igt_subtest("sync_merge_same")
 		test_sync_merge_same();
 
+	igt_parallel_safe();
 	igt_subtest("sync_multi_timeline_wait")
 		test_sync_multi_timeline_wait();
 
@@ -936,9 +947,11 @@ igt_main
 	igt_subtest("sync_multi_producer_single_consumer")
 		test_sync_multi_producer_single_consumer();
 
+	igt_parallel_safe();
 	igt_subtest("sync_expired_merge")
 		test_sync_expired_merge();
 
+	igt_parallel_safe();
 	igt_subtest("sync_random_merge")
 		test_sync_random_merge();
 }
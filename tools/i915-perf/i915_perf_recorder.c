@@ -35,6 +35,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 #include <sys/time.h>
@@ -52,160 +53,13 @@
 #include "i915/perf_data.h"
 
 #include "i915_perf_recorder_commands.h"
+#include "i915_perf_ring.h"
 
 #define ALIGN(v, a) (((v) + (a)-1) & ~((a)-1))
 #define ARRAY_SIZE(arr) (sizeof(arr)/sizeof((arr)[0]))
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 
-struct circular_buffer {
-	char   *data;
-	size_t  allocated_size;
-	size_t  size;
-	size_t  beginpos;
-	size_t  endpos;
-};
-
-struct chunk {
-	char *data;
-	size_t len;
-};
-
-static size_t
-circular_available_size(const struct circular_buffer *buffer)
-{
-	assert(buffer->size <= buffer->allocated_size);
-	return buffer->allocated_size - buffer->size;
-}
-
-static void
-get_chunks(struct chunk *chunks, struct circular_buffer *buffer, bool write, size_t len)
-{
-	size_t offset = write ? buffer->endpos : buffer->beginpos;
-
-	if (write)
-		assert(circular_available_size(buffer) >= len);
-	else
-		assert(buffer->size >= len);
-
-	chunks[0].data = &buffer->data[offset];
-
-	if ((offset + len) > buffer->allocated_size) {
-		chunks[0].len = buffer->allocated_size - offset;
-		chunks[1].data = buffer->data;
-		chunks[1].len = len - (buffer->allocated_size - offset);
-	} else {
-		chunks[0].len = len;
-		chunks[1].data = NULL;
-		chunks[1].len = 0;
-	}
-}
-
-static ssize_t
-circular_buffer_read(void *c, char *buf, size_t size)
-{
-	struct circular_buffer *buffer = c;
-	struct chunk chunks[2];
-
-	if (buffer->size < size)
-		return -1;
-
-	get_chunks(chunks, buffer, false, size);
-
-	memcpy(buf, chunks[0].data, chunks[0].len);
-	memcpy(buf + chunks[0].len, chunks[1].data, chunks[1].len);
-	buffer->beginpos = (buffer->beginpos + size) % buffer->allocated_size;
-	buffer->size -= size;
-
-	return size;
-}
-
-static size_t
-peek_item_size(struct circular_buffer *buffer)
-{
-	struct drm_i915_perf_record_header header;
-	struct chunk chunks[2];
-
-	if (!buffer->size)
-		return 0;
-
-	assert(buffer->size >= sizeof(header));
-
-	get_chunks(chunks, buffer, false, sizeof(header));
-	memcpy(&header, chunks[0].data, chunks[0].len);
-	memcpy((char *) &header + chunks[0].len, chunks[1].data, chunks[1].len);
-
-	return header.size;
-}
-
-static void
-circular_shrink(struct circular_buffer *buffer, size_t size)
-{
-	size_t shrank = 0, item_size;
-
-	assert(size <= buffer->allocated_size);
-
-	while (shrank < size && buffer->size > (item_size = peek_item_size(buffer))) {
-		assert(item_size > 0 && item_size <= buffer->allocated_size);
-
-		buffer->beginpos = (buffer->beginpos + item_size) % buffer->allocated_size;
-		buffer->size -= item_size;
-
-		shrank += item_size;
-	}
-}
-
-static ssize_t
-circular_buffer_write(void *c, const char *buf, size_t _size)
-{
-	struct circular_buffer *buffer = c;
-	size_t size = _size;
-
-	while (size) {
-		size_t avail = circular_available_size(buffer), item_size;
-		struct chunk chunks[2];
-
-		/* Make space in the buffer if there is too much data. */
-		if (avail < size)
-			circular_shrink(buffer, size - avail);
-
-		item_size = MIN(circular_available_size(buffer), size);
-
-		get_chunks(chunks, buffer, true, item_size);
-
-		memcpy(chunks[0].data, buf, chunks[0].len);
-		memcpy(chunks[1].data, buf + chunks[0].len, chunks[1].len);
-
-		buf += item_size;
-		size -= item_size;
-
-		buffer->endpos = (buffer->endpos + item_size) % buffer->allocated_size;
-		buffer->size += item_size;
-	}
-
-	return _size;
-}
-
-static int
-circular_buffer_seek(void *c, off64_t *offset, int whence)
-{
-	return -1;
-}
-
-static int
-circular_buffer_close(void *c)
-{
-	return 0;
-}
-
-cookie_io_functions_t circular_buffer_functions = {
-	.read  = circular_buffer_read,
-	.write = circular_buffer_write,
-	.seek  = circular_buffer_seek,
-	.close = circular_buffer_close,
-};
-
-
 static bool
 read_file_uint64(const char *file, uint64_t *value)
 {
@@ -404,7 +258,9 @@ struct recording_context {
 
 	uint32_t oa_exponent;
 
-	struct circular_buffer circular_buffer;
+	/* Either the circular buffer or the output file is recorded into */
+	struct i915_perf_ring *ring;
+	const char *ring_name;
 	FILE *output_stream;
 
 	const char *command_fifo;
@@ -579,15 +435,51 @@ write_topology(FILE *output, struct recording_context *ctx)
 }
 
 static bool
-write_i915_perf_data(FILE *output, int perf_fd)
+write_data(struct recording_context *ctx, const void *data, size_t len)
 {
+	if (ctx->ring) {
+		if (!i915_perf_ring_write(ctx->ring, data, len)) {
+			errno = EMSGSIZE;
+			return false;
+		}
+		return true;
+	}
+
+	return fwrite(data, len, 1, ctx->output_stream) == 1;
+}
+
+static bool
+write_i915_perf_data(struct recording_context *ctx)
+{
+	static char data[64 * 1024];
+	size_t max = sizeof(data);
+	size_t len = 0;
 	ssize_t ret;
-	char data[4096];
 
-	while ((ret = read(perf_fd, data, sizeof(data))) > 0 ||
-	       errno == EINTR) {
-		if (fwrite(data, ret, 1, output) != 1)
+	/* A batch must fit in the circular buffer, which can be smaller */
+	if (ctx->ring)
+		max = MIN(max, ctx->ring->size);
+
+	/*
+	 * i915-perf only hands out whole reports, so everything that's
+	 * available is gathered into data and copied out in one go rather
+	 * than a report at a time.
+	 */
+	for (;;) {
+		ret = read(ctx->perf_fd, data + len, max - len);
+		if (ret > 0) {
+			len += ret;
+			if (max - len >= 4096)
+				continue;
+		} else if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (len && !write_data(ctx, data, len))
 			return false;
+		if (ret <= 0)
+			break;
+		len = 0;
 	}
 
 	return true;
@@ -685,6 +577,41 @@ write_correlation_timestamps(FILE *output, int drm_fd)
 	return write_saved_correlation_timestamps(output, &corr);
 }
 
+static bool
+record_correlation_timestamps(struct recording_context *ctx)
+{
+	struct {
+		struct drm_i915_perf_record_header header;
+		struct intel_perf_record_timestamp_correlation corr;
+	} record = {
+		.header = {
+			.type = INTEL_PERF_RECORD_TYPE_TIMESTAMP_CORRELATION,
+			.size = sizeof(record),
+		},
+	};
+
+	if (!get_correlation_timestamps(&record.corr, ctx->drm_fd))
+		return false;
+
+	return write_data(ctx, &record, sizeof(record));
+}
+
+/* Copies the records in the circular buffer to a file */
+static bool
+write_ring(FILE *output, struct recording_context *ctx)
+{
+	static char data[64 * 1024];
+	uint64_t pos = 0, lost = 0;
+	size_t len;
+
+	while ((len = i915_perf_ring_read(ctx->ring, &pos, data, sizeof(data), &lost))) {
+		if (fwrite(data, len, 1, output) != 1)
+			return false;
+	}
+
+	return true;
+}
+
 static void
 read_command_file(struct recording_context *ctx)
 {
@@ -712,18 +639,10 @@ read_command_file(struct recording_context *ctx)
 
 		file = fopen((const char *) dump, "w+");
 		if (file) {
-			struct chunk chunks[2];
-
-			fflush(ctx->output_stream);
-			get_chunks(chunks, &ctx->circular_buffer,
-				   false, ctx->circular_buffer.size);
-
 			if (!write_version(file, ctx) ||
 			    !write_header(file, ctx) ||
 			    !write_topology(file, ctx) ||
-			    fwrite(chunks[0].data, chunks[0].len, 1, file) != 1 ||
-			    (chunks[1].len > 0 &&
-			     fwrite(chunks[1].data, chunks[1].len, 1, file) != 1) ||
+			    !write_ring(file, ctx) ||
 			    !write_correlation_timestamps(file, ctx->drm_fd)) {
 				fprintf(stderr, "Unable to write circular buffer data in file '%s'\n",
 					dump);
@@ -813,6 +732,9 @@ usage(const char *name)
 		"                                       be recorded.\n"
 		"     --command-fifo,       -f <path>   Path to a command fifo, implies circular buffer\n"
 		"                                       (To use with i915-perf-control)\n"
+		"     --shm,                -S <name>   Share the circular buffer as /dev/shm/<name>,\n"
+		"                                       implies circular buffer\n"
+		"                                       (records can be streamed while recording)\n"
 		"     --output,             -o <path>   Output file (default = i915_perf.record)\n"
 		"     --cpu-clock,          -k <path>   Cpu clock to use for correlations\n"
 		"                                       Values: boot, mono, mono_raw (default = mono)\n"
@@ -841,7 +763,9 @@ teardown_recording_context(struct recording_context *ctx)
 	if (ctx->output_stream)
 		fclose(ctx->output_stream);
 
-	free(ctx->circular_buffer.data);
+	i915_perf_ring_close(ctx->ring);
+	if (ctx->ring && ctx->ring_name)
+		shm_unlink(ctx->ring_name);
 
 	if (ctx->perf_fd != -1)
 		close(ctx->perf_fd);
@@ -889,6 +813,7 @@ main(int argc, char *argv[])
 		{"output",               required_argument, 0, 'o'},
 		{"size",                 required_argument, 0, 's'},
 		{"command-fifo",         required_argument, 0, 'f'},
+		{"shm",                  required_argument, 0, 'S'},
 		{"cpu-clock",            required_argument, 0, 'k'},
 		{"poll-period",          required_argument, 0, 'P'},
 		{"engine-class",         required_argument, 0, 'e'},
@@ -925,7 +850,7 @@ main(int argc, char *argv[])
 		.engine = { USHRT_MAX, USHRT_MAX },
 	};
 
-	while ((opt = getopt_long(argc, argv, "hc:d:p:m:Co:s:f:k:P:e:i:", long_options, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "hc:d:p:m:Co:s:f:S:k:P:e:i:", long_options, NULL)) != -1) {
 		switch (opt) {
 		case 'h':
 			usage(argv[0]);
@@ -958,6 +883,11 @@ main(int argc, char *argv[])
 			ctx.command_fifo = optarg;
 			circular_size = 8 * 1024 * 1024;
 			break;
+		case 'S':
+			ctx.ring_name = optarg;
+			if (!circular_size)
+				circular_size = 8 * 1024 * 1024;
+			break;
 		case 'k': {
 			bool found = false;
 			for (uint32_t i = 0; i < ARRAY_SIZE(clock_names); i++) {
@@ -1093,17 +1023,10 @@ main(int argc, char *argv[])
 	}
 
 	if (circular_size) {
-		ctx.circular_buffer.allocated_size = circular_size;
-		ctx.circular_buffer.data = malloc(circular_size);
-		if (!ctx.circular_buffer.data) {
-			fprintf(stderr, "Unable to allocate circular buffer\n");
-			goto fail;
-		}
-
-		ctx.output_stream = fopencookie(&ctx.circular_buffer, "w+",
-						circular_buffer_functions);
-		if (!ctx.output_stream) {
-			fprintf(stderr, "Unable to create circular buffer\n");
+		ctx.ring = i915_perf_ring_create(ctx.ring_name, circular_size);
+		if (!ctx.ring) {
+			fprintf(stderr, "Unable to create circular buffer: %s\n",
+				strerror(errno));
 			goto fail;
 		}
 
@@ -1112,10 +1035,13 @@ main(int argc, char *argv[])
 			goto fail;
 		}
 
-		write_correlation_timestamps(ctx.output_stream, ctx.drm_fd);
+		record_correlation_timestamps(&ctx);
 		fprintf(stdout,
 			"Recoding in internal circular buffer.\n"
 			"Use i915-perf-control to snapshot into file.\n");
+		if (ctx.ring_name)
+			fprintf(stdout, "Streaming records through shared memory '%s'.\n",
+				ctx.ring_name);
 	} else {
 		output = fopen(output_file, "w+");
 		if (!output) {
@@ -1180,7 +1106,7 @@ main(int argc, char *argv[])
 
 		if (ret > 0) {
 			if (pollfd[0].revents & POLLIN) {
-				if (!write_i915_perf_data(ctx.output_stream, ctx.perf_fd)) {
+				if (!write_i915_perf_data(&ctx)) {
 					fprintf(stderr, "Failed to write i915-perf data: %s\n",
 						strerror(errno));
 					break;
@@ -1195,7 +1121,7 @@ main(int argc, char *argv[])
 		elapsed_ns = igt_nsec_elapsed(&now);
 		if (elapsed_ns > poll_time_ns) {
 			poll_time_ns = corr_period_ns;
-			if (!write_correlation_timestamps(ctx.output_stream, ctx.drm_fd)) {
+			if (!record_correlation_timestamps(&ctx)) {
 				fprintf(stderr,
 					"Failed to write i915 timestamp correlation data: %s\n",
 					strerror(errno));
@@ -1208,12 +1134,12 @@ main(int argc, char *argv[])
 
 	fprintf(stdout, "Exiting...\n");
 
-	if (!write_i915_perf_data(ctx.output_stream, ctx.perf_fd)) {
+	if (!write_i915_perf_data(&ctx)) {
 		fprintf(stderr, "Failed to write i915-perf data: %s\n",
 			strerror(errno));
 	}
 
-	if (!write_correlation_timestamps(ctx.output_stream, ctx.drm_fd)) {
+	if (!record_correlation_timestamps(&ctx)) {
 		fprintf(stderr,
 			"Failed to write final i915 timestamp correlation data: %s\n",
 			strerror(errno));
@@ -0,0 +1,249 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <i915_drm.h>
+
+#include "i915_perf_ring.h"
+
+#define RING_DATA_OFFSET 4096
+
+static size_t ring_mapping_size(const struct i915_perf_ring *ring)
+{
+	return ring->data_offset + ring->size;
+}
+
+static char *ring_data(const struct i915_perf_ring *ring)
+{
+	return (char *)ring + ring->data_offset;
+}
+
+/* Copies len bytes from the stream position pos out of the ring */
+static void copy_out(const struct i915_perf_ring *ring, uint64_t pos,
+		     void *buf, size_t len)
+{
+	size_t offset = pos % ring->size;
+	size_t first = ring->size - offset < len ? ring->size - offset : len;
+
+	memcpy(buf, ring_data(ring) + offset, first);
+	memcpy((char *)buf + first, ring_data(ring), len - first);
+}
+
+static void copy_in(struct i915_perf_ring *ring, uint64_t pos,
+		    const void *buf, size_t len)
+{
+	size_t offset = pos % ring->size;
+	size_t first = ring->size - offset < len ? ring->size - offset : len;
+
+	memcpy(ring_data(ring) + offset, buf, first);
+	memcpy(ring_data(ring), (const char *)buf + first, len - first);
+}
+
+/**
+ * i915_perf_ring_create:
+ * @name: name of the POSIX shared memory object to create, as for
+ * shm_open(), or NULL for an anonymous memfd
+ * @size: size of the ring data in bytes
+ *
+ * Creates an empty ring for i915_perf_ring_write(). A named ring is
+ * replaced if it exists, and can be opened by readers with
+ * i915_perf_ring_open() until it is removed with shm_unlink().
+ *
+ * Returns: The mapped ring, or NULL on failure with errno set.
+ */
+struct i915_perf_ring *i915_perf_ring_create(const char *name, uint64_t size)
+{
+	struct i915_perf_ring *ring;
+	int fd, err;
+
+	if (name)
+		fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	else
+		fd = memfd_create("i915-perf-ring", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (ftruncate(fd, RING_DATA_OFFSET + size))
+		goto err;
+
+	ring = mmap(NULL, RING_DATA_OFFSET + size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fd, 0);
+	if (ring == MAP_FAILED)
+		goto err;
+	close(fd);
+
+	ring->magic = I915_PERF_RING_MAGIC;
+	ring->version = I915_PERF_RING_VERSION;
+	ring->size = size;
+	ring->data_offset = RING_DATA_OFFSET;
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->head, 0);
+
+	return ring;
+
+err:
+	err = errno;
+	close(fd);
+	if (name)
+		shm_unlink(name);
+	errno = err;
+	return NULL;
+}
+
+/**
+ * i915_perf_ring_open:
+ * @name: name of the shared memory object of the ring
+ *
+ * Maps the ring of a running recorder read-only, for
+ * i915_perf_ring_read().
+ *
+ * Returns: The mapped ring, or NULL on failure with errno set.
+ */
+struct i915_perf_ring *i915_perf_ring_open(const char *name)
+{
+	struct i915_perf_ring *ring;
+	struct stat st;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) || st.st_size < sizeof(*ring)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ring = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring == MAP_FAILED)
+		return NULL;
+
+	if (ring->magic != I915_PERF_RING_MAGIC ||
+	    ring->version != I915_PERF_RING_VERSION ||
+	    !ring->size || ring->data_offset < sizeof(*ring) ||
+	    ring_mapping_size(ring) > st.st_size) {
+		munmap(ring, st.st_size);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return ring;
+}
+
+void i915_perf_ring_close(struct i915_perf_ring *ring)
+{
+	if (ring)
+		munmap(ring, ring_mapping_size(ring));
+}
+
+/**
+ * i915_perf_ring_write:
+ * @ring: ring from i915_perf_ring_create()
+ * @records: one or more complete records
+ * @len: size of @records in bytes
+ *
+ * Appends @records to the ring in one go, dropping as many of the oldest
+ * records as needed to make room for them.
+ *
+ * Returns: false if @records can't fit in the ring at all.
+ */
+bool i915_perf_ring_write(struct i915_perf_ring *ring,
+			  const void *records, size_t len)
+{
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	if (len > ring->size)
+		return false;
+
+	if (head + len - tail > ring->size) {
+		while (tail < head && head + len - tail > ring->size) {
+			struct drm_i915_perf_record_header header;
+
+			copy_out(ring, tail, &header, sizeof(header));
+			if (!header.size || header.size > head - tail)
+				tail = head; /* not a record, drop everything */
+			else
+				tail += header.size;
+		}
+
+		/*
+		 * Readers check tail after copying, so it must be visible
+		 * before any of the dropped records get overwritten.
+		 */
+		atomic_store_explicit(&ring->tail, tail, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+	}
+
+	copy_in(ring, head, records, len);
+	atomic_store_explicit(&ring->head, head + len, memory_order_release);
+
+	return true;
+}
+
+/**
+ * i915_perf_ring_read:
+ * @ring: ring from i915_perf_ring_open() or i915_perf_ring_create()
+ * @pos: stream position to read from, updated past the records read
+ * @buf: buffer for the records
+ * @len: size of @buf, which should fit the largest record
+ * @lost: incremented by the number of bytes dropped by the writer before
+ * they could be read
+ *
+ * Copies as many complete records as fit in @buf from @pos on. Start with
+ * @pos set to 0 to read everything still in the ring, or to the head of the
+ * ring to only read new records.
+ *
+ * Returns: The number of bytes copied to @buf, 0 if there are no new
+ * records.
+ */
+size_t i915_perf_ring_read(const struct i915_perf_ring *ring, uint64_t *pos,
+			   void *buf, size_t len, uint64_t *lost)
+{
+	for (;;) {
+		uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+		size_t n, offset;
+
+		if (*pos > head)
+			*pos = tail;
+
+		if (*pos < tail) {
+			*lost += tail - *pos;
+			*pos = tail;
+		}
+
+		n = head - *pos < len ? head - *pos : len;
+		copy_out(ring, *pos, buf, n);
+
+		/* Was any of it overwritten while we were copying? */
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&ring->tail, memory_order_relaxed) > *pos)
+			continue;
+
+		/* Only hand out complete records */
+		for (offset = 0; n - offset >= sizeof(struct drm_i915_perf_record_header); ) {
+			const struct drm_i915_perf_record_header *header =
+				(const void *)((const char *)buf + offset);
+
+			if (!header->size || header->size > n - offset)
+				break;
+
+			offset += header->size;
+		}
+
+		*pos += offset;
+
+		return offset;
+	}
+}
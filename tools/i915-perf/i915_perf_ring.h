@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#ifndef I915_PERF_RING_H
+#define I915_PERF_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Shared memory ring i915-perf-recorder keeps the most recent records in
+ * when recording into a circular buffer, so that other processes can
+ * stream them while the recorder is running.
+ *
+ * The shared memory region starts with struct i915_perf_ring, followed at
+ * data_offset by size bytes of data. The data is a stream of records in the
+ * format of the files written by the recorder, each starting with a
+ * struct drm_i915_perf_record_header whose size covers the whole record.
+ *
+ * head and tail are positions in the stream, in bytes since the start of
+ * the recording, and only ever increase. The byte at position p is at
+ * data[p % size], so records may wrap around the end of the data.
+ * [tail, head) holds complete records, tail being the start of the oldest.
+ *
+ * There is a single writer, the recorder, and it never waits for readers:
+ * when it needs room for new records it drops the oldest ones by moving
+ * tail forward, and only then overwrites them. New records are published
+ * by moving head forward once they are copied in.
+ *
+ * A reader keeps its own position. It loads head, copies the records from
+ * its position up to head, and then loads tail again: if tail has moved past
+ * its position meanwhile, what it copied may have been overwritten and it
+ * has to restart from tail. i915_perf_ring_read() does all that.
+ */
+
+#define I915_PERF_RING_MAGIC 0x52503969 /* "i9PR" */
+#define I915_PERF_RING_VERSION 1
+
+struct i915_perf_ring {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+	uint64_t data_offset;
+
+	_Atomic(uint64_t) tail __attribute__((aligned(64)));
+	_Atomic(uint64_t) head __attribute__((aligned(64)));
+};
+
+struct i915_perf_ring *i915_perf_ring_create(const char *name, uint64_t size);
+struct i915_perf_ring *i915_perf_ring_open(const char *name);
+void i915_perf_ring_close(struct i915_perf_ring *ring);
+
+bool i915_perf_ring_write(struct i915_perf_ring *ring,
+			  const void *records, size_t len);
+size_t i915_perf_ring_read(const struct i915_perf_ring *ring, uint64_t *pos,
+			   void *buf, size_t len, uint64_t *lost);
+
+#endif /* I915_PERF_RING_H */
@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+/*
+ * Feeds synthetic records through the i915-perf-recorder shared memory
+ * ring, with a writer process that never waits for the reader, and checks
+ * that the reader only ever sees complete records, in order, and accounts
+ * for every byte that got dropped.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <i915_drm.h>
+
+#include "i915_perf_ring.h"
+
+#define check(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", \
+			__func__, __LINE__, #cond); \
+		exit(EXIT_FAILURE); \
+	} \
+} while (0)
+
+struct test_record {
+	struct drm_i915_perf_record_header header;
+	uint32_t seq;
+	uint8_t payload[];
+};
+
+static size_t make_record(void *buf, uint32_t seq)
+{
+	struct test_record *record = buf;
+	size_t len = (seq * 37) % 1000;
+
+	record->header.type = DRM_I915_PERF_RECORD_SAMPLE;
+	record->header.pad = 0;
+	record->header.size = sizeof(*record) + len;
+	record->seq = seq;
+	memset(record->payload, seq & 0xff, len);
+
+	return record->header.size;
+}
+
+/* Checks the records in buf and returns the sequence number of the last */
+static uint32_t check_records(const void *buf, size_t len, uint32_t last)
+{
+	size_t offset = 0;
+
+	while (offset < len) {
+		const struct test_record *record = buf + offset;
+		size_t i;
+
+		check(len - offset >= sizeof(*record));
+		check(record->header.type == DRM_I915_PERF_RECORD_SAMPLE);
+		check(record->header.size <= len - offset);
+		check(record->header.size == sizeof(*record) + (record->seq * 37) % 1000);
+		check(record->seq > last || last == UINT32_MAX);
+
+		for (i = 0; i < record->header.size - sizeof(*record); i++)
+			check(record->payload[i] == (record->seq & 0xff));
+
+		last = record->seq;
+		offset += record->header.size;
+	}
+
+	return last;
+}
+
+static void test_wrap(void)
+{
+	struct i915_perf_ring *ring = i915_perf_ring_create(NULL, 10000);
+	static char record[2048], buf[64 * 1024];
+	uint64_t pos = 0, lost = 0, total = 0, read;
+	uint32_t seq, last = UINT32_MAX;
+	size_t len;
+
+	check(ring);
+
+	/* Nothing to read yet */
+	check(i915_perf_ring_read(ring, &pos, buf, sizeof(buf), &lost) == 0);
+	check(pos == 0 && lost == 0);
+
+	/* Wrap around the end of the data several times, reading as we go */
+	for (seq = 0; seq < 1000; seq++) {
+		len = make_record(record, seq);
+		check(i915_perf_ring_write(ring, record, len));
+		total += len;
+
+		len = i915_perf_ring_read(ring, &pos, buf, sizeof(buf), &lost);
+		last = check_records(buf, len, last);
+		check(last == seq);
+	}
+	check(pos == total && lost == 0);
+
+	/* Overflow, only the most recent records are kept */
+	for (seq = 1000; seq < 1100; seq++) {
+		len = make_record(record, seq);
+		check(i915_perf_ring_write(ring, record, len));
+		total += len;
+	}
+	check(atomic_load(&ring->head) - atomic_load(&ring->tail) <= ring->size);
+
+	read = pos;
+	len = i915_perf_ring_read(ring, &pos, buf, sizeof(buf), &lost);
+	check(len && lost);
+	check(check_records(buf, len, last) == 1099);
+	check(pos == total);
+	check(read + lost == atomic_load(&ring->tail));
+	check(read + lost + len == total);
+
+	/* A record bigger than the ring is refused */
+	check(!i915_perf_ring_write(ring, buf, ring->size + 1));
+	check(atomic_load(&ring->head) == total);
+
+	i915_perf_ring_close(ring);
+}
+
+static void test_partial_read(void)
+{
+	struct i915_perf_ring *ring = i915_perf_ring_create(NULL, 64 * 1024);
+	static char record[2048], buf[1500];
+	uint64_t pos = 0, lost = 0, total = 0, read = 0;
+	uint32_t seq, last = UINT32_MAX;
+	size_t len;
+
+	check(ring);
+
+	for (seq = 0; seq < 20; seq++) {
+		len = make_record(record, seq);
+		check(i915_perf_ring_write(ring, record, len));
+		total += len;
+	}
+
+	/* Only whole records are handed out when buf is too small for all */
+	while ((len = i915_perf_ring_read(ring, &pos, buf, sizeof(buf), &lost))) {
+		last = check_records(buf, len, last);
+		read += len;
+	}
+	check(last == 19);
+	check(read == total && pos == total && lost == 0);
+
+	i915_perf_ring_close(ring);
+}
+
+static void test_concurrent(void)
+{
+	static char name[64], buf[64 * 1024];
+	struct i915_perf_ring *ring, *reader;
+	uint64_t pos = 0, lost = 0, read = 0;
+	uint32_t last = UINT32_MAX, records = 0;
+	const uint32_t count = 200000;
+	int status;
+	pid_t pid;
+
+	snprintf(name, sizeof(name), "/i915-perf-ring-test-%d", getpid());
+
+	ring = i915_perf_ring_create(name, 100000);
+	check(ring);
+
+	reader = i915_perf_ring_open(name);
+	check(reader);
+	check(reader->size == ring->size);
+
+	pid = fork();
+	check(pid >= 0);
+	if (pid == 0) {
+		static char batch[8192];
+		uint32_t seq = 0, batches = 0;
+
+		/* Write batches of records, like the recorder does */
+		while (seq < count) {
+			size_t len = 0;
+
+			while (seq < count && sizeof(batch) - len >= 1024 + 8)
+				len += make_record(batch + len, seq++);
+
+			if (!i915_perf_ring_write(ring, batch, len))
+				_exit(EXIT_FAILURE);
+
+			/* Give the reader a chance to keep up every now and then */
+			if (++batches % 16 == 0)
+				usleep(1);
+		}
+
+		_exit(EXIT_SUCCESS);
+	}
+
+	for (;;) {
+		bool done = waitpid(pid, &status, WNOHANG) == pid;
+		size_t len;
+
+		/* Drain whatever is left once the writer is gone */
+		while ((len = i915_perf_ring_read(reader, &pos, buf, sizeof(buf), &lost))) {
+			const struct test_record *record = (const void *)buf;
+
+			/* Any gap in the sequence has to be accounted for */
+			check(last == UINT32_MAX || record->seq == last + 1 || lost);
+
+			last = check_records(buf, len, last);
+			read += len;
+			records++;
+		}
+
+		if (done)
+			break;
+	}
+
+	check(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+	check(last == count - 1);
+	check(read + lost == atomic_load(&ring->head));
+
+	printf("read %u batches, %llu bytes, %llu bytes dropped\n",
+	       records, (unsigned long long)read, (unsigned long long)lost);
+
+	i915_perf_ring_close(reader);
+	i915_perf_ring_close(ring);
+	shm_unlink(name);
+
+	/* Gone with the recorder */
+	check(!i915_perf_ring_open(name) && errno == ENOENT);
+}
+
+int main(int argc, char **argv)
+{
+	test_wrap();
+	test_partial_read();
+	test_concurrent();
+
+	return EXIT_SUCCESS;
+}
@@ -39,6 +39,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -120,6 +121,15 @@ struct engines {
 
 	int num_gts;
 
+	/* Every PMU group, read straight into a sample row */
+	struct pmu_group {
+		int fd;
+		unsigned int num;
+		unsigned int offset;
+	} groups[3];
+	unsigned int num_groups;
+	uint64_t *sample;
+
 	/* Do not edit below this line.
 	 * This structure is reallocated every time a new engine is
 	 * found and size is increased by sizeof (engine).
@@ -346,6 +356,19 @@ static int engine_cmp(const void *__a, const void *__b)
 		return a->instance - b->instance;
 }
 
+static int engine_init_names(struct engine *engine)
+{
+	if (asprintf(&engine->display_name, "%s/%u",
+		     class_display_name(engine->class), engine->instance) <= 0)
+		return -errno;
+
+	if (asprintf(&engine->short_name, "%s/%u",
+		     class_short_name(engine->class), engine->instance) <= 0)
+		return -errno;
+
+	return 0;
+}
+
 #define IGPU_PCI "0000:00:02.0"
 #define is_igpu_pci(x) (strcmp(x, IGPU_PCI) == 0)
 #define is_igpu(x) (strcmp(x, "i915") == 0)
@@ -428,19 +451,9 @@ static struct engines *discover_engines(char *device)
 				    I915_PMU_SAMPLE_BITS) &
 				    ((1 << I915_PMU_SAMPLE_INSTANCE_BITS) - 1);
 
-		ret = asprintf(&engine->display_name, "%s/%u",
-			       class_display_name(engine->class),
-			       engine->instance);
-		if (ret <= 0) {
-			ret = errno;
-			break;
-		}
-
-		ret = asprintf(&engine->short_name, "%s/%u",
-			       class_short_name(engine->class),
-			       engine->instance);
-		if (ret <= 0) {
-			ret = errno;
+		ret = engine_init_names(engine);
+		if (ret) {
+			ret = -ret;
 			break;
 		}
 
@@ -500,9 +513,11 @@ static void free_engines(struct engines *engines)
 		free((char *)engine->display_name);
 	}
 
-	closedir(engines->root);
+	if (engines->root)
+		closedir(engines->root);
 
 	free(engines->class);
+	free(engines->sample);
 	free(engines);
 }
 
@@ -596,6 +611,44 @@ static void init_aggregate_counters(struct engines *engines)
 	pmu->present = true;
 }
 
+/*
+ * A sample row holds the timestamp followed by the values of every group.
+ * Each group is read in one go into its place in the row, with the
+ * PERF_FORMAT_GROUP header of the number of values and the time enabled
+ * landing in the two slots before it. Reading the groups last to first
+ * overwrites each header with the values of the group before it, and
+ * leaves the time enabled of the first group as the timestamp.
+ */
+static void pmu_add_group(struct engines *engines, int fd, unsigned int num,
+			  unsigned int *offset)
+{
+	if (num) {
+		struct pmu_group *group = &engines->groups[engines->num_groups++];
+
+		assert(engines->num_groups <= ARRAY_SIZE(engines->groups));
+
+		group->fd = fd;
+		group->num = num;
+		group->offset = *offset;
+	}
+
+	*offset += num;
+}
+
+static int pmu_init_groups(struct engines *engines)
+{
+	unsigned int offset = 1;
+
+	pmu_add_group(engines, engines->fd, engines->num_counters, &offset);
+	pmu_add_group(engines, engines->rapl_fd, engines->num_rapl, &offset);
+	pmu_add_group(engines, engines->imc_fd, engines->num_imc, &offset);
+
+	/* Room for the header of the first group before the row */
+	engines->sample = calloc(1 + offset, sizeof(*engines->sample));
+
+	return engines->sample ? 0 : -1;
+}
+
 static int pmu_init(struct engines *engines)
 {
 	unsigned int i;
@@ -661,24 +714,329 @@ static int pmu_init(struct engines *engines)
 	imc_reads_open(&engines->imc_reads, engines);
 	imc_writes_open(&engines->imc_writes, engines);
 
-	return 0;
+	return pmu_init_groups(engines);
 }
 
-static uint64_t pmu_read_multi(int fd, unsigned int num, uint64_t *val)
+static void pmu_read_group(const struct pmu_group *group, uint64_t *row)
 {
-	uint64_t buf[2 + num];
-	unsigned int i;
+	const size_t size = (2 + group->num) * sizeof(uint64_t);
 	ssize_t len;
 
-	memset(buf, 0, sizeof(buf));
+	len = read(group->fd, row + group->offset - 2, size);
+	assert(len == size);
+}
+
+/*
+ * Binary recordings of the raw counters, written with -b and converted to
+ * any of the other output formats with -i. A header describing the engines
+ * and counters is followed by fixed size rows of u64 values, each one
+ * sample with the timestamp first and then the values in the order the
+ * counter groups are read in.
+ */
+#define RECORDING_MAGIC "IGTGPUT"
+#define RECORDING_VERSION 1
+
+struct recording_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t period_us;
+	uint32_t num_gts;
+	uint32_t discrete;
+	uint32_t num_engines;
+	uint32_t num_descs;
+	uint32_t num_counters;
+	uint32_t num_rapl;
+	uint32_t num_imc;
+};
+
+struct recording_engine {
+	uint32_t class;
+	uint32_t instance;
+	char name[32];
+};
 
-	len = read(fd, buf, sizeof(buf));
-	assert(len == sizeof(buf));
+struct recording_counter {
+	uint32_t kind;
+	uint32_t index;
+	uint32_t idx;
+	uint32_t pad;
+	double scale;
+	char units[16];
+};
 
-	for (i = 0; i < num; i++)
-		val[i] = buf[2 + i];
+enum recorded_counter {
+	REC_IRQ,
+	REC_FREQ_REQ,
+	REC_FREQ_ACT,
+	REC_RC6,
+	REC_BUSY,
+	REC_WAIT,
+	REC_SEMA,
+	REC_GPU_POWER,
+	REC_PKG_POWER,
+	REC_IMC_READS,
+	REC_IMC_WRITES,
+	REC_NUM
+};
+
+static struct {
+	FILE *file;
+	void *map;
+	size_t size;
+	const uint64_t *row;
+	const uint64_t *end;
+} recording;
 
-	return buf[1];
+static unsigned int num_columns(const struct engines *engines)
+{
+	return 1 + engines->num_counters + engines->num_rapl + engines->num_imc;
+}
+
+static struct pmu_counter *
+recorded_counter(struct engines *engines, unsigned int kind, unsigned int index)
+{
+	unsigned int max = REC_BUSY <= kind && kind <= REC_SEMA ?
+			   engines->num_engines : kind == REC_IRQ ||
+			   kind >= REC_GPU_POWER ? 1 : MAX_GTS;
+
+	if (index >= max)
+		return NULL;
+
+	switch (kind) {
+	case REC_IRQ:
+		return &engines->irq;
+	case REC_FREQ_REQ:
+		return &engines->freq_req_gt[index];
+	case REC_FREQ_ACT:
+		return &engines->freq_act_gt[index];
+	case REC_RC6:
+		return &engines->rc6_gt[index];
+	case REC_BUSY:
+		return &engine_ptr(engines, index)->busy;
+	case REC_WAIT:
+		return &engine_ptr(engines, index)->wait;
+	case REC_SEMA:
+		return &engine_ptr(engines, index)->sema;
+	case REC_GPU_POWER:
+		return &engines->r_gpu;
+	case REC_PKG_POWER:
+		return &engines->r_pkg;
+	case REC_IMC_READS:
+		return &engines->imc_reads;
+	case REC_IMC_WRITES:
+		return &engines->imc_writes;
+	default:
+		return NULL;
+	}
+}
+
+static int
+record_header(FILE *file, struct engines *engines, unsigned int period_us)
+{
+	struct recording_header header = {
+		.magic = RECORDING_MAGIC,
+		.version = RECORDING_VERSION,
+		.period_us = period_us,
+		.num_gts = engines->num_gts,
+		.discrete = engines->discrete,
+		.num_engines = engines->num_engines,
+		.num_counters = engines->num_counters,
+		.num_rapl = engines->num_rapl,
+		.num_imc = engines->num_imc,
+	};
+	unsigned int kind, i;
+
+	for (kind = 0; kind < REC_NUM; kind++) {
+		struct pmu_counter *pmu;
+
+		for (i = 0; (pmu = recorded_counter(engines, kind, i)); i++)
+			header.num_descs += pmu->present;
+	}
+
+	header.header_size = sizeof(header) +
+			     header.num_engines * sizeof(struct recording_engine) +
+			     header.num_descs * sizeof(struct recording_counter);
+
+	fwrite(&header, sizeof(header), 1, file);
+
+	for (i = 0; i < engines->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+		struct recording_engine e = {
+			.class = engine->class,
+			.instance = engine->instance,
+		};
+
+		strncpy(e.name, engine->name, sizeof(e.name) - 1);
+		fwrite(&e, sizeof(e), 1, file);
+	}
+
+	for (kind = 0; kind < REC_NUM; kind++) {
+		struct pmu_counter *pmu;
+
+		for (i = 0; (pmu = recorded_counter(engines, kind, i)); i++) {
+			struct recording_counter c = {
+				.kind = kind,
+				.index = i,
+				.idx = pmu->idx,
+				.scale = pmu->scale,
+			};
+
+			if (!pmu->present)
+				continue;
+
+			if (pmu->units)
+				strncpy(c.units, pmu->units, sizeof(c.units) - 1);
+			fwrite(&c, sizeof(c), 1, file);
+		}
+	}
+
+	return fflush(file) ? -errno : 0;
+}
+
+/*
+ * Sets up engines from the header of a recording, for pmu_sample() to
+ * return the recorded samples one by one.
+ */
+static struct engines *load_recording(const char *path)
+{
+	const struct recording_header *header;
+	const struct recording_engine *e;
+	const struct recording_counter *c;
+	struct engines *engines;
+	struct stat st;
+	unsigned int i;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) || st.st_size < sizeof(*header)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	recording.size = st.st_size;
+	recording.map = mmap(NULL, recording.size, PROT_READ, MAP_PRIVATE,
+			     fd, 0);
+	close(fd);
+	if (recording.map == MAP_FAILED)
+		return NULL;
+
+	header = recording.map;
+	if (memcmp(header->magic, RECORDING_MAGIC, sizeof(header->magic)) ||
+	    header->version != RECORDING_VERSION ||
+	    !header->num_engines || header->num_engines > 256 ||
+	    !header->num_gts || header->num_gts > MAX_GTS ||
+	    header->num_descs > 4096 || header->num_counters > 4096 ||
+	    header->num_rapl > 2 || header->num_imc > 2 ||
+	    header->header_size != sizeof(*header) +
+	    header->num_engines * sizeof(*e) + header->num_descs * sizeof(*c) ||
+	    header->header_size > recording.size)
+		goto err_map;
+
+	engines = calloc(1, sizeof(struct engines) +
+			    header->num_engines * sizeof(struct engine));
+	if (!engines)
+		goto err_map;
+
+	engines->fd = engines->rapl_fd = engines->imc_fd = -1;
+	engines->num_gts = header->num_gts;
+	engines->discrete = header->discrete;
+	engines->num_counters = header->num_counters;
+	engines->num_rapl = header->num_rapl;
+	engines->num_imc = header->num_imc;
+
+	e = (const void *)(header + 1);
+	for (i = 0; i < header->num_engines; i++, e++) {
+		struct engine *engine = engine_ptr(engines, i);
+
+		engine->class = e->class;
+		engine->instance = e->instance;
+		engine->name = strndup(e->name, sizeof(e->name));
+		engines->num_engines++;
+
+		if (!engine->name || engine_init_names(engine))
+			goto err_engines;
+	}
+
+	c = (const void *)e;
+	for (i = 0; i < header->num_descs; i++, c++) {
+		struct pmu_counter *pmu =
+			recorded_counter(engines, c->kind, c->index);
+
+		if (!pmu || pmu->present ||
+		    c->idx >= (c->kind >= REC_IMC_READS ? engines->num_imc :
+			       c->kind >= REC_GPU_POWER ? engines->num_rapl :
+			       engines->num_counters))
+			goto err_engines;
+
+		pmu->present = true;
+		pmu->idx = c->idx;
+		pmu->scale = c->scale;
+
+		if (c->kind >= REC_GPU_POWER) {
+			pmu->units = strndup(c->units, sizeof(c->units));
+			if (!pmu->units)
+				goto err_engines;
+		}
+
+		if (c->kind >= REC_BUSY && c->kind <= REC_SEMA)
+			engine_ptr(engines, c->index)->num_counters++;
+	}
+
+	/* Fully written rows only, whatever state the recorder died in */
+	recording.row = (const void *)((const char *)recording.map +
+				       header->header_size);
+	recording.end = recording.row +
+			(recording.size - header->header_size) /
+			(num_columns(engines) * sizeof(uint64_t)) *
+			num_columns(engines);
+
+	engines->freq_req.present = true;
+	engines->freq_act.present = true;
+	engines->rc6.present = true;
+
+	return engines;
+
+err_engines:
+	free_engines(engines);
+err_map:
+	munmap(recording.map, recording.size);
+	recording.map = NULL;
+	errno = EINVAL;
+	return NULL;
+}
+
+/*
+ * Reads every counter group into one row, timestamp first, or takes the
+ * next row of the recording. Returns NULL at the end of the recording.
+ */
+static const uint64_t *pmu_read_all(struct engines *engines)
+{
+	const unsigned int num = num_columns(engines);
+	uint64_t *row = engines->sample + 1;
+	int i;
+
+	if (recording.map) {
+		const uint64_t *next = recording.row;
+
+		if (next == recording.end)
+			return NULL;
+
+		recording.row += num;
+		return next;
+	}
+
+	for (i = engines->num_groups - 1; i >= 0; i--)
+		pmu_read_group(&engines->groups[i], row);
+
+	if (recording.file)
+		fwrite(row, sizeof(*row), num, recording.file);
+
+	return row;
 }
 
 static double pmu_calc(struct pmu_pair *p, double d, double t, double s)
@@ -712,20 +1070,24 @@ static void __update_sample(struct pmu_counter *counter, uint64_t val)
 	counter->val.cur = val;
 }
 
-static void update_sample(struct pmu_counter *counter, uint64_t *val)
+static void update_sample(struct pmu_counter *counter, const uint64_t *val)
 {
 	if (counter->present)
 		__update_sample(counter, val[counter->idx]);
 }
 
-static void pmu_sample(struct engines *engines)
+static bool pmu_sample(struct engines *engines)
 {
-	const int num_val = engines->num_counters;
-	uint64_t val[2 + num_val];
+	const uint64_t *row, *val;
 	unsigned int i;
 
+	row = pmu_read_all(engines);
+	if (!row)
+		return false;
+
+	val = row + 1;
 	engines->ts.prev = engines->ts.cur;
-	engines->ts.cur = pmu_read_multi(engines->fd, num_val, val);
+	engines->ts.cur = row[0];
 
 	engines->freq_req.val.cur = engines->freq_req.val.prev = 0;
 	engines->freq_act.val.cur = engines->freq_act.val.prev = 0;
@@ -764,17 +1126,15 @@ static void pmu_sample(struct engines *engines)
 		update_sample(&engine->wait, val);
 	}
 
-	if (engines->num_rapl) {
-		pmu_read_multi(engines->rapl_fd, engines->num_rapl, val);
-		update_sample(&engines->r_gpu, val);
-		update_sample(&engines->r_pkg, val);
-	}
+	val += engines->num_counters;
+	update_sample(&engines->r_gpu, val);
+	update_sample(&engines->r_pkg, val);
 
-	if (engines->num_imc) {
-		pmu_read_multi(engines->imc_fd, engines->num_imc, val);
-		update_sample(&engines->imc_reads, val);
-		update_sample(&engines->imc_writes, val);
-	}
+	val += engines->num_rapl;
+	update_sample(&engines->imc_reads, val);
+	update_sample(&engines->imc_writes, val);
+
+	return true;
 }
 
 static int
@@ -1044,6 +1404,8 @@ usage(const char *appname)
 		"\t[-h]            Show this help text.\n"
 		"\t[-c]            Output CSV formatted data.\n"
 		"\t[-J]            Output JSON formatted data.\n"
+		"\t[-b]            Output a binary recording of the raw counters.\n"
+		"\t[-i <file>]     Read the counters from a binary recording.\n"
 		"\t[-l]            List plain text data.\n"
 		"\t[-o <file|->]   Output to specified file or '-' for standard out.\n"
 		"\t[-s <ms>]       Refresh period in milliseconds (default %ums).\n"
@@ -1060,7 +1422,8 @@ static enum {
 	INTERACTIVE,
 	TEXT,
 	CSV,
-	JSON
+	JSON,
+	BINARY
 } output_mode;
 
 struct cnt_item {
@@ -1712,23 +2075,25 @@ print_imc(struct engines *engines, double t, int lines, int con_w, int con_h)
 		&imc_group,
 		NULL
 	};
+	static char *display_name, *unit;
 	int ret;
 
 	if (!engines->num_imc)
 		return lines;
 
-	ret = asprintf((char **)&imc_group.display_name, "IMC %s/s",
-			engines->imc_reads.units);
-	assert(ret >= 0);
+	if (!display_name) {
+		ret = asprintf(&display_name, "IMC %s/s",
+			       engines->imc_reads.units);
+		assert(ret >= 0);
 
-	ret = asprintf((char **)&imc_items[2].unit, "%s/s",
-			engines->imc_reads.units);
-	assert(ret >= 0);
+		ret = asprintf(&unit, "%s/s", engines->imc_reads.units);
+		assert(ret >= 0);
+	}
 
-	print_groups(groups);
+	imc_group.display_name = display_name;
+	imc_items[2].unit = unit;
 
-	free((void *)imc_group.display_name);
-	free((void *)imc_items[2].unit);
+	print_groups(groups);
 
 	if (output_mode == INTERACTIVE) {
 		if (lines++ < con_h)
@@ -2608,19 +2973,21 @@ int main(int argc, char **argv)
 	unsigned int period_us = DEFAULT_PERIOD_MS * 1000;
 	bool physical_engines = false;
 	bool separate_regions = false;
-	struct intel_clients iclients;
+	struct intel_clients iclients = { };
 	int con_w = -1, con_h = -1;
 	char *output_path = NULL;
+	char *input_path = NULL;
 	struct engines *engines;
 	int ret = 0, ch;
 	bool list_device = false;
-	char *pmu_device, *opt_device = NULL;
-	struct igt_device_card card;
+	char *opt_device = NULL;
+	struct igt_device_card card = { };
+	char *pmu_device = NULL;
 	char *codename = NULL;
 	struct timespec ts;
 
 	/* Parse options */
-	while ((ch = getopt(argc, argv, "o:s:d:mpcJLlh")) != -1) {
+	while ((ch = getopt(argc, argv, "o:s:d:i:mpcJbLlh")) != -1) {
 		switch (ch) {
 		case 'o':
 			output_path = optarg;
@@ -2643,6 +3010,12 @@ int main(int argc, char **argv)
 		case 'J':
 			output_mode = JSON;
 			break;
+		case 'b':
+			output_mode = BINARY;
+			break;
+		case 'i':
+			input_path = optarg;
+			break;
 		case 'L':
 			list_device = true;
 			break;
@@ -2659,9 +3032,15 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (output_mode == INTERACTIVE && (output_path || isatty(1) != 1))
+	if (output_mode == INTERACTIVE &&
+	    (output_path || input_path || isatty(1) != 1))
 		output_mode = TEXT;
 
+	if (output_mode == BINARY && input_path) {
+		fprintf(stderr, "Recordings can only be converted to the other output formats!\n");
+		exit(1);
+	}
+
 	if (output_path && strcmp(output_path, "-")) {
 		out = fopen(output_path, "w");
 
@@ -2674,6 +3053,11 @@ int main(int argc, char **argv)
 		out = stdout;
 	}
 
+	if (output_mode == BINARY && isatty(fileno(out))) {
+		fprintf(stderr, "Refusing to write a binary recording to a terminal!\n");
+		exit(1);
+	}
+
 	text_header_repeat = output_mode == TEXT && isatty(fileno(out));
 
 	if (signal(SIGINT, sigint_handler) == SIG_ERR)
@@ -2696,63 +3080,75 @@ int main(int argc, char **argv)
 	case JSON:
 		pops = &json_pops;
 		break;
+	case BINARY:
+		recording.file = out;
+		break;
 	default:
 		assert(0);
 		break;
 	};
 
-	igt_devices_scan(false);
+	if (input_path) {
+		engines = load_recording(input_path);
+		if (!engines) {
+			fprintf(stderr, "Failed to load recording '%s'! (%s)\n",
+				input_path, strerror(errno));
+			ret = EXIT_FAILURE;
+			goto exit;
+		}
+	} else {
+		igt_devices_scan(false);
 
-	if (list_device) {
-		struct igt_devices_print_format fmt = {
-			.type = IGT_PRINT_USER,
-			.option = IGT_PRINT_PCI,
-		};
+		if (list_device) {
+			struct igt_devices_print_format fmt = {
+				.type = IGT_PRINT_USER,
+				.option = IGT_PRINT_PCI,
+			};
 
-		igt_devices_print(&fmt);
-		goto exit;
-	}
+			igt_devices_print(&fmt);
+			goto exit;
+		}
 
-	if (opt_device != NULL) {
-		ret = igt_device_card_match_pci(opt_device, &card);
-		if (!ret)
-			fprintf(stderr, "Requested device %s not found!\n", opt_device);
-		free(opt_device);
-	} else {
-		ret = igt_device_find_first_i915_discrete_card(&card);
-		if (!ret)
-			ret = igt_device_find_integrated_card(&card);
-		if (!ret)
-			fprintf(stderr, "No device filter specified and no discrete/integrated i915 devices found\n");
-	}
+		if (opt_device != NULL) {
+			ret = igt_device_card_match_pci(opt_device, &card);
+			if (!ret)
+				fprintf(stderr, "Requested device %s not found!\n", opt_device);
+			free(opt_device);
+		} else {
+			ret = igt_device_find_first_i915_discrete_card(&card);
+			if (!ret)
+				ret = igt_device_find_integrated_card(&card);
+			if (!ret)
+				fprintf(stderr, "No device filter specified and no discrete/integrated i915 devices found\n");
+		}
 
-	if (!ret) {
-		ret = EXIT_FAILURE;
-		goto exit;
-	}
+		if (!ret) {
+			ret = EXIT_FAILURE;
+			goto exit;
+		}
 
-	if (card.pci_slot_name[0] && !is_igpu_pci(card.pci_slot_name))
-		pmu_device = tr_pmu_name(&card);
-	else
-		pmu_device = strdup("i915");
+		if (card.pci_slot_name[0] && !is_igpu_pci(card.pci_slot_name))
+			pmu_device = tr_pmu_name(&card);
+		else
+			pmu_device = strdup("i915");
 
-	codename = igt_device_get_pretty_name(&card, false);
+		codename = igt_device_get_pretty_name(&card, false);
 
-	engines = discover_engines(pmu_device);
-	if (!engines) {
-		fprintf(stderr,
-			"Failed to detect engines! (%s)\n(Kernel 4.16 or newer is required for i915 PMU support.)\n",
-			strerror(errno));
-		ret = EXIT_FAILURE;
-		goto err_engines;
-	}
+		engines = discover_engines(pmu_device);
+		if (!engines) {
+			fprintf(stderr,
+				"Failed to detect engines! (%s)\n(Kernel 4.16 or newer is required for i915 PMU support.)\n",
+				strerror(errno));
+			ret = EXIT_FAILURE;
+			goto err_engines;
+		}
 
-	ret = pmu_init(engines);
-	if (ret) {
-		fprintf(stderr,
-			"Failed to initialize PMU! (%s)\n", strerror(errno));
-		if (errno == EACCES && geteuid())
+		ret = pmu_init(engines);
+		if (ret) {
 			fprintf(stderr,
+				"Failed to initialize PMU! (%s)\n", strerror(errno));
+			if (errno == EACCES && geteuid())
+				fprintf(stderr,
 "\n"
 "When running as a normal user CAP_PERFMON is required to access performance\n"
 "monitoring. See \"man 7 capabilities\", \"man 8 setcap\", or contact your\n"
@@ -2760,23 +3156,35 @@ int main(int argc, char **argv)
 "\n"
 "More information can be found at 'Perf events and tool security' document:\n"
 "https://www.kernel.org/doc/html/latest/admin-guide/perf-security.html\n");
-		ret = EXIT_FAILURE;
-		goto err_pmu;
+			ret = EXIT_FAILURE;
+			goto err_pmu;
+		}
 	}
 
 	ret = EXIT_SUCCESS;
 
 	init_engine_classes(engines);
 
-	if (has_drm_fdinfo(&card))
+	/* The clients are not recorded */
+	if (output_mode != BINARY && !input_path && has_drm_fdinfo(&card))
 		intel_init_clients(&iclients, &card, engines);
 
+	if (output_mode == BINARY) {
+		ret = record_header(out, engines, period_us);
+		if (ret) {
+			fprintf(stderr, "Failed to write recording! (%s)\n",
+				strerror(-ret));
+			ret = EXIT_FAILURE;
+			goto err_pmu;
+		}
+	}
+
 	pmu_sample(engines);
 	intel_scan_clients(&iclients);
 	gettime(&ts);
 
 	if (output_mode == JSON)
-		printf("[\n");
+		fprintf(out, "[\n");
 
 	while (!stop_top) {
 		struct igt_drm_clients *disp_clients;
@@ -2800,7 +3208,14 @@ int main(int argc, char **argv)
 			}
 		}
 
-		pmu_sample(engines);
+		if (!pmu_sample(engines))
+			break;
+
+		if (output_mode == BINARY) {
+			usleep(period_us);
+			continue;
+		}
+
 		t = (double)(engines->ts.cur - engines->ts.prev) / 1e9;
 
 		intel_scan_clients(&iclients);
@@ -2863,12 +3278,12 @@ int main(int argc, char **argv)
 
 		if (output_mode == INTERACTIVE)
 			process_stdin(period_us);
-		else
+		else if (!input_path)
 			usleep(period_us);
 	}
 
 	if (output_mode == JSON)
-		printf("]\n");
+		fprintf(out, "]\n");
 
 	intel_free_clients(&iclients);
 
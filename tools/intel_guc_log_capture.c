@@ -0,0 +1,511 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "intel_guc_log_capture.h"
+
+#define ZBUF_SIZE (256 << 10)
+
+struct guc_log_capture {
+	struct guc_log_capture_params params;
+	bool spliced;
+
+	pthread_t writer;
+	bool writer_started;
+	atomic_int error;
+
+	uint64_t captured;
+	uint64_t stalls;
+	atomic_uint_least64_t written;
+
+	/* Splice path: the pipe holds the sub-buffers in flight */
+	int pipe[2];
+
+	/*
+	 * Copy path: sub-buffers [tail, head) are filled. Each side bumps a
+	 * futex word after moving its index, for the other side to sleep on
+	 * while the ring is full or empty, and only wakes it up if it said it
+	 * was going to sleep.
+	 */
+	char *buffers;
+	size_t *lengths;
+	atomic_uint head;
+	atomic_uint tail;
+	atomic_uint filled_seq;
+	atomic_uint drained_seq;
+	atomic_bool writer_waiting;
+	atomic_bool reader_waiting;
+	atomic_bool stopping;
+
+	z_stream zstream;
+	unsigned char *zbuf;
+};
+
+static void futex_wait(atomic_uint *addr, unsigned int val)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_uint *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static void set_error(struct guc_log_capture *capture, int err)
+{
+	int none = 0;
+
+	atomic_compare_exchange_strong(&capture->error, &none, err);
+}
+
+static int write_all(int fd, const void *data, size_t len)
+{
+	while (len) {
+		ssize_t ret = write(fd, data, len);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		data = (const char *)data + ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static void *splice_writer(void *data)
+{
+	struct guc_log_capture *capture = data;
+
+	for (;;) {
+		ssize_t ret;
+
+		ret = splice(capture->pipe[0], NULL, capture->params.out_fd,
+			     NULL, INT_MAX, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (ret == 0) /* The capture is finished */
+			break;
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			set_error(capture, -errno);
+			break;
+		}
+
+		atomic_fetch_add(&capture->written, ret);
+	}
+
+	return NULL;
+}
+
+static int deflate_out(struct guc_log_capture *capture, int flush)
+{
+	z_stream *zs = &capture->zstream;
+	int ret;
+
+	do {
+		size_t len;
+
+		zs->next_out = capture->zbuf;
+		zs->avail_out = ZBUF_SIZE;
+
+		ret = deflate(zs, flush);
+		if (ret == Z_STREAM_ERROR)
+			return -EINVAL;
+
+		len = ZBUF_SIZE - zs->avail_out;
+		ret = write_all(capture->params.out_fd, capture->zbuf, len);
+		if (ret)
+			return ret;
+
+		atomic_fetch_add(&capture->written, len);
+	} while (zs->avail_out == 0);
+
+	return 0;
+}
+
+static int write_subbuf(struct guc_log_capture *capture, const char *data,
+			size_t len)
+{
+	int ret;
+
+	if (!capture->params.compress) {
+		ret = write_all(capture->params.out_fd, data, len);
+		if (!ret)
+			atomic_fetch_add(&capture->written, len);
+		return ret;
+	}
+
+	capture->zstream.next_in = (unsigned char *)data;
+	capture->zstream.avail_in = len;
+
+	return deflate_out(capture, Z_NO_FLUSH);
+}
+
+static void *copy_writer(void *data)
+{
+	struct guc_log_capture *capture = data;
+	const unsigned int num = capture->params.num_subbufs;
+	unsigned int tail = atomic_load(&capture->tail);
+	int ret = 0;
+
+	for (;;) {
+		unsigned int head = atomic_load(&capture->head);
+
+		if (tail == head) {
+			unsigned int seq;
+
+			if (atomic_load(&capture->stopping))
+				break;
+
+			atomic_store(&capture->writer_waiting, true);
+			seq = atomic_load(&capture->filled_seq);
+			if (atomic_load(&capture->head) == tail &&
+			    !atomic_load(&capture->stopping))
+				futex_wait(&capture->filled_seq, seq);
+			atomic_store(&capture->writer_waiting, false);
+			continue;
+		}
+
+		/* After an error, keep draining so the reader never blocks */
+		while (tail != head) {
+			unsigned int slot = tail % num;
+
+			if (!ret)
+				ret = write_subbuf(capture,
+						   capture->buffers +
+						   (size_t)slot * capture->params.subbuf_size,
+						   capture->lengths[slot]);
+
+			atomic_store(&capture->tail, ++tail);
+			atomic_fetch_add(&capture->drained_seq, 1);
+			if (atomic_load(&capture->reader_waiting))
+				futex_wake(&capture->drained_seq);
+		}
+	}
+
+	if (!ret && capture->params.compress)
+		ret = deflate_out(capture, Z_FINISH);
+
+	if (ret)
+		set_error(capture, ret);
+
+	return NULL;
+}
+
+static int start_copy(struct guc_log_capture *capture)
+{
+	const struct guc_log_capture_params *params = &capture->params;
+	int ret;
+
+	capture->spliced = false;
+
+	ret = posix_memalign((void **)&capture->buffers, 4096,
+			     (size_t)params->num_subbufs * params->subbuf_size);
+	if (ret)
+		return -ret;
+
+	capture->lengths = calloc(params->num_subbufs,
+				  sizeof(*capture->lengths));
+	if (!capture->lengths)
+		return -ENOMEM;
+
+	if (params->compress) {
+		capture->zbuf = malloc(ZBUF_SIZE);
+		if (!capture->zbuf)
+			return -ENOMEM;
+
+		/* 16 + MAX_WBITS for a gzip header and trailer */
+		if (deflateInit2(&capture->zstream, params->compress,
+				 Z_DEFLATED, 16 + MAX_WBITS, 8,
+				 Z_DEFAULT_STRATEGY) != Z_OK) {
+			free(capture->zbuf);
+			capture->zbuf = NULL;
+			return -EINVAL;
+		}
+	}
+
+	ret = pthread_create(&capture->writer, NULL, copy_writer, capture);
+	if (ret)
+		return -ret;
+
+	capture->writer_started = true;
+	return 0;
+}
+
+static int start_splice(struct guc_log_capture *capture)
+{
+	const struct guc_log_capture_params *params = &capture->params;
+	size_t size = (size_t)params->num_subbufs * params->subbuf_size;
+	int ret;
+
+	if (pipe2(capture->pipe, O_CLOEXEC))
+		return -errno;
+
+	/* Unprivileged pipes are limited by /proc/sys/fs/pipe-max-size */
+	while (size > params->subbuf_size &&
+	       fcntl(capture->pipe[1], F_SETPIPE_SZ, size) < 0)
+		size /= 2;
+
+	capture->spliced = true;
+
+	ret = pthread_create(&capture->writer, NULL, splice_writer, capture);
+	if (ret)
+		return -ret;
+
+	capture->writer_started = true;
+	return 0;
+}
+
+static void stop_splice(struct guc_log_capture *capture)
+{
+	if (capture->pipe[1] >= 0) {
+		close(capture->pipe[1]);
+		capture->pipe[1] = -1;
+	}
+
+	if (capture->writer_started) {
+		pthread_join(capture->writer, NULL);
+		capture->writer_started = false;
+	}
+
+	if (capture->pipe[0] >= 0) {
+		close(capture->pipe[0]);
+		capture->pipe[0] = -1;
+	}
+}
+
+/**
+ * guc_log_capture_create:
+ * @params: the files to move the log between and how
+ *
+ * Starts the writer thread of a capture.
+ *
+ * Returns: the capture, or NULL with errno set on failure.
+ */
+struct guc_log_capture *
+guc_log_capture_create(const struct guc_log_capture_params *params)
+{
+	struct guc_log_capture *capture;
+	int ret;
+
+	if (!params->subbuf_size || !params->num_subbufs) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	capture = calloc(1, sizeof(*capture));
+	if (!capture)
+		return NULL;
+
+	capture->params = *params;
+	capture->pipe[0] = capture->pipe[1] = -1;
+
+	if (params->copy || params->compress)
+		ret = start_copy(capture);
+	else
+		ret = start_splice(capture);
+	if (ret) {
+		guc_log_capture_destroy(capture);
+		errno = -ret;
+		return NULL;
+	}
+
+	return capture;
+}
+
+static int wait_for_room(struct guc_log_capture *capture)
+{
+	struct pollfd pfd = { .fd = capture->pipe[1], .events = POLLOUT };
+	int ret;
+
+	capture->stalls++;
+
+	/* Poll in slices, to notice if the writer gave up */
+	while (!(ret = atomic_load(&capture->error))) {
+		if (poll(&pfd, 1, 100) > 0)
+			break;
+	}
+
+	return ret;
+}
+
+static int pull_splice(struct guc_log_capture *capture)
+{
+	for (;;) {
+		ssize_t ret;
+
+		ret = splice(capture->params.relay_fd, NULL, capture->pipe[1],
+			     NULL, capture->params.subbuf_size,
+			     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (ret >= 0) {
+			capture->captured += ret;
+			return ret;
+		}
+
+		switch (errno) {
+		case EINTR:
+			continue;
+
+		case EAGAIN: {
+			struct pollfd pfd = {
+				.fd = capture->pipe[1],
+				.events = POLLOUT
+			};
+
+			/* Either the pipe is full, or there is no data yet */
+			if (poll(&pfd, 1, 0) > 0)
+				return 0;
+
+			ret = wait_for_room(capture);
+			if (ret)
+				return ret;
+			continue;
+		}
+
+		case EINVAL:
+			/* The relay file can't be spliced, read it instead */
+			if (!capture->captured) {
+				stop_splice(capture);
+				ret = start_copy(capture);
+				if (ret)
+					return ret;
+
+				return guc_log_capture_pull(capture);
+			}
+			/* fallthrough */
+		default:
+			return -errno;
+		}
+	}
+}
+
+static int pull_copy(struct guc_log_capture *capture)
+{
+	const unsigned int num = capture->params.num_subbufs;
+	unsigned int head = atomic_load_explicit(&capture->head,
+						 memory_order_relaxed);
+	unsigned int slot = head % num;
+	ssize_t ret;
+
+	if (head - atomic_load(&capture->tail) == num) {
+		capture->stalls++;
+
+		atomic_store(&capture->reader_waiting, true);
+		for (;;) {
+			unsigned int seq = atomic_load(&capture->drained_seq);
+
+			if (head - atomic_load(&capture->tail) != num)
+				break;
+
+			futex_wait(&capture->drained_seq, seq);
+		}
+		atomic_store(&capture->reader_waiting, false);
+	}
+
+	do {
+		ret = read(capture->params.relay_fd,
+			   capture->buffers +
+			   (size_t)slot * capture->params.subbuf_size,
+			   capture->params.subbuf_size);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0)
+		return errno == EAGAIN ? 0 : -errno;
+	if (ret == 0)
+		return 0;
+
+	capture->lengths[slot] = ret;
+	capture->captured += ret;
+
+	atomic_store(&capture->head, head + 1);
+	atomic_fetch_add(&capture->filled_seq, 1);
+	if (atomic_load(&capture->writer_waiting))
+		futex_wake(&capture->filled_seq);
+
+	return ret;
+}
+
+/**
+ * guc_log_capture_pull:
+ * @capture: the capture
+ *
+ * Moves the next sub-buffer out of the relay file, waiting for the writer
+ * to make room first if all of them are in flight.
+ *
+ * Returns: the number of bytes moved, 0 if there was no data to move, or a
+ * negative error code.
+ */
+int guc_log_capture_pull(struct guc_log_capture *capture)
+{
+	int ret = atomic_load(&capture->error);
+
+	if (ret)
+		return ret;
+
+	return capture->spliced ? pull_splice(capture) : pull_copy(capture);
+}
+
+/**
+ * guc_log_capture_finish:
+ * @capture: the capture
+ *
+ * Waits for the writer to write out everything pulled so far and stops it.
+ *
+ * Returns: 0, or the first error the writer hit.
+ */
+int guc_log_capture_finish(struct guc_log_capture *capture)
+{
+	if (capture->spliced) {
+		stop_splice(capture);
+	} else if (capture->writer_started) {
+		atomic_store(&capture->stopping, true);
+		atomic_fetch_add(&capture->filled_seq, 1);
+		futex_wake(&capture->filled_seq);
+
+		pthread_join(capture->writer, NULL);
+		capture->writer_started = false;
+	}
+
+	return atomic_load(&capture->error);
+}
+
+void guc_log_capture_get_stats(struct guc_log_capture *capture,
+			       struct guc_log_capture_stats *stats)
+{
+	stats->captured = capture->captured;
+	stats->written = atomic_load(&capture->written);
+	stats->stalls = capture->stalls;
+	stats->spliced = capture->spliced;
+}
+
+void guc_log_capture_destroy(struct guc_log_capture *capture)
+{
+	guc_log_capture_finish(capture);
+
+	if (capture->zbuf) {
+		deflateEnd(&capture->zstream);
+		free(capture->zbuf);
+	}
+
+	free(capture->lengths);
+	free(capture->buffers);
+	free(capture);
+}
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#ifndef INTEL_GUC_LOG_CAPTURE_H
+#define INTEL_GUC_LOG_CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Moves the GuC log from the relay file to the output file in the
+ * background. By default the relay sub-buffers are spliced into a pipe
+ * sized to hold all of the buffers, which a writer thread splices into the
+ * output, so the data is never copied to user space. When splicing isn't
+ * possible or the output is compressed, the sub-buffers are read into a
+ * lock-free single producer, single consumer ring for the writer thread
+ * instead.
+ */
+struct guc_log_capture;
+
+struct guc_log_capture_params {
+	int relay_fd;
+	int out_fd;
+	size_t subbuf_size;
+	unsigned int num_subbufs;
+
+	/* Read into the ring even if the relay file can be spliced */
+	bool copy;
+	/* zlib level to gzip the output with, 0 to leave it uncompressed */
+	int compress;
+};
+
+struct guc_log_capture_stats {
+	uint64_t captured;
+	uint64_t written;
+	/* Pulls that had to wait for the writer to make room */
+	uint64_t stalls;
+	bool spliced;
+};
+
+struct guc_log_capture *
+guc_log_capture_create(const struct guc_log_capture_params *params);
+int guc_log_capture_pull(struct guc_log_capture *capture);
+int guc_log_capture_finish(struct guc_log_capture *capture);
+void guc_log_capture_get_stats(struct guc_log_capture *capture,
+			       struct guc_log_capture_stats *stats);
+void guc_log_capture_destroy(struct guc_log_capture *capture);
+
+#endif /* INTEL_GUC_LOG_CAPTURE_H */
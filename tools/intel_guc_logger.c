@@ -38,9 +38,9 @@
 #include <sys/syscall.h>
 #include <sys/mman.h>
 #include <assert.h>
-#include <pthread.h>
 
 #include "igt.h"
+#include "intel_guc_log_capture.h"
 
 #define MB(x) ((uint64_t)(x) * 1024 * 1024)
 #ifndef PAGE_SIZE
@@ -60,19 +60,17 @@
 #define DEFAULT_OUTPUT_FILE_NAME  "guc_log_dump.dat"
 #define CONTROL_FILE_NAME "i915_guc_log_control"
 
-char *read_buffer;
 char *out_filename;
+char *relay_filename;
 int poll_timeout = 2; /* by default 2ms timeout */
-pthread_mutex_t mutex;
-pthread_t flush_thread;
 int verbosity_level = 3; /* by default capture logs at max verbosity */
-uint32_t produced, consumed;
-uint64_t total_bytes_written;
 int num_buffers = NUM_SUBBUFS;
 int relay_fd, outfile_fd = -1;
 uint32_t test_duration, max_filesize;
-pthread_cond_t underflow_cond, overflow_cond;
-bool stop_logging, discard_oldlogs, capturing_stopped;
+bool stop_logging, discard_oldlogs;
+bool copy_logs;
+int compress_level;
+struct guc_log_capture *capture;
 
 static void guc_log_control(bool enable, uint32_t log_level)
 {
@@ -112,156 +110,97 @@ static void int_sig_handler(int sig)
 	stop_logging = true;
 }
 
-static void pull_leftover_data(void)
+static void discard_leftover_data(void)
 {
 	unsigned int bytes_read = 0;
+	char *buf;
 	int ret;
 
+	buf = malloc(SUBBUF_SIZE);
+	igt_assert_f(buf, "couldn't allocate the read buffer\n");
+
 	do {
 		/* Read the logs from relay buffer */
-		ret = read(relay_fd, read_buffer, SUBBUF_SIZE);
-		if (!ret)
+		ret = read(relay_fd, buf, SUBBUF_SIZE);
+		if (!ret || (ret < 0 && errno == EAGAIN))
 			break;
 
 		igt_assert_f(ret > 0, "failed to read from the guc log file\n");
-		igt_assert_f(ret == SUBBUF_SIZE, "invalid read from relay file\n");
+		igt_assert_f(relay_filename || ret == SUBBUF_SIZE,
+			     "invalid read from relay file\n");
 
 		bytes_read += ret;
-
-		if (outfile_fd >= 0) {
-			ret = write(outfile_fd, read_buffer, SUBBUF_SIZE);
-			igt_assert_f(ret == SUBBUF_SIZE, "couldn't dump the logs in a file\n");
-			total_bytes_written += ret;
-		}
 	} while(1);
 
-	igt_debug("%u bytes flushed\n", bytes_read);
-}
-
-static int num_filled_bufs(void)
-{
-	return (produced - consumed);
+	free(buf);
+	igt_debug("%u bytes discarded\n", bytes_read);
 }
 
-static void pull_data(void)
+static bool pull_data(void)
 {
-	char *ptr;
+	struct guc_log_capture_stats stats;
 	int ret;
 
-	pthread_mutex_lock(&mutex);
-	while (num_filled_bufs() >= num_buffers) {
-		igt_debug("overflow, will wait, produced %u, consumed %u\n", produced, consumed);
-		/* Stall the main thread in case of overflow, as there are no
-		 * buffers available to store the new logs, otherwise there
-		 * could be corruption if both threads work on the same buffer.
-		 */
-		pthread_cond_wait(&overflow_cond, &mutex);
-	};
-	pthread_mutex_unlock(&mutex);
-
-	ptr = read_buffer + (produced % num_buffers) * SUBBUF_SIZE;
+	/* Moves a sub-buffer to the writer thread of the capture, which
+	 * flushes the logs to the disk file in the background.
+	 */
+	ret = guc_log_capture_pull(capture);
+	igt_assert_f(ret >= 0, "failed to capture the guc logs: %s\n",
+		     strerror(-ret));
 
-	/* Read the logs from relay buffer */
-	ret = read(relay_fd, ptr, SUBBUF_SIZE);
-	igt_assert_f(ret >= 0, "failed to read from the guc log file\n");
-	igt_assert_f(!ret || ret == SUBBUF_SIZE, "invalid read from relay file\n");
+	if (!ret) {
+		/* A file standing in for the relay file has run dry */
+		if (relay_filename)
+			return false;
 
-	if (ret) {
-		pthread_mutex_lock(&mutex);
-		produced++;
-		pthread_cond_signal(&underflow_cond);
-		pthread_mutex_unlock(&mutex);
-	} else {
 		/* Occasionally (very rare) read from the relay file returns no
 		 * data, albeit the polling done prior to read call indicated
 		 * availability of data.
 		 */
 		igt_debug("no data read from the relay file\n");
+		return true;
 	}
-}
 
-static void *flusher(void *arg)
-{
-	char *ptr;
-	int ret;
-
-	igt_debug("execution started of flusher thread\n");
-
-	do {
-		pthread_mutex_lock(&mutex);
-		while (!num_filled_bufs()) {
-			/* Exit only after completing the flush of all the filled
-			 * buffers as User would expect that all logs captured up
-			 * till the point of interruption/exit are written out to
-			 * the disk file.
-			 */
-			if (capturing_stopped) {
-				igt_debug("flusher to exit now\n");
-				pthread_mutex_unlock(&mutex);
-				return NULL;
-			}
-			pthread_cond_wait(&underflow_cond, &mutex);
-		};
-		pthread_mutex_unlock(&mutex);
-
-		ptr = read_buffer + (consumed % num_buffers) * SUBBUF_SIZE;
-
-		ret = write(outfile_fd, ptr, SUBBUF_SIZE);
-		igt_assert_f(ret == SUBBUF_SIZE, "couldn't dump the logs in a file\n");
-
-		total_bytes_written += ret;
-		if (max_filesize && (total_bytes_written > MB(max_filesize))) {
-			igt_debug("reached the target of %" PRIu64 " bytes\n", MB(max_filesize));
-			stop_logging = true;
-		}
+	guc_log_capture_get_stats(capture, &stats);
+	igt_assert_f(relay_filename || stats.spliced || ret == SUBBUF_SIZE,
+		     "invalid read from relay file\n");
 
-		pthread_mutex_lock(&mutex);
-		consumed++;
-		pthread_cond_signal(&overflow_cond);
-		pthread_mutex_unlock(&mutex);
-	} while(1);
+	if (max_filesize && (stats.written > MB(max_filesize))) {
+		igt_debug("reached the target of %" PRIu64 " bytes\n", MB(max_filesize));
+		return false;
+	}
 
-	return NULL;
+	return true;
 }
 
-static void init_flusher_thread(void)
+static void init_capture(void)
 {
-	struct sched_param	thread_sched;
-	pthread_attr_t		p_attr;
-	int ret;
-
-	pthread_cond_init(&underflow_cond, NULL);
-	pthread_cond_init(&overflow_cond, NULL);
-	pthread_mutex_init(&mutex, NULL);
-
-	ret = pthread_attr_init(&p_attr);
-	igt_assert_f(ret == 0, "error obtaining default thread attributes\n");
-
-	ret = pthread_attr_setinheritsched(&p_attr, PTHREAD_EXPLICIT_SCHED);
-	igt_assert_f(ret == 0, "couldn't set inheritsched\n");
-
-	ret = pthread_attr_setschedpolicy(&p_attr, SCHED_RR);
-	igt_assert_f(ret == 0, "couldn't set thread scheduling policy\n");
+	struct guc_log_capture_params params = {
+		.relay_fd = relay_fd,
+		.out_fd = outfile_fd,
+		.subbuf_size = SUBBUF_SIZE,
+		.num_subbufs = num_buffers,
+		.copy = copy_logs,
+		.compress = compress_level,
+	};
 
-	/* Keep the flusher task also at rt priority, so that it doesn't get
-	 * too late in flushing the collected logs in local buffers to the disk,
-	 * and so main thread always have spare buffers to collect the logs.
+	/* The writer thread inherits the rt priority of the main thread, so
+	 * that it doesn't get too late in flushing the collected logs to the
+	 * disk, and so main thread always has spare buffers to collect the logs.
 	 */
-	thread_sched.sched_priority = 5;
-	ret = pthread_attr_setschedparam(&p_attr, &thread_sched);
-	igt_assert_f(ret == 0, "couldn't set thread priority\n");
-
-	ret = pthread_create(&flush_thread, &p_attr, flusher, NULL);
-	igt_assert_f(ret == 0, "thread creation failed\n");
-
-	ret = pthread_attr_destroy(&p_attr);
-	igt_assert_f(ret == 0, "error destroying thread attributes\n");
+	capture = guc_log_capture_create(&params);
+	igt_assert_f(capture, "couldn't start the capture: %m\n");
 }
 
 static void open_relay_file(void)
 {
-	relay_fd = igt_debugfs_open(-1, RELAY_FILE_NAME, O_RDONLY);
-	igt_assert_f(relay_fd >= 0, "couldn't open the guc log file\n");
+	if (relay_filename) {
+		relay_fd = open(relay_filename, O_RDONLY | O_NONBLOCK);
+		igt_assert_f(relay_fd >= 0, "couldn't open %s\n", relay_filename);
+	} else {
+		relay_fd = igt_debugfs_open(-1, RELAY_FILE_NAME, O_RDONLY);
+		igt_assert_f(relay_fd >= 0, "couldn't open the guc log file\n");
+	}
 
 	/* Purge the old/boot-time logs from the relay buffer.
 	 * This is more for Val team's requirement, where they have to first
@@ -271,20 +210,27 @@ static void open_relay_file(void)
 	 * a different shell.
 	 */
 	if (discard_oldlogs)
-		pull_leftover_data();
+		discard_leftover_data();
 }
 
 static void open_output_file(void)
 {
-	/* Use Direct IO mode for the output file, as the data written is not
-	 * supposed to be accessed again, this saves a copy of data from App's
-	 * buffer to kernel buffer (Page cache). Due to no buffering on kernel
-	 * side, data is flushed out to disk faster and more buffering can be
-	 * done on the logger side to hide the disk IO latency.
+	int flags = O_CREAT | O_WRONLY | O_TRUNC;
+
+	/* When the logs are copied through the logger's buffers, use Direct IO
+	 * mode for the output file, as the data written is not supposed to be
+	 * accessed again, this saves a copy of data from App's buffer to kernel
+	 * buffer (Page cache). Due to no buffering on kernel side, data is
+	 * flushed out to disk faster and more buffering can be done on the
+	 * logger side to hide the disk IO latency. Spliced logs never go
+	 * through the logger's buffers in the first place, and compressed or
+	 * stand-in logs don't come in page aligned sizes.
 	 */
+	if (copy_logs && !compress_level && !relay_filename)
+		flags |= O_DIRECT;
+
 	outfile_fd = open(out_filename ? : DEFAULT_OUTPUT_FILE_NAME,
-			  O_CREAT | O_WRONLY | O_TRUNC | O_DIRECT,
-			  0440);
+			  flags, 0440);
 	igt_assert_f(outfile_fd >= 0, "couldn't open the output file\n");
 
 	free(out_filename);
@@ -295,33 +241,35 @@ static void init_main_thread(void)
 	struct sched_param	thread_sched;
 	int ret;
 
-	/* Run the main thread at highest priority to ensure that it always
-	 * gets woken-up at earliest on arrival of new data and so is always
-	 * ready to pull the logs, otherwise there could be loss logs if
-	 * GuC firmware is generating logs at a very high rate.
-	 */
-	thread_sched.sched_priority = 1;
-	ret = sched_setscheduler(getpid(), SCHED_FIFO, &thread_sched);
-	igt_assert_f(ret == 0, "couldn't set the priority\n");
-
 	if (signal(SIGINT, int_sig_handler) == SIG_ERR)
 		igt_assert_f(0, "SIGINT handler registration failed\n");
 
 	if (signal(SIGALRM, int_sig_handler) == SIG_ERR)
 		igt_assert_f(0, "SIGALRM handler registration failed\n");
 
-	/* Need an aligned pointer for direct IO */
-	ret = posix_memalign((void **)&read_buffer, PAGE_SIZE, num_buffers * SUBBUF_SIZE);
-	igt_assert_f(ret == 0, "couldn't allocate the read buffer\n");
+	/* A file standing in for the relay file needs none of the below */
+	if (!relay_filename) {
+		/* Run the main thread at highest priority to ensure that it
+		 * always gets woken-up at earliest on arrival of new data and
+		 * so is always ready to pull the logs, otherwise there could be
+		 * loss logs if GuC firmware is generating logs at a very high
+		 * rate.
+		 */
+		thread_sched.sched_priority = 1;
+		ret = sched_setscheduler(getpid(), SCHED_FIFO, &thread_sched);
+		igt_assert_f(ret == 0, "couldn't set the priority\n");
 
-	/* Keep the pages locked in RAM, avoid page fault overhead */
-	ret = mlock(read_buffer, num_buffers * SUBBUF_SIZE);
-	igt_assert_f(ret == 0, "failed to lock memory\n");
+		/* Keep the buffers of the capture locked in RAM, avoid page
+		 * fault overhead.
+		 */
+		ret = mlockall(MCL_CURRENT | MCL_FUTURE);
+		igt_assert_f(ret == 0, "failed to lock memory\n");
 
-	/* Enable the logging, it may not have been enabled from boot and so
-	 * the relay file also wouldn't have been created.
-	 */
-	guc_log_control(true, verbosity_level);
+		/* Enable the logging, it may not have been enabled from boot
+		 * and so the relay file also wouldn't have been created.
+		 */
+		guc_log_control(true, verbosity_level);
+	}
 
 	open_relay_file();
 	open_output_file();
@@ -367,6 +315,20 @@ static int parse_options(int opt, int opt_index, void *data)
 		discard_oldlogs = true;
 		igt_debug("old/boot-time logs will be discarded\n");
 		break;
+	case 'r':
+		relay_filename = strdup(optarg);
+		igt_assert_f(relay_filename, "Couldn't allocate the relay filename\n");
+		igt_debug("logs to be read from file %s\n", relay_filename);
+		break;
+	case 'c':
+		copy_logs = true;
+		igt_debug("logs to be copied instead of spliced\n");
+		break;
+	case 'z':
+		compress_level = atoi(optarg);
+		igt_assert_f(compress_level > 0 && compress_level <= 9, "invalid input for -z option\n");
+		igt_debug("logs to be gzipped at level %d\n", compress_level);
+		break;
 	}
 
 	return 0;
@@ -382,6 +344,9 @@ static void process_command_line(int argc, char **argv)
 		{"polltimeout", required_argument, 0, 'p'},
 		{"size", required_argument, 0, 's'},
 		{"discard", no_argument, 0, 'd'},
+		{"relay", required_argument, 0, 'r'},
+		{"copy", no_argument, 0, 'c'},
+		{"compress", required_argument, 0, 'z'},
 		{ 0, 0, 0, 0 }
 	};
 
@@ -392,14 +357,18 @@ static void process_command_line(int argc, char **argv)
 		"  -t --testduration=sec  max duration in seconds for which the logger should run\n"
 		"  -p --polltimeout=ms    polling timeout in ms, -1 == indefinite wait for the new data\n"
 		"  -s --size=MB           max size of output file in MBs after which logging will be stopped\n"
-		"  -d --discard           discard the old/boot-time logs before entering into the capture loop\n";
+		"  -d --discard           discard the old/boot-time logs before entering into the capture loop\n"
+		"  -r --relay=file        read the logs from a file or FIFO standing in for the relay file\n"
+		"  -c --copy              copy the logs through the logger's buffers instead of splicing them\n"
+		"  -z --compress=level    gzip the logs at the given level (1-9), implies --copy\n";
 
-	igt_simple_init_parse_opts(&argc, argv, "v:o:b:t:p:s:d", long_options,
+	igt_simple_init_parse_opts(&argc, argv, "v:o:b:t:p:s:dr:cz:", long_options,
 				   help, parse_options, NULL);
 }
 
 int main(int argc, char **argv)
 {
+	struct guc_log_capture_stats stats;
 	struct pollfd relay_poll_fd;
 	int nfds;
 	int ret;
@@ -409,14 +378,14 @@ int main(int argc, char **argv)
 	init_main_thread();
 
 	/* Use a separate thread for flushing the logs to a file on disk.
-	 * Main thread will buffer the data from relay file in its pool of
+	 * Main thread will move the data from relay file to a pool of
 	 * buffers and other thread will flush the data to disk in background.
 	 * This is needed, albeit by default data is written out to disk in
 	 * async mode, as when there are too many dirty pages in the RAM,
 	 * (/proc/sys/vm/dirty_ratio), kernel starts blocking the processes
 	 * doing the file writes.
 	 */
-	init_flusher_thread();
+	init_capture();
 
 	relay_poll_fd.fd = relay_fd;
 	relay_poll_fd.events = POLLIN;
@@ -449,21 +418,30 @@ int main(int argc, char **argv)
 		if (!relay_poll_fd.revents)
 			continue;
 
-		pull_data();
+		if (!pull_data())
+			break;
 	} while (!stop_logging);
 
 	/* Pause logging on the GuC side */
-	guc_log_control(false, 0);
-
-	/* Signal flusher thread to make an exit */
-	capturing_stopped = 1;
-	pthread_cond_signal(&underflow_cond);
-	pthread_join(flush_thread, NULL);
+	if (!relay_filename)
+		guc_log_control(false, 0);
 
-	pull_leftover_data();
-	igt_info("total bytes written %" PRIu64 "\n", total_bytes_written);
-
-	free(read_buffer);
+	/* Flush whatever is left in the relay file, then wait for the writer
+	 * thread to write out everything.
+	 */
+	while (guc_log_capture_pull(capture) > 0)
+		;
+	ret = guc_log_capture_finish(capture);
+	igt_assert_f(ret == 0, "couldn't dump the logs in a file: %s\n",
+		     strerror(-ret));
+
+	guc_log_capture_get_stats(capture, &stats);
+	igt_info("total bytes written %" PRIu64 "\n", stats.written);
+	igt_debug("logs %s, %" PRIu64 " stalls on a full buffer pool\n",
+		  stats.spliced ? "spliced" : "copied", stats.stalls);
+
+	guc_log_capture_destroy(capture);
+	free(relay_filename);
 	close(relay_fd);
 	close(outfile_fd);
 	igt_exit();
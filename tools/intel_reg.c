@@ -21,13 +21,16 @@
  * SOFTWARE.
  */
 
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -35,6 +38,7 @@
 #include "i915/gem_create.h"
 #include "igt.h"
 #include "igt_gt.h"
+#include "igt_map.h"
 #include "intel_io.h"
 #include "intel_chipset.h"
 
@@ -86,35 +90,99 @@ struct config {
 	struct reg *regs;
 	ssize_t regcount;
 
+	/* indexes into regs, by port and address and by port and name */
+	struct igt_map *regs_by_addr;
+	struct igt_map *regs_by_name;
+
 	int verbosity;
 };
 
+static uint32_t reg_addr_hash(const void *key)
+{
+	const struct reg *reg = key;
+	/* ->mmio_offset should be 0 for non-MMIO ports. */
+	uint64_t k = (uint64_t)(uint32_t)reg->port_desc.port << 32 |
+		(uint32_t)(reg->addr + reg->mmio_offset);
+
+	return igt_map_hash_64(&k);
+}
+
+static int reg_addr_equal(const void *key1, const void *key2)
+{
+	const struct reg *a = key1, *b = key2;
+
+	return a->port_desc.port == b->port_desc.port &&
+		a->addr + a->mmio_offset == b->addr + b->mmio_offset;
+}
+
+/* Names are matched case-insensitively */
+static uint32_t reg_name_hash(const void *key)
+{
+	const struct reg *reg = key;
+	uint32_t hash = 2166136261u ^ (uint32_t)reg->port_desc.port;
+	const char *p;
+
+	for (p = reg->name; *p; p++)
+		hash = (hash ^ tolower((unsigned char)*p)) * 16777619u;
+
+	return hash;
+}
+
+static int reg_name_equal(const void *key1, const void *key2)
+{
+	const struct reg *a = key1, *b = key2;
+
+	return a->port_desc.port == b->port_desc.port &&
+		strcasecmp(a->name, b->name) == 0;
+}
+
+/*
+ * Index the register spec for the command line lookups, keeping the first
+ * register of the spec for duplicates like the linear search used to.
+ */
+static void index_reg_spec(struct config *config)
+{
+	int i;
+
+	config->regs_by_addr = igt_map_create(reg_addr_hash, reg_addr_equal);
+	config->regs_by_name = igt_map_create(reg_name_hash, reg_name_equal);
+
+	for (i = 0; i < config->regcount; i++) {
+		struct reg *r = &config->regs[i];
+
+		if (!igt_map_search(config->regs_by_addr, r))
+			igt_map_insert(config->regs_by_addr, r, r);
+
+		if (r->name && !igt_map_search(config->regs_by_name, r))
+			igt_map_insert(config->regs_by_name, r, r);
+	}
+}
+
+static void free_reg_spec(struct config *config)
+{
+	igt_map_destroy(config->regs_by_name, NULL);
+	igt_map_destroy(config->regs_by_addr, NULL);
+	intel_reg_spec_free(config->regs, config->regcount);
+}
+
 /* port desc must have been set */
 static int set_reg_by_addr(struct config *config, struct reg *reg,
 			   uint32_t addr)
 {
-	int i;
+	struct reg *r;
 
 	reg->addr = addr;
 	if (reg->name)
 		free(reg->name);
 	reg->name = NULL;
 
-	for (i = 0; i < config->regcount; i++) {
-		struct reg *r = &config->regs[i];
-
-		if (reg->port_desc.port != r->port_desc.port)
-			continue;
-
-		/* ->mmio_offset should be 0 for non-MMIO ports. */
-		if (addr + reg->mmio_offset == r->addr + r->mmio_offset) {
-			/* Always output the "normalized" offset+addr. */
-			reg->mmio_offset = r->mmio_offset;
-			reg->addr = r->addr;
+	r = igt_map_search(config->regs_by_addr, reg);
+	if (r) {
+		/* Always output the "normalized" offset+addr. */
+		reg->mmio_offset = r->mmio_offset;
+		reg->addr = r->addr;
 
-			reg->name = r->name ? strdup(r->name) : NULL;
-			break;
-		}
+		reg->name = r->name ? strdup(r->name) : NULL;
 	}
 
 	return 0;
@@ -124,32 +192,22 @@ static int set_reg_by_addr(struct config *config, struct reg *reg,
 static int set_reg_by_name(struct config *config, struct reg *reg,
 			   const char *name)
 {
-	int i;
+	struct reg *r;
 
 	reg->name = strdup(name);
 	reg->addr = 0;
 
-	for (i = 0; i < config->regcount; i++) {
-		struct reg *r = &config->regs[i];
-
-		if (reg->port_desc.port != r->port_desc.port)
-			continue;
-
-		if (!r->name)
-			continue;
+	r = igt_map_search(config->regs_by_name, reg);
+	if (!r)
+		return -1;
 
-		if (strcasecmp(name, r->name) == 0) {
-			reg->addr = r->addr;
+	reg->addr = r->addr;
 
-			/* Also get MMIO offset if not already specified. */
-			if (!reg->mmio_offset && r->mmio_offset)
-				reg->mmio_offset = r->mmio_offset;
+	/* Also get MMIO offset if not already specified. */
+	if (!reg->mmio_offset && r->mmio_offset)
+		reg->mmio_offset = r->mmio_offset;
 
-			return 0;
-		}
-	}
-
-	return -1;
+	return 0;
 }
 
 static void to_binary(char *buf, size_t buflen, uint32_t val)
@@ -920,11 +978,127 @@ static int intel_reg_snapshot(struct config *config, int argc, char *argv[])
 	return EXIT_SUCCESS;
 }
 
-/* XXX: add support for reading and re-decoding a previously done dump */
+/* MMIO bar snapshot, as created by the snapshot command */
+struct snapshot {
+	const char *filename;
+	const void *data;
+	size_t size;
+};
+
+static int map_snapshot(struct snapshot *snapshot, const char *filename)
+{
+	struct stat st;
+	int fd;
+
+	snapshot->filename = filename;
+	snapshot->data = NULL;
+	snapshot->size = 0;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "Error opening snapshot '%s': %s\n",
+			filename, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	if (st.st_size) {
+		snapshot->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+				      fd, 0);
+		if (snapshot->data == MAP_FAILED) {
+			fprintf(stderr, "Error mapping snapshot '%s': %s\n",
+				filename, strerror(errno));
+			close(fd);
+			return -1;
+		}
+		snapshot->size = st.st_size;
+	}
+
+	close(fd);
+
+	return 0;
+}
+
+static void unmap_snapshot(struct snapshot *snapshot)
+{
+	if (snapshot->size)
+		munmap((void *)snapshot->data, snapshot->size);
+}
+
+/* Only MMIO registers are in the snapshot, and only if it covers them */
+static bool snapshot_read(const struct snapshot *snapshot,
+			  const struct reg *reg, uint32_t *valp)
+{
+	uint32_t offset = reg->mmio_offset + reg->addr;
+	const uint8_t *p = (const uint8_t *)snapshot->data + offset;
+	size_t size;
+
+	switch (reg->port_desc.port) {
+	case PORT_MCHBAR_32:
+	case PORT_MMIO_32:
+		size = 4;
+		break;
+	case PORT_MCHBAR_16:
+	case PORT_MMIO_16:
+		size = 2;
+		break;
+	case PORT_MCHBAR_8:
+	case PORT_MMIO_8:
+		size = 1;
+		break;
+	default:
+		return false;
+	}
+
+	if (reg->engine || offset > snapshot->size ||
+	    snapshot->size - offset < size)
+		return false;
+
+	switch (size) {
+	case 4:
+		*valp = *(const uint32_t *)p;
+		break;
+	case 2:
+		*valp = *(const uint16_t *)p;
+		break;
+	default:
+		*valp = *p;
+		break;
+	}
+
+	return true;
+}
+
+/* Decode all known registers in the --mmio snapshot */
+static int decode_snapshot(struct config *config)
+{
+	struct snapshot snapshot;
+	int i;
+
+	if (map_snapshot(&snapshot, config->mmiofile))
+		return EXIT_FAILURE;
+
+	for (i = 0; i < config->regcount; i++) {
+		struct reg *reg = &config->regs[i];
+		uint32_t val;
+
+		if (snapshot_read(&snapshot, reg, &val))
+			dump_regval(config, reg, val);
+	}
+
+	unmap_snapshot(&snapshot);
+
+	return EXIT_SUCCESS;
+}
+
 static int intel_reg_decode(struct config *config, int argc, char *argv[])
 {
 	int i;
 
+	if (argc == 1 && config->mmiofile)
+		return decode_snapshot(config);
+
 	if (argc == 1) {
 		fprintf(stderr, "decode: no registers specified\n");
 		return EXIT_FAILURE;
@@ -956,6 +1130,56 @@ static int intel_reg_decode(struct config *config, int argc, char *argv[])
 	return EXIT_SUCCESS;
 }
 
+static int intel_reg_diff(struct config *config, int argc, char *argv[])
+{
+	struct snapshot old, new;
+	int i, known = 0, changed = 0;
+
+	if (!config->mmiofile || argc != 2) {
+		fprintf(stderr, "diff: specify the snapshots with --mmio=FILE and as argument\n");
+		return EXIT_FAILURE;
+	}
+
+	if (map_snapshot(&old, config->mmiofile))
+		return EXIT_FAILURE;
+
+	if (map_snapshot(&new, argv[1])) {
+		unmap_snapshot(&old);
+		return EXIT_FAILURE;
+	}
+
+	if (old.size != new.size)
+		fprintf(stderr, "Warning: snapshot sizes differ (%zu vs. %zu)\n",
+			old.size, new.size);
+
+	for (i = 0; i < config->regcount; i++) {
+		struct reg *reg = &config->regs[i];
+		uint32_t oldval, newval;
+
+		if (!snapshot_read(&old, reg, &oldval) ||
+		    !snapshot_read(&new, reg, &newval))
+			continue;
+
+		known++;
+		if (oldval == newval)
+			continue;
+
+		changed++;
+		printf("-");
+		dump_regval(config, reg, oldval);
+		printf("+");
+		dump_regval(config, reg, newval);
+	}
+
+	if (config->verbosity > 0)
+		printf("%d of %d known registers differ\n", changed, known);
+
+	unmap_snapshot(&new);
+	unmap_snapshot(&old);
+
+	return EXIT_SUCCESS;
+}
+
 static int intel_reg_list(struct config *config, int argc, char *argv[])
 {
 	int i;
@@ -1010,7 +1234,16 @@ static const struct command commands[] = {
 		.name = "decode",
 		.function = intel_reg_decode,
 		.synopsis = "REGISTER VALUE [REGISTER VALUE ...]",
-		.description = "decode value(s) for specified register(s)",
+		.description = "decode value(s) for specified register(s),\n"
+		"                or all known registers in the --mmio=FILE snapshot",
+		.decode = true,
+	},
+	{
+		.name = "diff",
+		.function = intel_reg_diff,
+		.synopsis = "SNAPSHOT",
+		.description = "decode the known registers that differ between\n"
+		"                the --mmio=FILE snapshot and SNAPSHOT",
 		.decode = true,
 	},
 	{
@@ -1121,7 +1354,7 @@ static int read_reg_spec(struct config *config)
 	int r;
 
 	if (!config->decode)
-		return 0;
+		goto index;
 
 	path = config->specfile;
 	if (!path)
@@ -1155,11 +1388,16 @@ static int read_reg_spec(struct config *config)
 		goto builtin;
 	}
 
-	return config->regcount;
+	goto index;
 
 builtin:
 	/* Fallback to builtin register spec. */
 	config->regcount = intel_reg_spec_builtin(&config->regs, config->devid);
+	if (config->regcount < 0)
+		return config->regcount;
+
+index:
+	index_reg_spec(config);
 
 	return config->regcount;
 }
@@ -1322,6 +1560,7 @@ int main(int argc, char *argv[])
 
 	ret = command->function(&config, argc, argv);
 
+	free_reg_spec(&config);
 	free(config.mmiofile);
 
 	if (config.fd >= 0)